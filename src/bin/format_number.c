@@ -0,0 +1,326 @@
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+
+#include "format_number.h"
+
+/* Shortest round-trip formatting of floating-point numbers, after Florian
+ * Loitsch's Grisu2 ("Printing Floating-Point Numbers Quickly and Accurately
+ * with Integers", PLDI 2010) as adapted by Milo Yip. The digits always read
+ * back as the same number, and are the shortest such in nearly all cases. */
+
+typedef struct diy_fp_s {
+    uint64_t    f;
+    int         e;
+} diy_fp_t;
+
+/* 10^-348, 10^-340, ..., 10^340 as normalized 64-bit significands */
+static const uint64_t cached_powers_f[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+    0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+    0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+    0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+    0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+    0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+    0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+    0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+    0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+    0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+    0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+    0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+    0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+    0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+    0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+    0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+    0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+    0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+    0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+    0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+    0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+    0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const int16_t cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066
+};
+
+/* The fractional digit loop can run past 10^9, so this goes up to 10^19 */
+static const uint64_t pow10_64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static diy_fp_t diy_fp_make(uint64_t f, int e) {
+    diy_fp_t fp = { .f = f, .e = e };
+    return fp;
+}
+
+static diy_fp_t diy_fp_normalize(diy_fp_t fp) {
+    while (!(fp.f & 0x8000000000000000ULL)) {
+        fp.f <<= 1;
+        fp.e--;
+    }
+    return fp;
+}
+
+/* Upper 64 bits of the 128-bit product, rounded */
+static diy_fp_t diy_fp_multiply(diy_fp_t x, diy_fp_t y) {
+    const uint64_t m32 = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & m32;
+    uint64_t c = y.f >> 32, d = y.f & m32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+    tmp += 1ULL << 31;
+    return diy_fp_make(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64);
+}
+
+static diy_fp_t cached_power(int e, int *K) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if (k != dk)
+        k++;
+
+    int index = (k >> 3) + 1;
+    *K = -(-348 + (index << 3));
+
+    return diy_fp_make(cached_powers_f[index], cached_powers_e[index]);
+}
+
+static int count_decimal_digits32(uint32_t n) {
+    int digits = 1;
+    while (digits < 10 && n >= pow10_64[digits])
+        digits++;
+    return digits;
+}
+
+static void grisu_round(char *digits, int len, uint64_t delta, uint64_t rest,
+        uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+            (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        digits[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static void digit_gen(diy_fp_t W, diy_fp_t Mp, uint64_t delta, char *digits, int *len, int *K) {
+    diy_fp_t one = diy_fp_make(1ULL << -Mp.e, Mp.e);
+    uint64_t wp_w = Mp.f - W.f;
+    uint32_t p1 = (uint32_t)(Mp.f >> -one.e);
+    uint64_t p2 = Mp.f & (one.f - 1);
+    int kappa = count_decimal_digits32(p1);
+
+    *len = 0;
+
+    while (kappa > 0) {
+        uint32_t d = p1 / (uint32_t)pow10_64[kappa - 1];
+        p1 %= (uint32_t)pow10_64[kappa - 1];
+        if (d || *len)
+            digits[(*len)++] = '0' + d;
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *K += kappa;
+            grisu_round(digits, *len, delta, rest, pow10_64[kappa] << -one.e, wp_w);
+            return;
+        }
+    }
+
+    while (1) {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || *len)
+            digits[(*len)++] = '0' + d;
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            int index = -kappa;
+            *K += kappa;
+            grisu_round(digits, *len, delta, p2, one.f, wp_w * (index < 20 ? pow10_64[index] : 0));
+            return;
+        }
+    }
+}
+
+/* Generates the digits of f * 2^e, where hidden_bit is the implicit leading
+ * bit of a normal number of the original precision */
+static void grisu2(uint64_t f, int e, uint64_t hidden_bit, char *digits, int *len, int *K) {
+    diy_fp_t plus = diy_fp_normalize(diy_fp_make((f << 1) + 1, e - 1));
+    diy_fp_t minus = (f == hidden_bit) ? diy_fp_make((f << 2) - 1, e - 2) : diy_fp_make((f << 1) - 1, e - 1);
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    diy_fp_t c_mk = cached_power(plus.e, K);
+    diy_fp_t W = diy_fp_multiply(diy_fp_normalize(diy_fp_make(f, e)), c_mk);
+    diy_fp_t Wp = diy_fp_multiply(plus, c_mk);
+    diy_fp_t Wm = diy_fp_multiply(minus, c_mk);
+    Wm.f++;
+    Wp.f--;
+
+    digit_gen(W, Wp, Wp.f - Wm.f, digits, len, K);
+}
+
+static size_t write_exponent(char *out, int K) {
+    size_t len = 0;
+    out[len++] = 'e';
+    if (K < 0) {
+        out[len++] = '-';
+        K = -K;
+    }
+    if (K >= 100) {
+        out[len++] = '0' + K / 100;
+        K %= 100;
+        out[len++] = '0' + K / 10;
+    } else if (K >= 10) {
+        out[len++] = '0' + K / 10;
+    }
+    out[len++] = '0' + K % 10;
+    return len;
+}
+
+/* Lays out digits * 10^K as plain decimal where that stays short, and in
+ * scientific notation otherwise */
+static size_t prettify(char *out, const char *digits, int len, int K) {
+    int kk = len + K; /* 10^(kk-1) <= v < 10^kk */
+    size_t out_len = 0;
+    int i;
+
+    if (len <= kk && kk <= 21) {
+        /* 1234e7 -> 12340000000 */
+        memcpy(out, digits, len);
+        for (i=len; i<kk; i++)
+            out[i] = '0';
+        out_len = kk;
+    } else if (0 < kk && kk <= 21) {
+        /* 1234e-2 -> 12.34 */
+        memcpy(out, digits, kk);
+        out[kk] = '.';
+        memcpy(&out[kk + 1], &digits[kk], len - kk);
+        out_len = len + 1;
+    } else if (-6 < kk && kk <= 0) {
+        /* 1234e-6 -> 0.001234 */
+        int offset = 2 - kk;
+        out[0] = '0';
+        out[1] = '.';
+        for (i=2; i<offset; i++)
+            out[i] = '0';
+        memcpy(&out[offset], digits, len);
+        out_len = len + offset;
+    } else {
+        /* 1234e30 -> 1.234e33 */
+        out[out_len++] = digits[0];
+        if (len > 1) {
+            out[out_len++] = '.';
+            memcpy(&out[out_len], &digits[1], len - 1);
+            out_len += len - 1;
+        }
+        out_len += write_exponent(&out[out_len], kk - 1);
+    }
+    return out_len;
+}
+
+size_t rs_format_int64(char *out, int64_t value) {
+    char digits[20];
+    uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+    size_t len = 0, digits_len = 0;
+
+    do {
+        digits[digits_len++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (value < 0)
+        out[len++] = '-';
+    while (digits_len)
+        out[len++] = digits[--digits_len];
+
+    return len;
+}
+
+size_t rs_format_double(char *out, double value) {
+    char digits[24];
+    int digits_len = 0, K = 0;
+    size_t len = 0;
+    uint64_t bits;
+
+    if (!isfinite(value))
+        return snprintf(out, RS_FORMAT_NUMBER_MAX_LEN, "%g", value);
+
+    if (value == 0.0) {
+        if (signbit(value))
+            out[len++] = '-';
+        out[len++] = '0';
+        return len;
+    }
+
+    /* Exact integers are common, and need none of the machinery below */
+    if (fabs(value) < 9007199254740992.0 && value == (double)(int64_t)value)
+        return rs_format_int64(out, (int64_t)value);
+
+    memcpy(&bits, &value, sizeof(uint64_t));
+    if (bits >> 63)
+        out[len++] = '-';
+
+    int biased_e = (bits >> 52) & 0x7FF;
+    uint64_t f = bits & 0x000FFFFFFFFFFFFFULL;
+    if (biased_e) {
+        grisu2(f + (1ULL << 52), biased_e - 1075, 1ULL << 52, digits, &digits_len, &K);
+    } else {
+        grisu2(f, -1074, 1ULL << 52, digits, &digits_len, &K);
+    }
+
+    return len + prettify(&out[len], digits, digits_len, K);
+}
+
+size_t rs_format_float(char *out, float value) {
+    char digits[24];
+    int digits_len = 0, K = 0;
+    size_t len = 0;
+    uint32_t bits;
+
+    if (!isfinite(value))
+        return snprintf(out, RS_FORMAT_NUMBER_MAX_LEN, "%g", value);
+
+    if (value == 0.0f) {
+        if (signbit(value))
+            out[len++] = '-';
+        out[len++] = '0';
+        return len;
+    }
+
+    if (fabsf(value) < 16777216.0f && value == (float)(int32_t)value)
+        return rs_format_int64(out, (int32_t)value);
+
+    memcpy(&bits, &value, sizeof(uint32_t));
+    if (bits >> 31)
+        out[len++] = '-';
+
+    int biased_e = (bits >> 23) & 0xFF;
+    uint64_t f = bits & 0x007FFFFF;
+    if (biased_e) {
+        grisu2(f + (1ULL << 23), biased_e - 150, 1ULL << 23, digits, &digits_len, &K);
+    } else {
+        grisu2(f, -149, 1ULL << 23, digits, &digits_len, &K);
+    }
+
+    return len + prettify(&out[len], digits, digits_len, K);
+}
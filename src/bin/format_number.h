@@ -0,0 +1,10 @@
+
+/* Longest output of the functions below, e.g. -2.2250738585072014e-308 */
+#define RS_FORMAT_NUMBER_MAX_LEN    32
+
+/* Each writes the number to out without a terminating NUL and returns the
+ * number of characters written. Floating-point numbers get the shortest
+ * digits that read back as the same value. */
+size_t rs_format_int64(char *out, int64_t value);
+size_t rs_format_double(char *out, double value);
+size_t rs_format_float(char *out, float value);
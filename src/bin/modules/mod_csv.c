@@ -1,5 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -7,15 +10,21 @@
 #include "../../readstat.h"
 #include "../module_util.h"
 #include "../module.h"
+#include "../format_number.h"
+
+#define CSV_BUFFER_SIZE     (1<<20)
 
 typedef struct mod_csv_ctx_s {
-    FILE *out_file;
-    long var_count;
+    int   out_fd;
+    long  var_count;
+    char *buffer;
+    size_t buffer_used;
+    int   error;
 } mod_csv_ctx_t;
 
 static int accept_file(const char *filename);
 static void *ctx_init(const char *filename);
-static void finish_file(void *ctx);
+static int finish_file(void *ctx);
 static int handle_info(int obs_count, int var_count, void *ctx);
 static int handle_variable(int index, readstat_variable_t *variable,
                            const char *val_labels, void *ctx);
@@ -32,26 +41,115 @@ rs_module_t rs_mod_csv = {
     NULL /* value label */
 };
 
+static int csv_flush(mod_csv_ctx_t *mod_ctx) {
+    size_t written = 0;
+    while (!mod_ctx->error && written < mod_ctx->buffer_used) {
+        ssize_t len = write(mod_ctx->out_fd, &mod_ctx->buffer[written], mod_ctx->buffer_used - written);
+        if (len == -1 && errno == EINTR)
+            continue;
+        if (len <= 0) {
+            fprintf(stderr, "Error writing CSV output: %s\n", strerror(errno));
+            mod_ctx->error = 1;
+            break;
+        }
+        written += len;
+    }
+    mod_ctx->buffer_used = 0;
+    return mod_ctx->error;
+}
+
+/* Makes room for len more bytes, returning where they go */
+static char *csv_reserve(mod_csv_ctx_t *mod_ctx, size_t len) {
+    if (mod_ctx->buffer_used + len > CSV_BUFFER_SIZE && csv_flush(mod_ctx))
+        return NULL;
+
+    return &mod_ctx->buffer[mod_ctx->buffer_used];
+}
+
+static int csv_write_bytes(mod_csv_ctx_t *mod_ctx, const char *bytes, size_t len) {
+    while (len) {
+        size_t chunk_len = CSV_BUFFER_SIZE - mod_ctx->buffer_used;
+        if (chunk_len == 0) {
+            if (csv_flush(mod_ctx))
+                return 1;
+            continue;
+        }
+        if (chunk_len > len)
+            chunk_len = len;
+
+        memcpy(&mod_ctx->buffer[mod_ctx->buffer_used], bytes, chunk_len);
+        mod_ctx->buffer_used += chunk_len;
+        bytes += chunk_len;
+        len -= chunk_len;
+    }
+    return 0;
+}
+
+static int csv_write_char(mod_csv_ctx_t *mod_ctx, char c) {
+    char *out = csv_reserve(mod_ctx, 1);
+    if (out == NULL)
+        return 1;
+
+    *out = c;
+    mod_ctx->buffer_used++;
+    return 0;
+}
+
+/* Quotes a field per RFC 4180, doubling any embedded quotes */
+static int csv_write_quoted_len(mod_csv_ctx_t *mod_ctx, const char *string, size_t string_len) {
+    if (csv_write_char(mod_ctx, '"'))
+        return 1;
+
+    while (string_len) {
+        const char *quote = memchr(string, '"', string_len);
+        size_t len = quote ? quote - string + 1 : string_len;
+        if (csv_write_bytes(mod_ctx, string, len))
+            return 1;
+        if (quote && csv_write_char(mod_ctx, '"'))
+            return 1;
+        string += len;
+        string_len -= len;
+    }
+
+    return csv_write_char(mod_ctx, '"');
+}
+
+static int csv_write_quoted(mod_csv_ctx_t *mod_ctx, const char *string) {
+    return csv_write_quoted_len(mod_ctx, string, strlen(string));
+}
+
 static int accept_file(const char *filename) {
     return rs_ends_with(filename, ".csv");
 }
 
 static void *ctx_init(const char *filename) {
-    mod_csv_ctx_t *mod_ctx = malloc(sizeof(mod_csv_ctx_t));
-    mod_ctx->out_file = fopen(filename, "w");
-    if (mod_ctx->out_file == NULL) {
+    mod_csv_ctx_t *mod_ctx = calloc(1, sizeof(mod_csv_ctx_t));
+    mod_ctx->out_fd = open(filename, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (mod_ctx->out_fd == -1) {
         fprintf(stderr, "Error opening %s for writing: %s\n", filename, strerror(errno));
+        free(mod_ctx);
+        return NULL;
+    }
+    if ((mod_ctx->buffer = malloc(CSV_BUFFER_SIZE)) == NULL) {
+        fprintf(stderr, "Error allocating CSV output buffer\n");
+        close(mod_ctx->out_fd);
+        free(mod_ctx);
         return NULL;
     }
     return mod_ctx;
 }
 
-static void finish_file(void *ctx) {
+static int finish_file(void *ctx) {
     mod_csv_ctx_t *mod_ctx = (mod_csv_ctx_t *)ctx;
+    int retval = 0;
     if (mod_ctx) {
-        if (mod_ctx->out_file != NULL)
-            fclose(mod_ctx->out_file);
+        retval = csv_flush(mod_ctx);
+        if (mod_ctx->out_fd != -1)
+            close(mod_ctx->out_fd);
+        free(mod_ctx->buffer);
+        free(mod_ctx);
     }
+    return retval;
 }
 
 static int handle_info(int obs_count, int var_count, void *ctx) {
@@ -64,41 +162,56 @@ static int handle_variable(int index, readstat_variable_t *variable,
                            const char *val_labels, void *ctx) {
     mod_csv_ctx_t *mod_ctx = (mod_csv_ctx_t *)ctx;
     const char *name = readstat_variable_get_name(variable);
-    if (index > 0) {
-        fprintf(mod_ctx->out_file, ",\"%s\"", name);
-    } else {
-        fprintf(mod_ctx->out_file, "\"%s\"", name);
-    }
-    if (index == mod_ctx->var_count - 1) {
-        fprintf(mod_ctx->out_file, "\n");
-    }
+    if (index > 0 && csv_write_char(mod_ctx, ','))
+        return 1;
+    if (csv_write_quoted(mod_ctx, name))
+        return 1;
+    if (index == mod_ctx->var_count - 1 && csv_write_char(mod_ctx, '\n'))
+        return 1;
     return 0;
 }
 
 static int handle_value(int obs_index, int var_index, readstat_value_t value, void *ctx) {
     mod_csv_ctx_t *mod_ctx = (mod_csv_ctx_t *)ctx;
     readstat_type_t type = readstat_value_type(value);
-    if (var_index > 0) {
-        fprintf(mod_ctx->out_file, ",");
-    }
+    char *out = NULL;
+    size_t len = 0;
+
+    /* Room for a separator, a number and a newline */
+    if ((out = csv_reserve(mod_ctx, RS_FORMAT_NUMBER_MAX_LEN + 2)) == NULL)
+        return 1;
+
+    if (var_index > 0)
+        out[len++] = ',';
+
     if (readstat_value_is_system_missing(value)) {
         /* void */
     } else if (type == READSTAT_TYPE_STRING || type == READSTAT_TYPE_LONG_STRING) {
-        /* TODO escape */
-        fprintf(mod_ctx->out_file, "\"%s\"", readstat_string_value(value));
+        mod_ctx->buffer_used += len;
+        len = 0;
+        if (csv_write_quoted_len(mod_ctx, readstat_string_value(value), readstat_string_value_len(value)))
+            return 1;
+        if ((out = csv_reserve(mod_ctx, 1)) == NULL)
+            return 1;
     } else if (type == READSTAT_TYPE_INT8) {
-        fprintf(mod_ctx->out_file, "%hhd", readstat_int8_value(value));
+        len += rs_format_int64(&out[len], readstat_int8_value(value));
     } else if (type == READSTAT_TYPE_INT16) {
-        fprintf(mod_ctx->out_file, "%hd", readstat_int16_value(value));
+        len += rs_format_int64(&out[len], readstat_int16_value(value));
     } else if (type == READSTAT_TYPE_INT32) {
-        fprintf(mod_ctx->out_file, "%d", readstat_int32_value(value));
+        len += rs_format_int64(&out[len], readstat_int32_value(value));
     } else if (type == READSTAT_TYPE_FLOAT) {
-        fprintf(mod_ctx->out_file, "%f", readstat_float_value(value));
+        float fp_value = readstat_float_value(value);
+        if (!isnan(fp_value))
+            len += rs_format_float(&out[len], fp_value);
     } else if (type == READSTAT_TYPE_DOUBLE) {
-        fprintf(mod_ctx->out_file, "%lf", readstat_double_value(value));
-    }
-    if (var_index == mod_ctx->var_count - 1) {
-        fprintf(mod_ctx->out_file, "\n");
+        double fp_value = readstat_double_value(value);
+        if (!isnan(fp_value))
+            len += rs_format_double(&out[len], fp_value);
     }
+
+    if (var_index == mod_ctx->var_count - 1)
+        out[len++] = '\n';
+
+    mod_ctx->buffer_used += len;
     return 0;
 }
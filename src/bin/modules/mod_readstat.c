@@ -19,15 +19,17 @@ typedef struct mod_readstat_ctx_s {
 
     int out_fd;
     int is_sav:1;
+    int is_zsav:1;
     int is_dta:1;
     int is_por:1;
 } mod_readstat_ctx_t;
 
 static ssize_t write_data(const void *bytes, size_t len, void *ctx);
+static readstat_off_t seek_data(readstat_off_t offset, readstat_io_flags_t whence, void *ctx);
 
 static int accept_file(const char *filename);
 static void *ctx_init(const char *filename);
-static void finish_file(void *ctx);
+static int finish_file(void *ctx);
 
 static int handle_fweight(int var_index, void *ctx);
 static int handle_info(int obs_count, int var_count, void *ctx);
@@ -53,8 +55,20 @@ static ssize_t write_data(const void *bytes, size_t len, void *ctx) {
     return write(mod_ctx->out_fd, bytes, len);
 }
 
+static readstat_off_t seek_data(readstat_off_t offset, readstat_io_flags_t whence, void *ctx) {
+    mod_readstat_ctx_t *mod_ctx = (mod_readstat_ctx_t *)ctx;
+    int flag = SEEK_SET;
+    if (whence == READSTAT_SEEK_CUR) {
+        flag = SEEK_CUR;
+    } else if (whence == READSTAT_SEEK_END) {
+        flag = SEEK_END;
+    }
+    return lseek(mod_ctx->out_fd, offset, flag);
+}
+
 static int accept_file(const char *filename) {
-    return rs_ends_with(filename, ".dta") || rs_ends_with(filename, ".sav") || rs_ends_with(filename, ".por");
+    return rs_ends_with(filename, ".dta") || rs_ends_with(filename, ".sav") ||
+        rs_ends_with(filename, ".zsav") || rs_ends_with(filename, ".por");
 }
 
 static void *ctx_init(const char *filename) {
@@ -62,6 +76,7 @@ static void *ctx_init(const char *filename) {
     mod_readstat_ctx_t *mod_ctx = malloc(sizeof(mod_readstat_ctx_t));
     mod_ctx->label_set_dict = ck_hash_table_init(1024);
     mod_ctx->is_sav = rs_ends_with(filename, ".sav");
+    mod_ctx->is_zsav = rs_ends_with(filename, ".zsav");
     mod_ctx->is_dta = rs_ends_with(filename, ".dta");
     mod_ctx->is_por = rs_ends_with(filename, ".por");
     mod_ctx->out_fd = open(filename, O_CREAT | O_WRONLY | O_EXCL, 0644);
@@ -73,13 +88,24 @@ static void *ctx_init(const char *filename) {
     mod_ctx->writer = readstat_writer_init();
     readstat_writer_set_file_label(mod_ctx->writer, "Created by ReadStat <https://github.com/WizardMac/ReadStat>");
     readstat_set_data_writer(mod_ctx->writer, &write_data);
+    readstat_set_data_seeker(mod_ctx->writer, &seek_data);
 
     return mod_ctx;
 }
 
-void finish_file(void *ctx) {
+int finish_file(void *ctx) {
     mod_readstat_ctx_t *mod_ctx = (mod_readstat_ctx_t *)ctx;
+    int retval = 0;
     if (mod_ctx) {
+        // Without a row count up front, the last row is only known now
+        if (mod_ctx->row_count == READSTAT_ROW_COUNT_UNKNOWN &&
+                mod_ctx->writer && mod_ctx->writer->initialized) {
+            readstat_error_t error = readstat_end_writing(mod_ctx->writer);
+            if (error != READSTAT_OK) {
+                fprintf(stderr, "Error writing: %s\n", readstat_error_message(error));
+                retval = 1;
+            }
+        }
         if (mod_ctx->out_fd != -1)
             close(mod_ctx->out_fd);
         if (mod_ctx->label_set_dict)
@@ -88,6 +114,7 @@ void finish_file(void *ctx) {
             readstat_writer_free(mod_ctx->writer);
         free(mod_ctx);
     }
+    return retval;
 }
 
 static int handle_fweight(int var_index, void *ctx) {
@@ -100,7 +127,8 @@ static int handle_fweight(int var_index, void *ctx) {
 static int handle_info(int obs_count, int var_count, void *ctx) {
     mod_readstat_ctx_t *mod_ctx = (mod_readstat_ctx_t *)ctx;
     mod_ctx->var_count = var_count;
-    mod_ctx->row_count = obs_count;
+    // Some inputs (e.g. POR) don't know their row count until the end
+    mod_ctx->row_count = obs_count < 0 ? READSTAT_ROW_COUNT_UNKNOWN : obs_count;
     return (var_count == 0 || obs_count == 0);
 }
 
@@ -183,6 +211,10 @@ static int handle_value(int obs_index, int var_index, readstat_value_t value, vo
     if (var_index == 0) {
         if (obs_index == 0) {
             if (mod_ctx->is_sav) {
+                readstat_writer_set_compression(writer, READSTAT_COMPRESS_ROWS);
+                error = readstat_begin_writing_sav(writer, mod_ctx, mod_ctx->row_count);
+            } else if (mod_ctx->is_zsav) {
+                readstat_writer_set_compression(writer, READSTAT_COMPRESS_BINARY);
                 error = readstat_begin_writing_sav(writer, mod_ctx, mod_ctx->row_count);
             } else if (mod_ctx->is_dta) {
                 error = readstat_begin_writing_dta(writer, mod_ctx, mod_ctx->row_count);
@@ -202,7 +234,8 @@ static int handle_value(int obs_index, int var_index, readstat_value_t value, vo
     if (readstat_value_is_system_missing(value)) {
         error = readstat_insert_missing_value(writer, variable);
     } else if (type == READSTAT_TYPE_STRING || type == READSTAT_TYPE_LONG_STRING) {
-        error = readstat_insert_string_value(writer, variable, readstat_string_value(value));
+        error = readstat_insert_string_value_len(writer, variable,
+                readstat_string_value(value), readstat_string_value_len(value));
     } else if (type == READSTAT_TYPE_INT8) {
         error = readstat_insert_int8_value(writer, variable, readstat_int8_value(value));
     } else if (type == READSTAT_TYPE_INT16) {
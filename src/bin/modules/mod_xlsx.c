@@ -21,7 +21,7 @@ typedef struct mod_xlsx_ctx_s {
 
 static int accept_file(const char *filename);
 static void *ctx_init(const char *filename);
-static void finish_file(void *ctx);
+static int finish_file(void *ctx);
 static int handle_info(int obs_count, int var_count, void *ctx);
 static int handle_variable(int index, readstat_variable_t *variable,
                            const char *val_labels, void *ctx);
@@ -57,15 +57,17 @@ static void *ctx_init(const char *filename) {
     return mod_ctx;
 }
 
-static void finish_file(void *ctx) {
+static int finish_file(void *ctx) {
     mod_xlsx_ctx_t *mod_ctx = (mod_xlsx_ctx_t *)ctx;
+    int retval = 0;
     if (mod_ctx) {
         if (mod_ctx->row_count > MIN_ROWS_TO_SPLIT) {
             worksheet_freeze_panes(mod_ctx->worksheet, 1, 0);
         }
-        workbook_close(mod_ctx->workbook);
+        retval = (workbook_close(mod_ctx->workbook) != LXW_NO_ERROR);
         free(mod_ctx);
     }
+    return retval;
 }
 
 static int handle_variable(int index, readstat_variable_t *variable,
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -7,6 +8,7 @@
 #include <sys/time.h>
 
 #include "../readstat.h"
+#include "../readstat_pipeline.h"
 #include "module.h"
 #include "modules/mod_readstat.h"
 #include "modules/mod_csv.h"
@@ -26,11 +28,29 @@
 
 #define RS_FORMAT_CAN_WRITE     (RS_FORMAT_DTA | RS_FORMAT_SAV)
 
+/* Row batches in flight between the parser and the writer thread */
+#define RS_BATCH_JOBS_COUNT     4
+
+/* A copy of one batch of rows, owned by the writer thread until delivered */
+typedef struct rs_batch_job_s {
+    int                 obs_index;
+    int                 obs_count;
+    readstat_column_t  *columns;
+    int                 columns_count;
+    int                 capacity;
+    char               *strings;
+    size_t              strings_capacity;
+} rs_batch_job_t;
+
 typedef struct rs_ctx_s {
     rs_module_t *module;
     void        *module_ctx;
     long         row_count;
     long         var_count;
+
+    readstat_pipeline_t *pipeline;
+    rs_batch_job_t      *jobs;
+    int                  write_error;
 } rs_ctx_t;
 
 int format(const char *filename) {
@@ -47,6 +67,12 @@ int format(const char *filename) {
     if (strncmp(filename + len - 4, ".por", 4) == 0)
         return RS_FORMAT_POR;
 
+    if (len < sizeof(".zsav")-1)
+        return RS_FORMAT_UNKNOWN;
+
+    if (strncmp(filename + len - 5, ".zsav", 5) == 0)
+        return RS_FORMAT_SAV;
+
     if (len < sizeof(".sas7bdat")-1)
         return RS_FORMAT_UNKNOWN;
 
@@ -152,6 +178,187 @@ static int handle_value(int obs_index, int var_index, readstat_value_t value, vo
     return 0;
 }
 
+static void rs_batch_job_free(rs_batch_job_t *job) {
+    int i;
+    for (i=0; i<job->columns_count; i++) {
+        free(job->columns[i].v.double_values);
+        free(job->columns[i].system_missing);
+        free(job->columns[i].considered_missing);
+        free(job->columns[i].tags);
+        free(job->columns[i].string_lengths);
+    }
+    free(job->columns);
+    free(job->strings);
+    memset(job, 0, sizeof(rs_batch_job_t));
+}
+
+static size_t rs_value_size(readstat_type_t type) {
+    switch (type) {
+        case READSTAT_TYPE_INT8:
+            return sizeof(int8_t);
+        case READSTAT_TYPE_INT16:
+            return sizeof(int16_t);
+        case READSTAT_TYPE_INT32:
+            return sizeof(int32_t);
+        case READSTAT_TYPE_FLOAT:
+            return sizeof(float);
+        case READSTAT_TYPE_DOUBLE:
+            return sizeof(double);
+        default:
+            return sizeof(const char *);
+    }
+}
+
+/* Copies a batch out of the parser's buffers, which it reuses as soon as
+ * the batch handler returns */
+static readstat_error_t rs_batch_job_copy(rs_batch_job_t *job, int obs_index, int obs_count,
+        const readstat_column_t *columns, int columns_count) {
+    size_t strings_len = 0;
+    int i, j;
+
+    if (job->capacity < obs_count || job->columns_count != columns_count) {
+        rs_batch_job_free(job);
+        if ((job->columns = calloc(columns_count, sizeof(readstat_column_t))) == NULL && columns_count > 0)
+            return READSTAT_ERROR_MALLOC;
+
+        job->columns_count = columns_count;
+        job->capacity = obs_count;
+
+        for (i=0; i<columns_count; i++) {
+            readstat_column_t *column = &job->columns[i];
+            if ((column->v.double_values = malloc(obs_count * rs_value_size(columns[i].type))) == NULL)
+                return READSTAT_ERROR_MALLOC;
+            if ((column->system_missing = malloc((obs_count + 7) / 8)) == NULL)
+                return READSTAT_ERROR_MALLOC;
+            if ((column->considered_missing = malloc((obs_count + 7) / 8)) == NULL)
+                return READSTAT_ERROR_MALLOC;
+            if ((column->tags = malloc(obs_count)) == NULL)
+                return READSTAT_ERROR_MALLOC;
+            if ((columns[i].type == READSTAT_TYPE_STRING || columns[i].type == READSTAT_TYPE_LONG_STRING) &&
+                    (column->string_lengths = malloc(obs_count * sizeof(size_t))) == NULL)
+                return READSTAT_ERROR_MALLOC;
+        }
+    }
+
+    for (i=0; i<columns_count; i++) {
+        readstat_column_t *column = &job->columns[i];
+        column->type = columns[i].type;
+        column->index = columns[i].index;
+        memcpy(column->system_missing, columns[i].system_missing, (obs_count + 7) / 8);
+        memcpy(column->considered_missing, columns[i].considered_missing, (obs_count + 7) / 8);
+        memcpy(column->tags, columns[i].tags, obs_count);
+        if (column->type == READSTAT_TYPE_STRING || column->type == READSTAT_TYPE_LONG_STRING) {
+            memcpy(column->string_lengths, columns[i].string_lengths, obs_count * sizeof(size_t));
+            for (j=0; j<obs_count; j++) {
+                if (columns[i].v.string_values[j])
+                    strings_len += columns[i].string_lengths[j] + 1;
+            }
+        } else {
+            memcpy(column->v.double_values, columns[i].v.double_values, obs_count * rs_value_size(column->type));
+        }
+    }
+
+    if (strings_len > job->strings_capacity) {
+        char *strings = realloc(job->strings, strings_len);
+        if (strings == NULL)
+            return READSTAT_ERROR_MALLOC;
+
+        job->strings = strings;
+        job->strings_capacity = strings_len;
+    }
+
+    strings_len = 0;
+    for (i=0; i<columns_count; i++) {
+        readstat_column_t *column = &job->columns[i];
+        if (column->type != READSTAT_TYPE_STRING && column->type != READSTAT_TYPE_LONG_STRING)
+            continue;
+
+        for (j=0; j<obs_count; j++) {
+            const char *string = columns[i].v.string_values[j];
+            if (string == NULL) {
+                column->v.string_values[j] = NULL;
+                continue;
+            }
+            size_t len = columns[i].string_lengths[j] + 1;
+            memcpy(&job->strings[strings_len], string, len);
+            column->v.string_values[j] = &job->strings[strings_len];
+            strings_len += len;
+        }
+    }
+
+    job->obs_index = obs_index;
+    job->obs_count = obs_count;
+
+    return READSTAT_OK;
+}
+
+/* Runs on the writer thread: feeds the batch to the output module a value
+ * at a time, in row order */
+static readstat_error_t rs_write_batch(void *job_ptr, int worker_index, void *ctx) {
+    rs_ctx_t *rs_ctx = (rs_ctx_t *)ctx;
+    rs_batch_job_t *job = (rs_batch_job_t *)job_ptr;
+    int i, j;
+
+    if (rs_ctx->write_error)
+        return READSTAT_ERROR_USER_ABORT;
+
+    for (i=0; i<job->obs_count; i++) {
+        for (j=0; j<job->columns_count; j++) {
+            readstat_column_t *column = &job->columns[j];
+            readstat_value_t value = { .type = column->type, .tag = column->tags[i] };
+            switch (column->type) {
+                case READSTAT_TYPE_STRING:
+                case READSTAT_TYPE_LONG_STRING:
+                    value.v.string_value = column->v.string_values[i];
+                    value.string_len = column->string_lengths[i]; break;
+                case READSTAT_TYPE_INT8:
+                    value.v.i8_value = column->v.i8_values[i]; break;
+                case READSTAT_TYPE_INT16:
+                    value.v.i16_value = column->v.i16_values[i]; break;
+                case READSTAT_TYPE_INT32:
+                    value.v.i32_value = column->v.i32_values[i]; break;
+                case READSTAT_TYPE_FLOAT:
+                    value.v.float_value = column->v.float_values[i]; break;
+                case READSTAT_TYPE_DOUBLE:
+                    value.v.double_value = column->v.double_values[i]; break;
+            }
+            value.is_system_missing = readstat_column_is_system_missing(column, i);
+            value.is_considered_missing = readstat_column_is_considered_missing(column, i);
+            if (rs_ctx->module->handle_value(job->obs_index + i, column->index, value, rs_ctx->module_ctx)) {
+                rs_ctx->write_error = 1;
+                return READSTAT_ERROR_USER_ABORT;
+            }
+        }
+    }
+
+    return READSTAT_OK;
+}
+
+static readstat_error_t rs_deliver_batch(void *job, readstat_error_t work_retval, void *ctx) {
+    return work_retval;
+}
+
+/* Runs on the parser thread: waits for a free slot, which bounds the
+ * number of rows buffered ahead of a slow writer */
+static int handle_batch(int obs_index, int obs_count,
+        const readstat_column_t *columns, int columns_count, void *ctx) {
+    rs_ctx_t *rs_ctx = (rs_ctx_t *)ctx;
+    rs_batch_job_t *job = NULL;
+
+    if (obs_index == 0)
+        rs_ctx->var_count = columns_count;
+    rs_ctx->row_count += obs_count;
+
+    if (readstat_pipeline_acquire(rs_ctx->pipeline, (void **)&job) != READSTAT_OK)
+        return 1;
+
+    if (rs_batch_job_copy(job, obs_index, obs_count, columns, columns_count) != READSTAT_OK)
+        return 1;
+
+    readstat_pipeline_submit(rs_ctx->pipeline);
+    return 0;
+}
+
 readstat_error_t parse_file(readstat_parser_t *parser, const char *input_filename, int input_format, void *ctx) {
     readstat_error_t error = READSTAT_OK;
 
@@ -204,8 +411,7 @@ static int convert_file(const char *input_filename, const char *catalog_filename
 
     gettimeofday(&start_time, NULL);
 
-    readstat_parser_t *pass1_parser = readstat_parser_init();
-    readstat_parser_t *pass2_parser = readstat_parser_init();
+    readstat_parser_t *parser = readstat_parser_init();
 
     rs_ctx_t *rs_ctx = calloc(1, sizeof(rs_ctx_t));
 
@@ -217,30 +423,52 @@ static int convert_file(const char *input_filename, const char *catalog_filename
     rs_ctx->module = module;
     rs_ctx->module_ctx = module_ctx;
 
-    // Pass 1 - Collect fweight and value labels
-    readstat_set_error_handler(pass1_parser, &handle_error);
-    readstat_set_info_handler(pass1_parser, &handle_info);
-    readstat_set_value_label_handler(pass1_parser, &handle_value_label);
-    readstat_set_fweight_handler(pass1_parser, &handle_fweight);
+    if (module->handle_value) {
+        void *jobs[RS_BATCH_JOBS_COUNT];
+        int i;
 
-    if (catalog_filename) {
-        error = parse_file(pass1_parser, catalog_filename, RS_FORMAT_SAS_CATALOG, rs_ctx);
+        if ((rs_ctx->jobs = calloc(RS_BATCH_JOBS_COUNT, sizeof(rs_batch_job_t))) == NULL) {
+            error = READSTAT_ERROR_MALLOC;
+            error_filename = input_filename;
+            goto cleanup;
+        }
+        for (i=0; i<RS_BATCH_JOBS_COUNT; i++)
+            jobs[i] = &rs_ctx->jobs[i];
+
+        rs_ctx->pipeline = readstat_pipeline_init(1, jobs, RS_BATCH_JOBS_COUNT,
+                &rs_write_batch, &rs_deliver_batch, rs_ctx);
+    }
+
+    readstat_set_error_handler(parser, &handle_error);
+    if (module->handle_value_label)
+        readstat_set_value_label_handler(parser, &handle_value_label);
+
+    // SAS keeps its value labels in a separate catalog file
+    if (catalog_filename && module->handle_value_label) {
+        error = parse_file(parser, catalog_filename, RS_FORMAT_SAS_CATALOG, rs_ctx);
         error_filename = catalog_filename;
-    } else {
-        error = parse_file(pass1_parser, input_filename, input_format, rs_ctx);
-        error_filename = input_filename;
+        if (error != READSTAT_OK)
+            goto cleanup;
     }
-    if (error != READSTAT_OK)
-        goto cleanup;
 
-    // Pass 2 - Parse full file
-    readstat_set_error_handler(pass2_parser, &handle_error);
-    readstat_set_info_handler(pass2_parser, &handle_info);
-    readstat_set_variable_handler(pass2_parser, &handle_variable);
-    readstat_set_value_handler(pass2_parser, &handle_value);
+    // The other formats report value labels and the frequency weight
+    // before the values, so one pass over the input is enough
+    readstat_set_info_handler(parser, &handle_info);
+    readstat_set_fweight_handler(parser, &handle_fweight);
+    readstat_set_variable_handler(parser, &handle_variable);
+
+    // Decode on this thread while a second one encodes and writes the
+    // output, unless threads are unavailable
+    if (rs_ctx->pipeline) {
+        readstat_set_batch_handler(parser, &handle_batch);
+    } else {
+        readstat_set_value_handler(parser, &handle_value);
+    }
 
-    error = parse_file(pass2_parser, input_filename, input_format, rs_ctx);
+    error = parse_file(parser, input_filename, input_format, rs_ctx);
     error_filename = input_filename;
+    if (error == READSTAT_OK && rs_ctx->pipeline)
+        error = readstat_pipeline_drain(rs_ctx->pipeline);
     if (error != READSTAT_OK)
         goto cleanup;
 
@@ -252,11 +480,20 @@ static int convert_file(const char *input_filename, const char *catalog_filename
             (start_time.tv_sec + 1e-6 * start_time.tv_usec));
 
 cleanup:
-    readstat_parser_free(pass1_parser);
-    readstat_parser_free(pass2_parser);
+    readstat_parser_free(parser);
+
+    // Stop the writer thread before the module it writes to goes away
+    readstat_pipeline_free(rs_ctx->pipeline);
+    if (rs_ctx->jobs) {
+        int i;
+        for (i=0; i<RS_BATCH_JOBS_COUNT; i++)
+            rs_batch_job_free(&rs_ctx->jobs[i]);
+        free(rs_ctx->jobs);
+    }
 
-    if (module->finish) {
-        module->finish(rs_ctx->module_ctx);
+    if (module->finish && module->finish(rs_ctx->module_ctx) != 0 && error == READSTAT_OK) {
+        error = READSTAT_ERROR_WRITE;
+        error_filename = output_filename;
     }
 
     free(rs_ctx);
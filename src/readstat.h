@@ -86,6 +86,8 @@ typedef struct readstat_value_s {
         int32_t     i32_value;
         const char *string_value;
     } v;
+    size_t                  string_len;
+    uint32_t                dictionary_entry; /* 1 + the string's dictionary id, or 0 */
     readstat_type_t         type;
     char                    tag;
     unsigned int            is_system_missing:1;
@@ -104,6 +106,11 @@ int32_t readstat_int32_value(readstat_value_t value);
 float readstat_float_value(readstat_value_t value);
 double readstat_double_value(readstat_value_t value);
 const char *readstat_string_value(readstat_value_t value);
+// Length in bytes of the string value, not counting the terminating NUL
+size_t readstat_string_value_len(readstat_value_t value);
+// Id of the string value in its column's dictionary (see
+// readstat_set_string_dictionary), or -1 if the value wasn't interned
+int32_t readstat_string_value_dictionary_id(readstat_value_t value);
 
 /* Internal data structures */
 typedef struct readstat_value_label_s {
@@ -130,25 +137,25 @@ typedef struct readstat_label_set_s {
     long                        variables_capacity;
 } readstat_label_set_t;
 
-typedef struct readstat_missingness_s {
-    readstat_value_t missing_ranges[32];
-    long             missing_ranges_count;
-} readstat_missingness_t;
-
+/* The strings are never NULL (they are empty when unset), and missing_ranges
+ * holds missing_ranges_count lo/hi pairs. Variables added to a writer keep
+ * their strings and ranges in the writer's store. */
 typedef struct readstat_variable_s {
     readstat_type_t         type;
     int                     index;
-    char                    name[256];
-    char                    format[256];
-    char                    label[1024];
+    const char             *name;
+    const char             *format;
+    const char             *label;
     readstat_label_set_t   *label_set;
     off_t                   offset;
     size_t                  storage_width;
     size_t                  user_width;
-    readstat_missingness_t  missingness;
+    readstat_value_t       *missing_ranges;
+    int                     missing_ranges_count;
     readstat_measure_t      measure;
     readstat_alignment_t    alignment;
     int                     display_width;
+    struct readstat_variable_store_s *store;
 } readstat_variable_t;
 
 /* Accessor methods for use inside a variable handler */
@@ -165,6 +172,42 @@ int readstat_variable_get_missing_ranges_count(const readstat_variable_t *variab
 readstat_value_t readstat_variable_get_missing_range_lo(const readstat_variable_t *variable, int i);
 readstat_value_t readstat_variable_get_missing_range_hi(const readstat_variable_t *variable, int i);
 
+/* A block of rows for a single variable, delivered to a batch handler. Row i is
+ * system-missing if bit (i % 8) of system_missing[i / 8] is set, and similarly
+ * for user-defined missing values in considered_missing. index is the
+ * variable's position in the file. For string columns, string_lengths holds
+ * the byte length of each value; it is NULL for other types.
+ *
+ * String columns read with a string dictionary are also dictionary-encoded:
+ * dictionary_ids holds each row's id, or -1 for a value that wasn't interned,
+ * and dictionary lists the dictionary_count entries seen so far, by id. The
+ * entries' strings (and the string_values that point at them) stay valid
+ * until the parse returns. Otherwise dictionary_ids and dictionary are NULL. */
+typedef struct readstat_column_s {
+    readstat_type_t     type;
+    union {
+        int8_t         *i8_values;
+        int16_t        *i16_values;
+        int32_t        *i32_values;
+        float          *float_values;
+        double         *double_values;
+        const char    **string_values;
+    } v;
+    size_t             *string_lengths;
+    int32_t            *dictionary_ids;
+    const char * const *dictionary;
+    const size_t       *dictionary_lengths;
+    int32_t             dictionary_count;
+    uint8_t            *system_missing;
+    uint8_t            *considered_missing;
+    char               *tags;
+    int                 index;
+} readstat_column_t;
+
+int readstat_column_is_missing(const readstat_column_t *column, int i);
+int readstat_column_is_system_missing(const readstat_column_t *column, int i);
+int readstat_column_is_considered_missing(const readstat_column_t *column, int i);
+
 /* Callbacks should return 0 on success and non-zero to abort */
 typedef int (*readstat_info_handler)(int obs_count, int var_count, void *ctx);
 typedef int (*readstat_metadata_handler)(const char *file_label, time_t timestamp, long format_version, void *ctx);
@@ -173,6 +216,10 @@ typedef int (*readstat_variable_handler)(int index, readstat_variable_t *variabl
 typedef int (*readstat_fweight_handler)(int var_index, void *ctx);
 typedef int (*readstat_value_handler)(int obs_index, int var_index, 
         readstat_value_t value, void *ctx);
+/* Called with obs_count rows beginning at obs_index, one column per variable.
+ * The arrays are only valid for the duration of the call. */
+typedef int (*readstat_batch_handler)(int obs_index, int obs_count,
+        const readstat_column_t *columns, int columns_count, void *ctx);
 typedef int (*readstat_value_label_handler)(const char *val_labels, 
         readstat_value_t value, const char *label, void *ctx);
 typedef void (*readstat_error_handler)(const char *error_message, void *ctx);
@@ -192,18 +239,40 @@ typedef enum readstat_io_flags_e {
     READSTAT_SEEK_END
 } readstat_io_flags_t;
 
+typedef enum readstat_io_advice_e {
+    READSTAT_ADVICE_NORMAL,
+    READSTAT_ADVICE_SEQUENTIAL,
+    READSTAT_ADVICE_RANDOM,
+    READSTAT_ADVICE_WILLNEED
+} readstat_io_advice_t;
+
 typedef int (*readstat_open_handler)(const char *path, void *io_ctx);
 typedef int (*readstat_close_handler)(void *io_ctx);
 typedef readstat_off_t (*readstat_seek_handler)(readstat_off_t offset, readstat_io_flags_t whence, void *io_ctx);
 typedef ssize_t (*readstat_read_handler)(void *buf, size_t nbyte, void *io_ctx);
 typedef readstat_error_t (*readstat_update_handler)(long file_size, readstat_progress_handler progress_handler, void *user_ctx, void *io_ctx);
 
+/* Optional. Like the read handler, but instead of copying, points *buf at up to
+ * nbyte bytes of input that stay valid until the file is closed. Should return
+ * the number of bytes made available, or -1 on error. */
+typedef ssize_t (*readstat_borrow_handler)(const void **buf, size_t nbyte, void *io_ctx);
+/* Optional. A hint about how the given byte range is about to be accessed;
+ * a len of 0 extends the range to the end of the file. */
+typedef int (*readstat_advise_handler)(readstat_off_t offset, readstat_off_t len, readstat_io_advice_t advice, void *io_ctx);
+/* Optional. Reads up to nbyte bytes at the given absolute offset without
+ * moving the file position. May be called from several threads at once.
+ * Should return the number of bytes read, or -1 on error. */
+typedef ssize_t (*readstat_pread_handler)(void *buf, size_t nbyte, readstat_off_t offset, void *io_ctx);
+
 typedef struct readstat_io_s {
     readstat_open_handler          open;
     readstat_close_handler         close;
     readstat_seek_handler          seek;
     readstat_read_handler          read;
     readstat_update_handler        update;
+    readstat_borrow_handler        borrow;
+    readstat_advise_handler        advise;
+    readstat_pread_handler         pread;
     void                          *io_ctx;
     int                            external_io;
 } readstat_io_t;
@@ -214,13 +283,20 @@ typedef struct readstat_parser_s {
     readstat_variable_handler      variable_handler;
     readstat_fweight_handler       fweight_handler;
     readstat_value_handler         value_handler;
+    readstat_batch_handler         batch_handler;
     readstat_value_label_handler   value_label_handler;
     readstat_error_handler         error_handler;
     readstat_progress_handler      progress_handler;
+    double                         progress_granularity;
     readstat_io_t                 *io;
     const char                    *input_encoding;
     const char                    *output_encoding;
     long                           row_limit;
+    long                           row_offset;
+    long                           batch_size;
+    int                            thread_count;
+    long                           string_dictionary_max;
+    struct readstat_column_filter_s *column_filter;
 } readstat_parser_t;
 
 readstat_parser_t *readstat_parser_init();
@@ -232,17 +308,32 @@ readstat_error_t readstat_set_metadata_handler(readstat_parser_t *parser, readst
 readstat_error_t readstat_set_variable_handler(readstat_parser_t *parser, readstat_variable_handler variable_handler);
 readstat_error_t readstat_set_fweight_handler(readstat_parser_t *parser, readstat_fweight_handler fweight_handler);
 readstat_error_t readstat_set_value_handler(readstat_parser_t *parser, readstat_value_handler value_handler);
+readstat_error_t readstat_set_batch_handler(readstat_parser_t *parser, readstat_batch_handler batch_handler);
 readstat_error_t readstat_set_value_label_handler(readstat_parser_t *parser, readstat_value_label_handler value_label_handler);
 readstat_error_t readstat_set_error_handler(readstat_parser_t *parser, readstat_error_handler error_handler);
 readstat_error_t readstat_set_progress_handler(readstat_parser_t *parser, readstat_progress_handler progress_handler);
 
+// Minimum advance, as a fraction of the file, between calls to the progress
+// handler. The handler is also called once at the end of the file. Defaults to
+// 0.01; pass 0 to be called at every opportunity.
+readstat_error_t readstat_set_progress_granularity(readstat_parser_t *parser, double granularity);
+
 readstat_error_t readstat_set_open_handler(readstat_parser_t *parser, readstat_open_handler open_handler);
 readstat_error_t readstat_set_close_handler(readstat_parser_t *parser, readstat_close_handler close_handler);
 readstat_error_t readstat_set_seek_handler(readstat_parser_t *parser, readstat_seek_handler seek_handler);
 readstat_error_t readstat_set_read_handler(readstat_parser_t *parser, readstat_read_handler read_handler);
 readstat_error_t readstat_set_update_handler(readstat_parser_t *parser, readstat_update_handler update_handler);
+readstat_error_t readstat_set_borrow_handler(readstat_parser_t *parser, readstat_borrow_handler borrow_handler);
+readstat_error_t readstat_set_advise_handler(readstat_parser_t *parser, readstat_advise_handler advise_handler);
+readstat_error_t readstat_set_pread_handler(readstat_parser_t *parser, readstat_pread_handler pread_handler);
 readstat_error_t readstat_set_io_ctx(readstat_parser_t *parser, void *io_ctx);
 
+// Read input through a read-only memory mapping instead of read(2). Readers
+// will then decode directly from the mapped pages where they can. Returns
+// READSTAT_ERROR_OPEN, leaving the default I/O in place, on platforms without
+// mmap.
+readstat_error_t readstat_set_mmap_io(readstat_parser_t *parser);
+
 // Usually inferred from the file, but sometimes a manual override is desirable.
 // In particular, pre-14 Stata uses the system encoding, which is usually Win 1252
 // but could be anything. `encoding' should be an iconv-compatible name.
@@ -253,6 +344,39 @@ readstat_error_t readstat_set_handler_character_encoding(readstat_parser_t *pars
 
 readstat_error_t readstat_set_row_limit(readstat_parser_t *parser, long row_limit);
 
+// Skip this many rows before the first one handed to the value or batch handler.
+// Observation indices passed to the handlers, and the observation count passed to
+// the info handler, are relative to the first row that is not skipped.
+readstat_error_t readstat_set_row_offset(readstat_parser_t *parser, long row_offset);
+
+// Maximum number of rows handed to the batch handler at once, from 1 to
+// INT_MAX. Defaults to 1024.
+readstat_error_t readstat_set_batch_size(readstat_parser_t *parser, long batch_size);
+
+// Decode rows on this many worker threads. Handlers are still called on the
+// parsing thread and in row order. Defaults to 1, meaning no worker threads.
+// Currently used by the SAS7BDAT reader, by the DTA reader when the I/O has
+// a pread handler, and by the ZSAV reader for files with more than one
+// compressed block (workers also read the blocks when there is a pread
+// handler).
+readstat_error_t readstat_set_thread_count(readstat_parser_t *parser, int thread_count);
+
+// Intern the values of fixed-width string variables, for columns with few
+// distinct values: each distinct value is converted once, and handlers get a
+// dictionary id (readstat_string_value_dictionary_id) and a string that stays
+// valid until the parse returns. A column stops taking new entries after
+// max_entries distinct values; later new values are delivered without an id.
+// Defaults to 0, meaning no dictionaries. Not supported by the SAS catalog and
+// RData readers, or for Stata strL variables.
+readstat_error_t readstat_set_string_dictionary(readstat_parser_t *parser, long max_entries);
+
+// Only decode the given variables. The variable, value and batch handlers are
+// not called for anything else. Indices are zero-based positions in the file
+// and are passed to the handlers unchanged. Repeated calls (with either indices
+// or names) add to the selection.
+readstat_error_t readstat_set_column_filter(readstat_parser_t *parser, const int *indices, int indices_count);
+readstat_error_t readstat_set_column_filter_names(readstat_parser_t *parser, const char * const *names, int names_count);
+
 readstat_error_t readstat_parse_dta(readstat_parser_t *parser, const char *path, void *user_ctx);
 readstat_error_t readstat_parse_sav(readstat_parser_t *parser, const char *path, void *user_ctx);
 readstat_error_t readstat_parse_por(readstat_parser_t *parser, const char *path, void *user_ctx);
@@ -268,13 +392,14 @@ typedef readstat_error_t (*readstat_write_int16_callback)(void *row_data, const
 typedef readstat_error_t (*readstat_write_int32_callback)(void *row_data, const readstat_variable_t *variable, int32_t value);
 typedef readstat_error_t (*readstat_write_float_callback)(void *row_data, const readstat_variable_t *variable, float value);
 typedef readstat_error_t (*readstat_write_double_callback)(void *row_data, const readstat_variable_t *variable, double value);
-typedef readstat_error_t (*readstat_write_string_callback)(void *row_data, const readstat_variable_t *variable, const char *value);
+typedef readstat_error_t (*readstat_write_string_callback)(void *row_data, const readstat_variable_t *variable, const char *value, size_t value_len);
 typedef readstat_error_t (*readstat_write_missing_callback)(void *row_data, const readstat_variable_t *variable);
 typedef readstat_error_t (*readstat_write_tagged_callback)(void *row_data, const readstat_variable_t *variable, char tag);
 
 typedef readstat_error_t (*readstat_begin_data_callback)(void *writer);
 typedef readstat_error_t (*readstat_write_row_callback)(void *writer, void *row_data, size_t row_len);
 typedef readstat_error_t (*readstat_end_data_callback)(void *writer);
+typedef readstat_error_t (*readstat_patch_row_count_callback)(void *writer);
 
 typedef struct readstat_writer_callbacks_s {
     readstat_variable_width_callback   variable_width;
@@ -290,21 +415,46 @@ typedef struct readstat_writer_callbacks_s {
     readstat_begin_data_callback    begin_data;
     readstat_write_row_callback     write_row;
     readstat_end_data_callback      end_data;
+    readstat_patch_row_count_callback patch_row_count;
 } readstat_writer_callbacks_t;
 
 /* You'll need to define one of these to get going. Should return # bytes written,
  * or -1 on error, a la write(2) */
 typedef ssize_t (*readstat_data_writer)(const void *data, size_t len, void *ctx);
 
+/* Optional; lets the writer go back and fill in the row count when it was not
+ * known up front, and the offsets in a ZSAV header. Should return the new
+ * offset, or -1 on error, a la lseek(2) */
+typedef readstat_off_t (*readstat_data_seeker)(readstat_off_t offset, readstat_io_flags_t whence, void *ctx);
+
+#define READSTAT_ROW_COUNT_UNKNOWN  -1
+
+typedef enum readstat_compress_e {
+    READSTAT_COMPRESS_NONE,
+    READSTAT_COMPRESS_ROWS,
+    READSTAT_COMPRESS_BINARY
+} readstat_compress_t;
+
+#define READSTAT_WRITER_DEFAULT_BUFFER_SIZE  65536
+
 typedef struct readstat_writer_s {
     readstat_data_writer        data_writer;
+    readstat_data_seeker        data_seeker;
+    FILE                       *spill_file;
+    int                         patches_header;
     size_t                      bytes_written;
+    unsigned char              *buffer;
+    size_t                      buffer_len;
+    size_t                      buffer_size;
     long                        version;
+    readstat_compress_t         compression;
+    int                         thread_count;
     time_t                      timestamp;
 
     readstat_variable_t       **variables;
     long                        variables_count;
     long                        variables_capacity;
+    struct readstat_variable_store_s *variable_store;
 
     readstat_label_set_t      **label_sets;
     long                        label_sets_count;
@@ -313,6 +463,10 @@ typedef struct readstat_writer_s {
     unsigned char              *row;
     size_t                      row_len;
 
+    unsigned char              *block;
+    long                        block_rows;
+    long                        block_capacity;
+
     int                         row_count;
     int                         current_row;
     char                        file_label[100];
@@ -335,6 +489,7 @@ readstat_writer_t *readstat_writer_init();
 
 // Then specify a function that will handle the output bytes...
 readstat_error_t readstat_set_data_writer(readstat_writer_t *writer, readstat_data_writer data_writer);
+readstat_error_t readstat_set_data_seeker(readstat_writer_t *writer, readstat_data_seeker data_seeker);
 
 // Next define your value labels, if any. Create as many named sets as you'd like.
 readstat_label_set_t *readstat_add_label_set(readstat_writer_t *writer, readstat_type_t type, const char *name);
@@ -361,12 +516,22 @@ readstat_error_t readstat_writer_set_file_timestamp(readstat_writer_t *writer, t
 readstat_error_t readstat_writer_set_fweight_variable(readstat_writer_t *writer, const readstat_variable_t *variable);
 readstat_error_t readstat_writer_set_file_format_version(readstat_writer_t *writer, 
         long file_format_version); // e.g. 104-118 for DTA
+readstat_error_t readstat_writer_set_compression(readstat_writer_t *writer,
+        readstat_compress_t compression); // Only supported by SAV; BINARY writes a ZSAV file
+readstat_error_t readstat_writer_set_thread_count(readstat_writer_t *writer,
+        int thread_count); // Threads used for BINARY compression; default 1
+readstat_error_t readstat_writer_set_buffer_size(readstat_writer_t *writer,
+        size_t buffer_size); // Bytes collected before calling the data writer; 0 disables buffering
 
 // Optional error handler
 readstat_error_t readstat_writer_set_error_handler(readstat_writer_t *writer, 
         readstat_error_handler error_handler);
 
-// Call one of these at any time before the first invocation of readstat_begin_row
+// Call one of these at any time before the first invocation of readstat_begin_row.
+// If row_count is READSTAT_ROW_COUNT_UNKNOWN, the count is filled in by
+// readstat_end_writing, through the data seeker if there is one and otherwise
+// by holding the output in a temporary file until the end. ZSAV files are
+// always patched this way.
 readstat_error_t readstat_begin_writing_dta(readstat_writer_t *writer, void *user_ctx, long row_count);
 readstat_error_t readstat_begin_writing_por(readstat_writer_t *writer, void *user_ctx, long row_count);
 readstat_error_t readstat_begin_writing_sav(readstat_writer_t *writer, void *user_ctx, long row_count);
@@ -381,12 +546,38 @@ readstat_error_t readstat_insert_int32_value(readstat_writer_t *writer, const re
 readstat_error_t readstat_insert_float_value(readstat_writer_t *writer, const readstat_variable_t *variable, float value);
 readstat_error_t readstat_insert_double_value(readstat_writer_t *writer, const readstat_variable_t *variable, double value);
 readstat_error_t readstat_insert_string_value(readstat_writer_t *writer, const readstat_variable_t *variable, const char *value);
+// Same, for a string whose length is already known. value need not be NUL-terminated.
+readstat_error_t readstat_insert_string_value_len(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const char *value, size_t value_len);
 readstat_error_t readstat_insert_missing_value(readstat_writer_t *writer, const readstat_variable_t *variable);
 readstat_error_t readstat_insert_tagged_missing_value(readstat_writer_t *writer, const readstat_variable_t *variable, char tag);
 
 // Finally, close out the row
 readstat_error_t readstat_end_row(readstat_writer_t *writer);
 
+// Alternatively, write a block of rows a column at a time. Every column in
+// the block must have the same rows_count; row i is system-missing if bit
+// (i % 8) of missing[i / 8] is set, and missing may be NULL.
+readstat_error_t readstat_insert_int8_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const int8_t *values, const uint8_t *missing, long rows_count);
+readstat_error_t readstat_insert_int16_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const int16_t *values, const uint8_t *missing, long rows_count);
+readstat_error_t readstat_insert_int32_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const int32_t *values, const uint8_t *missing, long rows_count);
+readstat_error_t readstat_insert_float_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const float *values, const uint8_t *missing, long rows_count);
+readstat_error_t readstat_insert_double_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const double *values, const uint8_t *missing, long rows_count);
+readstat_error_t readstat_insert_string_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const char * const *values, const uint8_t *missing, long rows_count);
+// Same, for strings whose lengths are already known, such as a batch
+// column's string_lengths. The values need not be NUL-terminated.
+readstat_error_t readstat_insert_string_column_len(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const char * const *values, const size_t *lengths, const uint8_t *missing, long rows_count);
+
+// ...and then write out the block
+readstat_error_t readstat_end_rows(readstat_writer_t *writer);
+
 // Once you've written all the rows, clean up after yourself
 readstat_error_t readstat_end_writing(readstat_writer_t *writer);
 void readstat_writer_free(readstat_writer_t *writer);
@@ -404,6 +595,8 @@ typedef struct rdata_parser_s {
     rdata_text_value_handler    text_value_handler;
     rdata_text_value_handler    value_label_handler;
     readstat_error_handler      error_handler;
+    readstat_progress_handler   progress_handler;
+    double                      progress_granularity;
     readstat_io_t              *io;
 } rdata_parser_t;
 
@@ -416,6 +609,8 @@ readstat_error_t rdata_set_column_name_handler(rdata_parser_t *parser, rdata_col
 readstat_error_t rdata_set_text_value_handler(rdata_parser_t *parser, rdata_text_value_handler text_value_handler);
 readstat_error_t rdata_set_value_label_handler(rdata_parser_t *parser, rdata_text_value_handler value_label_handler);
 readstat_error_t rdata_set_error_handler(rdata_parser_t *parser, readstat_error_handler error_handler);
+readstat_error_t rdata_set_progress_handler(rdata_parser_t *parser, readstat_progress_handler progress_handler);
+readstat_error_t rdata_set_progress_granularity(rdata_parser_t *parser, double granularity);
 readstat_error_t rdata_set_open_handler(rdata_parser_t *parser, readstat_open_handler open_handler);
 readstat_error_t rdata_set_close_handler(rdata_parser_t *parser, readstat_close_handler close_handler);
 readstat_error_t rdata_set_seek_handler(rdata_parser_t *parser, readstat_seek_handler seek_handler);
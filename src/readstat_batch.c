@@ -0,0 +1,250 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "readstat.h"
+#include "readstat_batch.h"
+#include "readstat_dictionary.h"
+
+static void readstat_batch_reset(readstat_batch_t *batch) {
+    int i;
+    size_t bitmap_len = (batch->capacity + 7) / 8;
+    for (i=0; i<batch->columns_count; i++) {
+        readstat_column_t *column = &batch->columns[i];
+        memset(column->system_missing, 0, bitmap_len);
+        memset(column->considered_missing, 0, bitmap_len);
+    }
+    batch->obs_index += batch->rows;
+    batch->rows = 0;
+    batch->strings_len = 0;
+}
+
+readstat_batch_t *readstat_batch_init(readstat_batch_handler handler, int capacity,
+        int vars_count, void *user_ctx) {
+    readstat_batch_t *batch = NULL;
+    int i;
+
+    if ((batch = calloc(1, sizeof(readstat_batch_t))) == NULL)
+        goto error;
+
+    batch->handler = handler;
+    batch->user_ctx = user_ctx;
+    batch->capacity = capacity;
+    batch->vars_count = vars_count;
+
+    if ((batch->columns = calloc(vars_count, sizeof(readstat_column_t))) == NULL && vars_count > 0)
+        goto error;
+
+    if ((batch->string_offsets = calloc(vars_count, sizeof(size_t *))) == NULL && vars_count > 0)
+        goto error;
+
+    if ((batch->dictionaries = calloc(vars_count, sizeof(readstat_dictionary_t *))) == NULL && vars_count > 0)
+        goto error;
+
+    if ((batch->column_map = malloc(vars_count * sizeof(int))) == NULL && vars_count > 0)
+        goto error;
+
+    for (i=0; i<vars_count; i++) {
+        batch->column_map[i] = -1;
+    }
+
+    return batch;
+
+error:
+    readstat_batch_free(batch);
+    return NULL;
+}
+
+readstat_error_t readstat_batch_add_column(readstat_batch_t *batch, int var_index, readstat_type_t type) {
+    readstat_column_t *column = NULL;
+    size_t bitmap_len = (batch->capacity + 7) / 8;
+    size_t value_len = 0;
+    void *values = NULL;
+    int i = batch->columns_count;
+
+    if (var_index < 0 || var_index >= batch->vars_count || i == batch->vars_count)
+        return READSTAT_ERROR_PARSE;
+
+    column = &batch->columns[i];
+    column->index = var_index;
+    batch->column_map[var_index] = i;
+    batch->columns_count++;
+
+    if ((column->system_missing = calloc(bitmap_len, 1)) == NULL)
+        return READSTAT_ERROR_MALLOC;
+    if ((column->considered_missing = calloc(bitmap_len, 1)) == NULL)
+        return READSTAT_ERROR_MALLOC;
+    if ((column->tags = calloc(batch->capacity, 1)) == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    switch (type) {
+        case READSTAT_TYPE_INT8:
+            value_len = sizeof(int8_t); break;
+        case READSTAT_TYPE_INT16:
+            value_len = sizeof(int16_t); break;
+        case READSTAT_TYPE_INT32:
+            value_len = sizeof(int32_t); break;
+        case READSTAT_TYPE_FLOAT:
+            value_len = sizeof(float); break;
+        case READSTAT_TYPE_DOUBLE:
+            value_len = sizeof(double); break;
+        case READSTAT_TYPE_STRING:
+        case READSTAT_TYPE_LONG_STRING:
+            value_len = sizeof(const char *); break;
+    }
+
+    if ((values = calloc(batch->capacity, value_len)) == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    column->type = type;
+    column->v.double_values = values;
+
+    if (type == READSTAT_TYPE_STRING || type == READSTAT_TYPE_LONG_STRING) {
+        if ((batch->string_offsets[i] = calloc(batch->capacity, sizeof(size_t))) == NULL)
+            return READSTAT_ERROR_MALLOC;
+        if ((column->string_lengths = calloc(batch->capacity, sizeof(size_t))) == NULL)
+            return READSTAT_ERROR_MALLOC;
+    }
+
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_batch_set_dictionary(readstat_batch_t *batch, int var_index,
+        readstat_dictionary_t *dict) {
+    int i = batch->column_map[var_index];
+    if (i == -1 || batch->string_offsets[i] == NULL)
+        return READSTAT_ERROR_PARSE;
+
+    readstat_column_t *column = &batch->columns[i];
+    if (column->dictionary_ids == NULL &&
+            (column->dictionary_ids = malloc(batch->capacity * sizeof(int32_t))) == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    batch->dictionaries[i] = dict;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_batch_put_interned_string(readstat_batch_t *batch, int i, readstat_value_t value) {
+    readstat_column_t *column = &batch->columns[i];
+    int row = batch->rows;
+
+    if (column->dictionary_ids == NULL)
+        return readstat_batch_put_string(batch, i, value.v.string_value, value.string_len);
+
+    column->tags[row] = '\0';
+    column->v.string_values[row] = value.v.string_value;
+    column->string_lengths[row] = value.string_len;
+    column->dictionary_ids[row] = value.dictionary_entry - 1;
+    batch->string_offsets[i][row] = READSTAT_BATCH_INTERNED_STRING;
+
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_batch_put_string(readstat_batch_t *batch, int i, const char *string, size_t len) {
+    readstat_column_t *column = &batch->columns[i];
+    size_t *offsets = batch->string_offsets[i];
+    int row = batch->rows;
+
+    column->tags[row] = '\0';
+    if (column->dictionary_ids)
+        column->dictionary_ids[row] = -1;
+
+    if (string == NULL) {
+        offsets[row] = READSTAT_BATCH_NULL_STRING;
+        column->string_lengths[row] = 0;
+        return READSTAT_OK;
+    }
+
+    column->string_lengths[row] = len;
+    /* The arena copy gets its own terminator */
+    if (batch->strings_len + len + 1 > batch->strings_capacity) {
+        size_t capacity = batch->strings_capacity ? batch->strings_capacity : 4096;
+        while (batch->strings_len + len + 1 > capacity)
+            capacity *= 2;
+
+        char *strings = realloc(batch->strings, capacity);
+        if (strings == NULL)
+            return READSTAT_ERROR_MALLOC;
+
+        batch->strings = strings;
+        batch->strings_capacity = capacity;
+    }
+
+    memcpy(&batch->strings[batch->strings_len], string, len);
+    batch->strings[batch->strings_len + len] = '\0';
+    offsets[row] = batch->strings_len;
+    batch->strings_len += len + 1;
+
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_batch_flush(readstat_batch_t *batch) {
+    readstat_error_t retval = READSTAT_OK;
+    int i, j;
+
+    if (batch->rows == 0)
+        return READSTAT_OK;
+
+    for (i=0; i<batch->columns_count; i++) {
+        size_t *offsets = batch->string_offsets[i];
+        if (offsets == NULL)
+            continue;
+
+        readstat_column_t *column = &batch->columns[i];
+        readstat_dictionary_t *dict = batch->dictionaries[i];
+        if (dict) {
+            column->dictionary = dict->strings;
+            column->dictionary_lengths = dict->lengths;
+            column->dictionary_count = dict->count;
+        }
+
+        const char **string_values = column->v.string_values;
+        for (j=0; j<batch->rows; j++) {
+            if (offsets[j] == READSTAT_BATCH_INTERNED_STRING) {
+                /* void */
+            } else if (offsets[j] == READSTAT_BATCH_NULL_STRING) {
+                string_values[j] = NULL;
+            } else {
+                string_values[j] = &batch->strings[offsets[j]];
+            }
+        }
+    }
+
+    if (batch->handler(batch->obs_index, batch->rows,
+                batch->columns, batch->columns_count, batch->user_ctx)) {
+        retval = READSTAT_ERROR_USER_ABORT;
+    }
+
+    readstat_batch_reset(batch);
+
+    return retval;
+}
+
+void readstat_batch_free(readstat_batch_t *batch) {
+    int i;
+    if (batch == NULL)
+        return;
+
+    if (batch->columns) {
+        for (i=0; i<batch->columns_count; i++) {
+            readstat_column_t *column = &batch->columns[i];
+            free(column->v.double_values);
+            free(column->system_missing);
+            free(column->considered_missing);
+            free(column->tags);
+            free(column->string_lengths);
+            free(column->dictionary_ids);
+        }
+        free(batch->columns);
+    }
+    if (batch->string_offsets) {
+        for (i=0; i<batch->columns_count; i++) {
+            free(batch->string_offsets[i]);
+        }
+        free(batch->string_offsets);
+    }
+    free(batch->dictionaries);
+    free(batch->column_map);
+    free(batch->strings);
+    free(batch);
+}
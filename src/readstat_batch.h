@@ -0,0 +1,88 @@
+
+#define READSTAT_DEFAULT_BATCH_SIZE  1024
+
+/* Column buffers shared by the readers for delivering rows to a
+ * readstat_batch_handler. Strings are copied into one arena per batch and
+ * recorded as offsets, which are turned into pointers at flush time.
+ * Readers add one column per selected variable and pass values by variable
+ * index; column_map takes the variable index to its column. Interned strings
+ * are not copied, as they outlive the batch. */
+typedef struct readstat_batch_s {
+    readstat_batch_handler  handler;
+    void                   *user_ctx;
+
+    readstat_column_t      *columns;
+    size_t                **string_offsets;
+    struct readstat_dictionary_s **dictionaries;
+    int                     columns_count;
+
+    int                    *column_map;
+    int                     vars_count;
+
+    int                     capacity;
+    int                     rows;
+    int                     obs_index;
+
+    char                   *strings;
+    size_t                  strings_len;
+    size_t                  strings_capacity;
+} readstat_batch_t;
+
+#define READSTAT_BATCH_NULL_STRING      ((size_t)-1)
+#define READSTAT_BATCH_INTERNED_STRING  ((size_t)-2)
+
+readstat_batch_t *readstat_batch_init(readstat_batch_handler handler, int capacity,
+        int vars_count, void *user_ctx);
+readstat_error_t readstat_batch_add_column(readstat_batch_t *batch, int var_index, readstat_type_t type);
+/* Delivers the column dictionary-encoded, with the values' ids and the
+ * dictionary's entries so far */
+readstat_error_t readstat_batch_set_dictionary(readstat_batch_t *batch, int var_index,
+        struct readstat_dictionary_s *dict);
+readstat_error_t readstat_batch_put_string(readstat_batch_t *batch, int i, const char *string, size_t len);
+readstat_error_t readstat_batch_put_interned_string(readstat_batch_t *batch, int i, readstat_value_t value);
+readstat_error_t readstat_batch_flush(readstat_batch_t *batch);
+void readstat_batch_free(readstat_batch_t *batch);
+
+static inline readstat_error_t readstat_batch_put_value(readstat_batch_t *batch, int var_index, readstat_value_t value) {
+    int i = batch->column_map[var_index];
+    readstat_column_t *column = &batch->columns[i];
+    readstat_error_t retval = READSTAT_OK;
+    int row = batch->rows;
+    switch (column->type) {
+        case READSTAT_TYPE_STRING:
+        case READSTAT_TYPE_LONG_STRING:
+            if (value.dictionary_entry) {
+                retval = readstat_batch_put_interned_string(batch, i, value);
+            } else {
+                retval = readstat_batch_put_string(batch, i, value.v.string_value, value.string_len);
+            }
+            if (retval != READSTAT_OK)
+                return retval;
+            break;
+        case READSTAT_TYPE_INT8:
+            column->v.i8_values[row] = value.v.i8_value; break;
+        case READSTAT_TYPE_INT16:
+            column->v.i16_values[row] = value.v.i16_value; break;
+        case READSTAT_TYPE_INT32:
+            column->v.i32_values[row] = value.v.i32_value; break;
+        case READSTAT_TYPE_FLOAT:
+            column->v.float_values[row] = value.v.float_value; break;
+        case READSTAT_TYPE_DOUBLE:
+            column->v.double_values[row] = value.v.double_value; break;
+        default:
+            break;
+    }
+    if (value.is_system_missing)
+        column->system_missing[row / 8] |= (1 << (row % 8));
+    if (value.is_considered_missing)
+        column->considered_missing[row / 8] |= (1 << (row % 8));
+    column->tags[row] = value.tag;
+    return READSTAT_OK;
+}
+
+static inline readstat_error_t readstat_batch_end_row(readstat_batch_t *batch) {
+    if (++batch->rows == batch->capacity)
+        return readstat_batch_flush(batch);
+
+    return READSTAT_OK;
+}
@@ -0,0 +1,6 @@
+
+/* Returns the code points of bytes 0x80-0xFF in the given single-byte
+ * character set, or NULL if there is no built-in table for it. */
+const uint16_t *readstat_codepage_table(const char *charset);
+
+int readstat_charset_is_utf8(const char *charset);
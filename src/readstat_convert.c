@@ -1,27 +1,193 @@
 
 #include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include "readstat.h"
 #include "readstat_iconv.h"
 #include "readstat_convert.h"
+#include "readstat_codepage.h"
 
-static void unpad(char *string, size_t len) {
+struct readstat_converter_s {
+    iconv_t           cd;
+    const uint16_t   *codepage;
+    /* ASCII comes through unchanged, so all-ASCII input can be copied */
+    int               ascii_passthrough;
+};
+
+/* Bytes of a 64-bit word, for scanning eight bytes at a time */
+#define WORD_HIGH_BITS  0x8080808080808080ULL
+#define WORD_SPACES     0x2020202020202020ULL
+
+/* Returns the length of src without trailing spaces */
+static size_t padded_len(const char *src, size_t len) {
+    uint64_t word;
+    while (len >= sizeof(word)) {
+        memcpy(&word, &src[len-sizeof(word)], sizeof(word));
+        if (word != WORD_SPACES)
+            break;
+        len -= sizeof(word);
+    }
+    while (len > 0 && src[len-1] == ' ')
+        len--;
+    return len;
+}
+
+static int is_ascii(const char *src, size_t len) {
+    uint64_t word;
+    size_t i = 0;
+    for (; i + sizeof(word) <= len; i += sizeof(word)) {
+        memcpy(&word, &src[i], sizeof(word));
+        if (word & WORD_HIGH_BITS)
+            return 0;
+    }
+    for (; i < len; i++) {
+        if (src[i] & 0x80)
+            return 0;
+    }
+    return 1;
+}
+
+/* Removes space padding, returning the new length. NUL-padded fields (as
+ * in DTA) end at their first NUL, which is also where readers of the
+ * terminated string would stop. */
+static size_t unpad(char *string, size_t len) {
+    len = padded_len(string, len);
     string[len] = '\0';
-    /* remove space padding */
-    ssize_t i;
-    for (i=len-1; i>=0; i--) {
-        if (string[i] == ' ') {
-            string[i] = '\0';
-        } else {
+
+    const char *nul = memchr(string, '\0', len);
+    return nul ? nul - string : len;
+}
+
+/* Converts every ASCII character but NUL once, and checks that each one comes
+ * out as itself. Stateful encodings fail this, as do charsets such as
+ * Shift-JIS that reassign some of the ASCII range. */
+static int readstat_converter_passes_ascii(readstat_converter_t *converter) {
+    char ascii[127];
+    char output[sizeof(ascii)];
+    int i;
+    for (i=0; i<sizeof(ascii); i++) {
+        ascii[i] = i + 1;
+    }
+
+    const char *src = ascii;
+    size_t src_left = sizeof(ascii);
+    char *dst = output;
+    size_t dst_left = sizeof(output);
+    size_t status = readstat_iconv(converter, &src, &src_left, &dst, &dst_left);
+
+    if (converter->codepage == NULL)
+        iconv(converter->cd, NULL, NULL, NULL, NULL);
+
+    return (status != (size_t)-1 && src_left == 0 && dst_left == 0 &&
+            memcmp(ascii, output, sizeof(ascii)) == 0);
+}
+
+readstat_converter_t *readstat_converter_open(const char *dst_charset, const char *src_charset) {
+    readstat_converter_t *converter = calloc(1, sizeof(readstat_converter_t));
+    if (converter == NULL)
+        return NULL;
+
+    if (readstat_charset_is_utf8(dst_charset))
+        converter->codepage = readstat_codepage_table(src_charset);
+
+    if (converter->codepage == NULL) {
+        converter->cd = iconv_open(dst_charset, src_charset);
+        if (converter->cd == (iconv_t)-1) {
+            free(converter);
+            return NULL;
+        }
+    }
+
+    converter->ascii_passthrough = readstat_converter_passes_ascii(converter);
+
+    return converter;
+}
+
+void readstat_converter_close(readstat_converter_t *converter) {
+    if (converter == NULL)
+        return;
+
+    if (converter->codepage == NULL)
+        iconv_close(converter->cd);
+    free(converter);
+}
+
+static size_t readstat_decode_codepage(const uint16_t *codepage,
+        const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft) {
+    const unsigned char *src = (const unsigned char *)*inbuf;
+    const unsigned char *src_end = src + *inbytesleft;
+    unsigned char *dst = (unsigned char *)*outbuf;
+    unsigned char *dst_end = dst + *outbytesleft;
+    int error = 0;
+
+    while (src < src_end) {
+        uint16_t cp = *src;
+        if (cp >= 0x80 && (cp = codepage[cp - 0x80]) == 0) {
+            error = EILSEQ;
             break;
         }
+        if (cp < 0x80) {
+            if (dst == dst_end) {
+                error = E2BIG;
+                break;
+            }
+            *dst++ = cp;
+        } else if (cp < 0x800) {
+            if (dst_end - dst < 2) {
+                error = E2BIG;
+                break;
+            }
+            *dst++ = 0xC0 | (cp >> 6);
+            *dst++ = 0x80 | (cp & 0x3F);
+        } else {
+            if (dst_end - dst < 3) {
+                error = E2BIG;
+                break;
+            }
+            *dst++ = 0xE0 | (cp >> 12);
+            *dst++ = 0x80 | ((cp >> 6) & 0x3F);
+            *dst++ = 0x80 | (cp & 0x3F);
+        }
+        src++;
+    }
+
+    *inbytesleft -= (const char *)src - *inbuf;
+    *outbytesleft -= (char *)dst - *outbuf;
+    *inbuf = (const char *)src;
+    *outbuf = (char *)dst;
+
+    if (error) {
+        errno = error;
+        return (size_t)-1;
     }
+    return 0;
+}
+
+size_t readstat_iconv(readstat_converter_t *converter,
+        const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft) {
+    if (converter->codepage)
+        return readstat_decode_codepage(converter->codepage, inbuf, inbytesleft, outbuf, outbytesleft);
+
+    return iconv(converter->cd, (readstat_iconv_inbuf_t)inbuf, inbytesleft, outbuf, outbytesleft);
 }
 
-readstat_error_t readstat_convert(char *dst, size_t dst_len, const char *src, size_t src_len, iconv_t converter) {
+readstat_error_t readstat_convert_len(char *dst, size_t dst_len, const char *src, size_t src_len,
+        readstat_converter_t *converter, size_t *out_len) {
+    size_t len = 0;
+    if (converter && converter->ascii_passthrough) {
+        /* Trailing spaces would come out as spaces, so drop them up front */
+        src_len = padded_len(src, src_len);
+        if (is_ascii(src, src_len)) {
+            if (src_len > dst_len)
+                return READSTAT_ERROR_CONVERT_LONG_STRING;
+            converter = NULL;
+        }
+    }
     if (converter) {
         size_t dst_left = dst_len;
         char *dst_end = dst;
-        size_t status = iconv(converter, (readstat_iconv_inbuf_t)&src, &src_len, &dst_end, &dst_left);
+        size_t status = readstat_iconv(converter, &src, &src_len, &dst_end, &dst_left);
         if (status == (size_t)-1) {
             if (errno == E2BIG) {
                 return READSTAT_ERROR_CONVERT_LONG_STRING;
@@ -32,10 +198,17 @@ readstat_error_t readstat_convert(char *dst, size_t dst_len, const char *src, si
             }
             return READSTAT_ERROR_CONVERT;
         }
-        unpad(dst, dst_len - dst_left);
+        len = unpad(dst, dst_len - dst_left);
     } else {
         memcpy(dst, src, src_len);
-        unpad(dst, src_len);
+        len = unpad(dst, src_len);
     }
+    if (out_len)
+        *out_len = len;
     return READSTAT_OK;
 }
+
+readstat_error_t readstat_convert(char *dst, size_t dst_len, const char *src, size_t src_len,
+        readstat_converter_t *converter) {
+    return readstat_convert_len(dst, dst_len, src, src_len, converter, NULL);
+}
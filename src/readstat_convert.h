@@ -1,2 +1,20 @@
 
-readstat_error_t readstat_convert(char *dst, size_t dst_len, const char *src, size_t src_len, iconv_t converter);
+/* Converts strings between character sets: with a built-in table when decoding
+ * a common single-byte charset to UTF-8, and with iconv otherwise. */
+typedef struct readstat_converter_s readstat_converter_t;
+
+/* Returns NULL if the conversion is unsupported */
+readstat_converter_t *readstat_converter_open(const char *dst_charset, const char *src_charset);
+void readstat_converter_close(readstat_converter_t *converter);
+
+/* Same contract as iconv(3), including errno on failure */
+size_t readstat_iconv(readstat_converter_t *converter,
+        const char **inbuf, size_t *inbytesleft, char **outbuf, size_t *outbytesleft);
+
+/* Converts src into dst and strips trailing spaces. All-ASCII input is
+ * copied without a conversion wherever the charsets agree on ASCII. */
+readstat_error_t readstat_convert(char *dst, size_t dst_len, const char *src, size_t src_len,
+        readstat_converter_t *converter);
+/* Same, also storing the length of the NUL-terminated result in *out_len */
+readstat_error_t readstat_convert_len(char *dst, size_t dst_len, const char *src, size_t src_len,
+        readstat_converter_t *converter, size_t *out_len);
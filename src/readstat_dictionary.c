@@ -0,0 +1,251 @@
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "readstat.h"
+#include "readstat_convert.h"
+#include "readstat_dictionary.h"
+
+#define DICTIONARY_BLOCK_SIZE       65536
+#define DICTIONARY_INITIAL_SLOTS    256
+
+static uint64_t readstat_dictionary_hash(const char *bytes, size_t len) {
+    uint64_t hash = 5381;
+    size_t i;
+    for (i=0; i<len; i++) {
+        hash = ((hash << 5) + hash) + (unsigned char)bytes[i];
+    }
+    return hash;
+}
+
+readstat_dictionary_t *readstat_dictionary_init(long max_entries) {
+    readstat_dictionary_t *dict = NULL;
+    if ((dict = calloc(1, sizeof(readstat_dictionary_t))) == NULL)
+        return NULL;
+
+    if ((dict->slots = calloc(DICTIONARY_INITIAL_SLOTS, sizeof(int32_t))) == NULL) {
+        free(dict);
+        return NULL;
+    }
+
+    dict->slots_mask = DICTIONARY_INITIAL_SLOTS - 1;
+    dict->max_entries = max_entries;
+
+    return dict;
+}
+
+void readstat_dictionary_free(readstat_dictionary_t *dict) {
+    if (dict == NULL)
+        return;
+
+    readstat_dictionary_block_t *block = dict->blocks;
+    while (block) {
+        readstat_dictionary_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(dict->strings);
+    free(dict->lengths);
+    free(dict->keys);
+    free(dict->key_lengths);
+    free(dict->hashes);
+    free(dict->slots);
+    free(dict->scratch);
+    free(dict);
+}
+
+/* Returns len bytes that won't move for the life of the dictionary */
+static char *readstat_dictionary_alloc(readstat_dictionary_t *dict, size_t len) {
+    readstat_dictionary_block_t *block = dict->blocks;
+    if (block == NULL || block->capacity - block->used < len) {
+        size_t capacity = len > DICTIONARY_BLOCK_SIZE ? len : DICTIONARY_BLOCK_SIZE;
+        if ((block = malloc(sizeof(readstat_dictionary_block_t) + capacity)) == NULL)
+            return NULL;
+
+        block->used = 0;
+        block->capacity = capacity;
+        block->next = dict->blocks;
+        dict->blocks = block;
+    }
+
+    char *bytes = (char *)(block + 1) + block->used;
+    block->used += len;
+    return bytes;
+}
+
+static readstat_error_t readstat_dictionary_grow_entries(readstat_dictionary_t *dict) {
+    int32_t capacity = dict->capacity ? 2 * dict->capacity : 64;
+
+    const char **strings = realloc(dict->strings, capacity * sizeof(const char *));
+    if (strings == NULL)
+        return READSTAT_ERROR_MALLOC;
+    dict->strings = strings;
+
+    size_t *lengths = realloc(dict->lengths, capacity * sizeof(size_t));
+    if (lengths == NULL)
+        return READSTAT_ERROR_MALLOC;
+    dict->lengths = lengths;
+
+    const char **keys = realloc(dict->keys, capacity * sizeof(const char *));
+    if (keys == NULL)
+        return READSTAT_ERROR_MALLOC;
+    dict->keys = keys;
+
+    size_t *key_lengths = realloc(dict->key_lengths, capacity * sizeof(size_t));
+    if (key_lengths == NULL)
+        return READSTAT_ERROR_MALLOC;
+    dict->key_lengths = key_lengths;
+
+    uint64_t *hashes = realloc(dict->hashes, capacity * sizeof(uint64_t));
+    if (hashes == NULL)
+        return READSTAT_ERROR_MALLOC;
+    dict->hashes = hashes;
+
+    dict->capacity = capacity;
+    return READSTAT_OK;
+}
+
+/* Doubles the slot table, keeping it at most three-quarters full */
+static readstat_error_t readstat_dictionary_grow_slots(readstat_dictionary_t *dict) {
+    size_t slots_count = 2 * (dict->slots_mask + 1);
+    int32_t *slots = calloc(slots_count, sizeof(int32_t));
+    int32_t i;
+    if (slots == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    for (i=0; i<dict->count; i++) {
+        size_t slot = dict->hashes[i] & (slots_count - 1);
+        while (slots[slot])
+            slot = (slot + 1) & (slots_count - 1);
+        slots[slot] = i + 1;
+    }
+
+    free(dict->slots);
+    dict->slots = slots;
+    dict->slots_mask = slots_count - 1;
+    return READSTAT_OK;
+}
+
+static readstat_error_t readstat_dictionary_convert_scratch(readstat_dictionary_t *dict,
+        const char *src, size_t src_len, struct readstat_converter_s *converter, size_t *out_len) {
+    size_t dst_len = 4*src_len+1;
+    if (dst_len > dict->scratch_len) {
+        char *scratch = realloc(dict->scratch, dst_len);
+        if (scratch == NULL)
+            return READSTAT_ERROR_MALLOC;
+
+        dict->scratch = scratch;
+        dict->scratch_len = dst_len;
+    }
+    return readstat_convert_len(dict->scratch, dict->scratch_len, src, src_len, converter, out_len);
+}
+
+/* Returns the index of the entry keyed on src, or -1 with *slot_out set to
+ * the empty slot where it belongs */
+static int32_t readstat_dictionary_find(readstat_dictionary_t *dict, const char *src, size_t src_len,
+        uint64_t hash, size_t *slot_out) {
+    size_t slot = hash & dict->slots_mask;
+    int32_t index;
+
+    while ((index = dict->slots[slot])) {
+        index--;
+        if (dict->hashes[index] == hash && dict->key_lengths[index] == src_len &&
+                memcmp(dict->keys[index], src, src_len) == 0) {
+            return index;
+        }
+        slot = (slot + 1) & dict->slots_mask;
+    }
+
+    *slot_out = slot;
+    return -1;
+}
+
+static readstat_error_t readstat_dictionary_insert(readstat_dictionary_t *dict, size_t slot, uint64_t hash,
+        const char *key, size_t key_len, const char *string, size_t len) {
+    int32_t index = dict->count++;
+    dict->keys[index] = key;
+    dict->key_lengths[index] = key_len;
+    dict->strings[index] = string;
+    dict->lengths[index] = len;
+    dict->hashes[index] = hash;
+    dict->slots[slot] = index + 1;
+
+    if (4 * (size_t)dict->count >= 3 * (dict->slots_mask + 1))
+        return readstat_dictionary_grow_slots(dict);
+
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_dictionary_convert(readstat_dictionary_t *dict, const char *src, size_t src_len,
+        struct readstat_converter_s *converter, readstat_value_t *value) {
+    readstat_error_t retval = READSTAT_OK;
+    uint64_t hash = readstat_dictionary_hash(src, src_len);
+    size_t slot = 0;
+    size_t len = 0;
+    int32_t index = readstat_dictionary_find(dict, src, src_len, hash, &slot);
+
+    if (index != -1) {
+        value->v.string_value = dict->strings[index];
+        value->string_len = dict->lengths[index];
+        value->dictionary_entry = index + 1;
+        return READSTAT_OK;
+    }
+
+    if ((retval = readstat_dictionary_convert_scratch(dict, src, src_len, converter, &len)) != READSTAT_OK)
+        return retval;
+
+    if (dict->count >= dict->max_entries) {
+        value->v.string_value = dict->scratch;
+        value->string_len = len;
+        value->dictionary_entry = 0;
+        return READSTAT_OK;
+    }
+
+    if (dict->count == dict->capacity &&
+            (retval = readstat_dictionary_grow_entries(dict)) != READSTAT_OK)
+        return retval;
+
+    char *bytes = readstat_dictionary_alloc(dict, src_len + len + 1);
+    if (bytes == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    memcpy(bytes, src, src_len);
+    memcpy(&bytes[src_len], dict->scratch, len + 1);
+
+    index = dict->count;
+    if ((retval = readstat_dictionary_insert(dict, slot, hash, bytes, src_len,
+                    &bytes[src_len], len)) != READSTAT_OK)
+        return retval;
+
+    value->v.string_value = dict->strings[index];
+    value->string_len = len;
+    value->dictionary_entry = index + 1;
+
+    return READSTAT_OK;
+}
+
+const char *readstat_dictionary_intern(readstat_dictionary_t *dict, const char *string, size_t len) {
+    uint64_t hash = readstat_dictionary_hash(string, len);
+    size_t slot = 0;
+    int32_t index = readstat_dictionary_find(dict, string, len, hash, &slot);
+
+    if (index != -1)
+        return dict->strings[index];
+
+    if (dict->count == dict->capacity &&
+            readstat_dictionary_grow_entries(dict) != READSTAT_OK)
+        return NULL;
+
+    char *bytes = readstat_dictionary_alloc(dict, len + 1);
+    if (bytes == NULL)
+        return NULL;
+
+    memcpy(bytes, string, len);
+    bytes[len] = '\0';
+
+    if (readstat_dictionary_insert(dict, slot, hash, bytes, len, bytes, len) != READSTAT_OK)
+        return NULL;
+
+    return bytes;
+}
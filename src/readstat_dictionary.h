@@ -0,0 +1,52 @@
+
+/* Interns the values of one string column. Values are keyed on their raw
+ * bytes, so each distinct raw value is converted only once; the converted
+ * strings live in blocks that are never moved, and their ids count up from
+ * zero in order of first appearance. Once max_entries values are stored,
+ * new values are still converted but are not given an id. */
+
+struct readstat_converter_s;
+
+typedef struct readstat_dictionary_block_s {
+    struct readstat_dictionary_block_s *next;
+    size_t      used;
+    size_t      capacity;
+} readstat_dictionary_block_t;
+
+typedef struct readstat_dictionary_s {
+    long            max_entries;
+
+    const char    **strings;
+    size_t         *lengths;
+    const char    **keys;
+    size_t         *key_lengths;
+    uint64_t       *hashes;
+    int32_t         count;
+    int32_t         capacity;
+
+    /* Open addressing over the entries; each slot holds 1 + an entry index,
+     * or 0 when empty */
+    int32_t        *slots;
+    size_t          slots_mask;
+
+    readstat_dictionary_block_t *blocks;
+
+    /* Holds values that arrive after the dictionary is full */
+    char           *scratch;
+    size_t          scratch_len;
+} readstat_dictionary_t;
+
+readstat_dictionary_t *readstat_dictionary_init(long max_entries);
+void readstat_dictionary_free(readstat_dictionary_t *dict);
+
+/* Sets the string, length and dictionary id of *value from the raw bytes in
+ * src, converting them only if they haven't been seen before. The string
+ * stays valid until the dictionary is freed, unless the dictionary was full,
+ * in which case it is valid until the next call. */
+readstat_error_t readstat_dictionary_convert(readstat_dictionary_t *dict, const char *src, size_t src_len,
+        struct readstat_converter_s *converter, readstat_value_t *value);
+
+/* Returns the stored copy of the len bytes at string, NUL-terminated, adding
+ * it unconverted if it hasn't been seen before; max_entries doesn't apply.
+ * Returns NULL if out of memory. */
+const char *readstat_dictionary_intern(readstat_dictionary_t *dict, const char *string, size_t len);
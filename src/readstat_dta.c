@@ -5,6 +5,9 @@
 #include <sys/types.h>
 
 #include "readstat_dta.h"
+#include "readstat_convert.h"
+#include "readstat_batch.h"
+#include "readstat_dictionary.h"
 
 #define DTA_MIN_VERSION 104
 #define DTA_MAX_VERSION 118
@@ -139,16 +142,19 @@ readstat_error_t dta_ctx_init(dta_ctx_t *ctx, int16_t nvar, int32_t nobs,
 
     if (output_encoding) {
         if (input_encoding) {
-            ctx->converter = iconv_open(output_encoding, input_encoding);
+            ctx->input_encoding = input_encoding;
         } else if (ds_format < 118) {
-            ctx->converter = iconv_open(output_encoding, "WINDOWS-1252");
+            ctx->input_encoding = "WINDOWS-1252";
         } else if (strcmp(output_encoding, "UTF-8") != 0) {
-            ctx->converter = iconv_open(output_encoding, "UTF-8");
+            ctx->input_encoding = "UTF-8";
         }
-        if (ctx->converter == (iconv_t)-1) {
-            ctx->converter = NULL;
-            retval = READSTAT_ERROR_UNSUPPORTED_CHARSET;
-            goto cleanup;
+        if (ctx->input_encoding) {
+            ctx->output_encoding = output_encoding;
+            ctx->converter = readstat_converter_open(output_encoding, ctx->input_encoding);
+            if (ctx->converter == NULL) {
+                retval = READSTAT_ERROR_UNSUPPORTED_CHARSET;
+                goto cleanup;
+            }
         }
     }
 
@@ -205,9 +211,20 @@ void dta_ctx_free(dta_ctx_t *ctx) {
     if (ctx->variable_labels)
         free(ctx->variable_labels);
     if (ctx->converter)
-        iconv_close(ctx->converter);
+        readstat_converter_close(ctx->converter);
     if (ctx->data_label)
         free(ctx->data_label);
+    if (ctx->strls)
+        free(ctx->strls);
+    if (ctx->columns) {
+        int i;
+        for (i=0; i<ctx->columns_count; i++) {
+            readstat_dictionary_free(ctx->columns[i].dictionary);
+        }
+        free(ctx->columns);
+    }
+    if (ctx->batch)
+        readstat_batch_free(ctx->batch);
     free(ctx);
 }
 
@@ -35,6 +35,22 @@ typedef struct dta_gso_header_s {
 
 #pragma pack(pop)
 
+typedef struct dta_strl_s {
+    uint32_t         v;
+    uint32_t         o;
+    unsigned char    type;
+    size_t           len;
+    off_t            offset;
+} dta_strl_t;
+
+typedef struct dta_column_s {
+    int              index;
+    readstat_type_t  type;
+    size_t           offset;
+    size_t           max_len;
+    struct readstat_dictionary_s *dictionary;
+} dta_column_t;
+
 typedef struct dta_ctx_s {
     char          *data_label;
     size_t         data_label_len;
@@ -69,10 +85,22 @@ typedef struct dta_ctx_s {
     off_t          strls_offset;
     off_t          value_labels_offset;
 
+    dta_strl_t    *strls;
+    size_t         strls_count;
+    size_t         strls_capacity;
+    int            strls_indexed;
+
+    dta_column_t  *columns;
+    int            columns_count;
+
     int            nvar;
     int            nobs;
     size_t         record_len;
+    size_t         nobs_offset;
+    size_t         map_offset;
     int            row_limit;
+    int            row_offset;
+    int            thread_count;
 
     int            machine_needs_byte_swap;
     int            machine_is_twos_complement;
@@ -85,13 +113,18 @@ typedef struct dta_ctx_s {
     int32_t        max_float;
     int64_t        max_double;
 
-    iconv_t        converter;
+    struct readstat_converter_s *converter;
+    const char    *input_encoding;
+    const char    *output_encoding;
     readstat_error_handler error_handler;
     readstat_progress_handler progress_handler;
     readstat_variable_handler variable_handler;
     readstat_value_handler value_handler;
     readstat_value_label_handler value_label_handler;
+    struct readstat_batch_s  *batch;
     size_t                    file_size;
+    double                    next_progress;
+    double                    progress_granularity;
     void                     *user_ctx;
     readstat_io_t            *io;
     int                       initialized;
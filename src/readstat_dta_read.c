@@ -8,38 +8,47 @@
 #include "readstat_dta.h"
 #include "readstat_dta_parse_timestamp.h"
 #include "readstat_convert.h"
+#include "readstat_batch.h"
+#include "readstat_dictionary.h"
+#include "readstat_filter.h"
+#include "readstat_pipeline.h"
+#include "readstat_progress.h"
+#include "readstat_variable.h"
 
 static readstat_error_t dta_update_progress(dta_ctx_t *ctx);
 static readstat_error_t dta_read_descriptors(dta_ctx_t *ctx);
 static readstat_error_t dta_read_tag(dta_ctx_t *ctx, const char *tag);
-static readstat_error_t dta_read_long_string(dta_ctx_t *ctx, int v, int o, char **long_string_out);
+static readstat_error_t dta_read_long_string(dta_ctx_t *ctx, int v, int o, char **long_string_out,
+        size_t *long_string_len_out);
 static readstat_error_t dta_skip_expansion_fields(dta_ctx_t *ctx);
 
 
 static readstat_error_t dta_update_progress(dta_ctx_t *ctx) {
     readstat_io_t *io = ctx->io;
-    return io->update(ctx->file_size, ctx->progress_handler, ctx->user_ctx, io->io_ctx);
+    return readstat_update_progress(io, ctx->file_size, ctx->progress_handler, ctx->user_ctx,
+            ctx->progress_granularity, &ctx->next_progress);
 }
 
-static readstat_variable_t *dta_init_variable(dta_ctx_t *ctx, int i, readstat_type_t type, size_t max_len) {
-    readstat_variable_t *variable = calloc(1, sizeof(readstat_variable_t));
+static readstat_variable_t *dta_init_variable(dta_ctx_t *ctx, int i, readstat_type_t type, size_t max_len,
+        readstat_variable_buffer_t *buffer) {
+    readstat_variable_t *variable = readstat_variable_buffer_reset(buffer);
 
     variable->type = type;
     variable->index = i;
     variable->storage_width = max_len;
 
-    readstat_convert(variable->name, sizeof(variable->name), 
+    readstat_convert(buffer->name, sizeof(buffer->name), 
             &ctx->varlist[ctx->variable_name_len*i],
             ctx->variable_name_len, ctx->converter);
 
     if (ctx->variable_labels[ctx->variable_labels_entry_len*i]) {
-        readstat_convert(variable->label, sizeof(variable->label),
+        readstat_convert(buffer->label, sizeof(buffer->label),
                 &ctx->variable_labels[ctx->variable_labels_entry_len*i],
                 ctx->variable_labels_entry_len, ctx->converter);
     }
 
     if (ctx->fmtlist[ctx->fmtlist_entry_len*i]) {
-        readstat_convert(variable->format, sizeof(variable->format),
+        readstat_convert(buffer->format, sizeof(buffer->format),
                 &ctx->fmtlist[ctx->fmtlist_entry_len*i],
                 ctx->fmtlist_entry_len, ctx->converter);
         if (variable->format[0] == '%') {
@@ -230,9 +239,26 @@ cleanup:
     return retval;
 }
 
-static readstat_error_t dta_read_long_string(dta_ctx_t *ctx, int v, int o, char **long_string_out) {
+static int dta_compare_strls(const void *elem1, const void *elem2) {
+    const dta_strl_t *strl1 = (const dta_strl_t *)elem1;
+    const dta_strl_t *strl2 = (const dta_strl_t *)elem2;
+    if (strl1->v == strl2->v) {
+        if (strl1->o == strl2->o)
+            return 0;
+        return strl1->o < strl2->o ? -1 : 1;
+    }
+    return strl1->v < strl2->v ? -1 : 1;
+}
+
+/* Walks the <strls> section once, recording where each (v,o) payload
+ * lives so that long strings can be fetched with a single seek + read. */
+static readstat_error_t dta_index_strls(dta_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
     readstat_io_t *io = ctx->io;
+    off_t offset = ctx->strls_offset;
+
+    ctx->strls_indexed = 1;
+
     if (io->seek(ctx->strls_offset, READSTAT_SEEK_SET, io->io_ctx) != ctx->strls_offset) {
         retval = READSTAT_ERROR_SEEK;
         goto cleanup;
@@ -242,54 +268,123 @@ static readstat_error_t dta_read_long_string(dta_ctx_t *ctx, int v, int o, char
     if (retval != READSTAT_OK)
         goto cleanup;
 
+    offset += sizeof("<strls>")-1;
+
     dta_gso_header_t header;
 
     while (1) {
-        if (io->read(&header, sizeof(dta_gso_header_t), io->io_ctx) != sizeof(dta_gso_header_t)) {
-            retval = READSTAT_ERROR_READ;
-            goto cleanup;
+        if (io->read(&header, sizeof(dta_gso_header_t), io->io_ctx) != sizeof(dta_gso_header_t))
+            break;
+
+        if (strncmp(header.gso, "GSO", sizeof("GSO")-1) != 0)
+            break;
+
+        if (ctx->machine_needs_byte_swap) {
+            header.v = byteswap4(header.v);
+            header.o = byteswap4(header.o);
+            header.len = byteswap4(header.len);
         }
 
-        if (strncmp(header.gso, "GSO", sizeof("GSO")-1) != 0) {
+        if (header.len <= 0) {
             retval = READSTAT_ERROR_PARSE;
             goto cleanup;
         }
-        
-        if (header.len <= 0) {
-            retval = READSTAT_ERROR_PARSE;
+
+        offset += sizeof(dta_gso_header_t);
+
+        if (ctx->strls_count == ctx->strls_capacity) {
+            ctx->strls_capacity = ctx->strls_capacity ? 2 * ctx->strls_capacity : 1024;
+            dta_strl_t *strls = realloc(ctx->strls, ctx->strls_capacity * sizeof(dta_strl_t));
+            if (strls == NULL) {
+                retval = READSTAT_ERROR_MALLOC;
+                goto cleanup;
+            }
+            ctx->strls = strls;
+        }
+
+        dta_strl_t *strl = &ctx->strls[ctx->strls_count++];
+        strl->v = header.v;
+        strl->o = header.o;
+        strl->type = header.t;
+        strl->len = header.len;
+        strl->offset = offset;
+
+        if (io->seek(header.len, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+            retval = READSTAT_ERROR_SEEK;
             goto cleanup;
         }
 
-        if (header.v == v && header.o == o) {
-            if (header.t == DTA_GSO_TYPE_BINARY) {
-                *long_string_out = NULL;
-            } else if (header.t == DTA_GSO_TYPE_ASCII) {
-                char *string_buf = malloc(header.len);
-                if (io->read(string_buf, header.len, io->io_ctx) != header.len) {
-                    free(string_buf);
-                    retval = READSTAT_ERROR_READ;
-                    goto cleanup;
-                }
-                if (string_buf[header.len-1] != '\0') {
-                    free(string_buf);
-                    retval = READSTAT_ERROR_PARSE;
-                    goto cleanup;
-                }
-                *long_string_out = string_buf;
-            } else {
-                retval = READSTAT_ERROR_PARSE;
+        offset += header.len;
+    }
+
+    qsort(ctx->strls, ctx->strls_count, sizeof(dta_strl_t), &dta_compare_strls);
+
+cleanup:
+    return retval;
+}
+
+/* Callers must index the strLs first. Safe to call from several threads at
+ * once if the I/O has a pread handler. */
+static readstat_error_t dta_read_long_string(dta_ctx_t *ctx, int v, int o, char **long_string_out,
+        size_t *long_string_len_out) {
+    readstat_error_t retval = READSTAT_OK;
+    readstat_io_t *io = ctx->io;
+    char *string_buf = NULL;
+    off_t cur_pos = -1;
+
+    dta_strl_t key = { .v = v, .o = o };
+    dta_strl_t *strl = bsearch(&key, ctx->strls, ctx->strls_count, sizeof(dta_strl_t), &dta_compare_strls);
+    if (strl == NULL) {
+        retval = READSTAT_ERROR_PARSE;
+        goto cleanup;
+    }
+
+    if (strl->type == DTA_GSO_TYPE_BINARY) {
+        *long_string_out = NULL;
+    } else if (strl->type == DTA_GSO_TYPE_ASCII) {
+        if ((string_buf = malloc(strl->len)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        if (io->pread) {
+            if (io->pread(string_buf, strl->len, strl->offset, io->io_ctx) != strl->len) {
+                retval = READSTAT_ERROR_READ;
                 goto cleanup;
             }
-            break;
         } else {
-            if (io->seek(header.len, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+            if ((cur_pos = io->seek(0, READSTAT_SEEK_CUR, io->io_ctx)) == -1) {
+                retval = READSTAT_ERROR_SEEK;
+                goto cleanup;
+            }
+            if (io->seek(strl->offset, READSTAT_SEEK_SET, io->io_ctx) == -1) {
+                retval = READSTAT_ERROR_SEEK;
+                goto cleanup;
+            }
+            if (io->read(string_buf, strl->len, io->io_ctx) != strl->len) {
+                retval = READSTAT_ERROR_READ;
+                goto cleanup;
+            }
+            if (io->seek(cur_pos, READSTAT_SEEK_SET, io->io_ctx) == -1) {
                 retval = READSTAT_ERROR_SEEK;
                 goto cleanup;
             }
         }
+        if (string_buf[strl->len-1] != '\0') {
+            retval = READSTAT_ERROR_PARSE;
+            goto cleanup;
+        }
+        *long_string_out = string_buf;
+        *long_string_len_out = strlen(string_buf);
+        string_buf = NULL;
+    } else {
+        retval = READSTAT_ERROR_PARSE;
+        goto cleanup;
     }
 
 cleanup:
+    if (string_buf)
+        free(string_buf);
+
     return retval;
 }
 
@@ -466,21 +561,60 @@ cleanup:
     return retval;
 }
 
-static readstat_error_t dta_handle_variables(dta_ctx_t *ctx) {
-    if (!ctx->variable_handler)
-        return READSTAT_OK;
-
+/* Lays out the row and records the offset of every selected variable, so the
+ * row loop can jump straight to the projected columns */
+static readstat_error_t dta_select_columns(dta_ctx_t *ctx, const readstat_column_filter_t *filter) {
     readstat_error_t retval = READSTAT_OK;
+    char name[256];
     int i;
 
+    if ((ctx->columns = calloc(ctx->nvar, sizeof(dta_column_t))) == NULL && ctx->nvar > 0) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+
     for (i=0; i<ctx->nvar; i++) {
         size_t      max_len;
         readstat_type_t type = dta_type_info(ctx->typlist[i], &max_len, ctx);
 
+        name[0] = '\0';
+        if (filter && filter->names_count) {
+            readstat_convert(name, sizeof(name), &ctx->varlist[ctx->variable_name_len*i],
+                    ctx->variable_name_len, ctx->converter);
+        }
+
+        if (readstat_column_filter_selects(filter, i, name)) {
+            dta_column_t *column = &ctx->columns[ctx->columns_count++];
+            column->index = i;
+            column->type = type;
+            column->offset = ctx->record_len;
+            column->max_len = max_len;
+        }
+
+        ctx->record_len += max_len;
+    }
+
+cleanup:
+    return retval;
+}
+
+static readstat_error_t dta_handle_variables(dta_ctx_t *ctx) {
+    if (!ctx->variable_handler)
+        return READSTAT_OK;
+
+    readstat_error_t retval = READSTAT_OK;
+    readstat_variable_buffer_t buffer;
+    int j;
+
+    for (j=0; j<ctx->columns_count; j++) {
+        int         i = ctx->columns[j].index;
+        size_t      max_len = ctx->columns[j].max_len;
+        readstat_type_t type = ctx->columns[j].type;
+
         if (type == READSTAT_TYPE_STRING)
             max_len++; /* might append NULL */
 
-        readstat_variable_t *variable = dta_init_variable(ctx, i, type, max_len);
+        readstat_variable_t *variable = dta_init_variable(ctx, i, type, max_len, &buffer);
 
         const char *value_labels = NULL;
 
@@ -489,8 +623,6 @@ static readstat_error_t dta_handle_variables(dta_ctx_t *ctx) {
 
         int cb_retval = ctx->variable_handler(i, variable, value_labels, ctx->user_ctx);
 
-        free(variable);
-
         if (cb_retval) {
             retval = READSTAT_ERROR_USER_ABORT;
             goto cleanup;
@@ -500,163 +632,182 @@ cleanup:
     return retval;
 }
 
-static readstat_error_t dta_handle_rows(dta_ctx_t *ctx) {
+/* Decodes one cell. Reads only fields that are fixed once the descriptors
+ * have been read, so rows can be decoded on several threads at once, except
+ * that strings with a dictionary must be decoded on the delivering thread. */
+static readstat_error_t dta_decode_value(dta_ctx_t *ctx, const char *row, const dta_column_t *column,
+        char *str_buf, size_t str_buf_len, readstat_converter_t *converter, char **long_string,
+        readstat_value_t *out_value) {
+    readstat_error_t retval = READSTAT_OK;
+    size_t max_len = column->max_len;
+    off_t offset = column->offset;
+    readstat_value_t value;
+    memset(&value, 0, sizeof(readstat_value_t));
+
+    value.type = column->type;
+
+    if (value.type == READSTAT_TYPE_STRING && column->dictionary) {
+        retval = readstat_dictionary_convert(column->dictionary, &row[offset], max_len, converter, &value);
+        if (retval != READSTAT_OK)
+            goto cleanup;
+    } else if (value.type == READSTAT_TYPE_STRING) {
+        readstat_convert_len(str_buf, str_buf_len, &row[offset], max_len, converter, &value.string_len);
+        value.v.string_value = str_buf;
+    } else if (value.type == READSTAT_TYPE_LONG_STRING) {
+        uint32_t v, o;
+        v = *((const uint32_t *)&row[offset]);
+        o = *((const uint32_t *)&row[offset+4]);
+        if (ctx->machine_needs_byte_swap) {
+            v = byteswap4(v);
+            o = byteswap4(o);
+        }
+        if (v > 0 && o > 0) {
+            retval = dta_read_long_string(ctx, v, o, long_string, &value.string_len);
+            if (retval != READSTAT_OK) {
+                goto cleanup;
+            }
+            value.v.string_value = *long_string;
+        }
+    } else if (value.type == READSTAT_TYPE_INT8) {
+        int8_t byte = row[offset];
+        if (ctx->machine_is_twos_complement) {
+            byte = ones_to_twos_complement1(byte);
+        }
+        if (byte > ctx->max_int8) {
+            value.is_system_missing = 1;
+            if (ctx->supports_tagged_missing && byte > DTA_113_MISSING_INT8) {
+                value.tag = 'a' + (byte - DTA_113_MISSING_INT8_A);
+            }
+        }
+        value.v.i8_value = byte;
+    } else if (value.type == READSTAT_TYPE_INT16) {
+        int16_t num = *((const int16_t *)&row[offset]);
+        if (ctx->machine_needs_byte_swap) {
+            num = byteswap2(num);
+        }
+        if (ctx->machine_is_twos_complement) {
+            num = ones_to_twos_complement2(num);
+        }
+        if (num > ctx->max_int16) {
+            value.is_system_missing = 1;
+            if (ctx->supports_tagged_missing && num > DTA_113_MISSING_INT16) {
+                value.tag = 'a' + (num - DTA_113_MISSING_INT16_A);
+            }
+        }
+        value.v.i16_value = num;
+    } else if (value.type == READSTAT_TYPE_INT32) {
+        int32_t num = *((const int32_t *)&row[offset]);
+        if (ctx->machine_needs_byte_swap) {
+            num = byteswap4(num);
+        }
+        if (ctx->machine_is_twos_complement) {
+            num = ones_to_twos_complement4(num);
+        }
+        if (num > ctx->max_int32) {
+            value.is_system_missing = 1;
+            if (ctx->supports_tagged_missing && num > DTA_113_MISSING_INT32) {
+                value.tag = 'a' + (num - DTA_113_MISSING_INT32_A);
+            }
+        }
+        value.v.i32_value = num;
+    } else if (value.type == READSTAT_TYPE_FLOAT) {
+        int32_t num = *((const int32_t *)&row[offset]);
+        float f_num = NAN;
+        if (ctx->machine_needs_byte_swap) {
+            num = byteswap4(num);
+        }
+        if (num > ctx->max_float) {
+            value.is_system_missing = 1;
+            if (ctx->supports_tagged_missing && num > DTA_113_MISSING_FLOAT) {
+                value.tag = 'a' + ((num - DTA_113_MISSING_FLOAT_A) >> 11);
+            }
+        } else {
+            memcpy(&f_num, &num, sizeof(int32_t));
+        }
+        value.v.float_value = f_num;
+    } else if (value.type == READSTAT_TYPE_DOUBLE) {
+        int64_t num = *((const int64_t *)&row[offset]);
+        double d_num = NAN;
+        if (ctx->machine_needs_byte_swap) {
+            num = byteswap8(num);
+        }
+        if (num > ctx->max_double) {
+            value.is_system_missing = 1;
+            if (ctx->supports_tagged_missing && num > DTA_113_MISSING_DOUBLE) {
+                value.tag = 'a' + ((num - DTA_113_MISSING_DOUBLE_A) >> 40);
+            }
+        } else {
+            memcpy(&d_num, &num, sizeof(int64_t));
+        }
+        value.v.double_value = d_num;
+    }
+
+    *out_value = value;
+
+cleanup:
+    return retval;
+}
+
+static readstat_error_t dta_read_rows(dta_ctx_t *ctx) {
     readstat_io_t *io = ctx->io;
     char *buf = NULL;
+    const char *row = NULL;
     char  str_buf[2048];
     int i;
     readstat_error_t retval = READSTAT_OK;
     char *long_string = NULL;
 
-    if (!ctx->value_handler) {
-        if (io->seek(ctx->record_len * ctx->nobs, READSTAT_SEEK_CUR, io->io_ctx) == -1)
-            retval = READSTAT_ERROR_SEEK;
-
-        return retval;
-    }
-
-    if ((buf = malloc(ctx->record_len)) == NULL) {
+    if (!io->borrow && (buf = malloc(ctx->record_len)) == NULL) {
         retval = READSTAT_ERROR_MALLOC;
         goto cleanup;
     }
 
     for (i=0; i<ctx->row_limit; i++) {
-        if (io->read(buf, ctx->record_len, io->io_ctx) != ctx->record_len) {
-            retval = READSTAT_ERROR_READ;
-            goto cleanup;
+        if (io->borrow) {
+            if (io->borrow((const void **)&row, ctx->record_len, io->io_ctx) != ctx->record_len) {
+                retval = READSTAT_ERROR_READ;
+                goto cleanup;
+            }
+        } else {
+            if (io->read(buf, ctx->record_len, io->io_ctx) != ctx->record_len) {
+                retval = READSTAT_ERROR_READ;
+                goto cleanup;
+            }
+            row = buf;
         }
-        int j;
-        off_t offset = 0;
-        for (j=0; j<ctx->nvar; j++) {
-            size_t max_len;
+        int k;
+        for (k=0; k<ctx->columns_count; k++) {
+            int j = ctx->columns[k].index;
             readstat_value_t value;
-            memset(&value, 0, sizeof(readstat_value_t));
-
-            value.type = dta_type_info(ctx->typlist[j], &max_len, ctx);
-
-            if (value.type == READSTAT_TYPE_STRING) {
-                readstat_convert(str_buf, sizeof(str_buf), &buf[offset], max_len, ctx->converter);
-                value.v.string_value = str_buf;
-            } else if (value.type == READSTAT_TYPE_LONG_STRING) {
-                uint32_t v, o;
-                v = *((uint32_t *)&buf[offset]);
-                o = *((uint32_t *)&buf[offset+4]);
-                if (ctx->machine_needs_byte_swap) {
-                    v = byteswap4(v);
-                    o = byteswap4(o);
-                }
-                if (v > 0 && o > 0) {
-                    off_t cur_pos = io->seek(0, READSTAT_SEEK_CUR, io->io_ctx);
-                    if (cur_pos == -1) {
-                        retval = READSTAT_ERROR_SEEK;
-                        goto cleanup;
-                    }
-                    retval = dta_read_long_string(ctx, v, o, &long_string);
-                    if (retval != READSTAT_OK) {
-                        goto cleanup;
-                    }
-                    value.v.string_value = long_string;
-                    if (io->seek(cur_pos, READSTAT_SEEK_SET, io->io_ctx) == -1) {
-                        retval = READSTAT_ERROR_SEEK;
-                        goto cleanup;
-                    }
-                }
-            } else if (value.type == READSTAT_TYPE_INT8) {
-                int8_t byte = buf[offset];
-                if (ctx->machine_is_twos_complement) {
-                    byte = ones_to_twos_complement1(byte);
-                }
-                if (byte > ctx->max_int8) {
-                    value.is_system_missing = 1;
-                    if (ctx->supports_tagged_missing && byte > DTA_113_MISSING_INT8) {
-                        value.tag = 'a' + (byte - DTA_113_MISSING_INT8_A);
-                    }
-                }
-                value.v.i8_value = byte;
-            } else if (value.type == READSTAT_TYPE_INT16) {
-                int16_t num = *((int16_t *)&buf[offset]);
-                if (ctx->machine_needs_byte_swap) {
-                    num = byteswap2(num);
-                }
-                if (ctx->machine_is_twos_complement) {
-                    num = ones_to_twos_complement2(num);
-                }
-                if (num > ctx->max_int16) {
-                    value.is_system_missing = 1;
-                    if (ctx->supports_tagged_missing && num > DTA_113_MISSING_INT16) {
-                        value.tag = 'a' + (num - DTA_113_MISSING_INT16_A);
-                    }
-                }
-                value.v.i16_value = num;
-            } else if (value.type == READSTAT_TYPE_INT32) {
-                int32_t num = *((int32_t *)&buf[offset]);
-                if (ctx->machine_needs_byte_swap) {
-                    num = byteswap4(num);
-                }
-                if (ctx->machine_is_twos_complement) {
-                    num = ones_to_twos_complement4(num);
-                }
-                if (num > ctx->max_int32) {
-                    value.is_system_missing = 1;
-                    if (ctx->supports_tagged_missing && num > DTA_113_MISSING_INT32) {
-                        value.tag = 'a' + (num - DTA_113_MISSING_INT32_A);
-                    }
-                }
-                value.v.i32_value = num;
-            } else if (value.type == READSTAT_TYPE_FLOAT) {
-                int32_t num = *((int32_t *)&buf[offset]);
-                float f_num = NAN;
-                if (ctx->machine_needs_byte_swap) {
-                    num = byteswap4(num);
-                }
-                if (num > ctx->max_float) {
-                    value.is_system_missing = 1;
-                    if (ctx->supports_tagged_missing && num > DTA_113_MISSING_FLOAT) {
-                        value.tag = 'a' + ((num - DTA_113_MISSING_FLOAT_A) >> 11);
-                    }
-                } else {
-                    memcpy(&f_num, &num, sizeof(int32_t));
-                }
-                value.v.float_value = f_num;
-            } else if (value.type == READSTAT_TYPE_DOUBLE) {
-                int64_t num = *((int64_t *)&buf[offset]);
-                double d_num = NAN;
-                if (ctx->machine_needs_byte_swap) {
-                    num = byteswap8(num);
-                }
-                if (num > ctx->max_double) {
-                    value.is_system_missing = 1;
-                    if (ctx->supports_tagged_missing && num > DTA_113_MISSING_DOUBLE) {
-                        value.tag = 'a' + ((num - DTA_113_MISSING_DOUBLE_A) >> 40);
-                    }
-                } else {
-                    memcpy(&d_num, &num, sizeof(int64_t));
-                }
-                value.v.double_value = d_num;
+
+            retval = dta_decode_value(ctx, row, &ctx->columns[k], str_buf, sizeof(str_buf),
+                    ctx->converter, &long_string, &value);
+            if (retval != READSTAT_OK) {
+                goto cleanup;
             }
 
-            if (ctx->value_handler(i, j, value, ctx->user_ctx)) {
+            if (ctx->value_handler && ctx->value_handler(i, j, value, ctx->user_ctx)) {
                 retval = READSTAT_ERROR_USER_ABORT;
                 goto cleanup;
             }
 
+            if (ctx->batch && (retval = readstat_batch_put_value(ctx->batch, j, value)) != READSTAT_OK) {
+                goto cleanup;
+            }
+
             if (long_string) {
                 free(long_string);
                 long_string = NULL;
             }
-
-            offset += max_len;
+        }
+        if (ctx->batch && (retval = readstat_batch_end_row(ctx->batch)) != READSTAT_OK) {
+            goto cleanup;
         }
         if ((retval = dta_update_progress(ctx)) != READSTAT_OK) {
             goto cleanup;
         }
     }
 
-    if (ctx->row_limit < ctx->nobs) {
-        if (io->seek(ctx->record_len * (ctx->nobs - ctx->row_limit), READSTAT_SEEK_CUR, io->io_ctx) == -1)
-            retval = READSTAT_ERROR_SEEK;
-    }
-
 cleanup:
     if (buf)
         free(buf);
@@ -666,16 +817,347 @@ cleanup:
     return retval;
 }
 
-static readstat_error_t dta_handle_value_labels(dta_ctx_t *ctx) {
+#define DTA_ROWS_JOB_BYTES  (256*1024)
+
+/* A contiguous run of rows that a worker thread reads with pread and
+ * decodes. Strings are stored as offsets into the strings arena until the
+ * job is delivered. */
+typedef struct dta_rows_job_s {
+    int                 row_start;
+    int                 rows_count;
+    char               *data;
+
+    readstat_value_t   *values;
+    size_t             *string_offsets;
+
+    char               *strings;
+    size_t              strings_len;
+    size_t              strings_capacity;
+} dta_rows_job_t;
+
+typedef struct dta_rows_pipeline_ctx_s {
+    dta_ctx_t          *ctx;
+    off_t               data_offset;
+    readstat_converter_t **converters;
+} dta_rows_pipeline_ctx_t;
+
+static readstat_error_t dta_rows_job_reserve(dta_rows_job_t *job, size_t len) {
+    if (job->strings_len + len > job->strings_capacity) {
+        size_t strings_capacity = 2 * (job->strings_len + len);
+        char *strings = realloc(job->strings, strings_capacity);
+        if (strings == NULL)
+            return READSTAT_ERROR_MALLOC;
+
+        job->strings = strings;
+        job->strings_capacity = strings_capacity;
+    }
+    return READSTAT_OK;
+}
+
+static readstat_error_t dta_decode_rows_job(void *job_ptr, int worker_index, void *pipeline_ctx_ptr) {
+    dta_rows_job_t *job = (dta_rows_job_t *)job_ptr;
+    dta_rows_pipeline_ctx_t *pipeline_ctx = (dta_rows_pipeline_ctx_t *)pipeline_ctx_ptr;
+    dta_ctx_t *ctx = pipeline_ctx->ctx;
     readstat_io_t *io = ctx->io;
+    size_t len = (size_t)job->rows_count * ctx->record_len;
     readstat_error_t retval = READSTAT_OK;
-    if (!ctx->value_label_handler) {
-        if (io->seek(0, READSTAT_SEEK_END, io->io_ctx) == -1)
-            return READSTAT_ERROR_SEEK;
+    char *long_string = NULL;
+    int i, k;
 
-        return READSTAT_OK;
+    if (io->pread(job->data, len, pipeline_ctx->data_offset + (off_t)job->row_start * ctx->record_len,
+                io->io_ctx) != len) {
+        retval = READSTAT_ERROR_READ;
+        goto cleanup;
+    }
+
+    job->strings_len = 0;
+
+    for (i=0; i<job->rows_count; i++) {
+        const char *row = &job->data[(size_t)i * ctx->record_len];
+        for (k=0; k<ctx->columns_count; k++) {
+            size_t value_index = (size_t)i * ctx->columns_count + k;
+            readstat_value_t *value = &job->values[value_index];
+
+            /* Left for dta_deliver_rows_job */
+            if (ctx->columns[k].dictionary)
+                continue;
+
+            if ((retval = dta_rows_job_reserve(job, 2048)) != READSTAT_OK)
+                goto cleanup;
+
+            retval = dta_decode_value(ctx, row, &ctx->columns[k], &job->strings[job->strings_len], 2048,
+                    pipeline_ctx->converters[worker_index], &long_string, value);
+            if (retval != READSTAT_OK)
+                goto cleanup;
+
+            if (long_string) {
+                size_t long_string_len = value->string_len + 1;
+                if ((retval = dta_rows_job_reserve(job, long_string_len)) != READSTAT_OK)
+                    goto cleanup;
+
+                memcpy(&job->strings[job->strings_len], long_string, long_string_len);
+                value->v.string_value = &job->strings[job->strings_len];
+                free(long_string);
+                long_string = NULL;
+            }
+            if ((value->type == READSTAT_TYPE_STRING || value->type == READSTAT_TYPE_LONG_STRING) &&
+                    value->v.string_value) {
+                job->string_offsets[value_index] = job->strings_len;
+                job->strings_len += value->string_len + 1;
+            }
+        }
+    }
+
+cleanup:
+    if (long_string)
+        free(long_string);
+
+    return retval;
+}
+
+static readstat_error_t dta_deliver_rows_job(void *job_ptr, readstat_error_t work_retval, void *pipeline_ctx_ptr) {
+    dta_rows_job_t *job = (dta_rows_job_t *)job_ptr;
+    dta_rows_pipeline_ctx_t *pipeline_ctx = (dta_rows_pipeline_ctx_t *)pipeline_ctx_ptr;
+    dta_ctx_t *ctx = pipeline_ctx->ctx;
+    readstat_io_t *io = ctx->io;
+    readstat_error_t retval = work_retval;
+    int i, k;
+
+    if (retval != READSTAT_OK)
+        goto cleanup;
+
+    for (i=0; i<job->rows_count; i++) {
+        for (k=0; k<ctx->columns_count; k++) {
+            int j = ctx->columns[k].index;
+            size_t value_index = (size_t)i * ctx->columns_count + k;
+            readstat_value_t value = job->values[value_index];
+
+            if (ctx->columns[k].dictionary) {
+                retval = dta_decode_value(ctx, &job->data[(size_t)i * ctx->record_len], &ctx->columns[k],
+                        NULL, 0, ctx->converter, NULL, &value);
+                if (retval != READSTAT_OK)
+                    goto cleanup;
+            } else if ((value.type == READSTAT_TYPE_STRING || value.type == READSTAT_TYPE_LONG_STRING) &&
+                    value.v.string_value) {
+                value.v.string_value = &job->strings[job->string_offsets[value_index]];
+            }
+
+            if (ctx->value_handler && ctx->value_handler(job->row_start + i, j, value, ctx->user_ctx)) {
+                retval = READSTAT_ERROR_USER_ABORT;
+                goto cleanup;
+            }
+
+            if (ctx->batch && (retval = readstat_batch_put_value(ctx->batch, j, value)) != READSTAT_OK) {
+                goto cleanup;
+            }
+        }
+        if (ctx->batch && (retval = readstat_batch_end_row(ctx->batch)) != READSTAT_OK) {
+            goto cleanup;
+        }
+    }
+
+    /* Keep the file position (and so the progress) in step with the rows handed out */
+    if (io->seek((off_t)job->rows_count * ctx->record_len, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+    retval = dta_update_progress(ctx);
+
+cleanup:
+    return retval;
+}
+
+/* Reads the rows on ctx->thread_count worker threads. Sets *out_done to 0,
+ * without reading anything, if threads are unavailable. */
+static readstat_error_t dta_read_rows_threaded(dta_ctx_t *ctx, int *out_done) {
+    readstat_io_t *io = ctx->io;
+    readstat_error_t retval = READSTAT_OK;
+    readstat_pipeline_t *pipeline = NULL;
+    dta_rows_pipeline_ctx_t pipeline_ctx = { .ctx = ctx };
+    int workers_count = ctx->thread_count;
+    int jobs_count = 2 * ctx->thread_count;
+    void **jobs = NULL;
+    int rows_per_job = DTA_ROWS_JOB_BYTES / ctx->record_len;
+    int row_start = 0;
+    int i;
+
+    *out_done = 0;
+
+    /* Spread small files across all of the workers */
+    if (rows_per_job > (ctx->row_limit + jobs_count - 1) / jobs_count)
+        rows_per_job = (ctx->row_limit + jobs_count - 1) / jobs_count;
+    if (rows_per_job < 1)
+        rows_per_job = 1;
+
+    if ((pipeline_ctx.data_offset = io->seek(0, READSTAT_SEEK_CUR, io->io_ctx)) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+    if ((pipeline_ctx.converters = calloc(workers_count, sizeof(readstat_converter_t *))) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+    for (i=0; i<workers_count; i++) {
+        if (ctx->converter) {
+            readstat_converter_t *converter = readstat_converter_open(ctx->output_encoding, ctx->input_encoding);
+            if (converter == NULL) {
+                retval = READSTAT_ERROR_UNSUPPORTED_CHARSET;
+                goto cleanup;
+            }
+            pipeline_ctx.converters[i] = converter;
+        }
+    }
+
+    if ((jobs = calloc(jobs_count, sizeof(void *))) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+    for (i=0; i<jobs_count; i++) {
+        dta_rows_job_t *job = calloc(1, sizeof(dta_rows_job_t));
+        if (job == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        jobs[i] = job;
+        size_t values_count = (size_t)rows_per_job * ctx->columns_count;
+        if ((job->data = malloc((size_t)rows_per_job * ctx->record_len)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        if ((job->values = calloc(values_count, sizeof(readstat_value_t))) == NULL && values_count > 0) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        if ((job->string_offsets = calloc(values_count, sizeof(size_t))) == NULL && values_count > 0) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+    }
+
+    if ((pipeline = readstat_pipeline_init(workers_count, jobs, jobs_count,
+                    &dta_decode_rows_job, &dta_deliver_rows_job, &pipeline_ctx)) == NULL) {
+        goto cleanup;
+    }
+
+    *out_done = 1;
+
+    while (row_start < ctx->row_limit) {
+        dta_rows_job_t *job = NULL;
+        if ((retval = readstat_pipeline_acquire(pipeline, (void **)&job)) != READSTAT_OK)
+            goto cleanup;
+
+        job->row_start = row_start;
+        job->rows_count = rows_per_job;
+        if (job->rows_count > ctx->row_limit - row_start)
+            job->rows_count = ctx->row_limit - row_start;
+
+        readstat_pipeline_submit(pipeline);
+        row_start += job->rows_count;
+    }
+
+    retval = readstat_pipeline_drain(pipeline);
+
+cleanup:
+    if (pipeline)
+        readstat_pipeline_free(pipeline);
+    if (jobs) {
+        for (i=0; i<jobs_count; i++) {
+            dta_rows_job_t *job = jobs[i];
+            if (job == NULL)
+                continue;
+            free(job->data);
+            free(job->values);
+            free(job->string_offsets);
+            free(job->strings);
+            free(job);
+        }
+        free(jobs);
+    }
+    if (pipeline_ctx.converters) {
+        for (i=0; i<workers_count; i++) {
+            if (pipeline_ctx.converters[i])
+                readstat_converter_close(pipeline_ctx.converters[i]);
+        }
+        free(pipeline_ctx.converters);
+    }
+
+    return retval;
+}
+
+static readstat_error_t dta_handle_rows(dta_ctx_t *ctx) {
+    readstat_io_t *io = ctx->io;
+    readstat_error_t retval = READSTAT_OK;
+    int k;
+
+    if (!ctx->value_handler && !ctx->batch) {
+        if (io->seek(ctx->record_len * ctx->nobs, READSTAT_SEEK_CUR, io->io_ctx) == -1)
+            retval = READSTAT_ERROR_SEEK;
+
+        return retval;
     }
 
+    /* Index the strLs up front so that they can be fetched without
+     * disturbing the row reads */
+    for (k=0; k<ctx->columns_count; k++) {
+        if (ctx->columns[k].type == READSTAT_TYPE_LONG_STRING && ctx->row_limit > 0) {
+            off_t data_pos = io->seek(0, READSTAT_SEEK_CUR, io->io_ctx);
+            if (data_pos == -1) {
+                retval = READSTAT_ERROR_SEEK;
+                goto cleanup;
+            }
+            if ((retval = dta_index_strls(ctx)) != READSTAT_OK)
+                goto cleanup;
+
+            if (io->seek(data_pos, READSTAT_SEEK_SET, io->io_ctx) == -1) {
+                retval = READSTAT_ERROR_SEEK;
+                goto cleanup;
+            }
+            break;
+        }
+    }
+
+    if (ctx->row_offset) {
+        if (io->seek(ctx->record_len * ctx->row_offset, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+            retval = READSTAT_ERROR_SEEK;
+            goto cleanup;
+        }
+    }
+
+    if (io->advise) {
+        off_t data_start = io->seek(0, READSTAT_SEEK_CUR, io->io_ctx);
+        if (data_start != -1) {
+            io->advise(data_start, ctx->record_len * ctx->row_limit,
+                    READSTAT_ADVICE_SEQUENTIAL, io->io_ctx);
+        }
+    }
+
+    int done = 0;
+    if (ctx->thread_count > 1 && io->pread && ctx->row_limit > 0) {
+        if ((retval = dta_read_rows_threaded(ctx, &done)) != READSTAT_OK)
+            goto cleanup;
+    }
+    if (!done && (retval = dta_read_rows(ctx)) != READSTAT_OK)
+        goto cleanup;
+
+    if (ctx->batch && (retval = readstat_batch_flush(ctx->batch)) != READSTAT_OK) {
+        goto cleanup;
+    }
+
+    if (ctx->row_offset + ctx->row_limit < ctx->nobs) {
+        if (io->seek(ctx->record_len * (ctx->nobs - ctx->row_offset - ctx->row_limit),
+                    READSTAT_SEEK_CUR, io->io_ctx) == -1)
+            retval = READSTAT_ERROR_SEEK;
+    }
+
+cleanup:
+    return retval;
+}
+
+static readstat_error_t dta_handle_value_labels(dta_ctx_t *ctx) {
+    readstat_io_t *io = ctx->io;
+    readstat_error_t retval = READSTAT_OK;
     char *table_buffer = NULL;
 
     while (1) {
@@ -791,6 +1273,48 @@ cleanup:
     return retval;
 }
 
+/* The value labels follow the data, but they are reported before the
+ * variables (as in the other formats) so that a single pass is enough to
+ * attach them. Leaves the file positioned at the start of the data. */
+static readstat_error_t dta_handle_value_labels_ahead(dta_ctx_t *ctx) {
+    readstat_io_t *io = ctx->io;
+    readstat_error_t retval = READSTAT_OK;
+    off_t data_offset = 0, value_labels_offset = 0;
+
+    if (!ctx->value_label_handler)
+        return READSTAT_OK;
+
+    if ((data_offset = io->seek(0, READSTAT_SEEK_CUR, io->io_ctx)) == -1)
+        return READSTAT_ERROR_SEEK;
+
+    if (ctx->file_is_xmlish) {
+        value_labels_offset = ctx->value_labels_offset;
+    } else {
+        value_labels_offset = data_offset + (off_t)ctx->record_len * ctx->nobs;
+    }
+
+    if (io->seek(value_labels_offset, READSTAT_SEEK_SET, io->io_ctx) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+    if (ctx->file_is_xmlish) {
+        if ((retval = dta_read_tag(ctx, "<value_labels>")) != READSTAT_OK)
+            goto cleanup;
+    }
+
+    if ((retval = dta_handle_value_labels(ctx)) != READSTAT_OK)
+        goto cleanup;
+
+    if (io->seek(data_offset, READSTAT_SEEK_SET, io->io_ctx) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+cleanup:
+    return retval;
+}
+
 readstat_error_t readstat_parse_dta(readstat_parser_t *parser, const char *path, void *user_ctx) {
     readstat_error_t retval = READSTAT_OK;
     readstat_io_t *io = parser->io;
@@ -842,11 +1366,17 @@ readstat_error_t readstat_parse_dta(readstat_parser_t *parser, const char *path,
     ctx->file_size = file_size;
     ctx->error_handler = parser->error_handler;
     ctx->progress_handler = parser->progress_handler;
+    ctx->progress_granularity = parser->progress_granularity;
     ctx->variable_handler = parser->variable_handler;
     ctx->value_handler = parser->value_handler;
     ctx->value_label_handler = parser->value_label_handler;
-    ctx->row_limit = ctx->nobs;
-    if (parser->row_limit > 0 && parser->row_limit < ctx->nobs)
+    ctx->thread_count = parser->thread_count;
+    ctx->row_offset = ctx->nobs;
+    if (parser->row_offset < ctx->nobs)
+        ctx->row_offset = parser->row_offset;
+
+    ctx->row_limit = ctx->nobs - ctx->row_offset;
+    if (parser->row_limit > 0 && parser->row_limit < ctx->row_limit)
         ctx->row_limit = parser->row_limit;
 
     retval = dta_update_progress(ctx);
@@ -884,48 +1414,67 @@ readstat_error_t readstat_parse_dta(readstat_parser_t *parser, const char *path,
         goto cleanup;
     }
 
-    for (i=0; i<ctx->nvar; i++) {
-        size_t      max_len;
-        dta_type_info(ctx->typlist[i], &max_len, ctx);
-        ctx->record_len += max_len;
-    }
+    if ((retval = dta_select_columns(ctx, parser->column_filter)) != READSTAT_OK)
+        goto cleanup;
 
     if (ctx->record_len == 0) {
         retval = READSTAT_ERROR_PARSE;
         goto cleanup;
     }
 
-    if ((retval = dta_handle_variables(ctx)) != READSTAT_OK)
-        goto cleanup;
-
     if ((retval = dta_skip_expansion_fields(ctx)) != READSTAT_OK)
         goto cleanup;
     
     if ((retval = dta_read_tag(ctx, "<data>")) != READSTAT_OK)
         goto cleanup;
 
-    if ((retval = dta_update_progress(ctx)) != READSTAT_OK)
+    if ((retval = dta_handle_value_labels_ahead(ctx)) != READSTAT_OK)
         goto cleanup;
 
-    if ((retval = dta_handle_rows(ctx)) != READSTAT_OK)
+    if ((retval = dta_handle_variables(ctx)) != READSTAT_OK)
         goto cleanup;
 
-    if ((retval = dta_read_tag(ctx, "</data>")) != READSTAT_OK)
-        goto cleanup;
+    if (parser->string_dictionary_max) {
+        for (i=0; i<ctx->columns_count; i++) {
+            dta_column_t *column = &ctx->columns[i];
+            if (column->type == READSTAT_TYPE_STRING &&
+                    (column->dictionary = readstat_dictionary_init(parser->string_dictionary_max)) == NULL) {
+                retval = READSTAT_ERROR_MALLOC;
+                goto cleanup;
+            }
+        }
+    }
 
-    if (ctx->file_is_xmlish) {
-        if (io->seek(ctx->value_labels_offset, READSTAT_SEEK_SET, io->io_ctx) == -1) {
-            retval = READSTAT_ERROR_SEEK;
+    if (parser->batch_handler) {
+        if ((ctx->batch = readstat_batch_init(parser->batch_handler, parser->batch_size,
+                        ctx->nvar, user_ctx)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
             goto cleanup;
         }
-        if ((retval = dta_read_tag(ctx, "<value_labels>")) != READSTAT_OK) {
-            goto cleanup;
+        for (i=0; i<ctx->columns_count; i++) {
+            dta_column_t *column = &ctx->columns[i];
+            if ((retval = readstat_batch_add_column(ctx->batch, column->index, column->type)) != READSTAT_OK)
+                goto cleanup;
+            if (column->dictionary &&
+                    (retval = readstat_batch_set_dictionary(ctx->batch, column->index, column->dictionary)) != READSTAT_OK)
+                goto cleanup;
         }
     }
 
-    if ((retval = dta_handle_value_labels(ctx)) != READSTAT_OK)
+    if ((retval = dta_update_progress(ctx)) != READSTAT_OK)
         goto cleanup;
-    
+
+    if ((retval = dta_handle_rows(ctx)) != READSTAT_OK)
+        goto cleanup;
+
+    if ((retval = dta_read_tag(ctx, "</data>")) != READSTAT_OK)
+        goto cleanup;
+
+    if (io->seek(0, READSTAT_SEEK_END, io->io_ctx) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
     if ((retval = dta_update_progress(ctx)) != READSTAT_OK)
         goto cleanup;
 
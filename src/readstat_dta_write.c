@@ -1,5 +1,6 @@
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <math.h>
 #include <stdint.h>
 #include <string.h>
@@ -697,6 +698,7 @@ static readstat_error_t dta_emit_header(readstat_writer_t *writer, dta_ctx_t *ct
     if (error != READSTAT_OK)
         goto cleanup;
 
+    ctx->nobs_offset = writer->bytes_written + sizeof("<N>")-1;
     if (header->ds_format >= 118) {
         int64_t nobs = header->nobs;
         error = dta_write_chunk(writer, ctx, "<N>", &nobs, sizeof(int64_t), "</N>");
@@ -819,14 +821,9 @@ static size_t dta_measure_value_labels(readstat_writer_t *writer, dta_ctx_t *ctx
     return len;
 }
 
-static readstat_error_t dta_emit_map(readstat_writer_t *writer, dta_ctx_t *ctx) {
-    if (!ctx->file_is_xmlish)
-        return READSTAT_OK;
-
-    uint64_t map[14];
-
+static void dta_compute_map(readstat_writer_t *writer, dta_ctx_t *ctx, uint64_t map[14]) {
     map[0] = 0;                                         /* <stata_dta> */
-    map[1] = writer->bytes_written;                     /* <map> */
+    map[1] = ctx->map_offset;                           /* <map> */
     map[2] = map[1] + dta_measure_map(ctx);             /* <variable_types> */
     map[3] = map[2] + dta_measure_typlist(ctx);         /* <varnames> */
     map[4] = map[3] + dta_measure_varlist(ctx);         /* <sortlist> */
@@ -839,6 +836,16 @@ static readstat_error_t dta_emit_map(readstat_writer_t *writer, dta_ctx_t *ctx)
     map[11]= map[10]+ dta_measure_strls(ctx);           /* <value_labels> */
     map[12]= map[11]+ dta_measure_value_labels(writer, ctx);    /* </stata_dta> */
     map[13]= map[12]+ dta_measure_tag(ctx, "</stata_dta>");
+}
+
+static readstat_error_t dta_emit_map(readstat_writer_t *writer, dta_ctx_t *ctx) {
+    if (!ctx->file_is_xmlish)
+        return READSTAT_OK;
+
+    uint64_t map[14];
+
+    ctx->map_offset = writer->bytes_written;
+    dta_compute_map(writer, ctx, map);
 
     return dta_write_chunk(writer, ctx, "<map>", map, sizeof(map), "</map>");
 }
@@ -858,7 +865,7 @@ static readstat_error_t dta_begin_data(void *writer_ctx) {
     header.filetype  = 0x01;
     header.unused    = 0x00;
     header.nvar      = writer->variables_count;
-    header.nobs      = writer->row_count;
+    header.nobs      = writer->row_count < 0 ? 0 : writer->row_count;
 
     error = dta_ctx_init(ctx, header.nvar, header.nobs, header.byteorder, header.ds_format, NULL, NULL);
     if (error != READSTAT_OK)
@@ -994,37 +1001,39 @@ static readstat_error_t dta_write_double(void *row, const readstat_variable_t *v
     return dta_write_raw_double(row, value);
 }
 
-static readstat_error_t dta_write_string(void *row, const char *value, size_t max_len) {
-    if (value == NULL || value[0] == '\0') {
-        memset(row, '\0', max_len);
-    } else {
-        strncpy((char *)row, value, max_len);
-    }
+static readstat_error_t dta_write_string(void *row, const char *value, size_t value_len, size_t max_len) {
+    if (value == NULL)
+        value_len = 0;
+    if (value_len > max_len)
+        value_len = max_len;
+    if (value_len)
+        memcpy(row, value, value_len);
+    memset((char *)row + value_len, '\0', max_len - value_len);
     return READSTAT_OK;
 }
 
 static readstat_error_t dta_111_write_string(void *row, const readstat_variable_t *var, 
-        const char *value) {
-    size_t value_len = var->storage_width;
-    if (value_len > DTA_111_MAX_WIDTH)
-        value_len = DTA_111_MAX_WIDTH;
-    return dta_write_string(row, value, value_len);
+        const char *value, size_t value_len) {
+    size_t max_len = var->storage_width;
+    if (max_len > DTA_111_MAX_WIDTH)
+        max_len = DTA_111_MAX_WIDTH;
+    return dta_write_string(row, value, value_len, max_len);
 }
 
 static readstat_error_t dta_117_write_string(void *row, const readstat_variable_t *var, 
-        const char *value) {
-    size_t value_len = var->storage_width;
-    if (value_len > DTA_117_MAX_WIDTH)
-        value_len = DTA_117_MAX_WIDTH;
-    return dta_write_string(row, value, value_len);
+        const char *value, size_t value_len) {
+    size_t max_len = var->storage_width;
+    if (max_len > DTA_117_MAX_WIDTH)
+        max_len = DTA_117_MAX_WIDTH;
+    return dta_write_string(row, value, value_len, max_len);
 }
 
 static readstat_error_t dta_old_write_string(void *row, const readstat_variable_t *var, 
-        const char *value) {
-    size_t value_len = var->storage_width;
-    if (value_len > DTA_OLD_MAX_WIDTH)
-        value_len = DTA_OLD_MAX_WIDTH;
-    return dta_write_string(row, value, value_len);
+        const char *value, size_t value_len) {
+    size_t max_len = var->storage_width;
+    if (max_len > DTA_OLD_MAX_WIDTH)
+        max_len = DTA_OLD_MAX_WIDTH;
+    return dta_write_string(row, value, value_len, max_len);
 }
 
 static readstat_error_t dta_113_write_missing_numeric(void *row, const readstat_variable_t *var) {
@@ -1060,15 +1069,15 @@ static readstat_error_t dta_old_write_missing_numeric(void *row, const readstat_
 }
 
 static readstat_error_t dta_111_write_missing_string(void *row, const readstat_variable_t *var) {
-    return dta_111_write_string(row, var, NULL);
+    return dta_111_write_string(row, var, NULL, 0);
 }
 
 static readstat_error_t dta_117_write_missing_string(void *row, const readstat_variable_t *var) {
-    return dta_117_write_string(row, var, NULL);
+    return dta_117_write_string(row, var, NULL, 0);
 }
 
 static readstat_error_t dta_old_write_missing_string(void *row, const readstat_variable_t *var) {
-    return dta_old_write_string(row, var, NULL);
+    return dta_old_write_string(row, var, NULL, 0);
 }
 
 static readstat_error_t dta_113_write_missing_tagged(void *row, const readstat_variable_t *var, char tag) {
@@ -1129,10 +1138,42 @@ cleanup:
     return error;
 }
 
+/* Fills in the observation count, and the offsets in the map that follow
+ * the data, once the number of rows is known */
+static readstat_error_t dta_patch_row_count(void *writer_ctx) {
+    readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
+    dta_ctx_t *ctx = writer->module_ctx;
+    readstat_error_t error = READSTAT_OK;
+    int32_t nobs = writer->row_count;
+
+    ctx->nobs = writer->row_count;
+
+    if (!ctx->file_is_xmlish) {
+        return readstat_write_bytes_at(writer, offsetof(dta_header_t, nobs), &nobs, sizeof(int32_t));
+    }
+
+    if (writer->version >= 118) {
+        int64_t nobs64 = nobs;
+        error = readstat_write_bytes_at(writer, ctx->nobs_offset, &nobs64, sizeof(int64_t));
+    } else {
+        error = readstat_write_bytes_at(writer, ctx->nobs_offset, &nobs, sizeof(int32_t));
+    }
+    if (error != READSTAT_OK)
+        return error;
+
+    uint64_t map[14];
+    dta_compute_map(writer, ctx, map);
+
+    return readstat_write_bytes_at(writer, ctx->map_offset + sizeof("<map>")-1, map, sizeof(map));
+}
+
 readstat_error_t readstat_begin_writing_dta(readstat_writer_t *writer, void *user_ctx, long row_count) {
     writer->row_count = row_count;
     writer->user_ctx = user_ctx;
 
+    if (writer->compression != READSTAT_COMPRESS_NONE)
+        return READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
+
     if (writer->version == 0)
         writer->version = DTA_DEFAULT_FILE_VERSION;
 
@@ -1171,6 +1212,7 @@ readstat_error_t readstat_begin_writing_dta(readstat_writer_t *writer, void *use
 
     writer->callbacks.begin_data = &dta_begin_data;
     writer->callbacks.end_data = &dta_end_data;
+    writer->callbacks.patch_row_count = &dta_patch_row_count;
     writer->initialized = 1;
 
     return READSTAT_OK;
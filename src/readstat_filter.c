@@ -0,0 +1,70 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "readstat.h"
+#include "readstat_filter.h"
+
+readstat_error_t readstat_column_filter_add_indices(readstat_column_filter_t *filter,
+        const int *indices, int indices_count) {
+    int *new_indices = realloc(filter->indices,
+            (filter->indices_count + indices_count) * sizeof(int));
+    if (new_indices == NULL && indices_count > 0)
+        return READSTAT_ERROR_MALLOC;
+
+    filter->indices = new_indices;
+    memcpy(&filter->indices[filter->indices_count], indices, indices_count * sizeof(int));
+    filter->indices_count += indices_count;
+
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_column_filter_add_names(readstat_column_filter_t *filter,
+        const char * const *names, int names_count) {
+    int i;
+    char **new_names = realloc(filter->names,
+            (filter->names_count + names_count) * sizeof(char *));
+    if (new_names == NULL && names_count > 0)
+        return READSTAT_ERROR_MALLOC;
+
+    filter->names = new_names;
+    for (i=0; i<names_count; i++) {
+        if ((filter->names[filter->names_count] = strdup(names[i])) == NULL)
+            return READSTAT_ERROR_MALLOC;
+        filter->names_count++;
+    }
+
+    return READSTAT_OK;
+}
+
+void readstat_column_filter_free(readstat_column_filter_t *filter) {
+    int i;
+    if (filter == NULL)
+        return;
+
+    for (i=0; i<filter->names_count; i++) {
+        free(filter->names[i]);
+    }
+    free(filter->names);
+    free(filter->indices);
+    free(filter);
+}
+
+int readstat_column_filter_selects(const readstat_column_filter_t *filter,
+        int index, const char *name) {
+    int i;
+    if (filter == NULL)
+        return 1;
+
+    for (i=0; i<filter->indices_count; i++) {
+        if (filter->indices[i] == index)
+            return 1;
+    }
+    if (name) {
+        for (i=0; i<filter->names_count; i++) {
+            if (strcmp(filter->names[i], name) == 0)
+                return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,20 @@
+
+/* Set of variables selected with readstat_set_column_filter() and
+ * readstat_set_column_filter_names(). A variable is selected if either its
+ * index or its name appears in the filter. */
+typedef struct readstat_column_filter_s {
+    int                *indices;
+    int                 indices_count;
+    char              **names;
+    int                 names_count;
+} readstat_column_filter_t;
+
+readstat_error_t readstat_column_filter_add_indices(readstat_column_filter_t *filter,
+        const int *indices, int indices_count);
+readstat_error_t readstat_column_filter_add_names(readstat_column_filter_t *filter,
+        const char * const *names, int names_count);
+void readstat_column_filter_free(readstat_column_filter_t *filter);
+
+/* A NULL filter selects every variable */
+int readstat_column_filter_selects(const readstat_column_filter_t *filter,
+        int index, const char *name);
@@ -0,0 +1,193 @@
+
+#if !defined _WIN32
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "readstat.h"
+#include "readstat_io_mmap.h"
+
+#if defined _AIX
+#define MMAP_OPEN_OPTIONS O_RDONLY | O_LARGEFILE
+#else
+#define MMAP_OPEN_OPTIONS O_RDONLY
+#endif
+
+int mmap_open_handler(const char *path, void *io_ctx) {
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+    struct stat st;
+
+    int fd = open(path, MMAP_OPEN_OPTIONS);
+    if (fd == -1)
+        return -1;
+
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    ctx->fd = fd;
+    ctx->len = st.st_size;
+    ctx->pos = 0;
+    ctx->data = NULL;
+
+    if (ctx->len) {
+        void *data = mmap(NULL, ctx->len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            ctx->fd = -1;
+            return -1;
+        }
+        ctx->data = data;
+    }
+
+    return fd;
+}
+
+int mmap_close_handler(void *io_ctx) {
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+    int retval = 0;
+    if (ctx->data) {
+        munmap((void *)ctx->data, ctx->len);
+        ctx->data = NULL;
+    }
+    if (ctx->fd != -1) {
+        retval = close(ctx->fd);
+        ctx->fd = -1;
+    }
+    return retval;
+}
+
+readstat_off_t mmap_seek_handler(readstat_off_t offset,
+        readstat_io_flags_t whence, void *io_ctx) {
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+    readstat_off_t newpos = -1;
+    if (whence == READSTAT_SEEK_SET) {
+        newpos = offset;
+    } else if (whence == READSTAT_SEEK_CUR) {
+        newpos = ctx->pos + offset;
+    } else if (whence == READSTAT_SEEK_END) {
+        newpos = ctx->len + offset;
+    }
+
+    if (newpos < 0)
+        return -1;
+
+    ctx->pos = newpos;
+    return newpos;
+}
+
+ssize_t mmap_borrow_handler(const void **buf, size_t nbytes, void *io_ctx) {
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+    size_t bytes_left = 0;
+
+    if (ctx->pos < ctx->len)
+        bytes_left = ctx->len - ctx->pos;
+
+    if (nbytes > bytes_left)
+        nbytes = bytes_left;
+
+    *buf = ctx->data + ctx->pos;
+    ctx->pos += nbytes;
+    return nbytes;
+}
+
+ssize_t mmap_read_handler(void *buf, size_t nbytes, void *io_ctx) {
+    const void *src = NULL;
+    ssize_t bytes_read = mmap_borrow_handler(&src, nbytes, io_ctx);
+    if (bytes_read > 0)
+        memcpy(buf, src, bytes_read);
+    return bytes_read;
+}
+
+ssize_t mmap_pread_handler(void *buf, size_t nbytes, readstat_off_t offset, void *io_ctx) {
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+    size_t bytes_left = 0;
+
+    if (offset < 0)
+        return -1;
+
+    if (offset < ctx->len)
+        bytes_left = ctx->len - offset;
+
+    if (nbytes > bytes_left)
+        nbytes = bytes_left;
+
+    if (nbytes)
+        memcpy(buf, ctx->data + offset, nbytes);
+    return nbytes;
+}
+
+int mmap_advise_handler(readstat_off_t offset, readstat_off_t len,
+        readstat_io_advice_t advice, void *io_ctx) {
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+    int flag = MADV_NORMAL;
+    switch (advice) {
+        case READSTAT_ADVICE_NORMAL:
+            flag = MADV_NORMAL;
+            break;
+        case READSTAT_ADVICE_SEQUENTIAL:
+            flag = MADV_SEQUENTIAL;
+            break;
+        case READSTAT_ADVICE_RANDOM:
+            flag = MADV_RANDOM;
+            break;
+        case READSTAT_ADVICE_WILLNEED:
+            flag = MADV_WILLNEED;
+            break;
+        default:
+            return -1;
+    }
+
+    if (ctx->data == NULL || offset < 0 || offset >= ctx->len)
+        return 0;
+
+    if (len <= 0 || len > ctx->len - offset)
+        len = ctx->len - offset;
+
+    /* madvise wants a page-aligned start address */
+    long page_size = sysconf(_SC_PAGESIZE);
+    readstat_off_t aligned_offset = offset - offset % page_size;
+
+    return madvise((void *)(ctx->data + aligned_offset), len + (offset - aligned_offset), flag);
+}
+
+readstat_error_t mmap_update_handler(long file_size, 
+        readstat_progress_handler progress_handler, void *user_ctx,
+        void *io_ctx) {
+    if (!progress_handler)
+        return READSTAT_OK;
+
+    mmap_io_ctx_t *ctx = (mmap_io_ctx_t *)io_ctx;
+
+    if (progress_handler(1.0 * ctx->pos / file_size, user_ctx))
+        return READSTAT_ERROR_USER_ABORT;
+
+    return READSTAT_OK;
+}
+
+readstat_error_t mmap_io_init(readstat_parser_t *parser) {
+    mmap_io_ctx_t *io_ctx = calloc(1, sizeof(mmap_io_ctx_t));
+    if (io_ctx == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    io_ctx->fd = -1;
+
+    readstat_set_open_handler(parser, mmap_open_handler);
+    readstat_set_close_handler(parser, mmap_close_handler);
+    readstat_set_seek_handler(parser, mmap_seek_handler);
+    readstat_set_read_handler(parser, mmap_read_handler);
+    readstat_set_update_handler(parser, mmap_update_handler);
+    readstat_set_borrow_handler(parser, mmap_borrow_handler);
+    readstat_set_advise_handler(parser, mmap_advise_handler);
+    readstat_set_pread_handler(parser, mmap_pread_handler);
+    readstat_set_io_ctx(parser, (void*) io_ctx);
+
+    return READSTAT_OK;
+}
+
+#endif
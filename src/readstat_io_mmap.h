@@ -0,0 +1,17 @@
+
+typedef struct mmap_io_ctx_s {
+    int               fd;
+    const char       *data;
+    size_t            len;
+    readstat_off_t    pos;
+} mmap_io_ctx_t;
+
+int mmap_open_handler(const char *path, void *io_ctx);
+int mmap_close_handler(void *io_ctx);
+readstat_off_t mmap_seek_handler(readstat_off_t offset, readstat_io_flags_t whence, void *io_ctx);
+ssize_t mmap_read_handler(void *buf, size_t nbytes, void *io_ctx);
+ssize_t mmap_borrow_handler(const void **buf, size_t nbytes, void *io_ctx);
+ssize_t mmap_pread_handler(void *buf, size_t nbytes, readstat_off_t offset, void *io_ctx);
+int mmap_advise_handler(readstat_off_t offset, readstat_off_t len, readstat_io_advice_t advice, void *io_ctx);
+readstat_error_t mmap_update_handler(long file_size, readstat_progress_handler progress_handler, void *user_ctx, void *io_ctx);
+readstat_error_t mmap_io_init(readstat_parser_t *parser);
@@ -22,6 +22,7 @@
 int unistd_open_handler(const char *path, void *io_ctx) {
     int fd = open(path, UNISTD_OPEN_OPTIONS);
     ((unistd_io_ctx_t*) io_ctx)->fd = fd;
+    ((unistd_io_ctx_t*) io_ctx)->pos = 0;
     return fd;
 }
 
@@ -49,27 +50,37 @@ readstat_off_t unistd_seek_handler(readstat_off_t offset,
         default:
             return -1;
     }
-    int fd = ((unistd_io_ctx_t*) io_ctx)->fd;
-    return lseek(fd, offset, flag);
+    unistd_io_ctx_t *ctx = (unistd_io_ctx_t*) io_ctx;
+    readstat_off_t pos = lseek(ctx->fd, offset, flag);
+    if (pos != -1)
+        ctx->pos = pos;
+    return pos;
 }
 
 ssize_t unistd_read_handler(void *buf, size_t nbyte, void *io_ctx) {
-    int fd = ((unistd_io_ctx_t*) io_ctx)->fd;
-    ssize_t out = read(fd, buf, nbyte);
+    unistd_io_ctx_t *ctx = (unistd_io_ctx_t*) io_ctx;
+    ssize_t out = read(ctx->fd, buf, nbyte);
+    if (out > 0)
+        ctx->pos += out;
     return out;
 }
 
+#if !defined _WIN32
+ssize_t unistd_pread_handler(void *buf, size_t nbyte, readstat_off_t offset, void *io_ctx) {
+    int fd = ((unistd_io_ctx_t*) io_ctx)->fd;
+    return pread(fd, buf, nbyte, offset);
+}
+#endif
+
 readstat_error_t unistd_update_handler(long file_size, 
         readstat_progress_handler progress_handler, void *user_ctx,
         void *io_ctx) {
     if (!progress_handler)
         return READSTAT_OK;
 
-    int fd = ((unistd_io_ctx_t*) io_ctx)->fd;
-    long current_offset = lseek(fd, 0, SEEK_CUR);
-
-    if (current_offset == -1)
-        return READSTAT_ERROR_SEEK;
+    /* The read and seek handlers keep track of the offset, so this costs no
+     * system call however often the readers ask */
+    readstat_off_t current_offset = ((unistd_io_ctx_t*) io_ctx)->pos;
 
     if (progress_handler(1.0 * current_offset / file_size, user_ctx))
         return READSTAT_ERROR_USER_ABORT;
@@ -83,6 +94,9 @@ void unistd_io_init(readstat_parser_t *parser) {
     readstat_set_seek_handler(parser, unistd_seek_handler);
     readstat_set_read_handler(parser, unistd_read_handler);
     readstat_set_update_handler(parser, unistd_update_handler);
+#if !defined _WIN32
+    readstat_set_pread_handler(parser, unistd_pread_handler);
+#endif
 
     unistd_io_ctx_t *io_ctx = calloc(1, sizeof(unistd_io_ctx_t));
     io_ctx->fd = -1;
@@ -1,12 +1,16 @@
 
 typedef struct unistd_io_ctx_s {
     int               fd;
+    readstat_off_t    pos;
 } unistd_io_ctx_t;
 
 int unistd_open_handler(const char *path, void *io_ctx);
 int unistd_close_handler(void *io_ctx);
 readstat_off_t unistd_seek_handler(readstat_off_t offset, readstat_io_flags_t whence, void *io_ctx);
 ssize_t unistd_read_handler(void *buf, size_t nbytes, void *io_ctx);
+#if !defined _WIN32
+ssize_t unistd_pread_handler(void *buf, size_t nbyte, readstat_off_t offset, void *io_ctx);
+#endif
 readstat_error_t unistd_update_handler(long file_size, readstat_progress_handler progress_handler, void *user_ctx, void *io_ctx);
 void unistd_io_init(readstat_parser_t *parser);
 void unistd_io_init_rdata(rdata_parser_t *parser);
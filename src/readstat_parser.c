@@ -1,13 +1,21 @@
 
 #include <stdlib.h>
+#include <limits.h>
 #include "readstat.h"
 #include "readstat_io_unistd.h"
+#include "readstat_io_mmap.h"
+#include "readstat_batch.h"
+#include "readstat_filter.h"
+#include "readstat_progress.h"
 
 readstat_parser_t *readstat_parser_init() {
     readstat_parser_t *parser = calloc(1, sizeof(readstat_parser_t));
     parser->io = calloc(1, sizeof(readstat_io_t));
+    parser->progress_granularity = READSTAT_DEFAULT_PROGRESS_GRANULARITY;
     unistd_io_init(parser);
     parser->output_encoding = "UTF-8";
+    parser->batch_size = READSTAT_DEFAULT_BATCH_SIZE;
+    parser->thread_count = 1;
     return parser;
 }
 
@@ -15,6 +23,7 @@ void readstat_parser_free(readstat_parser_t *parser) {
     if (parser) {
         if (parser->io)
             free(parser->io);
+        readstat_column_filter_free(parser->column_filter);
         free(parser);
     }
 }
@@ -39,6 +48,11 @@ readstat_error_t readstat_set_value_handler(readstat_parser_t *parser, readstat_
     return READSTAT_OK;
 }
 
+readstat_error_t readstat_set_batch_handler(readstat_parser_t *parser, readstat_batch_handler batch_handler) {
+    parser->batch_handler = batch_handler;
+    return READSTAT_OK;
+}
+
 readstat_error_t readstat_set_value_label_handler(readstat_parser_t *parser, readstat_value_label_handler label_handler) {
     parser->value_label_handler = label_handler;
     return READSTAT_OK;
@@ -54,6 +68,14 @@ readstat_error_t readstat_set_progress_handler(readstat_parser_t *parser, readst
     return READSTAT_OK;
 }
 
+readstat_error_t readstat_set_progress_granularity(readstat_parser_t *parser, double granularity) {
+    if (granularity < 0.0 || granularity > 1.0)
+        return READSTAT_ERROR_PARSE;
+
+    parser->progress_granularity = granularity;
+    return READSTAT_OK;
+}
+
 readstat_error_t readstat_set_fweight_handler(readstat_parser_t *parser, readstat_fweight_handler fweight_handler) {
     parser->fweight_handler = fweight_handler;
     return READSTAT_OK;
@@ -76,6 +98,8 @@ readstat_error_t readstat_set_seek_handler(readstat_parser_t *parser, readstat_s
 
 readstat_error_t readstat_set_read_handler(readstat_parser_t *parser, readstat_read_handler read_handler) {
     parser->io->read = read_handler;
+    /* The default pread handler would bypass a custom read handler */
+    parser->io->pread = NULL;
     return READSTAT_OK;
 }
 
@@ -84,6 +108,21 @@ readstat_error_t readstat_set_update_handler(readstat_parser_t *parser, readstat
     return READSTAT_OK;
 }
 
+readstat_error_t readstat_set_borrow_handler(readstat_parser_t *parser, readstat_borrow_handler borrow_handler) {
+    parser->io->borrow = borrow_handler;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_set_advise_handler(readstat_parser_t *parser, readstat_advise_handler advise_handler) {
+    parser->io->advise = advise_handler;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_set_pread_handler(readstat_parser_t *parser, readstat_pread_handler pread_handler) {
+    parser->io->pread = pread_handler;
+    return READSTAT_OK;
+}
+
 readstat_error_t readstat_set_io_ctx(readstat_parser_t *parser, void *io_ctx) {
     if (!parser->io->external_io)
         free(parser->io->io_ctx);
@@ -94,6 +133,15 @@ readstat_error_t readstat_set_io_ctx(readstat_parser_t *parser, void *io_ctx) {
     return READSTAT_OK;
 }
 
+readstat_error_t readstat_set_mmap_io(readstat_parser_t *parser) {
+#if !defined _WIN32
+    return mmap_io_init(parser);
+#else
+    /* No mmap to open files with */
+    return READSTAT_ERROR_OPEN;
+#endif
+}
+
 readstat_error_t readstat_set_file_character_encoding(readstat_parser_t *parser, const char *encoding) {
     parser->input_encoding = encoding;
     return READSTAT_OK;
@@ -109,9 +157,42 @@ readstat_error_t readstat_set_row_limit(readstat_parser_t *parser, long row_limi
     return READSTAT_OK;
 }
 
+readstat_error_t readstat_set_row_offset(readstat_parser_t *parser, long row_offset) {
+    if (row_offset < 0)
+        return READSTAT_ERROR_PARSE;
+
+    parser->row_offset = row_offset;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_set_thread_count(readstat_parser_t *parser, int thread_count) {
+    if (thread_count < 1)
+        return READSTAT_ERROR_PARSE;
+
+    parser->thread_count = thread_count;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_set_string_dictionary(readstat_parser_t *parser, long max_entries) {
+    if (max_entries < 0 || max_entries > INT32_MAX)
+        return READSTAT_ERROR_PARSE;
+
+    parser->string_dictionary_max = max_entries;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_set_batch_size(readstat_parser_t *parser, long batch_size) {
+    if (batch_size < 1 || batch_size > INT_MAX)
+        return READSTAT_ERROR_PARSE;
+
+    parser->batch_size = batch_size;
+    return READSTAT_OK;
+}
+
 rdata_parser_t *rdata_parser_init() {
     rdata_parser_t *parser = calloc(1, sizeof(rdata_parser_t));
     parser->io = calloc(1, sizeof(readstat_io_t));
+    parser->progress_granularity = READSTAT_DEFAULT_PROGRESS_GRANULARITY;
     unistd_io_init_rdata(parser);
     return parser;
 }
@@ -154,6 +235,19 @@ readstat_error_t rdata_set_error_handler(rdata_parser_t *parser, readstat_error_
     return READSTAT_OK;
 }
 
+readstat_error_t rdata_set_progress_handler(rdata_parser_t *parser, readstat_progress_handler progress_handler) {
+    parser->progress_handler = progress_handler;
+    return READSTAT_OK;
+}
+
+readstat_error_t rdata_set_progress_granularity(rdata_parser_t *parser, double granularity) {
+    if (granularity < 0.0 || granularity > 1.0)
+        return READSTAT_ERROR_PARSE;
+
+    parser->progress_granularity = granularity;
+    return READSTAT_OK;
+}
+
 readstat_error_t rdata_set_open_handler(rdata_parser_t *parser, readstat_open_handler open_handler) {
     parser->io->open = open_handler;
     return READSTAT_OK;
@@ -188,3 +282,26 @@ readstat_error_t rdata_set_io_ctx(rdata_parser_t *parser, void *io_ctx) {
 
     return READSTAT_OK;
 }
+
+static readstat_column_filter_t *readstat_get_column_filter(readstat_parser_t *parser) {
+    if (parser->column_filter == NULL)
+        parser->column_filter = calloc(1, sizeof(readstat_column_filter_t));
+
+    return parser->column_filter;
+}
+
+readstat_error_t readstat_set_column_filter(readstat_parser_t *parser, const int *indices, int indices_count) {
+    readstat_column_filter_t *filter = readstat_get_column_filter(parser);
+    if (filter == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    return readstat_column_filter_add_indices(filter, indices, indices_count);
+}
+
+readstat_error_t readstat_set_column_filter_names(readstat_parser_t *parser, const char * const *names, int names_count) {
+    readstat_column_filter_t *filter = readstat_get_column_filter(parser);
+    if (filter == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    return readstat_column_filter_add_names(filter, names, names_count);
+}
@@ -0,0 +1,232 @@
+
+#include <stdlib.h>
+
+#include "readstat.h"
+#include "readstat_pipeline.h"
+
+#if HAVE_PTHREAD_H
+
+#include <pthread.h>
+
+#define READSTAT_JOB_FREE     0
+#define READSTAT_JOB_PENDING  1
+#define READSTAT_JOB_DONE     2
+
+typedef struct readstat_pipeline_worker_s {
+    struct readstat_pipeline_s *pipeline;
+    int                         index;
+    pthread_t                   thread;
+    int                         started;
+} readstat_pipeline_worker_t;
+
+struct readstat_pipeline_s {
+    readstat_pipeline_work_handler      work_handler;
+    readstat_pipeline_deliver_handler   deliver_handler;
+    void                               *ctx;
+
+    void                              **jobs;
+    int                                *states;
+    readstat_error_t                   *results;
+    int                                 jobs_count;
+
+    /* Monotonic job counters; job n lives in slot n % jobs_count */
+    long                                head;
+    long                                next;
+    long                                tail;
+    int                                 shutdown;
+
+    readstat_pipeline_worker_t         *workers;
+    int                                 workers_count;
+
+    pthread_mutex_t                     lock;
+    pthread_cond_t                      work_ready;
+    pthread_cond_t                      work_done;
+};
+
+static void *readstat_pipeline_worker_main(void *arg) {
+    readstat_pipeline_worker_t *worker = (readstat_pipeline_worker_t *)arg;
+    readstat_pipeline_t *pipeline = worker->pipeline;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (1) {
+        while (!pipeline->shutdown && pipeline->next == pipeline->tail)
+            pthread_cond_wait(&pipeline->work_ready, &pipeline->lock);
+
+        if (pipeline->shutdown)
+            break;
+
+        int slot = pipeline->next++ % pipeline->jobs_count;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        readstat_error_t retval = pipeline->work_handler(pipeline->jobs[slot],
+                worker->index, pipeline->ctx);
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->results[slot] = retval;
+        pipeline->states[slot] = READSTAT_JOB_DONE;
+        pthread_cond_broadcast(&pipeline->work_done);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+
+    return NULL;
+}
+
+static readstat_error_t readstat_pipeline_deliver_oldest(readstat_pipeline_t *pipeline) {
+    int slot = pipeline->head % pipeline->jobs_count;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (pipeline->states[slot] != READSTAT_JOB_DONE)
+        pthread_cond_wait(&pipeline->work_done, &pipeline->lock);
+    pthread_mutex_unlock(&pipeline->lock);
+
+    readstat_error_t retval = pipeline->deliver_handler(pipeline->jobs[slot],
+            pipeline->results[slot], pipeline->ctx);
+
+    pipeline->states[slot] = READSTAT_JOB_FREE;
+    pipeline->head++;
+
+    return retval;
+}
+
+readstat_pipeline_t *readstat_pipeline_init(int workers_count, void **jobs, int jobs_count,
+        readstat_pipeline_work_handler work_handler,
+        readstat_pipeline_deliver_handler deliver_handler, void *ctx) {
+    readstat_pipeline_t *pipeline = NULL;
+    int i;
+
+    if (workers_count < 1 || jobs_count < 1)
+        return NULL;
+
+    if ((pipeline = calloc(1, sizeof(readstat_pipeline_t))) == NULL)
+        return NULL;
+
+    pipeline->work_handler = work_handler;
+    pipeline->deliver_handler = deliver_handler;
+    pipeline->ctx = ctx;
+    pipeline->jobs = jobs;
+    pipeline->jobs_count = jobs_count;
+
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->work_ready, NULL);
+    pthread_cond_init(&pipeline->work_done, NULL);
+
+    if ((pipeline->states = calloc(jobs_count, sizeof(int))) == NULL)
+        goto error;
+
+    if ((pipeline->results = calloc(jobs_count, sizeof(readstat_error_t))) == NULL)
+        goto error;
+
+    if ((pipeline->workers = calloc(workers_count, sizeof(readstat_pipeline_worker_t))) == NULL)
+        goto error;
+
+    for (i=0; i<workers_count; i++) {
+        readstat_pipeline_worker_t *worker = &pipeline->workers[i];
+        worker->pipeline = pipeline;
+        worker->index = i;
+        if (pthread_create(&worker->thread, NULL, &readstat_pipeline_worker_main, worker) != 0)
+            goto error;
+
+        worker->started = 1;
+        pipeline->workers_count++;
+    }
+
+    return pipeline;
+
+error:
+    readstat_pipeline_free(pipeline);
+    return NULL;
+}
+
+readstat_error_t readstat_pipeline_acquire(readstat_pipeline_t *pipeline, void **out_job) {
+    readstat_error_t retval = READSTAT_OK;
+
+    while (pipeline->tail - pipeline->head == pipeline->jobs_count) {
+        if ((retval = readstat_pipeline_deliver_oldest(pipeline)) != READSTAT_OK)
+            return retval;
+    }
+
+    *out_job = pipeline->jobs[pipeline->tail % pipeline->jobs_count];
+
+    return retval;
+}
+
+void readstat_pipeline_submit(readstat_pipeline_t *pipeline) {
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->states[pipeline->tail % pipeline->jobs_count] = READSTAT_JOB_PENDING;
+    pipeline->tail++;
+    pthread_cond_signal(&pipeline->work_ready);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+readstat_error_t readstat_pipeline_deliver(readstat_pipeline_t *pipeline) {
+    if (pipeline->head == pipeline->tail)
+        return READSTAT_OK;
+
+    return readstat_pipeline_deliver_oldest(pipeline);
+}
+
+readstat_error_t readstat_pipeline_drain(readstat_pipeline_t *pipeline) {
+    readstat_error_t retval = READSTAT_OK;
+
+    while (pipeline->head < pipeline->tail) {
+        if ((retval = readstat_pipeline_deliver_oldest(pipeline)) != READSTAT_OK)
+            break;
+    }
+
+    return retval;
+}
+
+void readstat_pipeline_free(readstat_pipeline_t *pipeline) {
+    int i;
+    if (pipeline == NULL)
+        return;
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->shutdown = 1;
+    pthread_cond_broadcast(&pipeline->work_ready);
+    pthread_mutex_unlock(&pipeline->lock);
+
+    if (pipeline->workers) {
+        for (i=0; i<pipeline->workers_count; i++) {
+            if (pipeline->workers[i].started)
+                pthread_join(pipeline->workers[i].thread, NULL);
+        }
+        free(pipeline->workers);
+    }
+
+    pthread_mutex_destroy(&pipeline->lock);
+    pthread_cond_destroy(&pipeline->work_ready);
+    pthread_cond_destroy(&pipeline->work_done);
+
+    free(pipeline->states);
+    free(pipeline->results);
+    free(pipeline);
+}
+
+#else
+
+readstat_pipeline_t *readstat_pipeline_init(int workers_count, void **jobs, int jobs_count,
+        readstat_pipeline_work_handler work_handler,
+        readstat_pipeline_deliver_handler deliver_handler, void *ctx) {
+    return NULL;
+}
+
+readstat_error_t readstat_pipeline_acquire(readstat_pipeline_t *pipeline, void **out_job) {
+    return READSTAT_ERROR_PARSE;
+}
+
+void readstat_pipeline_submit(readstat_pipeline_t *pipeline) {
+}
+
+readstat_error_t readstat_pipeline_deliver(readstat_pipeline_t *pipeline) {
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_pipeline_drain(readstat_pipeline_t *pipeline) {
+    return READSTAT_OK;
+}
+
+void readstat_pipeline_free(readstat_pipeline_t *pipeline) {
+}
+
+#endif
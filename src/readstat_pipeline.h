@@ -0,0 +1,31 @@
+
+/* A pool of worker threads that decode jobs out of order while the calling
+ * thread delivers the results in the order the jobs were submitted. Jobs are
+ * caller-owned buffers that cycle through a fixed ring: the caller acquires a
+ * free job, fills it in and submits it; the work handler decodes it on some
+ * worker thread; and the deliver handler is then called on the caller's
+ * thread, oldest job first. */
+
+typedef readstat_error_t (*readstat_pipeline_work_handler)(void *job, int worker_index, void *ctx);
+typedef readstat_error_t (*readstat_pipeline_deliver_handler)(void *job, readstat_error_t work_retval, void *ctx);
+
+typedef struct readstat_pipeline_s readstat_pipeline_t;
+
+/* Returns NULL if threads are unavailable on this platform */
+readstat_pipeline_t *readstat_pipeline_init(int workers_count, void **jobs, int jobs_count,
+        readstat_pipeline_work_handler work_handler,
+        readstat_pipeline_deliver_handler deliver_handler, void *ctx);
+
+/* Delivers finished jobs until a slot is free, then returns it in *out_job.
+ * Acquiring again without submitting returns the same job. */
+readstat_error_t readstat_pipeline_acquire(readstat_pipeline_t *pipeline, void **out_job);
+void readstat_pipeline_submit(readstat_pipeline_t *pipeline);
+
+/* Waits for and delivers the oldest submitted job, if any */
+readstat_error_t readstat_pipeline_deliver(readstat_pipeline_t *pipeline);
+
+/* Waits for and delivers every submitted job */
+readstat_error_t readstat_pipeline_drain(readstat_pipeline_t *pipeline);
+
+/* Stops the workers without delivering outstanding jobs */
+void readstat_pipeline_free(readstat_pipeline_t *pipeline);
@@ -6,6 +6,8 @@
 #include "CKHashTable.h"
 #include "readstat_convert.h"
 #include "readstat_por.h"
+#include "readstat_batch.h"
+#include "readstat_dictionary.h"
 
 int8_t por_ascii_lookup[256] = {
     0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -80,13 +82,16 @@ void por_ctx_free(por_ctx_t *ctx) {
         for (i=0; i<ctx->var_count; i++) {
             if (ctx->varinfo[i].label)
                 free(ctx->varinfo[i].label);
+            readstat_dictionary_free(ctx->varinfo[i].dictionary);
         }
         free(ctx->varinfo);
     }
     if (ctx->var_dict)
         ck_hash_table_free(ctx->var_dict);
     if (ctx->converter)
-        iconv_close(ctx->converter);
+        readstat_converter_close(ctx->converter);
+    if (ctx->batch)
+        readstat_batch_free(ctx->batch);
     free(ctx);
 }
 
@@ -1,4 +1,6 @@
 
+#define POR_READ_BUFFER_SIZE    65536
+
 extern int8_t   por_ascii_lookup[256];
 extern uint16_t por_unicode_lookup[256];
 
@@ -8,14 +10,20 @@ typedef struct por_ctx_s {
     readstat_variable_handler       variable_handler;
     readstat_fweight_handler        fweight_handler;
     readstat_value_handler          value_handler;
+    struct readstat_batch_s        *batch;
     readstat_value_label_handler    value_label_handler;
     readstat_error_handler          error_handler;
     readstat_progress_handler       progress_handler;
     size_t                          file_size;
+    double                          next_progress;
+    double                          progress_granularity;
     void                           *user_ctx;
 
     int            pos;
     readstat_io_t *io;
+    unsigned char  read_buffer[POR_READ_BUFFER_SIZE];
+    size_t         read_buffer_pos;
+    size_t         read_buffer_len;
     char           space;
     long           num_spaces;
     time_t         timestamp;
@@ -23,7 +31,7 @@ typedef struct por_ctx_s {
     char           fweight_name[9];
     uint16_t       byte2unicode[256];
     size_t         base30_precision;
-    iconv_t        converter;
+    struct readstat_converter_s *converter;
     unsigned char *string_buffer;
     size_t         string_buffer_len;
     int            labels_offset;
@@ -31,6 +39,7 @@ typedef struct por_ctx_s {
     int            var_count;
     int            var_offset;
     int            row_limit;
+    int            row_offset;
     spss_varinfo_t *varinfo;
     ck_hash_table_t *var_dict;
 } por_ctx_t;
@@ -19,8 +19,13 @@
 #include "readstat_spss.h"
 #include "readstat_iconv.h"
 #include "readstat_convert.h"
+#include "readstat_progress.h"
 #include "CKHashTable.h"
 #include "readstat_por.h"
+#include "readstat_batch.h"
+#include "readstat_dictionary.h"
+#include "readstat_filter.h"
+#include "readstat_variable.h"
 
 #define POR_LINE_LENGTH         80
 #define POR_LABEL_NAME_PREFIX   "labels"
@@ -30,31 +35,64 @@ static readstat_error_t read_string(por_ctx_t *ctx, char *data, size_t len);
 
 static readstat_error_t por_update_progress(por_ctx_t *ctx) {
     readstat_io_t *io = ctx->io;
-    return io->update(ctx->file_size, ctx->progress_handler, ctx->user_ctx, io->io_ctx);
+    return readstat_update_progress(io, ctx->file_size, ctx->progress_handler, ctx->user_ctx,
+            ctx->progress_granularity, &ctx->next_progress);
 }
 
-static ssize_t read_bytes(por_ctx_t *ctx, void *dst, size_t len) {
-    char *dst_pos = (char *)dst;
+static ssize_t fill_read_buffer(por_ctx_t *ctx) {
     readstat_io_t *io = ctx->io;
-    char byte;
+    ssize_t bytes_read = io->read(ctx->read_buffer, sizeof(ctx->read_buffer), io->io_ctx);
+    if (bytes_read == -1)
+        return -1;
+
+    ctx->read_buffer_pos = 0;
+    ctx->read_buffer_len = bytes_read;
+    return bytes_read;
+}
+
+static ssize_t read_raw_byte(por_ctx_t *ctx, unsigned char *byte) {
+    if (ctx->read_buffer_pos == ctx->read_buffer_len) {
+        ssize_t bytes_read = fill_read_buffer(ctx);
+        if (bytes_read <= 0)
+            return bytes_read;
+    }
+    *byte = ctx->read_buffer[ctx->read_buffer_pos++];
+    return 1;
+}
+
+/* Reads len bytes of logical content, i.e. with line breaks stripped and
+ * short lines padded out to POR_LINE_LENGTH. Input is pulled from the IO
+ * layer in POR_READ_BUFFER_SIZE blocks and copied out a line segment at a
+ * time. */
+static ssize_t read_bytes(por_ctx_t *ctx, void *dst, size_t len) {
+    unsigned char *dst_pos = (unsigned char *)dst;
+    unsigned char *dst_end = dst_pos + len;
+    unsigned char byte;
 
-    while (dst_pos < (char *)dst + len) {
+    while (dst_pos < dst_end) {
         if (ctx->num_spaces) {
-            *dst_pos++ = ctx->space;
-            ctx->num_spaces--;
+            size_t run = dst_end - dst_pos;
+            if (run > ctx->num_spaces)
+                run = ctx->num_spaces;
+            memset(dst_pos, ctx->space, run);
+            dst_pos += run;
+            ctx->num_spaces -= run;
             continue;
         }
-        ssize_t bytes_read = io->read(&byte, 1, io->io_ctx);
-        if (bytes_read == 0) {
-            break;
-        }
-        if (bytes_read == -1) {
-            return -1;
+        if (ctx->read_buffer_pos == ctx->read_buffer_len) {
+            ssize_t bytes_read = fill_read_buffer(ctx);
+            if (bytes_read == 0) {
+                break;
+            }
+            if (bytes_read == -1) {
+                return -1;
+            }
         }
+        byte = ctx->read_buffer[ctx->read_buffer_pos];
         if (byte == '\r' || byte == '\n') {
+            ctx->read_buffer_pos++;
             if (byte == '\r') {
-                bytes_read = io->read(&byte, 1, io->io_ctx);
-                if (bytes_read == 0 || bytes_read == -1 || byte != '\n')
+                if (read_raw_byte(ctx, &byte) != 1 || byte != '\n')
                     return -1;
             }
             ctx->num_spaces = POR_LINE_LENGTH - ctx->pos;
@@ -63,11 +101,24 @@ static ssize_t read_bytes(por_ctx_t *ctx, void *dst, size_t len) {
         } else if (ctx->pos == POR_LINE_LENGTH) {
             return -1;
         }
-        *dst_pos++ = byte;
-        ctx->pos++;
+
+        const unsigned char *src = &ctx->read_buffer[ctx->read_buffer_pos];
+        size_t max_run = ctx->read_buffer_len - ctx->read_buffer_pos;
+        size_t run = 0;
+        if (max_run > dst_end - dst_pos)
+            max_run = dst_end - dst_pos;
+        if (max_run > POR_LINE_LENGTH - ctx->pos)
+            max_run = POR_LINE_LENGTH - ctx->pos;
+        while (run < max_run && src[run] != '\r' && src[run] != '\n')
+            run++;
+
+        memcpy(dst_pos, src, run);
+        dst_pos += run;
+        ctx->read_buffer_pos += run;
+        ctx->pos += run;
     }
     
-    return (int)(dst_pos - (char *)dst);
+    return (int)(dst_pos - (unsigned char *)dst);
 }
 
 static uint16_t read_tag(por_ctx_t *ctx) {
@@ -463,6 +514,7 @@ static readstat_error_t read_value_label_record(por_ctx_t *ctx) {
                 goto cleanup;
             }
             value.v.string_value = string;
+            value.string_len = strlen(string);
         } else {
             if ((retval = read_double(ctx, &dval)) != READSTAT_OK) {
                 goto cleanup;
@@ -486,9 +538,12 @@ static readstat_error_t read_por_file_data(por_ctx_t *ctx) {
     char output_string[4*256+1];
     char error_buf[1024];
     readstat_error_t rs_retval = READSTAT_OK;
+    int skipped_rows = 0;
 
     while (1) {
         int finished = 0;
+        /* Rows before the offset are parsed but not converted or handed out */
+        int skip_row = (skipped_rows < ctx->row_offset);
         for (i=0; i<ctx->var_count; i++) {
             spss_varinfo_t *info = &ctx->varinfo[i];
             readstat_value_t value = { .type = info->type };
@@ -507,12 +562,20 @@ static readstat_error_t read_por_file_data(por_ctx_t *ctx) {
                         rs_retval = READSTAT_ERROR_PARSE;
                     goto cleanup;
                 }
-                rs_retval = readstat_convert(output_string, sizeof(output_string),
-                        input_string, strlen(input_string), ctx->converter);
+                if (info->skip || skip_row)
+                    continue;
+
+                if (info->dictionary) {
+                    rs_retval = readstat_dictionary_convert(info->dictionary,
+                            input_string, strlen(input_string), ctx->converter, &value);
+                } else {
+                    rs_retval = readstat_convert_len(output_string, sizeof(output_string),
+                            input_string, strlen(input_string), ctx->converter, &value.string_len);
+                    value.v.string_value = output_string;
+                }
                 if (rs_retval != READSTAT_OK) {
                     goto cleanup;
                 }
-                value.v.string_value = output_string;
             } else if (info->type == READSTAT_TYPE_DOUBLE) {
                 rs_retval = maybe_read_double(ctx, &value.v.double_value, &finished);
                 if (rs_retval != READSTAT_OK) {
@@ -527,6 +590,9 @@ static readstat_error_t read_por_file_data(por_ctx_t *ctx) {
                         rs_retval = READSTAT_ERROR_PARSE;
                     goto cleanup;
                 }
+                if (info->skip || skip_row)
+                    continue;
+
                 spss_tag_missing_double(&value, &info->missingness);
             }
             if (ctx->value_handler) {
@@ -535,10 +601,24 @@ static readstat_error_t read_por_file_data(por_ctx_t *ctx) {
                     goto cleanup;
                 }
             }
+            if (ctx->batch) {
+                if ((rs_retval = readstat_batch_put_value(ctx->batch, i, value)) != READSTAT_OK)
+                    goto cleanup;
+            }
 
         }
+        if (skip_row) {
+            skipped_rows++;
+            continue;
+        }
+
         ctx->obs_count++;
 
+        if (ctx->batch) {
+            if ((rs_retval = readstat_batch_end_row(ctx->batch)) != READSTAT_OK)
+                goto cleanup;
+        }
+
         rs_retval = por_update_progress(ctx);
         if (rs_retval != READSTAT_OK)
             break;
@@ -547,6 +627,9 @@ static readstat_error_t read_por_file_data(por_ctx_t *ctx) {
             break;
     }
 cleanup:
+    if (rs_retval == READSTAT_OK && ctx->batch) {
+        rs_retval = readstat_batch_flush(ctx->batch);
+    }
     return rs_retval;
 }
 
@@ -585,15 +668,29 @@ cleanup:
     return retval;
 }
 
+static void select_variables(readstat_parser_t *parser, por_ctx_t *ctx) {
+    int i;
+    for (i=0; i<ctx->var_count; i++) {
+        spss_varinfo_t *info = &ctx->varinfo[i];
+        info->index = i;
+        info->skip = !readstat_column_filter_selects(parser->column_filter,
+                i, spss_varinfo_name(info));
+    }
+}
+
 readstat_error_t handle_variables(por_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
+    readstat_variable_buffer_t buffer;
     int i;
     for (i=0; i<ctx->var_count; i++) {
         char label_name_buf[256];
         spss_varinfo_t *info = &ctx->varinfo[i];
         info->missingness = spss_missingness_for_info(info);
 
-        readstat_variable_t *variable = spss_init_variable_for_info(info);
+        if (info->skip)
+            continue;
+
+        readstat_variable_t *variable = spss_init_variable_for_info(info, &buffer);
 
         snprintf(label_name_buf, sizeof(label_name_buf), POR_LABEL_NAME_PREFIX "%d", info->labels_index);
 
@@ -605,8 +702,6 @@ readstat_error_t handle_variables(por_ctx_t *ctx) {
                     ctx->user_ctx);
         }
 
-        spss_free_variable(variable);
-
         if (cb_retval) {
             retval = READSTAT_ERROR_USER_ABORT;
             goto cleanup;
@@ -646,16 +741,16 @@ readstat_error_t readstat_parse_por(readstat_parser_t *parser, const char *path,
     ctx->value_label_handler = parser->value_label_handler;
     ctx->error_handler = parser->error_handler;
     ctx->progress_handler = parser->progress_handler;
+    ctx->progress_granularity = parser->progress_granularity;
     ctx->user_ctx = user_ctx;
     ctx->io = io;
     ctx->row_limit = parser->row_limit;
+    ctx->row_offset = parser->row_offset;
 
-    if (parser->output_encoding) {
-        if (strcmp(parser->output_encoding, "UTF-8") != 0)
-            ctx->converter = iconv_open(parser->output_encoding, "UTF-8");
+    if (parser->output_encoding && strcmp(parser->output_encoding, "UTF-8") != 0) {
+        ctx->converter = readstat_converter_open(parser->output_encoding, "UTF-8");
 
-        if (ctx->converter == (iconv_t)-1) {
-            ctx->converter = NULL;
+        if (ctx->converter == NULL) {
             retval = READSTAT_ERROR_UNSUPPORTED_CHARSET;
             goto cleanup;
         }
@@ -675,6 +770,10 @@ readstat_error_t readstat_parse_por(readstat_parser_t *parser, const char *path,
         retval = READSTAT_ERROR_SEEK;
         goto cleanup;
     }
+
+    if (io->advise) {
+        io->advise(0, 0, READSTAT_ADVICE_SEQUENTIAL, io->io_ctx);
+    }
     
     if (read_bytes(ctx, vanity, sizeof(vanity)) != sizeof(vanity)) {
         retval = READSTAT_ERROR_READ;
@@ -786,11 +885,45 @@ readstat_error_t readstat_parse_por(readstat_parser_t *parser, const char *path,
                     goto cleanup;
                 }
 
+                select_variables(parser, ctx);
+
                 retval = handle_variables(ctx);
                 if (retval != READSTAT_OK)
                     goto cleanup;
 
-                if (ctx->value_handler) {
+                if (parser->string_dictionary_max) {
+                    for (i=0; i<ctx->var_count; i++) {
+                        spss_varinfo_t *info = &ctx->varinfo[i];
+                        if (!info->skip && info->type == READSTAT_TYPE_STRING &&
+                                (info->dictionary = readstat_dictionary_init(parser->string_dictionary_max)) == NULL) {
+                            retval = READSTAT_ERROR_MALLOC;
+                            goto cleanup;
+                        }
+                    }
+                }
+
+                if (parser->batch_handler) {
+                    if ((ctx->batch = readstat_batch_init(parser->batch_handler, parser->batch_size,
+                                    ctx->var_count, ctx->user_ctx)) == NULL) {
+                        retval = READSTAT_ERROR_MALLOC;
+                        goto cleanup;
+                    }
+                    for (i=0; i<ctx->var_count; i++) {
+                        if (ctx->varinfo[i].skip)
+                            continue;
+
+                        retval = readstat_batch_add_column(ctx->batch, i, ctx->varinfo[i].type);
+                        if (retval != READSTAT_OK)
+                            goto cleanup;
+
+                        if (ctx->varinfo[i].dictionary &&
+                                (retval = readstat_batch_set_dictionary(ctx->batch, i,
+                                    ctx->varinfo[i].dictionary)) != READSTAT_OK)
+                            goto cleanup;
+                    }
+                }
+
+                if (ctx->value_handler || ctx->batch) {
                     retval = read_por_file_data(ctx);
                 }
                 goto cleanup;
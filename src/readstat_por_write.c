@@ -666,9 +666,9 @@ static readstat_error_t por_write_missing_string(void *row, const readstat_varia
     return por_write_double_value(row, var, 0);
 }
 
-static readstat_error_t por_write_string_value(void *row, const readstat_variable_t *var, const char *string) {
-    size_t len = strlen(string);
-    if (len == 0) {
+static readstat_error_t por_write_string_value(void *row, const readstat_variable_t *var,
+        const char *string, size_t len) {
+    if (string == NULL || len == 0) {
         string = " ";
         len = 1;
     }
@@ -681,7 +681,7 @@ static readstat_error_t por_write_string_value(void *row, const readstat_variabl
         return READSTAT_ERROR_WRITE;
     }
 
-    strncpy(((char *)row) + bytes_written, string, len);
+    memcpy(((char *)row) + bytes_written, string, len);
     return READSTAT_OK;
 }
 
@@ -704,6 +704,9 @@ readstat_error_t readstat_begin_writing_por(readstat_writer_t *writer, void *use
     writer->row_count = row_count;
     writer->user_ctx = user_ctx;
 
+    if (writer->compression != READSTAT_COMPRESS_NONE)
+        return READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
+
     writer->callbacks.variable_width = &por_variable_width;
     writer->callbacks.write_int8 = &por_write_int8_value;
     writer->callbacks.write_int16 = &por_write_int16_value;
@@ -0,0 +1,43 @@
+
+#include "readstat.h"
+#include "readstat_progress.h"
+
+typedef struct readstat_progress_throttle_s {
+    readstat_progress_handler   progress_handler;
+    void                       *user_ctx;
+    double                      granularity;
+    double                     *next_progress;
+} readstat_progress_throttle_t;
+
+static int readstat_throttle_progress(double progress, void *ctx) {
+    readstat_progress_throttle_t *throttle = (readstat_progress_throttle_t *)ctx;
+
+    if (progress < *throttle->next_progress)
+        return 0;
+
+    if (progress >= 1.0) {
+        /* Report the end of the file just once */
+        *throttle->next_progress = 2.0;
+    } else if (progress + throttle->granularity < 1.0) {
+        *throttle->next_progress = progress + throttle->granularity;
+    } else {
+        *throttle->next_progress = 1.0;
+    }
+
+    return throttle->progress_handler(progress, throttle->user_ctx);
+}
+
+readstat_error_t readstat_update_progress(readstat_io_t *io, long file_size,
+        readstat_progress_handler progress_handler, void *user_ctx,
+        double granularity, double *next_progress) {
+    if (!progress_handler)
+        return READSTAT_OK;
+
+    readstat_progress_throttle_t throttle;
+    throttle.progress_handler = progress_handler;
+    throttle.user_ctx = user_ctx;
+    throttle.granularity = granularity;
+    throttle.next_progress = next_progress;
+
+    return io->update(file_size, &readstat_throttle_progress, &throttle, io->io_ctx);
+}
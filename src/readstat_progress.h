@@ -0,0 +1,10 @@
+
+#define READSTAT_DEFAULT_PROGRESS_GRANULARITY  0.01
+
+/* Calls progress_handler through io->update, but only once progress has
+ * advanced by granularity since the last call, and once more on
+ * reaching the end of the file. *next_progress holds the threshold between
+ * calls and should start out at zero for each file. */
+readstat_error_t readstat_update_progress(readstat_io_t *io, long file_size,
+        readstat_progress_handler progress_handler, void *user_ctx,
+        double granularity, double *next_progress);
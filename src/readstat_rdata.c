@@ -19,6 +19,7 @@
 #endif
 
 #include "readstat_rdata.h"
+#include "readstat_progress.h"
 
 #define RDATA_ATOM_LEN 128
 
@@ -37,6 +38,7 @@ typedef struct rdata_ctx_s {
     rdata_text_value_handler     text_value_handler;
     rdata_text_value_handler     value_label_handler;
     readstat_error_handler       error_handler;
+    readstat_progress_handler    progress_handler;
     void                        *user_ctx;
 #ifdef HAVE_LZMA
     lzma_stream                 *lzma_strm;
@@ -45,6 +47,9 @@ typedef struct rdata_ctx_s {
     unsigned char               *strm_buffer;
     readstat_io_t               *io;
     size_t                       bytes_read;
+    readstat_off_t               file_size;
+    double                       next_progress;
+    double                       progress_granularity;
     
     rdata_atom_table_t          *atom_table;
     int                          class_is_posixct;
@@ -66,6 +71,11 @@ static readstat_error_t read_attributes(int (*handle_attribute)(char *key, rdata
                            rdata_ctx_t *ctx);
 static readstat_error_t recursive_discard(rdata_sexptype_header_t sexptype_header, rdata_ctx_t *ctx);
 
+static readstat_error_t rdata_update_progress(rdata_ctx_t *ctx) {
+    return readstat_update_progress(ctx->io, ctx->file_size, ctx->progress_handler, ctx->user_ctx,
+            ctx->progress_granularity, &ctx->next_progress);
+}
+
 static int atom_table_add(rdata_atom_table_t *table, char *key) {
     table->data = realloc(table->data, RDATA_ATOM_LEN * (table->count + 1));
     memcpy(&table->data[RDATA_ATOM_LEN*table->count], key, strlen(key) + 1);
@@ -358,7 +368,19 @@ readstat_error_t rdata_parse(rdata_parser_t *parser, const char *filename, void
     ctx->text_value_handler = parser->text_value_handler;
     ctx->value_label_handler = parser->value_label_handler;
     ctx->error_handler = parser->error_handler;
-    
+    ctx->progress_handler = parser->progress_handler;
+    ctx->progress_granularity = parser->progress_granularity;
+
+    if ((ctx->file_size = ctx->io->seek(0, READSTAT_SEEK_END, ctx->io->io_ctx)) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+    if (ctx->io->seek(0, READSTAT_SEEK_SET, ctx->io->io_ctx) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
     if ((retval = init_stream(ctx)) != READSTAT_OK) {
         goto cleanup;
     }
@@ -399,6 +421,8 @@ readstat_error_t rdata_parse(rdata_parser_t *parser, const char *filename, void
         retval = READSTAT_ERROR_PARSE;
         goto cleanup;
     }
+
+    retval = rdata_update_progress(ctx);
     
 cleanup:
     if (ctx) {
@@ -468,6 +492,8 @@ static readstat_error_t read_toplevel_object(const char *table_name, const char
             goto cleanup;
     }
 
+    retval = rdata_update_progress(ctx);
+
 cleanup:
 
     return retval;
@@ -888,6 +914,8 @@ static readstat_error_t read_value_vector(rdata_sexptype_header_t header, const
         }
     }
 
+    retval = rdata_update_progress(ctx);
+
 cleanup:
     
     return retval;
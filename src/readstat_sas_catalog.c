@@ -26,12 +26,12 @@ typedef struct sas_catalog_ctx_s {
     int            block_pointers_capacity;
     const char    *input_encoding;
     const char    *output_encoding;
-    iconv_t        converter;
+    struct readstat_converter_s *converter;
 } sas_catalog_ctx_t;
 
 static void sas_catalog_ctx_free(sas_catalog_ctx_t *ctx) {
     if (ctx->converter)
-        iconv_close(ctx->converter);
+        readstat_converter_close(ctx->converter);
     if (ctx->block_pointers)
         free(ctx->block_pointers);
 
@@ -82,7 +82,8 @@ static readstat_error_t sas_parse_value_labels(const char *value_start, size_t v
         readstat_value_t value = { .type = is_string ? READSTAT_TYPE_STRING : READSTAT_TYPE_DOUBLE };
         if (is_string) {
             char val[4*16+1];
-            retval = readstat_convert(val, sizeof(val), &lbp1[value_entry_len-16], 16, ctx->converter);
+            retval = readstat_convert_len(val, sizeof(val), &lbp1[value_entry_len-16], 16, ctx->converter,
+                    &value.string_len);
             if (retval != READSTAT_OK)
                 goto cleanup;
 
@@ -282,8 +283,8 @@ readstat_error_t readstat_parse_sas7bcat(readstat_parser_t *parser, const char *
     }
 
     if (ctx->input_encoding && ctx->output_encoding && strcmp(ctx->input_encoding, ctx->output_encoding) != 0) {
-        iconv_t converter = iconv_open(ctx->output_encoding, ctx->input_encoding);
-        if (converter == (iconv_t)-1) {
+        readstat_converter_t *converter = readstat_converter_open(ctx->output_encoding, ctx->input_encoding);
+        if (converter == NULL) {
             retval = READSTAT_ERROR_UNSUPPORTED_CHARSET;
             goto cleanup;
         }
@@ -8,6 +8,12 @@
 #include "readstat_sas.h"
 #include "readstat_iconv.h"
 #include "readstat_convert.h"
+#include "readstat_batch.h"
+#include "readstat_dictionary.h"
+#include "readstat_filter.h"
+#include "readstat_pipeline.h"
+#include "readstat_progress.h"
+#include "readstat_variable.h"
 
 #define ERROR_BUF_SIZE 1024
 
@@ -70,14 +76,49 @@ typedef struct col_info_s {
     int    type;
 } col_info_t;
 
+typedef struct sas_row_ref_s {
+    size_t          offset;
+    size_t          len;
+    unsigned char   compression;
+} sas_row_ref_t;
+
+/* A page whose rows are decoded on a worker thread. Strings are stored as
+ * offsets into the strings arena until the page is delivered. */
+typedef struct sas_page_job_s {
+    char               *page;
+
+    sas_row_ref_t      *rows;
+    int                 rows_count;
+    int                 rows_capacity;
+
+    readstat_value_t   *values;
+    size_t             *string_offsets;
+    size_t              values_capacity;
+
+    char               *strings;
+    size_t              strings_len;
+    size_t              strings_capacity;
+
+    int                 error_row;
+    size_t              error_len;
+} sas_page_job_t;
+
+typedef struct sas_worker_s {
+    struct readstat_converter_s *converter;
+    char           *row_buffer;
+} sas_worker_t;
+
 typedef struct sas_ctx_s {
     readstat_info_handler       info_handler;
     readstat_metadata_handler   metadata_handler;
     readstat_variable_handler   variable_handler;
     readstat_value_handler      value_handler;
+    readstat_batch_handler      batch_handler;
     readstat_error_handler      error_handler;
     readstat_progress_handler   progress_handler;
     int64_t                     file_size;
+    double                      next_progress;
+    double                      progress_granularity;
 
     int            little_endian;
     int            u64;
@@ -86,12 +127,18 @@ typedef struct sas_ctx_s {
     readstat_io_t *io;
     int            bswap;
     int            did_submit_columns;
+    int            rdc_compression;
+    char          *row_buffer;
+    size_t         row_buffer_len;
 
     int32_t        row_length;
     int32_t        page_row_count;
     int32_t        parsed_row_count;
     int32_t        column_count;
     int32_t        row_limit;
+    int32_t        row_offset;
+    int32_t        skipped_row_count;
+    int32_t        dispatched_row_count;
 
     int64_t        header_size;
     int64_t        page_count;
@@ -112,9 +159,27 @@ typedef struct sas_ctx_s {
     int            col_info_count;
     col_info_t    *col_info;
 
+    const readstat_column_filter_t *column_filter;
+    int           *projected_cols;
+    int            projected_cols_count;
+
+    long             batch_size;
+    readstat_batch_t *batch;
+
+    long                    string_dictionary_max;
+    readstat_dictionary_t **dictionaries;
+
+    int                  thread_count;
+    readstat_pipeline_t *pipeline;
+    void               **jobs;
+    int                  jobs_count;
+    sas_worker_t        *workers;
+    int                  workers_count;
+    sas_page_job_t      *job;
+
     const char    *input_encoding;
     const char    *output_encoding;
-    iconv_t        converter;
+    struct readstat_converter_s *converter;
 
     time_t         timestamp;
     int            version;
@@ -123,6 +188,31 @@ typedef struct sas_ctx_s {
 
 static void sas_ctx_free(sas_ctx_t *ctx) {
     int i;
+    if (ctx->pipeline)
+        readstat_pipeline_free(ctx->pipeline);
+
+    if (ctx->jobs) {
+        for (i=0; i<ctx->jobs_count; i++) {
+            sas_page_job_t *job = ctx->jobs[i];
+            if (job == NULL)
+                continue;
+            free(job->page);
+            free(job->rows);
+            free(job->values);
+            free(job->string_offsets);
+            free(job->strings);
+            free(job);
+        }
+        free(ctx->jobs);
+    }
+    if (ctx->workers) {
+        for (i=0; i<ctx->workers_count; i++) {
+            if (ctx->workers[i].converter)
+                readstat_converter_close(ctx->workers[i].converter);
+            free(ctx->workers[i].row_buffer);
+        }
+        free(ctx->workers);
+    }
     if (ctx->text_blobs) {
         for (i=0; i<ctx->text_blob_count; i++) {
             free(ctx->text_blobs[i]);
@@ -133,18 +223,35 @@ static void sas_ctx_free(sas_ctx_t *ctx) {
     if (ctx->col_info)
         free(ctx->col_info);
 
+    if (ctx->projected_cols)
+        free(ctx->projected_cols);
+
     if (ctx->scratch_buffer)
         free(ctx->scratch_buffer);
 
+    if (ctx->row_buffer)
+        free(ctx->row_buffer);
+
     if (ctx->converter)
-        iconv_close(ctx->converter);
+        readstat_converter_close(ctx->converter);
+
+    if (ctx->batch)
+        readstat_batch_free(ctx->batch);
+
+    if (ctx->dictionaries) {
+        for (i=0; i<ctx->column_count; i++) {
+            readstat_dictionary_free(ctx->dictionaries[i]);
+        }
+        free(ctx->dictionaries);
+    }
 
     free(ctx);
 }
 
 static readstat_error_t sas_update_progress(sas_ctx_t *ctx) {
     readstat_io_t *io = ctx->io;
-    return io->update(ctx->file_size, ctx->progress_handler, ctx->user_ctx, io->io_ctx);
+    return readstat_update_progress(io, ctx->file_size, ctx->progress_handler, ctx->user_ctx,
+            ctx->progress_granularity, &ctx->next_progress);
 }
 
 static readstat_error_t sas_parse_column_text_subheader(const char *subheader, size_t len, sas_ctx_t *ctx) {
@@ -172,8 +279,7 @@ static readstat_error_t sas_parse_column_text_subheader(const char *subheader, s
     /* another bit of a hack */
     if (len-signature_len > 12 + sizeof(SAS_COMPRESSION_SIGNATURE_RDC)-1 &&
             strncmp(blob + 12, SAS_COMPRESSION_SIGNATURE_RDC, sizeof(SAS_COMPRESSION_SIGNATURE_RDC)-1) == 0) {
-        retval = READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
-        goto cleanup;
+        ctx->rdc_compression = 1;
     }
 
 cleanup:
@@ -213,6 +319,10 @@ static readstat_error_t sas_parse_row_size_subheader(const char *subheader, size
 
     ctx->row_length = row_length;
     ctx->page_row_count = page_row_count;
+    if (ctx->row_offset > total_row_count)
+        ctx->row_offset = total_row_count;
+
+    total_row_count -= ctx->row_offset;
     if (ctx->row_limit == 0 || total_row_count < ctx->row_limit)
         ctx->row_limit = total_row_count;
 
@@ -343,21 +453,30 @@ static readstat_error_t sas_parse_column_format_subheader(const char *subheader,
     return retval;
 }
 
-static readstat_error_t handle_data_value(const char *col_data, col_info_t *col_info, sas_ctx_t *ctx) {
+/* Only touches ctx fields that are fixed once the columns have been
+ * submitted, so that worker threads can decode values concurrently. Strings
+ * with a dictionary are the exception, and are left to the calling thread. */
+static readstat_error_t sas_decode_value(readstat_value_t *out_value, const char *col_data,
+        col_info_t *col_info, char *string_buf, size_t string_buf_len, readstat_converter_t *converter,
+        sas_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
-    int cb_retval = 0;
     readstat_value_t value;
     memset(&value, 0, sizeof(readstat_value_t));
 
     value.type = col_info->type;
 
-    if (col_info->type == READSTAT_TYPE_STRING) {
-        retval = readstat_convert(ctx->scratch_buffer, ctx->scratch_buffer_len,
-                col_data, col_info->width, ctx->converter);
+    if (col_info->type == READSTAT_TYPE_STRING && ctx->dictionaries && ctx->dictionaries[col_info->index]) {
+        retval = readstat_dictionary_convert(ctx->dictionaries[col_info->index],
+                col_data, col_info->width, converter, &value);
+        if (retval != READSTAT_OK)
+            goto cleanup;
+    } else if (col_info->type == READSTAT_TYPE_STRING) {
+        retval = readstat_convert_len(string_buf, string_buf_len,
+                col_data, col_info->width, converter, &value.string_len);
         if (retval != READSTAT_OK)
             goto cleanup;
 
-        value.v.string_value = ctx->scratch_buffer;
+        value.v.string_value = string_buf;
     } else if (col_info->type == READSTAT_TYPE_DOUBLE) {
         uint64_t  val = 0;
         double dval = NAN;
@@ -384,11 +503,35 @@ static readstat_error_t handle_data_value(const char *col_data, col_info_t *col_
             value.v.double_value = dval;
         }
     }
-    cb_retval = ctx->value_handler(ctx->parsed_row_count, col_info->index, 
-            value, ctx->user_ctx);
 
-    if (cb_retval)
-        retval = READSTAT_ERROR_USER_ABORT;
+    *out_value = value;
+
+cleanup:
+    return retval;
+}
+
+static readstat_error_t handle_data_value(const char *col_data, col_info_t *col_info, sas_ctx_t *ctx) {
+    readstat_error_t retval = READSTAT_OK;
+    int cb_retval = 0;
+    readstat_value_t value;
+
+    retval = sas_decode_value(&value, col_data, col_info, ctx->scratch_buffer, ctx->scratch_buffer_len,
+            ctx->converter, ctx);
+    if (retval != READSTAT_OK)
+        goto cleanup;
+
+    if (ctx->value_handler) {
+        cb_retval = ctx->value_handler(ctx->parsed_row_count, col_info->index, 
+                value, ctx->user_ctx);
+
+        if (cb_retval) {
+            retval = READSTAT_ERROR_USER_ABORT;
+            goto cleanup;
+        }
+    }
+    if (ctx->batch) {
+        retval = readstat_batch_put_value(ctx->batch, col_info->index, value);
+    }
 
 cleanup:
     return retval;
@@ -398,18 +541,34 @@ static readstat_error_t sas_parse_single_row(const char *data, sas_ctx_t *ctx) {
     if (ctx->parsed_row_count == ctx->row_limit)
         return READSTAT_OK;
 
+    if (ctx->skipped_row_count < ctx->row_offset) {
+        ctx->skipped_row_count++;
+        return READSTAT_OK;
+    }
+
     readstat_error_t retval = READSTAT_OK;
     int j;
-    if (ctx->value_handler) {
-        ctx->scratch_buffer_len = 4*ctx->max_col_width+1;
-        ctx->scratch_buffer = realloc(ctx->scratch_buffer, ctx->scratch_buffer_len);
-        for (j=0; j<ctx->column_count; j++) {
-            col_info_t *col_info = &ctx->col_info[j];
+    if (ctx->value_handler || ctx->batch) {
+        if (ctx->scratch_buffer_len != 4*ctx->max_col_width+1) {
+            char *scratch_buffer = realloc(ctx->scratch_buffer, 4*ctx->max_col_width+1);
+            if (scratch_buffer == NULL) {
+                retval = READSTAT_ERROR_MALLOC;
+                goto cleanup;
+            }
+            ctx->scratch_buffer = scratch_buffer;
+            ctx->scratch_buffer_len = 4*ctx->max_col_width+1;
+        }
+        for (j=0; j<ctx->projected_cols_count; j++) {
+            col_info_t *col_info = &ctx->col_info[ctx->projected_cols[j]];
             retval = handle_data_value(&data[col_info->offset], col_info, ctx);
             if (retval != READSTAT_OK) {
                 goto cleanup;
             }
         }
+        if (ctx->batch) {
+            if ((retval = readstat_batch_end_row(ctx->batch)) != READSTAT_OK)
+                goto cleanup;
+        }
     }
     ctx->parsed_row_count++;
 
@@ -419,9 +578,17 @@ cleanup:
 
 static readstat_error_t sas_parse_rows(const char *data, sas_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
-    int i;
+    int i = 0;
     size_t row_offset=0;
-    for (i=0; i<ctx->page_row_count && ctx->parsed_row_count < ctx->row_limit; i++) {
+    if (ctx->skipped_row_count < ctx->row_offset) {
+        i = ctx->row_offset - ctx->skipped_row_count;
+        if (i > ctx->page_row_count)
+            i = ctx->page_row_count;
+
+        ctx->skipped_row_count += i;
+        row_offset = (size_t)i * ctx->row_length;
+    }
+    for (; i<ctx->page_row_count && ctx->parsed_row_count < ctx->row_limit; i++) {
         if ((retval = sas_parse_single_row(&data[row_offset], ctx)) != READSTAT_OK)
             goto cleanup;
 
@@ -432,27 +599,39 @@ cleanup:
     return retval;
 }
 
-static readstat_error_t sas_parse_subheader_rle(const char *subheader, size_t len, sas_ctx_t *ctx) {
-    if (ctx->row_limit == ctx->parsed_row_count)
-        return READSTAT_OK;
-
-    /* TODO bounds checking */
+/* Expands one compressed row into buffer, which holds ctx->row_length bytes.
+ * Operands and copies are checked against the end of the subheader, and
+ * every copy or insert against the end of the row. */
+static readstat_error_t sas_decompress_row_rle(char *buffer, const char *subheader, size_t len,
+        size_t *out_len, sas_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
     const unsigned char *input = (const unsigned char *)subheader;
-    char error_buf[ERROR_BUF_SIZE];
-    char *buffer = malloc(ctx->row_length);
+    const unsigned char *input_end = input + len;
     char *output = buffer;
-    if (buffer == NULL) {
-        retval = READSTAT_ERROR_MALLOC;
-        goto cleanup;
-    }
-    while (input < (const unsigned char *)subheader + len) {
+    char *output_end = buffer + ctx->row_length;
+    while (input < input_end) {
         unsigned char control = *input++;
         unsigned char command = (control & 0xF0) >> 4;
         unsigned char length = (control & 0x0F);
-        int copy_len = 0;
-        int insert_len = 0;
+        size_t copy_len = 0;
+        size_t insert_len = 0;
         unsigned char insert_byte = '\0';
+        int operands_len = 0;
+        switch (command) {
+            case SAS_RLE_COMMAND_COPY64:
+            case SAS_RLE_COMMAND_INSERT_BLANK17:
+            case SAS_RLE_COMMAND_INSERT_ZERO17:
+            case SAS_RLE_COMMAND_INSERT_BYTE3:
+                operands_len = 1;
+                break;
+            case SAS_RLE_COMMAND_INSERT_BYTE18:
+                operands_len = 2;
+                break;
+        }
+        if (input_end - input < operands_len) {
+            retval = READSTAT_ERROR_PARSE;
+            goto cleanup;
+        }
         switch (command) {
             case SAS_RLE_COMMAND_COPY64:
                 copy_len = (*input++) + 64 + length * 256;
@@ -493,7 +672,16 @@ static readstat_error_t sas_parse_subheader_rle(const char *subheader, size_t le
                 retval = READSTAT_ERROR_PARSE;
                 goto cleanup;
         }
+        if (copy_len + insert_len > (size_t)(output_end - output)) {
+            output += copy_len + insert_len;
+            retval = READSTAT_ERROR_ROW_WIDTH_MISMATCH;
+            goto cleanup;
+        }
         if (copy_len) {
+            if (copy_len > (size_t)(input_end - input)) {
+                retval = READSTAT_ERROR_PARSE;
+                goto cleanup;
+            }
             memcpy(output, input, copy_len);
             input += copy_len;
             output += copy_len;
@@ -505,19 +693,395 @@ static readstat_error_t sas_parse_subheader_rle(const char *subheader, size_t le
     }
     if (output - buffer != ctx->row_length) {
         retval = READSTAT_ERROR_ROW_WIDTH_MISMATCH;
+    }
+
+cleanup:
+    *out_len = output - buffer;
+    return retval;
+}
+
+/* Ross Data Compression (COMPRESS=BINARY). Each big-endian control word
+ * says which of the next 16 items are literal bytes (0) and which are
+ * commands (1). Both the input and the output are bounds-checked. */
+static readstat_error_t sas_decompress_row_rdc(char *buffer, const char *subheader, size_t len,
+        size_t *out_len, sas_ctx_t *ctx) {
+    readstat_error_t retval = READSTAT_OK;
+    const unsigned char *input = (const unsigned char *)subheader;
+    const unsigned char *input_end = input + len;
+    unsigned char *output = (unsigned char *)buffer;
+    unsigned char *output_end = output + ctx->row_length;
+    uint16_t ctrl_bits = 0, ctrl_mask = 0;
+
+    while (input < input_end) {
+        ctrl_mask >>= 1;
+        if (ctrl_mask == 0) {
+            if (input_end - input < 2) {
+                retval = READSTAT_ERROR_PARSE;
+                goto cleanup;
+            }
+            ctrl_bits = (input[0] << 8) | input[1];
+            ctrl_mask = 0x8000;
+            input += 2;
+            if (input == input_end)
+                break;
+        }
+
+        if (!(ctrl_bits & ctrl_mask)) {
+            if (output == output_end) {
+                retval = READSTAT_ERROR_ROW_WIDTH_MISMATCH;
+                goto cleanup;
+            }
+            *output++ = *input++;
+            continue;
+        }
+
+        unsigned char command = (*input >> 4) & 0x0F;
+        size_t count = *input & 0x0F;
+        size_t offset = 0;
+        unsigned char insert_byte = 0;
+        int is_insert = 0;
+        input++;
+
+        if (input_end - input < (command == 0 || command > 2 ? 1 : 2)) {
+            retval = READSTAT_ERROR_PARSE;
+            goto cleanup;
+        }
+        if (command == 0) { /* short run */
+            count += 3;
+            insert_byte = input[0];
+            is_insert = 1;
+            input += 1;
+        } else if (command == 1) { /* long run */
+            count += (input[0] << 4) + 19;
+            insert_byte = input[1];
+            is_insert = 1;
+            input += 2;
+        } else if (command == 2) { /* long pattern */
+            offset = count + 3 + (input[0] << 4);
+            count = input[1] + 16;
+            input += 2;
+        } else { /* short pattern */
+            offset = count + 3 + (input[0] << 4);
+            count = command;
+            input += 1;
+        }
+
+        if (count > (size_t)(output_end - output)) {
+            output += count;
+            retval = READSTAT_ERROR_ROW_WIDTH_MISMATCH;
+            goto cleanup;
+        }
+        if (is_insert) {
+            memset(output, insert_byte, count);
+        } else {
+            if (offset > (size_t)(output - (unsigned char *)buffer)) {
+                retval = READSTAT_ERROR_PARSE;
+                goto cleanup;
+            }
+            if (offset >= count) {
+                memcpy(output, output - offset, count);
+            } else {
+                /* The pattern overlaps the bytes being written */
+                size_t i;
+                for (i=0; i<count; i++)
+                    output[i] = output[i - offset];
+            }
+        }
+        output += count;
+    }
+
+    if (output - (unsigned char *)buffer != ctx->row_length) {
+        retval = READSTAT_ERROR_ROW_WIDTH_MISMATCH;
+    }
+
+cleanup:
+    *out_len = output - (unsigned char *)buffer;
+    return retval;
+}
+
+static readstat_error_t sas_decompress_row(char *buffer, const char *subheader, size_t len,
+        size_t *out_len, sas_ctx_t *ctx) {
+    if (ctx->rdc_compression)
+        return sas_decompress_row_rdc(buffer, subheader, len, out_len, ctx);
+
+    return sas_decompress_row_rle(buffer, subheader, len, out_len, ctx);
+}
+
+static readstat_error_t sas_parse_subheader_compressed(const char *subheader, size_t len, sas_ctx_t *ctx) {
+    if (ctx->row_limit == ctx->parsed_row_count)
+        return READSTAT_OK;
+
+    if (ctx->skipped_row_count < ctx->row_offset) {
+        ctx->skipped_row_count++;
+        return READSTAT_OK;
+    }
+
+    readstat_error_t retval = READSTAT_OK;
+    char error_buf[ERROR_BUF_SIZE];
+    size_t row_len = 0;
+    if (ctx->row_buffer_len < (size_t)ctx->row_length) {
+        char *row_buffer = realloc(ctx->row_buffer, ctx->row_length);
+        if (row_buffer == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        ctx->row_buffer = row_buffer;
+        ctx->row_buffer_len = ctx->row_length;
+    }
+    retval = sas_decompress_row(ctx->row_buffer, subheader, len, &row_len, ctx);
+    if (retval == READSTAT_ERROR_ROW_WIDTH_MISMATCH) {
         if (ctx->error_handler) {
             snprintf(error_buf, sizeof(error_buf), 
                     "ReadStat: Row #%d decompressed to %ld bytes (expected %d bytes)\n",
-                    ctx->parsed_row_count, (long)(output - buffer), ctx->row_length);
+                    ctx->parsed_row_count, (long)row_len, ctx->row_length);
             ctx->error_handler(error_buf, ctx->user_ctx);
         }
         goto cleanup;
     }
-    retval = sas_parse_single_row(buffer, ctx);
+    if (retval != READSTAT_OK)
+        goto cleanup;
+
+    retval = sas_parse_single_row(ctx->row_buffer, ctx);
 cleanup:
-    if (buffer)
-        free(buffer);
+    return retval;
+}
+
+static readstat_error_t sas_queue_row(sas_ctx_t *ctx, size_t offset, size_t len, unsigned char compression) {
+    sas_page_job_t *job = ctx->job;
+
+    if (ctx->dispatched_row_count == ctx->row_limit)
+        return READSTAT_OK;
+
+    if (ctx->skipped_row_count < ctx->row_offset) {
+        ctx->skipped_row_count++;
+        return READSTAT_OK;
+    }
+
+    if (job->rows_count == job->rows_capacity) {
+        int rows_capacity = job->rows_capacity ? 2 * job->rows_capacity : 64;
+        sas_row_ref_t *rows = realloc(job->rows, rows_capacity * sizeof(sas_row_ref_t));
+        if (rows == NULL)
+            return READSTAT_ERROR_MALLOC;
+
+        job->rows = rows;
+        job->rows_capacity = rows_capacity;
+    }
+
+    sas_row_ref_t *ref = &job->rows[job->rows_count++];
+    ref->offset = offset;
+    ref->len = len;
+    ref->compression = compression;
+
+    ctx->dispatched_row_count++;
+
+    return READSTAT_OK;
+}
+
+static readstat_error_t sas_queue_rows(sas_ctx_t *ctx, size_t data_offset, size_t page_size) {
+    readstat_error_t retval = READSTAT_OK;
+    int i;
+    for (i=0; i<ctx->page_row_count; i++) {
+        size_t offset = data_offset + (size_t)i * ctx->row_length;
+        if (ctx->dispatched_row_count == ctx->row_limit)
+            break;
+
+        if (offset + ctx->row_length > page_size) {
+            retval = READSTAT_ERROR_PARSE;
+            goto cleanup;
+        }
+        if ((retval = sas_queue_row(ctx, offset, ctx->row_length, SAS_COMPRESSION_NONE)) != READSTAT_OK)
+            goto cleanup;
+    }
 
+cleanup:
+    return retval;
+}
+
+static readstat_error_t sas_decode_page_job(void *job_ptr, int worker_index, void *ctx_ptr) {
+    sas_page_job_t *job = (sas_page_job_t *)job_ptr;
+    sas_ctx_t *ctx = (sas_ctx_t *)ctx_ptr;
+    sas_worker_t *worker = &ctx->workers[worker_index];
+    readstat_error_t retval = READSTAT_OK;
+    size_t string_len = 4*ctx->max_col_width+1;
+    size_t values_count = (size_t)job->rows_count * ctx->projected_cols_count;
+    int i, j;
+
+    job->strings_len = 0;
+
+    if (values_count > job->values_capacity) {
+        readstat_value_t *values = realloc(job->values, values_count * sizeof(readstat_value_t));
+        if (values == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        job->values = values;
+
+        size_t *string_offsets = realloc(job->string_offsets, values_count * sizeof(size_t));
+        if (string_offsets == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        job->string_offsets = string_offsets;
+        job->values_capacity = values_count;
+    }
+
+    if (worker->row_buffer == NULL && (worker->row_buffer = malloc(ctx->row_length)) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+
+    for (i=0; i<job->rows_count; i++) {
+        sas_row_ref_t *ref = &job->rows[i];
+        const char *row = &job->page[ref->offset];
+        if (ref->compression == SAS_COMPRESSION_ROW) {
+            size_t row_len = 0;
+            if ((retval = sas_decompress_row(worker->row_buffer, row, ref->len, &row_len, ctx)) != READSTAT_OK) {
+                job->error_row = i;
+                job->error_len = row_len;
+                goto cleanup;
+            }
+            row = worker->row_buffer;
+        }
+        for (j=0; j<ctx->projected_cols_count; j++) {
+            col_info_t *col_info = &ctx->col_info[ctx->projected_cols[j]];
+            size_t value_index = (size_t)i * ctx->projected_cols_count + j;
+            char *string_buf = NULL;
+            if (col_info->type == READSTAT_TYPE_STRING) {
+                if (job->strings_len + string_len > job->strings_capacity) {
+                    size_t strings_capacity = 2 * (job->strings_len + string_len);
+                    char *strings = realloc(job->strings, strings_capacity);
+                    if (strings == NULL) {
+                        retval = READSTAT_ERROR_MALLOC;
+                        goto cleanup;
+                    }
+                    job->strings = strings;
+                    job->strings_capacity = strings_capacity;
+                }
+                string_buf = &job->strings[job->strings_len];
+            }
+            if (string_buf && ctx->dictionaries && ctx->dictionaries[col_info->index]) {
+                /* Keep the raw bytes for sas_deliver_page_job to look up */
+                memcpy(string_buf, &row[col_info->offset], col_info->width);
+                job->values[value_index].type = READSTAT_TYPE_STRING;
+                job->string_offsets[value_index] = job->strings_len;
+                job->strings_len += col_info->width;
+                continue;
+            }
+            retval = sas_decode_value(&job->values[value_index], &row[col_info->offset], col_info,
+                    string_buf, string_len, worker->converter, ctx);
+            if (retval != READSTAT_OK)
+                goto cleanup;
+
+            if (string_buf) {
+                job->string_offsets[value_index] = job->strings_len;
+                job->strings_len += job->values[value_index].string_len + 1;
+            }
+        }
+    }
+
+cleanup:
+    return retval;
+}
+
+static readstat_error_t sas_deliver_page_job(void *job_ptr, readstat_error_t work_retval, void *ctx_ptr) {
+    sas_page_job_t *job = (sas_page_job_t *)job_ptr;
+    sas_ctx_t *ctx = (sas_ctx_t *)ctx_ptr;
+    readstat_error_t retval = READSTAT_OK;
+    char error_buf[ERROR_BUF_SIZE];
+    int i, j;
+
+    if (work_retval != READSTAT_OK) {
+        if (work_retval == READSTAT_ERROR_ROW_WIDTH_MISMATCH && ctx->error_handler) {
+            snprintf(error_buf, sizeof(error_buf), 
+                    "ReadStat: Row #%d decompressed to %ld bytes (expected %d bytes)\n",
+                    ctx->parsed_row_count + job->error_row, (long)job->error_len, ctx->row_length);
+            ctx->error_handler(error_buf, ctx->user_ctx);
+        }
+        retval = work_retval;
+        goto cleanup;
+    }
+
+    for (i=0; i<job->rows_count; i++) {
+        for (j=0; j<ctx->projected_cols_count; j++) {
+            col_info_t *col_info = &ctx->col_info[ctx->projected_cols[j]];
+            size_t value_index = (size_t)i * ctx->projected_cols_count + j;
+            readstat_value_t value = job->values[value_index];
+            if (value.type == READSTAT_TYPE_STRING && ctx->dictionaries && ctx->dictionaries[col_info->index]) {
+                retval = sas_decode_value(&value, &job->strings[job->string_offsets[value_index]], col_info,
+                        NULL, 0, ctx->converter, ctx);
+                if (retval != READSTAT_OK)
+                    goto cleanup;
+            } else if (value.type == READSTAT_TYPE_STRING) {
+                value.v.string_value = &job->strings[job->string_offsets[value_index]];
+            }
+
+            if (ctx->value_handler) {
+                if (ctx->value_handler(ctx->parsed_row_count, col_info->index, 
+                            value, ctx->user_ctx)) {
+                    retval = READSTAT_ERROR_USER_ABORT;
+                    goto cleanup;
+                }
+            }
+            if (ctx->batch) {
+                if ((retval = readstat_batch_put_value(ctx->batch, col_info->index, value)) != READSTAT_OK)
+                    goto cleanup;
+            }
+        }
+        if (ctx->batch) {
+            if ((retval = readstat_batch_end_row(ctx->batch)) != READSTAT_OK)
+                goto cleanup;
+        }
+        ctx->parsed_row_count++;
+    }
+
+cleanup:
+    return retval;
+}
+
+/* Sets up the worker pool. Leaves ctx->pipeline NULL (and the rows to be
+ * parsed on the calling thread) if threads are unavailable. */
+static readstat_error_t sas_init_pipeline(sas_ctx_t *ctx) {
+    readstat_error_t retval = READSTAT_OK;
+    int i;
+
+    ctx->workers_count = ctx->thread_count;
+    if ((ctx->workers = calloc(ctx->workers_count, sizeof(sas_worker_t))) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+    for (i=0; i<ctx->workers_count; i++) {
+        if (ctx->converter) {
+            readstat_converter_t *converter = readstat_converter_open(ctx->output_encoding, ctx->input_encoding);
+            if (converter == NULL) {
+                retval = READSTAT_ERROR_UNSUPPORTED_CHARSET;
+                goto cleanup;
+            }
+            ctx->workers[i].converter = converter;
+        }
+    }
+
+    ctx->jobs_count = 2 * ctx->thread_count;
+    if ((ctx->jobs = calloc(ctx->jobs_count, sizeof(void *))) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+    for (i=0; i<ctx->jobs_count; i++) {
+        sas_page_job_t *job = calloc(1, sizeof(sas_page_job_t));
+        if (job == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        ctx->jobs[i] = job;
+        if ((job->page = malloc(ctx->page_size)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+    }
+
+    ctx->pipeline = readstat_pipeline_init(ctx->workers_count, ctx->jobs, ctx->jobs_count,
+            &sas_decode_page_job, &sas_deliver_page_job, ctx);
+
+cleanup:
     return retval;
 }
 
@@ -555,30 +1119,30 @@ cleanup:
     return retval;
 }
 
-static readstat_variable_t *sas_init_variable(sas_ctx_t *ctx, int i, readstat_error_t *out_retval) {
+static readstat_variable_t *sas_init_variable(sas_ctx_t *ctx, int i, readstat_variable_buffer_t *buffer,
+        readstat_error_t *out_retval) {
     readstat_error_t retval = READSTAT_OK;
-    readstat_variable_t *variable = calloc(1, sizeof(readstat_variable_t));
+    readstat_variable_t *variable = readstat_variable_buffer_reset(buffer);
 
     variable->index = i;
     variable->type = ctx->col_info[i].type;
     variable->storage_width = ctx->col_info[i].width;
 
-    if ((retval = copy_text_ref(variable->name, sizeof(variable->name), 
+    if ((retval = copy_text_ref(buffer->name, sizeof(buffer->name), 
                     ctx->col_info[i].name_ref, ctx)) != READSTAT_OK) {
         goto cleanup;
     }
-    if ((retval = copy_text_ref(variable->format, sizeof(variable->format), 
+    if ((retval = copy_text_ref(buffer->format, sizeof(buffer->format), 
                     ctx->col_info[i].format_ref, ctx)) != READSTAT_OK) {
         goto cleanup;
     }
-    if ((retval = copy_text_ref(variable->label, sizeof(variable->label), 
+    if ((retval = copy_text_ref(buffer->label, sizeof(buffer->label), 
                     ctx->col_info[i].label_ref, ctx)) != READSTAT_OK) {
         goto cleanup;
     }
 
 cleanup:
     if (retval != READSTAT_OK) {
-        free(variable);
         if (out_retval)
             *out_retval = retval;
 
@@ -602,21 +1166,65 @@ static readstat_error_t submit_columns(sas_ctx_t *ctx) {
             goto cleanup;
         }
     }
-    if (ctx->variable_handler) {
-        int i;
-        for (i=0; i<ctx->column_count; i++) {
-            readstat_variable_t *variable = sas_init_variable(ctx, i, &retval);
-            if (variable == NULL)
-                break;
+    if ((ctx->projected_cols = malloc(ctx->column_count * sizeof(int))) == NULL && ctx->column_count > 0) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+    readstat_variable_buffer_t buffer;
+    int i;
+    for (i=0; i<ctx->column_count; i++) {
+        if (!ctx->variable_handler && !ctx->column_filter) {
+            ctx->projected_cols[ctx->projected_cols_count++] = i;
+            continue;
+        }
 
-            int cb_retval = ctx->variable_handler(i, variable, variable->format, ctx->user_ctx);
-            free(variable);
-            if (cb_retval) {
-                retval = READSTAT_ERROR_USER_ABORT;
+        readstat_variable_t *variable = sas_init_variable(ctx, i, &buffer, &retval);
+        if (variable == NULL)
+            goto cleanup;
+
+        int cb_retval = 0;
+        if (readstat_column_filter_selects(ctx->column_filter, i, variable->name)) {
+            ctx->projected_cols[ctx->projected_cols_count++] = i;
+            if (ctx->variable_handler)
+                cb_retval = ctx->variable_handler(i, variable, variable->format, ctx->user_ctx);
+        }
+        if (cb_retval) {
+            retval = READSTAT_ERROR_USER_ABORT;
+            goto cleanup;
+        }
+    }
+    if (ctx->string_dictionary_max) {
+        if ((ctx->dictionaries = calloc(ctx->column_count, sizeof(readstat_dictionary_t *))) == NULL &&
+                ctx->column_count > 0) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        for (i=0; i<ctx->projected_cols_count; i++) {
+            col_info_t *col_info = &ctx->col_info[ctx->projected_cols[i]];
+            if (col_info->type == READSTAT_TYPE_STRING &&
+                    (ctx->dictionaries[col_info->index] = readstat_dictionary_init(ctx->string_dictionary_max)) == NULL) {
+                retval = READSTAT_ERROR_MALLOC;
                 goto cleanup;
             }
         }
     }
+    if (ctx->batch_handler) {
+        if ((ctx->batch = readstat_batch_init(ctx->batch_handler, ctx->batch_size,
+                        ctx->column_count, ctx->user_ctx)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        for (i=0; i<ctx->projected_cols_count; i++) {
+            col_info_t *col_info = &ctx->col_info[ctx->projected_cols[i]];
+            retval = readstat_batch_add_column(ctx->batch, col_info->index, col_info->type);
+            if (retval != READSTAT_OK)
+                goto cleanup;
+            if (ctx->dictionaries && ctx->dictionaries[col_info->index] &&
+                    (retval = readstat_batch_set_dictionary(ctx->batch, col_info->index,
+                        ctx->dictionaries[col_info->index])) != READSTAT_OK)
+                goto cleanup;
+        }
+    }
 cleanup:
     return retval;
 }
@@ -763,11 +1371,20 @@ static readstat_error_t sas_parse_page_pass2(const char *page, size_t page_size,
                         if ((retval = submit_columns_if_needed(ctx)) != READSTAT_OK) {
                             goto cleanup;
                         }
-                        if ((retval = sas_parse_single_row(page + offset, ctx)) != READSTAT_OK) {
+                        if (ctx->job) {
+                            retval = sas_queue_row(ctx, offset, len, SAS_COMPRESSION_NONE);
+                        } else {
+                            retval = sas_parse_single_row(page + offset, ctx);
+                        }
+                        if (retval != READSTAT_OK) {
                             goto cleanup;
                         }
                     } else {
                         if (signature != SAS_SUBHEADER_SIGNATURE_COLUMN_TEXT) {
+                            /* Metadata can change how rows are decoded */
+                            if (ctx->pipeline && (retval = readstat_pipeline_drain(ctx->pipeline)) != READSTAT_OK) {
+                                goto cleanup;
+                            }
                             if ((retval = sas_parse_subheader(signature, page + offset, len, ctx)) != READSTAT_OK) {
                                 goto cleanup;
                             }
@@ -777,7 +1394,12 @@ static readstat_error_t sas_parse_page_pass2(const char *page, size_t page_size,
                     if ((retval = submit_columns_if_needed(ctx)) != READSTAT_OK) {
                         goto cleanup;
                     }
-                    if ((retval = sas_parse_subheader_rle(page + offset, len, ctx)) != READSTAT_OK) {
+                    if (ctx->job) {
+                        retval = sas_queue_row(ctx, offset, len, SAS_COMPRESSION_ROW);
+                    } else {
+                        retval = sas_parse_subheader_compressed(page + offset, len, ctx);
+                    }
+                    if (retval != READSTAT_OK) {
                         goto cleanup;
                     }
                 } else {
@@ -808,7 +1430,9 @@ static readstat_error_t sas_parse_page_pass2(const char *page, size_t page_size,
         if ((retval = submit_columns_if_needed(ctx)) != READSTAT_OK) {
             goto cleanup;
         }
-        if (ctx->value_handler) {
+        if (ctx->job) {
+            retval = sas_queue_rows(ctx, data - page, page_size);
+        } else if (ctx->value_handler || ctx->batch) {
             retval = sas_parse_rows(data, ctx);
         }
     } 
@@ -952,23 +1576,102 @@ cleanup:
     return retval;
 }
 
+/* Steps over the next page without reading it in full if it is a data page
+ * whose rows all fall before the requested row offset */
+static readstat_error_t sas_skip_data_page(sas_ctx_t *ctx, int *out_skipped) {
+    readstat_error_t retval = READSTAT_OK;
+    readstat_io_t *io = ctx->io;
+    char header[40];
+    size_t header_len = ctx->u64 ? 40 : 24;
+    uint16_t page_type, page_row_count;
+
+    *out_skipped = 0;
+
+    if (io->read(header, header_len, io->io_ctx) < header_len) {
+        retval = READSTAT_ERROR_READ;
+        goto cleanup;
+    }
+
+    page_type = sas_read2(&header[header_len-8], ctx->bswap);
+    page_row_count = sas_read2(&header[header_len-6], ctx->bswap);
+
+    if ((page_type & SAS_PAGE_TYPE_MASK) == SAS_PAGE_TYPE_DATA &&
+            ctx->skipped_row_count + page_row_count <= ctx->row_offset) {
+        if (io->seek(ctx->page_size - header_len, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+            retval = READSTAT_ERROR_SEEK;
+            goto cleanup;
+        }
+        ctx->skipped_row_count += page_row_count;
+        *out_skipped = 1;
+    } else if (io->seek(-(readstat_off_t)header_len, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+cleanup:
+    return retval;
+}
+
 static readstat_error_t parse_all_pages_pass2(sas_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
     readstat_io_t *io = ctx->io;
     int64_t i;
     char error_buf[ERROR_BUF_SIZE];
-    char *page = malloc(ctx->page_size);
+    char *page = NULL;
+    const char *page_data = NULL;
+
+    if (io->advise) {
+        io->advise(ctx->header_size, ctx->page_count * ctx->page_size,
+                READSTAT_ADVICE_SEQUENTIAL, io->io_ctx);
+    }
+
+    if (ctx->thread_count > 1 && (ctx->value_handler || ctx->batch_handler)) {
+        if ((retval = sas_init_pipeline(ctx)) != READSTAT_OK) {
+            goto cleanup;
+        }
+    }
+
+    if (!ctx->pipeline && !io->borrow && (page = malloc(ctx->page_size)) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
 
     for (i=0; i<ctx->page_count; i++) {
         if ((retval = sas_update_progress(ctx)) != READSTAT_OK) {
             goto cleanup;
         }
-        if (io->read(page, ctx->page_size, io->io_ctx) < ctx->page_size) {
-            retval = READSTAT_ERROR_READ;
-            goto cleanup;
+        if (ctx->skipped_row_count < ctx->row_offset) {
+            int skipped = 0;
+            if ((retval = sas_skip_data_page(ctx, &skipped)) != READSTAT_OK) {
+                goto cleanup;
+            }
+            if (skipped)
+                continue;
+        }
+        if (ctx->pipeline) {
+            if ((retval = readstat_pipeline_acquire(ctx->pipeline, (void **)&ctx->job)) != READSTAT_OK) {
+                goto cleanup;
+            }
+            ctx->job->rows_count = 0;
+            if (io->read(ctx->job->page, ctx->page_size, io->io_ctx) < ctx->page_size) {
+                retval = READSTAT_ERROR_READ;
+                goto cleanup;
+            }
+            page_data = ctx->job->page;
+        } else if (io->borrow) {
+            if (io->borrow((const void **)&page_data, ctx->page_size, io->io_ctx) < ctx->page_size) {
+                retval = READSTAT_ERROR_READ;
+                goto cleanup;
+            }
+        } else {
+            if (io->read(page, ctx->page_size, io->io_ctx) < ctx->page_size) {
+                retval = READSTAT_ERROR_READ;
+                goto cleanup;
+            }
+            page_data = page;
         }
 
-        if ((retval = sas_parse_page_pass2(page, ctx->page_size, ctx)) != READSTAT_OK) {
+        if ((retval = sas_parse_page_pass2(page_data, ctx->page_size, ctx)) != READSTAT_OK) {
             if (ctx->error_handler && retval != READSTAT_ERROR_USER_ABORT) {
                 int64_t pos = io->seek(0, READSTAT_SEEK_CUR, io->io_ctx);
                 snprintf(error_buf, sizeof(error_buf), 
@@ -978,10 +1681,21 @@ static readstat_error_t parse_all_pages_pass2(sas_ctx_t *ctx) {
             }
             goto cleanup;
         }
-        if (ctx->parsed_row_count == ctx->row_limit)
+        if (ctx->job) {
+            if (ctx->job->rows_count)
+                readstat_pipeline_submit(ctx->pipeline);
+            ctx->job = NULL;
+            if (ctx->dispatched_row_count == ctx->row_limit)
+                break;
+        } else if (ctx->parsed_row_count == ctx->row_limit) {
             break;
+        }
+    }
+    if (ctx->pipeline) {
+        retval = readstat_pipeline_drain(ctx->pipeline);
     }
 cleanup:
+    ctx->job = NULL;
     if (page)
         free(page);
 
@@ -1001,13 +1715,20 @@ readstat_error_t readstat_parse_sas7bdat(readstat_parser_t *parser, const char *
     ctx->metadata_handler = parser->metadata_handler;
     ctx->variable_handler = parser->variable_handler;
     ctx->value_handler = parser->value_handler;
+    ctx->batch_handler = parser->batch_handler;
+    ctx->batch_size = parser->batch_size;
+    ctx->string_dictionary_max = parser->string_dictionary_max;
+    ctx->column_filter = parser->column_filter;
     ctx->error_handler = parser->error_handler;
     ctx->progress_handler = parser->progress_handler;
+    ctx->progress_granularity = parser->progress_granularity;
     ctx->input_encoding = parser->input_encoding;
     ctx->output_encoding = parser->output_encoding;
     ctx->user_ctx = user_ctx;
     ctx->io = parser->io;
     ctx->row_limit = parser->row_limit;
+    ctx->row_offset = parser->row_offset;
+    ctx->thread_count = parser->thread_count;
 
     if (io->open(path, io->io_ctx) == -1) {
         retval = READSTAT_ERROR_OPEN;
@@ -1050,8 +1771,8 @@ readstat_error_t readstat_parse_sas7bdat(readstat_parser_t *parser, const char *
     }
 
     if (ctx->input_encoding && ctx->output_encoding && strcmp(ctx->input_encoding, ctx->output_encoding) != 0) {
-        iconv_t converter = iconv_open(ctx->output_encoding, ctx->input_encoding);
-        if (converter == (iconv_t)-1) {
+        readstat_converter_t *converter = readstat_converter_open(ctx->output_encoding, ctx->input_encoding);
+        if (converter == NULL) {
             retval = READSTAT_ERROR_UNSUPPORTED_CHARSET;
             goto cleanup;
         }
@@ -1063,6 +1784,12 @@ readstat_error_t readstat_parse_sas7bdat(readstat_parser_t *parser, const char *
         goto cleanup;
     }
 
+    if (io->advise) {
+        /* Pass 1 jumps between the first and last pages */
+        io->advise(ctx->header_size, ctx->page_count * ctx->page_size,
+                READSTAT_ADVICE_RANDOM, io->io_ctx);
+    }
+
     if ((retval = parse_meta_pages_pass1(ctx, &last_examined_page_pass1)) != READSTAT_OK) {
         goto cleanup;
     }
@@ -1089,7 +1816,11 @@ readstat_error_t readstat_parse_sas7bdat(readstat_parser_t *parser, const char *
         goto cleanup;
     }
 
-    if (ctx->value_handler && ctx->parsed_row_count != ctx->row_limit) {
+    if (ctx->batch && (retval = readstat_batch_flush(ctx->batch)) != READSTAT_OK) {
+        goto cleanup;
+    }
+
+    if ((ctx->value_handler || ctx->batch) && ctx->parsed_row_count != ctx->row_limit) {
         retval = READSTAT_ERROR_ROW_COUNT_MISMATCH;
         if (ctx->error_handler) {
             snprintf(error_buf, sizeof(error_buf), "ReadStat: Expected %d rows in file, found %d\n",
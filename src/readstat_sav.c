@@ -16,6 +16,10 @@
 #include <time.h>
 
 #include "readstat_sav.h"
+#include "readstat_convert.h"
+#include "readstat_batch.h"
+#include "readstat_dictionary.h"
+#include "readstat_zsav_read.h"
 
 #define SAV_VARINFO_INITIAL_CAPACITY  512
 
@@ -32,7 +36,9 @@ sav_ctx_t *sav_ctx_init(sav_file_header_record_t *header, readstat_io_t *io) {
         ctx->machine_needs_byte_swap = 1;
     }
     
-    ctx->data_is_compressed = (header->compressed != 0);
+    int32_t compressed = ctx->machine_needs_byte_swap ? byteswap4(header->compressed) : header->compressed;
+    ctx->data_is_compressed = (compressed != SAV_COMPRESSION_NONE);
+    ctx->data_is_zlib_compressed = (compressed == SAV_COMPRESSION_ZLIB);
     ctx->record_count = ctx->machine_needs_byte_swap ? byteswap4(header->ncases) : header->ncases;
     ctx->fweight_index = ctx->machine_needs_byte_swap ? byteswap4(header->weight_index) : header->weight_index;
     
@@ -58,18 +64,25 @@ sav_ctx_t *sav_ctx_init(sav_file_header_record_t *header, readstat_io_t *io) {
 void sav_ctx_free(sav_ctx_t *ctx) {
     if (ctx->varinfo) {
         int i;
-        for (i=0; i<ctx->var_count; i++) {
+        for (i=0; i<ctx->var_index; i++) {
             if (ctx->varinfo[i].label)
                 free(ctx->varinfo[i].label);
+            readstat_dictionary_free(ctx->varinfo[i].dictionary);
         }
         free(ctx->varinfo);
     }
     if (ctx->converter) {
-        iconv_close(ctx->converter);
+        readstat_converter_close(ctx->converter);
     }
     if (ctx->variable_display_values) {
         free(ctx->variable_display_values);
     }
+    if (ctx->batch) {
+        readstat_batch_free(ctx->batch);
+    }
+    if (ctx->zsav_ctx) {
+        zsav_ctx_free(ctx->zsav_ctx);
+    }
     free(ctx);
 }
 
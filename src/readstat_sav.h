@@ -68,6 +68,28 @@ typedef struct sav_dictionary_termination_record_s {
     int32_t  filler;
 } sav_dictionary_termination_record_t;
 
+// ZSAV files
+
+typedef struct zsav_header_record_s {
+    int64_t  zheader_ofs;
+    int64_t  ztrailer_ofs;
+    int64_t  ztrailer_len;
+} zsav_header_record_t;
+
+typedef struct zsav_trailer_record_s {
+    int64_t  bias;
+    int64_t  zero;
+    int32_t  block_size;
+    int32_t  n_blocks;
+} zsav_trailer_record_t;
+
+typedef struct zsav_block_record_s {
+    int64_t  uncompressed_ofs;
+    int64_t  compressed_ofs;
+    int32_t  uncompressed_size;
+    int32_t  compressed_size;
+} zsav_block_record_t;
+
 #pragma pack(pop)
 
 typedef struct sav_ctx_s {
@@ -75,7 +97,10 @@ typedef struct sav_ctx_s {
     readstat_progress_handler       progress_handler;
     readstat_value_handler          value_handler;
     readstat_value_label_handler    value_label_handler;
+    struct readstat_batch_s        *batch;
     size_t                          file_size;
+    double                          next_progress;
+    double                          progress_granularity;
     readstat_io_t                  *io;
     void                           *user_ctx;
 
@@ -87,15 +112,19 @@ typedef struct sav_ctx_s {
     time_t         timestamp;
     int32_t       *variable_display_values;
     int            variable_display_values_count;
-    iconv_t        converter;
+    struct readstat_converter_s *converter;
     int            var_index;
     int            var_offset;
     int            var_count;
     int            record_count;
     int            row_limit;
+    int            row_offset;
     int            value_labels_count;
     int            fweight_index;
+    int            thread_count;
+    struct zsav_ctx_s *zsav_ctx;
     unsigned int   data_is_compressed:1;
+    unsigned int   data_is_zlib_compressed:1;
     unsigned int   machine_needs_byte_swap:1;
 } sav_ctx_t;
 
@@ -106,6 +135,10 @@ typedef struct sav_ctx_s {
 #define SAV_RECORD_TYPE_HAS_DATA                7
 #define SAV_RECORD_TYPE_DICT_TERMINATION        999
 
+#define SAV_COMPRESSION_NONE             0
+#define SAV_COMPRESSION_ROW              1
+#define SAV_COMPRESSION_ZLIB             2
+
 #define SAV_RECORD_SUBTYPE_INTEGER_INFO       3
 #define SAV_RECORD_SUBTYPE_FP_INFO            4
 #define SAV_RECORD_SUBTYPE_VAR_DISPLAY       11
@@ -0,0 +1,92 @@
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "readstat.h"
+#include "readstat_sav.h"
+#include "readstat_sav_compress.h"
+
+size_t sav_compressed_row_bound(size_t row_len) {
+    size_t slices = row_len / 8;
+    /* A block holds eight commands plus eight raw slices; a case can also
+     * complete the block left over from the previous one */
+    return (slices / 8 + 2) * (8 + 64);
+}
+
+static size_t sav_compress_flush_block(unsigned char *output, sav_compress_state_t *state) {
+    size_t len = 0;
+
+    memcpy(&output[len], state->commands, sizeof(state->commands));
+    len += sizeof(state->commands);
+
+    memcpy(&output[len], state->data, state->data_len);
+    len += state->data_len;
+
+    memset(state->commands, SAV_COMPRESSION_CODE_PADDING, sizeof(state->commands));
+    state->commands_count = 0;
+    state->data_len = 0;
+
+    return len;
+}
+
+static size_t sav_compress_slice(unsigned char *output, unsigned char command,
+        const unsigned char *raw, sav_compress_state_t *state) {
+    state->commands[state->commands_count++] = command;
+    if (command == SAV_COMPRESSION_CODE_RAW) {
+        memcpy(&state->data[state->data_len], raw, 8);
+        state->data_len += 8;
+    }
+    if (state->commands_count == sizeof(state->commands))
+        return sav_compress_flush_block(output, state);
+
+    return 0;
+}
+
+static unsigned char sav_compress_number(const unsigned char *slice) {
+    uint64_t bits;
+    double fp_value;
+
+    memcpy(&bits, slice, sizeof(uint64_t));
+    if (bits == SAV_MISSING_DOUBLE)
+        return SAV_COMPRESSION_CODE_SYSMIS;
+
+    memcpy(&fp_value, slice, sizeof(double));
+    if (fp_value >= 1 - SAV_COMPRESSION_BIAS && fp_value < 252 - SAV_COMPRESSION_BIAS &&
+            (int)fp_value == fp_value && !(fp_value == 0.0 && signbit(fp_value))) {
+        return (unsigned char)((int)fp_value + SAV_COMPRESSION_BIAS);
+    }
+
+    return SAV_COMPRESSION_CODE_RAW;
+}
+
+size_t sav_compress_row(unsigned char *output, const unsigned char *row,
+        readstat_writer_t *writer, sav_compress_state_t *state) {
+    size_t len = 0;
+    int i;
+    for (i=0; i<writer->variables_count; i++) {
+        readstat_variable_t *variable = readstat_get_variable(writer, i);
+        const unsigned char *slice = &row[variable->offset];
+        if (variable->type == READSTAT_TYPE_STRING) {
+            size_t j;
+            for (j=0; j<variable->storage_width; j+=8) {
+                unsigned char command = SAV_COMPRESSION_CODE_RAW;
+                if (memcmp(&slice[j], "        ", 8) == 0)
+                    command = SAV_COMPRESSION_CODE_SPACES;
+
+                len += sav_compress_slice(&output[len], command, &slice[j], state);
+            }
+        } else {
+            len += sav_compress_slice(&output[len], sav_compress_number(slice), slice, state);
+        }
+    }
+    return len;
+}
+
+size_t sav_compress_finish(unsigned char *output, sav_compress_state_t *state) {
+    if (state->commands_count == 0)
+        return 0;
+
+    state->commands[state->commands_count++] = SAV_COMPRESSION_CODE_END;
+    return sav_compress_flush_block(output, state);
+}
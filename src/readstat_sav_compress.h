@@ -0,0 +1,31 @@
+
+#define SAV_COMPRESSION_BIAS       100
+
+#define SAV_COMPRESSION_CODE_PADDING     0
+#define SAV_COMPRESSION_CODE_END       252
+#define SAV_COMPRESSION_CODE_RAW       253
+#define SAV_COMPRESSION_CODE_SPACES    254
+#define SAV_COMPRESSION_CODE_SYSMIS    255
+
+/* Streaming encoder for SPSS bytecode compression. Each 8-byte slice of a
+ * case becomes one command byte; commands are grouped eight to a block, and
+ * each block is followed by the raw slices its commands refer to. Blocks
+ * run on across case boundaries, so a block that is not yet full is kept
+ * here until the next case (or the end of the data) fills it. */
+typedef struct sav_compress_state_s {
+    unsigned char   commands[8];
+    int             commands_count;
+    unsigned char   data[64];
+    size_t          data_len;
+} sav_compress_state_t;
+
+/* Largest output of sav_compress_row() for a case of row_len bytes */
+size_t sav_compressed_row_bound(size_t row_len);
+
+/* Encodes one case, appending every block that it completes to output and
+ * returning the number of bytes appended */
+size_t sav_compress_row(unsigned char *output, const unsigned char *row,
+        readstat_writer_t *writer, sav_compress_state_t *state);
+
+/* Closes out the last block with an end-of-data code */
+size_t sav_compress_finish(unsigned char *output, sav_compress_state_t *state);
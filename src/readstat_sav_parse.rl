@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include "readstat_sav.h"
 #include "readstat_sav_parse.h"
+#include "readstat_convert.h"
 
 typedef struct varlookup {
     char      name[8*4+1];
@@ -63,8 +64,8 @@ readstat_error_t sav_parse_long_variable_names_record(void *data, int count, sav
         size_t input_len = count;
         size_t output_len = input_len * 4;
         pe = p = output_buffer = malloc(output_len);
-        size_t status = iconv(ctx->converter, 
-                (readstat_iconv_inbuf_t)&data, &input_len,
+        size_t status = readstat_iconv(ctx->converter, 
+                (const char **)&data, &input_len,
                 (char **)&pe, &output_len);
         if (status == (size_t)-1) {
             free(output_buffer);
@@ -170,8 +171,8 @@ readstat_error_t sav_parse_very_long_string_record(void *data, int count, sav_ct
 
         pe = p = output_buffer = malloc(output_len);
 
-        size_t status = iconv(ctx->converter, 
-                (readstat_iconv_inbuf_t)&data, &input_len,
+        size_t status = readstat_iconv(ctx->converter, 
+                (const char **)&data, &input_len,
                 (char **)&pe, &output_len);
         if (status == (size_t)-1) {
             free(output_buffer);
@@ -12,6 +12,12 @@
 #include "readstat_sav_parse.h"
 #include "readstat_sav_parse_timestamp.h"
 #include "readstat_convert.h"
+#include "readstat_batch.h"
+#include "readstat_dictionary.h"
+#include "readstat_filter.h"
+#include "readstat_progress.h"
+#include "readstat_variable.h"
+#include "readstat_zsav_read.h"
 
 #define DATA_BUFFER_SIZE            65536
 
@@ -135,7 +141,54 @@ static readstat_error_t sav_parse_long_value_labels_record(const void *data, siz
 
 static readstat_error_t sav_update_progress(sav_ctx_t *ctx) {
     readstat_io_t *io = ctx->io;
-    return io->update(ctx->file_size, ctx->progress_handler, ctx->user_ctx, io->io_ctx);
+    return readstat_update_progress(io, ctx->file_size, ctx->progress_handler, ctx->user_ctx,
+            ctx->progress_granularity, &ctx->next_progress);
+}
+
+static readstat_error_t sav_submit_value(sav_ctx_t *ctx, int row, int var_index, readstat_value_t value) {
+    if (ctx->value_handler && ctx->value_handler(row, var_index, value, ctx->user_ctx))
+        return READSTAT_ERROR_USER_ABORT;
+
+    if (ctx->batch)
+        return readstat_batch_put_value(ctx->batch, var_index, value);
+
+    return READSTAT_OK;
+}
+
+/* Converts a string assembled from its segments, through the variable's
+ * dictionary if it has one, and submits it */
+static readstat_error_t sav_submit_string_value(sav_ctx_t *ctx, int row, spss_varinfo_t *var_info,
+        const char *raw_str_value, size_t raw_str_used, char *utf8_str_value, size_t utf8_str_value_len) {
+    readstat_value_t value = { .type = READSTAT_TYPE_STRING };
+    readstat_error_t retval = READSTAT_OK;
+
+    if (var_info->dictionary) {
+        retval = readstat_dictionary_convert(var_info->dictionary, raw_str_value, raw_str_used,
+                ctx->converter, &value);
+    } else {
+        retval = readstat_convert_len(utf8_str_value, utf8_str_value_len,
+                raw_str_value, raw_str_used, ctx->converter, &value.string_len);
+        value.v.string_value = utf8_str_value;
+    }
+    if (retval != READSTAT_OK)
+        return retval;
+
+    return sav_submit_value(ctx, row, var_info->index, value);
+}
+
+/* Points *out_buffer at the next block of case data, borrowing it from
+ * the IO layer when possible and otherwise reading it into storage */
+static ssize_t sav_read_data_block(sav_ctx_t *ctx, unsigned char *storage, size_t storage_len,
+        const unsigned char **out_buffer) {
+    readstat_io_t *io = ctx->io;
+    if (ctx->zsav_ctx)
+        return zsav_read_block(ctx->zsav_ctx, out_buffer);
+
+    if (io->borrow)
+        return io->borrow((const void **)out_buffer, storage_len, io->io_ctx);
+
+    *out_buffer = storage;
+    return io->read(storage, storage_len, io->io_ctx);
 }
 
 static readstat_error_t sav_skip_variable_record(sav_ctx_t *ctx) {
@@ -365,7 +418,8 @@ static readstat_error_t sav_submit_value_labels(value_label_t *value_labels, int
             spss_tag_missing_double(&value, missingness);
         } else {
             char unpadded_val[8*4+1];
-            retval = readstat_convert(unpadded_val, sizeof(unpadded_val), vlabel->value, 8, ctx->converter);
+            retval = readstat_convert_len(unpadded_val, sizeof(unpadded_val), vlabel->value, 8, ctx->converter,
+                    &value.string_len);
             if (retval != READSTAT_OK)
                 break;
 
@@ -506,6 +560,7 @@ static readstat_error_t sav_read_dictionary_termination_record(sav_ctx_t *ctx) {
 
 static readstat_error_t sav_read_data(sav_ctx_t *ctx) {
     readstat_error_t retval = READSTAT_OK;
+    readstat_io_t *io = ctx->io;
     int longest_string = 256;
     int rows = 0;
     int i;
@@ -516,8 +571,32 @@ static readstat_error_t sav_read_data(sav_ctx_t *ctx) {
             longest_string = info->string_length;
         }
     }
+    if (ctx->row_offset && !ctx->data_is_compressed) {
+        /* Uncompressed cases all have the same width, so jump over them */
+        off_t case_size = 0;
+        for (i=0; i<ctx->var_index; i++) {
+            case_size += 8 * ctx->varinfo[i].width;
+        }
+        if (io->seek(case_size * ctx->row_offset, READSTAT_SEEK_CUR, io->io_ctx) == -1) {
+            retval = READSTAT_ERROR_SEEK;
+            goto done;
+        }
+    }
+    if (ctx->data_is_zlib_compressed) {
+        if ((retval = zsav_ctx_init(ctx, &ctx->zsav_ctx)) != READSTAT_OK)
+            goto done;
+    }
+    if (io->advise) {
+        off_t data_start = io->seek(0, READSTAT_SEEK_CUR, io->io_ctx);
+        if (data_start != -1) {
+            io->advise(data_start, 0, READSTAT_ADVICE_SEQUENTIAL, io->io_ctx);
+        }
+    }
+
     if (ctx->data_is_compressed) {
         retval = sav_read_compressed_data(longest_string, ctx, &rows);
+        if (retval == READSTAT_OK && ctx->zsav_ctx)
+            retval = zsav_error(ctx->zsav_ctx);
     } else {
         retval = sav_read_uncompressed_data(longest_string, ctx, &rows);
     }
@@ -535,7 +614,6 @@ done:
 static readstat_error_t sav_read_uncompressed_data(size_t longest_string, 
         sav_ctx_t *ctx, int *out_rows) {
     readstat_error_t retval = READSTAT_OK;
-    readstat_io_t *io = ctx->io;
     int segment_offset = 0;
     int row = 0, var_index = 0, col = 0;
     double fp_value;
@@ -545,7 +623,8 @@ static readstat_error_t sav_read_uncompressed_data(size_t longest_string,
     char *raw_str_value = NULL;
     char *utf8_str_value = NULL;
     size_t utf8_str_value_len = 0;
-    unsigned char buffer[DATA_BUFFER_SIZE];
+    unsigned char storage[DATA_BUFFER_SIZE];
+    const unsigned char *buffer = storage;
     int buffer_used = 0;
 
     if ((raw_str_value = malloc(longest_string)) == NULL) {
@@ -563,7 +642,7 @@ static readstat_error_t sav_read_uncompressed_data(size_t longest_string,
             if (retval != READSTAT_OK)
                 goto done;
 
-            if ((buffer_used = io->read(buffer, sizeof(buffer), io->io_ctx)) == -1 ||
+            if ((buffer_used = sav_read_data_block(ctx, storage, sizeof(storage), &buffer)) == -1 ||
                 buffer_used == 0 || (buffer_used % 8) != 0)
                 goto done;
 
@@ -578,7 +657,7 @@ static readstat_error_t sav_read_uncompressed_data(size_t longest_string,
             goto done;
         }
         if (var_info->type == READSTAT_TYPE_STRING) {
-            if (raw_str_used + 8 <= longest_string) {
+            if (!var_info->skip && raw_str_used + 8 <= longest_string) {
                 memcpy(raw_str_value + raw_str_used, &buffer[data_offset], 8);
                 raw_str_used += 8;
             }
@@ -586,14 +665,11 @@ static readstat_error_t sav_read_uncompressed_data(size_t longest_string,
             if (offset == col_info->width) {
                 segment_offset++;
                 if (segment_offset == var_info->n_segments) {
-                    retval = readstat_convert(utf8_str_value, utf8_str_value_len, 
-                            raw_str_value, raw_str_used, ctx->converter);
-                    if (retval != READSTAT_OK)
-                        goto done;
-                    value.v.string_value = utf8_str_value;
-                    if (ctx->value_handler(row, var_info->index, value, ctx->user_ctx)) {
-                        retval = READSTAT_ERROR_USER_ABORT;
-                        goto done;
+                    if (!var_info->skip) {
+                        retval = sav_submit_string_value(ctx, row, var_info, raw_str_value, raw_str_used,
+                                utf8_str_value, utf8_str_value_len);
+                        if (retval != READSTAT_OK)
+                            goto done;
                     }
                     raw_str_used = 0;
                     segment_offset = 0;
@@ -603,15 +679,15 @@ static readstat_error_t sav_read_uncompressed_data(size_t longest_string,
                 col++;
             }
         } else if (var_info->type == READSTAT_TYPE_DOUBLE) {
-            memcpy(&fp_value, &buffer[data_offset], 8);
-            if (ctx->machine_needs_byte_swap) {
-                fp_value = byteswap_double(fp_value);
-            }
-            value.v.double_value = fp_value;
-            spss_tag_missing_double(&value, &var_info->missingness);
-            if (ctx->value_handler(row, var_info->index, value, ctx->user_ctx)) {
-                retval = READSTAT_ERROR_USER_ABORT;
-                goto done;
+            if (!var_info->skip) {
+                memcpy(&fp_value, &buffer[data_offset], 8);
+                if (ctx->machine_needs_byte_swap) {
+                    fp_value = byteswap_double(fp_value);
+                }
+                value.v.double_value = fp_value;
+                spss_tag_missing_double(&value, &var_info->missingness);
+                if ((retval = sav_submit_value(ctx, row, var_info->index, value)) != READSTAT_OK)
+                    goto done;
             }
             var_index += var_info->n_segments;
             col++;
@@ -620,6 +696,8 @@ static readstat_error_t sav_read_uncompressed_data(size_t longest_string,
             col = 0;
             var_index = 0;
             row++;
+            if (ctx->batch && (retval = readstat_batch_end_row(ctx->batch)) != READSTAT_OK)
+                goto done;
         }
         if (row == ctx->row_limit) {
             goto done;
@@ -627,6 +705,9 @@ static readstat_error_t sav_read_uncompressed_data(size_t longest_string,
         data_offset += 8;
     }
 done:
+    if (retval == READSTAT_OK && ctx->batch) {
+        retval = readstat_batch_flush(ctx->batch);
+    }
     if (retval == READSTAT_OK) {
         if (out_rows)
             *out_rows = row;
@@ -642,11 +723,11 @@ done:
 static readstat_error_t sav_read_compressed_data(size_t longest_string,
         sav_ctx_t *ctx, int *out_rows) {
     readstat_error_t retval = READSTAT_OK;
-    readstat_io_t *io = ctx->io;
     unsigned char chunk[8];
     int offset = 0;
     int segment_offset = 0;
     int row = 0, var_index = 0, col = 0;
+    int skipped_rows = 0;
     int i;
     double fp_value;
     off_t data_offset = 0;
@@ -654,7 +735,8 @@ static readstat_error_t sav_read_compressed_data(size_t longest_string,
     char *raw_str_value = NULL;
     char *utf8_str_value = NULL;
     size_t utf8_str_value_len = 0;
-    unsigned char buffer[DATA_BUFFER_SIZE];
+    unsigned char storage[DATA_BUFFER_SIZE];
+    const unsigned char *buffer = storage;
     int buffer_used = 0;
 
     if ((raw_str_value = malloc(longest_string)) == NULL) {
@@ -672,7 +754,7 @@ static readstat_error_t sav_read_compressed_data(size_t longest_string,
             if (retval != READSTAT_OK)
                 goto done;
 
-            if ((buffer_used = io->read(buffer, sizeof(buffer), io->io_ctx)) == -1 ||
+            if ((buffer_used = sav_read_data_block(ctx, storage, sizeof(storage), &buffer)) == -1 ||
                 buffer_used == 0 || (buffer_used % 8) != 0)
                 goto done;
 
@@ -692,6 +774,8 @@ static readstat_error_t sav_read_compressed_data(size_t longest_string,
             col_info = &ctx->varinfo[col];
             var_info = &ctx->varinfo[var_index];
             readstat_value_t value = { .type = var_info->type };
+            /* Rows before the offset are scanned without decoding anything */
+            int skip = var_info->skip || skipped_rows < ctx->row_offset;
             switch (chunk[i]) {
                 case 0:
                     break;
@@ -699,14 +783,14 @@ static readstat_error_t sav_read_compressed_data(size_t longest_string,
                     goto done;
                 case 253:
                     if (data_offset >= buffer_used) {
-                        if ((buffer_used = io->read(buffer, sizeof(buffer), io->io_ctx)) == -1 ||
+                        if ((buffer_used = sav_read_data_block(ctx, storage, sizeof(storage), &buffer)) == -1 ||
                             buffer_used == 0 || (buffer_used % 8) != 0)
                             goto done;
 
                         data_offset = 0;
                     }
                     if (var_info->type == READSTAT_TYPE_STRING) {
-                        if (raw_str_used + 8 <= longest_string) {
+                        if (!skip && raw_str_used + 8 <= longest_string) {
                             memcpy(raw_str_value + raw_str_used, &buffer[data_offset], 8);
                             raw_str_used += 8;
                         }
@@ -714,14 +798,11 @@ static readstat_error_t sav_read_compressed_data(size_t longest_string,
                         if (offset == col_info->width) {
                             segment_offset++;
                             if (segment_offset == var_info->n_segments) {
-                                retval = readstat_convert(utf8_str_value, utf8_str_value_len, 
-                                        raw_str_value, raw_str_used, ctx->converter);
-                                if (retval != READSTAT_OK)
-                                    goto done;
-                                value.v.string_value = utf8_str_value;
-                                if (ctx->value_handler(row, var_info->index, value, ctx->user_ctx)) {
-                                    retval = READSTAT_ERROR_USER_ABORT;
-                                    goto done;
+                                if (!skip) {
+                                    retval = sav_submit_string_value(ctx, row, var_info, raw_str_value, raw_str_used,
+                                            utf8_str_value, utf8_str_value_len);
+                                    if (retval != READSTAT_OK)
+                                        goto done;
                                 }
                                 raw_str_used = 0;
                                 segment_offset = 0;
@@ -731,15 +812,15 @@ static readstat_error_t sav_read_compressed_data(size_t longest_string,
                             col++;
                         }
                     } else if (var_info->type == READSTAT_TYPE_DOUBLE) {
-                        memcpy(&fp_value, &buffer[data_offset], 8);
-                        if (ctx->machine_needs_byte_swap) {
-                            fp_value = byteswap_double(fp_value);
-                        }
-                        value.v.double_value = fp_value;
-                        spss_tag_missing_double(&value, &var_info->missingness);
-                        if (ctx->value_handler(row, var_info->index, value, ctx->user_ctx)) {
-                            retval = READSTAT_ERROR_USER_ABORT;
-                            goto done;
+                        if (!skip) {
+                            memcpy(&fp_value, &buffer[data_offset], 8);
+                            if (ctx->machine_needs_byte_swap) {
+                                fp_value = byteswap_double(fp_value);
+                            }
+                            value.v.double_value = fp_value;
+                            spss_tag_missing_double(&value, &var_info->missingness);
+                            if ((retval = sav_submit_value(ctx, row, var_info->index, value)) != READSTAT_OK)
+                                goto done;
                         }
                         var_index += var_info->n_segments;
                         col++;
@@ -748,7 +829,7 @@ static readstat_error_t sav_read_compressed_data(size_t longest_string,
                     break;
                 case 254:
                     if (var_info->type == READSTAT_TYPE_STRING) {
-                        if (raw_str_used + 8 <= longest_string) {
+                        if (!skip && raw_str_used + 8 <= longest_string) {
                             memcpy(raw_str_value + raw_str_used, SAV_EIGHT_SPACES, 8);
                             raw_str_used += 8;
                         }
@@ -756,14 +837,11 @@ static readstat_error_t sav_read_compressed_data(size_t longest_string,
                         if (offset == col_info->width) {
                             segment_offset++;
                             if (segment_offset == var_info->n_segments) {
-                                retval = readstat_convert(utf8_str_value, utf8_str_value_len, 
-                                        raw_str_value, raw_str_used, ctx->converter);
-                                if (retval != READSTAT_OK)
-                                    goto done;
-                                value.v.string_value = utf8_str_value;
-                                if (ctx->value_handler(row, var_info->index, value, ctx->user_ctx)) {
-                                    retval = READSTAT_ERROR_USER_ABORT;
-                                    goto done;
+                                if (!skip) {
+                                    retval = sav_submit_string_value(ctx, row, var_info, raw_str_value, raw_str_used,
+                                            utf8_str_value, utf8_str_value_len);
+                                    if (retval != READSTAT_OK)
+                                        goto done;
                                 }
                                 raw_str_used = 0;
                                 segment_offset = 0;
@@ -780,19 +858,18 @@ static readstat_error_t sav_read_compressed_data(size_t longest_string,
                 case 255:
                     value.v.double_value = NAN;
                     value.is_system_missing = 1;
-                    if (ctx->value_handler(row, var_info->index, value, ctx->user_ctx)) {
-                        retval = READSTAT_ERROR_USER_ABORT;
+                    if (!skip &&
+                            (retval = sav_submit_value(ctx, row, var_info->index, value)) != READSTAT_OK)
                         goto done;
-                    }
                     var_index += var_info->n_segments;
                     col++;
                     break;
                 default:
-                    value.v.double_value = chunk[i] - 100.0;
-                    spss_tag_missing_double(&value, &var_info->missingness);
-                    if (ctx->value_handler(row, var_info->index, value, ctx->user_ctx)) {
-                        retval = READSTAT_ERROR_USER_ABORT;
-                        goto done;
+                    if (!skip) {
+                        value.v.double_value = chunk[i] - 100.0;
+                        spss_tag_missing_double(&value, &var_info->missingness);
+                        if ((retval = sav_submit_value(ctx, row, var_info->index, value)) != READSTAT_OK)
+                            goto done;
                     }
                     var_index += var_info->n_segments;
                     col++;
@@ -801,13 +878,22 @@ static readstat_error_t sav_read_compressed_data(size_t longest_string,
             if (col == ctx->var_index) {
                 col = 0;
                 var_index = 0;
+                if (skipped_rows < ctx->row_offset) {
+                    skipped_rows++;
+                    continue;
+                }
                 row++;
+                if (ctx->batch && (retval = readstat_batch_end_row(ctx->batch)) != READSTAT_OK)
+                    goto done;
             }
             if (row == ctx->row_limit)
                 goto done;
         }
     }
 done:
+    if (retval == READSTAT_OK && ctx->batch) {
+        retval = readstat_batch_flush(ctx->batch);
+    }
     if (retval == READSTAT_OK) {
         if (out_rows)
             *out_rows = row;
@@ -853,8 +939,8 @@ static readstat_error_t sav_parse_machine_integer_info_record(const void *data,
         }
     }
     if (src_charset && dst_charset && strcmp(src_charset, dst_charset) != 0) {
-        iconv_t converter = iconv_open(dst_charset, src_charset);
-        if (converter == (iconv_t)-1) {
+        readstat_converter_t *converter = readstat_converter_open(dst_charset, src_charset);
+        if (converter == NULL) {
             return READSTAT_ERROR_UNSUPPORTED_CHARSET;
         }
         ctx->converter = converter;
@@ -1002,7 +1088,9 @@ static readstat_error_t sav_parse_long_value_labels_record(const void *data, siz
             goto cleanup;
         }
 
-        retval = readstat_convert(value_buffer, value_buffer_len, data_ptr, value_len, ctx->converter);
+        size_t value_string_len = 0;
+        retval = readstat_convert_len(value_buffer, value_buffer_len, data_ptr, value_len, ctx->converter,
+                &value_string_len);
         if (retval != READSTAT_OK)
             goto cleanup;
 
@@ -1039,6 +1127,7 @@ static readstat_error_t sav_parse_long_value_labels_record(const void *data, siz
 
         readstat_value_t value = { .type = READSTAT_TYPE_STRING };
         value.v.string_value = value_buffer;
+        value.string_len = value_string_len;
 
         ctx->value_label_handler(label_name_buf, value, label_buffer, ctx->user_ctx);
     }
@@ -1264,7 +1353,18 @@ static void sav_set_n_segments_and_var_count(sav_ctx_t *ctx) {
     }
 }
 
+static void sav_select_variables(readstat_parser_t *parser, sav_ctx_t *ctx) {
+    int i;
+    for (i=0; i<ctx->var_index;) {
+        spss_varinfo_t *info = &ctx->varinfo[i];
+        info->skip = !readstat_column_filter_selects(parser->column_filter,
+                info->index, spss_varinfo_name(info));
+        i += info->n_segments;
+    }
+}
+
 static readstat_error_t sav_handle_variables(readstat_parser_t *parser, sav_ctx_t *ctx) {
+    readstat_variable_buffer_t buffer;
     int i;
     readstat_error_t retval = READSTAT_OK;
 
@@ -1274,7 +1374,12 @@ static readstat_error_t sav_handle_variables(readstat_parser_t *parser, sav_ctx_
     for (i=0; i<ctx->var_index;) {
         char label_name_buf[256];
         spss_varinfo_t *info = &ctx->varinfo[i];
-        readstat_variable_t *variable = spss_init_variable_for_info(info);
+        if (info->skip) {
+            i += info->n_segments;
+            continue;
+        }
+
+        readstat_variable_t *variable = spss_init_variable_for_info(info, &buffer);
 
         snprintf(label_name_buf, sizeof(label_name_buf), SAV_LABEL_NAME_PREFIX "%d", info->labels_index);
 
@@ -1282,8 +1387,6 @@ static readstat_error_t sav_handle_variables(readstat_parser_t *parser, sav_ctx_
                 info->labels_index == -1 ? NULL : label_name_buf,
                 ctx->user_ctx);
 
-        spss_free_variable(variable);
-
         if (cb_retval) {
             retval = READSTAT_ERROR_USER_ABORT;
             goto cleanup;
@@ -1366,6 +1469,7 @@ readstat_error_t readstat_parse_sav(readstat_parser_t *parser, const char *path,
     }
 
     ctx->progress_handler = parser->progress_handler;
+    ctx->progress_granularity = parser->progress_granularity;
     ctx->error_handler = parser->error_handler;
     ctx->value_handler = parser->value_handler;
     ctx->value_label_handler = parser->value_label_handler;
@@ -1373,11 +1477,16 @@ readstat_error_t readstat_parse_sav(readstat_parser_t *parser, const char *path,
     ctx->output_encoding = parser->output_encoding;
     ctx->user_ctx = user_ctx;
     ctx->file_size = file_size;
+    ctx->row_offset = parser->row_offset;
+    ctx->thread_count = parser->thread_count;
+    if (ctx->record_count != -1 && ctx->row_offset > ctx->record_count)
+        ctx->row_offset = ctx->record_count;
+
     if (ctx->record_count == -1 ||
-            (parser->row_limit > 0 && parser->row_limit < ctx->record_count)) {
+            (parser->row_limit > 0 && parser->row_limit < ctx->record_count - ctx->row_offset)) {
         ctx->row_limit = parser->row_limit;
     } else {
-        ctx->row_limit = ctx->record_count;
+        ctx->row_limit = ctx->record_count - ctx->row_offset;
     }
     
     if ((retval = sav_parse_timestamp(ctx, &header)) != READSTAT_OK)
@@ -1420,13 +1529,47 @@ readstat_error_t readstat_parse_sav(readstat_parser_t *parser, const char *path,
 
     sav_parse_variable_display_parameter_record(ctx);
 
+    sav_select_variables(parser, ctx);
+
     if ((retval = sav_handle_variables(parser, ctx)) != READSTAT_OK)
         goto cleanup;
 
     if ((retval = sav_handle_fweight(parser, ctx)) != READSTAT_OK)
         goto cleanup;
 
-    if (ctx->value_handler) {
+    if (parser->string_dictionary_max) {
+        int i;
+        for (i=0; i<ctx->var_index;) {
+            spss_varinfo_t *info = &ctx->varinfo[i];
+            if (!info->skip && info->type == READSTAT_TYPE_STRING &&
+                    (info->dictionary = readstat_dictionary_init(parser->string_dictionary_max)) == NULL) {
+                retval = READSTAT_ERROR_MALLOC;
+                goto cleanup;
+            }
+            i += info->n_segments;
+        }
+    }
+
+    if (parser->batch_handler) {
+        if ((ctx->batch = readstat_batch_init(parser->batch_handler, parser->batch_size,
+                        ctx->var_count, ctx->user_ctx)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        int i;
+        for (i=0; i<ctx->var_index;) {
+            spss_varinfo_t *info = &ctx->varinfo[i];
+            if (!info->skip &&
+                    (retval = readstat_batch_add_column(ctx->batch, info->index, info->type)) != READSTAT_OK)
+                goto cleanup;
+            if (info->dictionary &&
+                    (retval = readstat_batch_set_dictionary(ctx->batch, info->index, info->dictionary)) != READSTAT_OK)
+                goto cleanup;
+            i += info->n_segments;
+        }
+    }
+
+    if (ctx->value_handler || ctx->batch) {
         retval = sav_read_data(ctx);
     }
     
@@ -1,6 +1,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -12,6 +13,8 @@
 #include "readstat_sav.h"
 #include "readstat_spss_parse.h"
 #include "readstat_writer.h"
+#include "readstat_sav_compress.h"
+#include "readstat_zsav_write.h"
 
 #define MAX_TEXT_SIZE               256
 #define MAX_LABEL_SIZE              256
@@ -60,14 +63,24 @@ static readstat_error_t sav_emit_header(readstat_writer_t *writer) {
     sav_file_header_record_t header;
     memset(&header, 0, sizeof(sav_file_header_record_t));
 
-    memcpy(header.rec_type, "$FL2", sizeof("$FL2")-1);
+    if (writer->compression == READSTAT_COMPRESS_BINARY) {
+        memcpy(header.rec_type, "$FL3", sizeof("$FL3")-1);
+    } else {
+        memcpy(header.rec_type, "$FL2", sizeof("$FL2")-1);
+    }
     memset(header.prod_name, ' ', sizeof(header.prod_name));
     memcpy(header.prod_name,
            "@(#) SPSS DATA FILE - " READSTAT_PRODUCT_URL, 
            sizeof("@(#) SPSS DATA FILE - " READSTAT_PRODUCT_URL)-1);
     header.layout_code = 2;
     header.nominal_case_size = writer->row_len / 8;
-    header.compressed = 0; /* TODO */
+    if (writer->compression == READSTAT_COMPRESS_ROWS) {
+        header.compressed = SAV_COMPRESSION_ROW;
+    } else if (writer->compression == READSTAT_COMPRESS_BINARY) {
+        header.compressed = SAV_COMPRESSION_ZLIB;
+    } else {
+        header.compressed = SAV_COMPRESSION_NONE;
+    }
     if (writer->fweight_variable) {
         int32_t dictionary_index = 1 + writer->fweight_variable->offset / 8;
         header.weight_index = dictionary_index;
@@ -670,10 +683,10 @@ static readstat_error_t sav_write_double(void *row, const readstat_variable_t *v
     return READSTAT_OK;
 }
 
-static readstat_error_t sav_write_string(void *row, const readstat_variable_t *var, const char *value) {
+static readstat_error_t sav_write_string(void *row, const readstat_variable_t *var,
+        const char *value, size_t value_len) {
     memset(row, ' ', var->storage_width);
-    if (value != NULL && value[0] != '\0') {
-        size_t value_len = strlen(value);
+    if (value != NULL && value_len) {
         if (value_len > var->storage_width)
             value_len = var->storage_width;
         memcpy(row, value, value_len);
@@ -705,12 +718,74 @@ static size_t sav_variable_width(readstat_type_t type, size_t user_width) {
     return 8;
 }
 
+typedef struct sav_row_compress_ctx_s {
+    sav_compress_state_t    state;
+    unsigned char          *buffer;
+    size_t                  buffer_len;
+} sav_row_compress_ctx_t;
+
+static void sav_row_compress_ctx_free(sav_row_compress_ctx_t *ctx) {
+    if (ctx) {
+        if (ctx->buffer)
+            free(ctx->buffer);
+        free(ctx);
+    }
+}
+
+static sav_row_compress_ctx_t *sav_row_compress_ctx_init(readstat_writer_t *writer) {
+    sav_row_compress_ctx_t *ctx = calloc(1, sizeof(sav_row_compress_ctx_t));
+    if (ctx == NULL)
+        return NULL;
+
+    ctx->buffer_len = sav_compressed_row_bound(writer->row_len);
+    if ((ctx->buffer = malloc(ctx->buffer_len)) == NULL) {
+        sav_row_compress_ctx_free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+static readstat_error_t sav_write_compressed_row(void *writer_ctx, void *row, size_t row_len) {
+    readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
+    sav_row_compress_ctx_t *ctx = writer->module_ctx;
+    size_t len = sav_compress_row(ctx->buffer, row, writer, &ctx->state);
+    if (len == 0)
+        return READSTAT_OK;
+
+    return readstat_write_bytes(writer, ctx->buffer, len);
+}
+
+static readstat_error_t sav_end_compressed_data(void *writer_ctx) {
+    readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
+    sav_row_compress_ctx_t *ctx = writer->module_ctx;
+    readstat_error_t retval = READSTAT_OK;
+    size_t len = 0;
+
+    if (ctx == NULL)
+        return READSTAT_ERROR_WRITER_NOT_INITIALIZED;
+
+    len = sav_compress_finish(ctx->buffer, &ctx->state);
+    if (len)
+        retval = readstat_write_bytes(writer, ctx->buffer, len);
+
+    sav_row_compress_ctx_free(ctx);
+    writer->module_ctx = NULL;
+
+    return retval;
+}
+
 static readstat_error_t sav_begin_data(void *writer_ctx) {
     readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
     readstat_error_t retval = READSTAT_OK;
     if (!writer->initialized)
         return READSTAT_ERROR_WRITER_NOT_INITIALIZED;
 
+    if (writer->compression == READSTAT_COMPRESS_ROWS) {
+        if ((writer->module_ctx = sav_row_compress_ctx_init(writer)) == NULL)
+            return READSTAT_ERROR_MALLOC;
+    }
+
     retval = sav_emit_header(writer);
     if (retval != READSTAT_OK)
         goto cleanup;
@@ -747,10 +822,26 @@ static readstat_error_t sav_begin_data(void *writer_ctx) {
     if (retval != READSTAT_OK)
         goto cleanup;
 
+    if (writer->compression == READSTAT_COMPRESS_BINARY) {
+        retval = zsav_begin_data(writer);
+    }
+
 cleanup:
+    if (retval != READSTAT_OK && writer->module_ctx) {
+        sav_row_compress_ctx_free(writer->module_ctx);
+        writer->module_ctx = NULL;
+    }
     return retval;
 }
 
+/* The header went out with ncases = -1, which SPSS reads as "unknown" */
+static readstat_error_t sav_patch_row_count(void *writer_ctx) {
+    readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
+    int32_t ncases = writer->row_count;
+    return readstat_write_bytes_at(writer, offsetof(sav_file_header_record_t, ncases),
+            &ncases, sizeof(int32_t));
+}
+
 readstat_error_t readstat_begin_writing_sav(readstat_writer_t *writer, void *user_ctx, long row_count) {
     writer->row_count = row_count;
     writer->user_ctx = user_ctx;
@@ -766,6 +857,21 @@ readstat_error_t readstat_begin_writing_sav(readstat_writer_t *writer, void *use
     writer->callbacks.write_missing_number = &sav_write_missing_number;
     writer->callbacks.write_missing_tagged = &sav_write_missing_tagged;
     writer->callbacks.begin_data = &sav_begin_data;
+    writer->callbacks.patch_row_count = &sav_patch_row_count;
+
+    if (writer->compression == READSTAT_COMPRESS_ROWS) {
+        writer->callbacks.write_row = &sav_write_compressed_row;
+        writer->callbacks.end_data = &sav_end_compressed_data;
+#if HAVE_ZLIB_H
+    } else if (writer->compression == READSTAT_COMPRESS_BINARY) {
+        writer->callbacks.write_row = &zsav_write_row;
+        writer->callbacks.end_data = &zsav_end_data;
+        writer->patches_header = 1;
+#endif
+    } else if (writer->compression != READSTAT_COMPRESS_NONE) {
+        return READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
+    }
+
     writer->initialized = 1;
 
     return READSTAT_OK;
@@ -5,6 +5,7 @@
 #include "readstat.h"
 #include "readstat_spss.h"
 #include "readstat_spss_parse.h"
+#include "readstat_variable.h"
 
 typedef struct spss_type_s {
     int     type;
@@ -158,8 +159,15 @@ readstat_missingness_t spss_missingness_for_info(spss_varinfo_t *info) {
     return missingness;
 }
 
-readstat_variable_t *spss_init_variable_for_info(spss_varinfo_t *info) {
-    readstat_variable_t *variable = calloc(1, sizeof(readstat_variable_t));
+const char *spss_varinfo_name(spss_varinfo_t *info) {
+    if (info->longname[0])
+        return info->longname;
+
+    return info->name;
+}
+
+readstat_variable_t *spss_init_variable_for_info(spss_varinfo_t *info, readstat_variable_buffer_t *buffer) {
+    readstat_variable_t *variable = readstat_variable_buffer_reset(buffer);
 
     variable->index = info->index;
     variable->type = info->type;
@@ -169,28 +177,21 @@ readstat_variable_t *spss_init_variable_for_info(spss_varinfo_t *info) {
         variable->storage_width = 8 * info->width;
     }
 
-    if (info->longname[0]) {
-        snprintf(variable->name, sizeof(variable->name), "%s", info->longname);
-    } else {
-        snprintf(variable->name, sizeof(variable->name), "%s", info->name);
-    }
+    variable->name = spss_varinfo_name(info);
     if (info->label) {
-        snprintf(variable->label, sizeof(variable->label), "%s", info->label);
+        variable->label = info->label;
     }
 
-    spss_format(variable->format, sizeof(variable->format), &info->print_format);
+    spss_format(buffer->format, sizeof(buffer->format), &info->print_format);
 
-    variable->missingness = info->missingness;
+    variable->missing_ranges = info->missingness.missing_ranges;
+    variable->missing_ranges_count = info->missingness.missing_ranges_count;
     variable->measure = info->measure;
     variable->display_width = info->display_width;
 
     return variable;
 }
 
-void spss_free_variable(readstat_variable_t *variable) {
-    free(variable);
-}
-
 int32_t spss_measure_from_readstat_measure(readstat_measure_t measure) {
     int32_t sav_measure = SAV_MEASURE_UNKNOWN;
     if (measure == READSTAT_MEASURE_NOMINAL) {
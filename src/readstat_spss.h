@@ -65,6 +65,12 @@ typedef struct spss_format_s {
     int          decimal_places;
 } spss_format_t;
 
+/* SPSS allows at most three missing values, or a range and one value */
+typedef struct readstat_missingness_s {
+    readstat_value_t missing_ranges[6];
+    long             missing_ranges_count;
+} readstat_missingness_t;
+
 typedef struct spss_varinfo_s {
     readstat_type_t  type;
     int              labels_index;
@@ -85,6 +91,8 @@ typedef struct spss_varinfo_s {
     readstat_measure_t      measure;
     readstat_alignment_t    alignment;
     int                     display_width;
+    int                     skip;
+    struct readstat_dictionary_s *dictionary;
 } spss_varinfo_t;
 
 int spss_format(char *buffer, size_t len, spss_format_t *format);
@@ -92,8 +100,11 @@ void spss_tag_missing_double(readstat_value_t *value, readstat_missingness_t *mi
 int spss_varinfo_compare(const void *elem1, const void *elem2);
 
 readstat_missingness_t spss_missingness_for_info(spss_varinfo_t *info);
-readstat_variable_t *spss_init_variable_for_info(spss_varinfo_t *info);
-void spss_free_variable(readstat_variable_t *);
+
+struct readstat_variable_buffer_s;
+readstat_variable_t *spss_init_variable_for_info(spss_varinfo_t *info,
+        struct readstat_variable_buffer_s *buffer);
+const char *spss_varinfo_name(spss_varinfo_t *info);
 
 uint64_t spss_64bit_value(readstat_value_t value);
 
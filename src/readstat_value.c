@@ -117,3 +117,30 @@ const char *readstat_string_value(readstat_value_t value) {
 
     return NULL;
 }
+
+size_t readstat_string_value_len(readstat_value_t value) {
+    if (value.type == READSTAT_TYPE_STRING || value.type == READSTAT_TYPE_LONG_STRING)
+        return value.v.string_value ? value.string_len : 0;
+
+    return 0;
+}
+
+int32_t readstat_string_value_dictionary_id(readstat_value_t value) {
+    if (value.type == READSTAT_TYPE_STRING || value.type == READSTAT_TYPE_LONG_STRING)
+        return (int32_t)value.dictionary_entry - 1;
+
+    return -1;
+}
+
+int readstat_column_is_system_missing(const readstat_column_t *column, int i) {
+    return (column->system_missing[i / 8] >> (i % 8)) & 1;
+}
+
+int readstat_column_is_considered_missing(const readstat_column_t *column, int i) {
+    return (column->considered_missing[i / 8] >> (i % 8)) & 1;
+}
+
+int readstat_column_is_missing(const readstat_column_t *column, int i) {
+    return (readstat_column_is_system_missing(column, i) ||
+            readstat_column_is_considered_missing(column, i));
+}
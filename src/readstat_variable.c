@@ -1,6 +1,13 @@
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include "readstat.h"
+#include "readstat_convert.h"
+#include "readstat_dictionary.h"
+#include "readstat_variable.h"
+
+#define VARIABLE_STORE_CHUNK_SIZE   1024
 
 static readstat_value_t make_blank_value();
 static readstat_value_t make_double_value(double dval);
@@ -16,21 +23,21 @@ static readstat_value_t make_double_value(double dval) {
 }
 
 const char *readstat_variable_get_name(const readstat_variable_t *variable) {
-    if (variable->name[0])
+    if (variable->name && variable->name[0])
         return variable->name;
 
     return NULL;
 }
 
 const char *readstat_variable_get_label(const readstat_variable_t *variable) {
-    if (variable->label[0])
+    if (variable->label && variable->label[0])
         return variable->label;
 
     return NULL;
 }
 
 const char *readstat_variable_get_format(const readstat_variable_t *variable) {
-    if (variable->format[0])
+    if (variable->format && variable->format[0])
         return variable->format;
 
     return NULL;
@@ -57,22 +64,20 @@ int readstat_variable_get_display_width(const readstat_variable_t *variable) {
 }
 
 int readstat_variable_get_missing_ranges_count(const readstat_variable_t *variable) {
-    return variable->missingness.missing_ranges_count;
+    return variable->missing_ranges_count;
 }
 
 readstat_value_t readstat_variable_get_missing_range_lo(const readstat_variable_t *variable, int i) {
-    if (i < variable->missingness.missing_ranges_count &&
-            2*i+1 < sizeof(variable->missingness.missing_ranges)/sizeof(variable->missingness.missing_ranges[0])) {
-        return variable->missingness.missing_ranges[2*i];
+    if (i >= 0 && i < variable->missing_ranges_count) {
+        return variable->missing_ranges[2*i];
     }
 
     return make_blank_value();
 }
 
 readstat_value_t readstat_variable_get_missing_range_hi(const readstat_variable_t *variable, int i) {
-    if (i < variable->missingness.missing_ranges_count &&
-            2*i+1 < sizeof(variable->missingness.missing_ranges)/sizeof(variable->missingness.missing_ranges[0])) {
-        return variable->missingness.missing_ranges[2*i+1];
+    if (i >= 0 && i < variable->missing_ranges_count) {
+        return variable->missing_ranges[2*i+1];
     }
 
     return make_blank_value();
@@ -83,11 +88,99 @@ void readstat_variable_add_missing_double_value(readstat_variable_t *variable, d
 }
 
 void readstat_variable_add_missing_double_range(readstat_variable_t *variable, double lo, double hi) {
-    int i = readstat_variable_get_missing_ranges_count(variable);
-    if (2*i < sizeof(variable->missingness.missing_ranges)/sizeof(variable->missingness.missing_ranges[0])) {
-        variable->missingness.missing_ranges[2*i] = make_double_value(lo);
-        variable->missingness.missing_ranges[2*i+1] = make_double_value(hi);
-        variable->missingness.missing_ranges_count++;
+    /* Only the store owns (and frees) a variable's ranges */
+    if (variable->store == NULL)
+        return;
+
+    int i = variable->missing_ranges_count;
+    readstat_value_t *missing_ranges = realloc(variable->missing_ranges, 2*(i+1) * sizeof(readstat_value_t));
+    if (missing_ranges == NULL)
+        return;
+
+    missing_ranges[2*i] = make_double_value(lo);
+    missing_ranges[2*i+1] = make_double_value(hi);
+    variable->missing_ranges = missing_ranges;
+    variable->missing_ranges_count++;
+}
+
+readstat_variable_store_t *readstat_variable_store_init() {
+    readstat_variable_store_t *store = NULL;
+    if ((store = calloc(1, sizeof(readstat_variable_store_t))) == NULL)
+        return NULL;
+
+    if ((store->strings = readstat_dictionary_init(INT32_MAX)) == NULL) {
+        free(store);
+        return NULL;
+    }
+
+    return store;
+}
+
+void readstat_variable_store_free(readstat_variable_store_t *store) {
+    long i;
+    if (store == NULL)
+        return;
+
+    for (i=0; i<store->variables_count; i++) {
+        free(store->chunks[i / VARIABLE_STORE_CHUNK_SIZE][i % VARIABLE_STORE_CHUNK_SIZE].missing_ranges);
+    }
+    for (i=0; i<store->chunks_count; i++) {
+        free(store->chunks[i]);
+    }
+    free(store->chunks);
+    readstat_dictionary_free(store->strings);
+    free(store);
+}
+
+readstat_variable_t *readstat_variable_store_add(readstat_variable_store_t *store) {
+    long index = store->variables_count;
+    if (index == store->chunks_count * VARIABLE_STORE_CHUNK_SIZE) {
+        if (store->chunks_count == store->chunks_capacity) {
+            long chunks_capacity = store->chunks_capacity ? 2 * store->chunks_capacity : 16;
+            readstat_variable_t **chunks = realloc(store->chunks, chunks_capacity * sizeof(readstat_variable_t *));
+            if (chunks == NULL)
+                return NULL;
+
+            store->chunks = chunks;
+            store->chunks_capacity = chunks_capacity;
+        }
+        readstat_variable_t *chunk = calloc(VARIABLE_STORE_CHUNK_SIZE, sizeof(readstat_variable_t));
+        if (chunk == NULL)
+            return NULL;
+
+        store->chunks[store->chunks_count++] = chunk;
     }
+
+    readstat_variable_t *variable = &store->chunks[index / VARIABLE_STORE_CHUNK_SIZE][index % VARIABLE_STORE_CHUNK_SIZE];
+    variable->name = "";
+    variable->format = "";
+    variable->label = "";
+    variable->store = store;
+
+    store->variables_count++;
+    return variable;
 }
 
+const char *readstat_variable_store_intern(readstat_variable_store_t *store, const char *string) {
+    if (string == NULL || string[0] == '\0')
+        return "";
+
+    if (store == NULL)
+        return NULL;
+
+    return readstat_dictionary_intern(store->strings, string, strlen(string));
+}
+
+readstat_variable_t *readstat_variable_buffer_reset(readstat_variable_buffer_t *buffer) {
+    readstat_variable_t *variable = &buffer->variable;
+    memset(variable, 0, sizeof(readstat_variable_t));
+
+    buffer->name[0] = '\0';
+    buffer->format[0] = '\0';
+    buffer->label[0] = '\0';
+    variable->name = buffer->name;
+    variable->format = buffer->format;
+    variable->label = buffer->label;
+
+    return variable;
+}
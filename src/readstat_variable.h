@@ -0,0 +1,36 @@
+
+/* Holds the variables added to a writer. Variables are allocated in chunks
+ * that are never moved, and their names, labels and formats are interned, so
+ * a wide file with a handful of distinct formats stores each format once. */
+
+typedef struct readstat_variable_store_s {
+    readstat_variable_t   **chunks;
+    long                    chunks_count;
+    long                    chunks_capacity;
+    long                    variables_count;
+
+    struct readstat_dictionary_s *strings;
+} readstat_variable_store_t;
+
+readstat_variable_store_t *readstat_variable_store_init();
+void readstat_variable_store_free(readstat_variable_store_t *store);
+
+/* Returns a zeroed variable with empty strings, or NULL if out of memory */
+readstat_variable_t *readstat_variable_store_add(readstat_variable_store_t *store);
+
+/* Returns the store's copy of string ("" for NULL or empty strings), or NULL
+ * if it can't be stored */
+const char *readstat_variable_store_intern(readstat_variable_store_t *store, const char *string);
+
+/* Readers hand variables to the variable handler one at a time, so they fill
+ * in a single variable whose strings point into this buffer (or into their
+ * own metadata) instead of allocating one per column. */
+typedef struct readstat_variable_buffer_s {
+    readstat_variable_t     variable;
+    char                    name[256];
+    char                    format[256];
+    char                    label[1024];
+} readstat_variable_buffer_t;
+
+/* Clears the buffer's variable and points its strings at the empty buffers */
+readstat_variable_t *readstat_variable_buffer_reset(readstat_variable_buffer_t *buffer);
@@ -1,8 +1,16 @@
 
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include "readstat.h"
 #include "readstat_writer.h"
+#include "readstat_variable.h"
+
+#if defined _WIN32
+#define fseeko fseeko64
+#endif
+
+#define SPILL_COPY_BUFFER_SIZE  65536
 
 #define VARIABLES_INITIAL_CAPACITY    50
 #define LABEL_SETS_INITIAL_CAPACITY   50
@@ -18,20 +26,19 @@ readstat_writer_t *readstat_writer_init() {
 
     writer->variables = calloc(VARIABLES_INITIAL_CAPACITY, sizeof(readstat_variable_t *));
     writer->variables_capacity = VARIABLES_INITIAL_CAPACITY;
+    writer->variable_store = readstat_variable_store_init();
 
     writer->label_sets = calloc(LABEL_SETS_INITIAL_CAPACITY, sizeof(readstat_label_set_t *));
     writer->label_sets_capacity = LABEL_SETS_INITIAL_CAPACITY;
 
     writer->timestamp = time(NULL);
+    writer->thread_count = 1;
+    writer->buffer_size = READSTAT_WRITER_DEFAULT_BUFFER_SIZE;
     writer->callbacks.write_row = &readstat_write_row_default_callback;
 
     return writer;
 }
 
-static void readstat_variable_free(readstat_variable_t *variable) {
-    free(variable);
-}
-
 static void readstat_label_set_free(readstat_label_set_t *label_set) {
     int i;
     for (i=0; i<label_set->value_labels_count; i++) {
@@ -70,11 +77,9 @@ void readstat_writer_free(readstat_writer_t *writer) {
     int i;
     if (writer) {
         if (writer->variables) {
-            for (i=0; i<writer->variables_count; i++) {
-                readstat_variable_free(writer->variables[i]);
-            }
             free(writer->variables);
         }
+        readstat_variable_store_free(writer->variable_store);
         if (writer->label_sets) {
             for (i=0; i<writer->label_sets_count; i++) {
                 readstat_label_set_free(writer->label_sets[i]);
@@ -84,6 +89,15 @@ void readstat_writer_free(readstat_writer_t *writer) {
         if (writer->row) {
             free(writer->row);
         }
+        if (writer->block) {
+            free(writer->block);
+        }
+        if (writer->buffer) {
+            free(writer->buffer);
+        }
+        if (writer->spill_file) {
+            fclose(writer->spill_file);
+        }
         free(writer);
     }
 }
@@ -93,15 +107,152 @@ readstat_error_t readstat_set_data_writer(readstat_writer_t *writer, readstat_da
     return READSTAT_OK;
 }
 
+readstat_error_t readstat_set_data_seeker(readstat_writer_t *writer, readstat_data_seeker data_seeker) {
+    writer->data_seeker = data_seeker;
+    return READSTAT_OK;
+}
+
+static readstat_error_t readstat_write_through(readstat_writer_t *writer, const void *bytes, size_t len) {
+    if (writer->spill_file) {
+        if (len && fwrite(bytes, len, 1, writer->spill_file) != 1)
+            return READSTAT_ERROR_WRITE;
+
+        return READSTAT_OK;
+    }
+    while (len) {
+        ssize_t bytes_written = writer->data_writer(bytes, len, writer->user_ctx);
+        if (bytes_written <= 0) {
+            return READSTAT_ERROR_WRITE;
+        }
+        bytes = (const char *)bytes + bytes_written;
+        len -= bytes_written;
+    }
+    return READSTAT_OK;
+}
+
+static readstat_error_t readstat_flush_buffer(readstat_writer_t *writer) {
+    readstat_error_t retval = READSTAT_OK;
+    if (writer->buffer_len) {
+        retval = readstat_write_through(writer, writer->buffer, writer->buffer_len);
+        writer->buffer_len = 0;
+    }
+    return retval;
+}
+
+/* Small writes (headers, tags, labels, rows) are collected into the buffer,
+ * so that the data writer sees a few large writes instead of many tiny
+ * ones. Writes that would not fit in an empty buffer go straight through. */
 readstat_error_t readstat_write_bytes(readstat_writer_t *writer, const void *bytes, size_t len) {
-    size_t bytes_written = writer->data_writer(bytes, len, writer->user_ctx);
-    if (bytes_written < len) {
-        return READSTAT_ERROR_WRITE;
+    readstat_error_t retval = READSTAT_OK;
+
+    if (writer->buffer_len + len > writer->buffer_size) {
+        if ((retval = readstat_flush_buffer(writer)) != READSTAT_OK)
+            return retval;
     }
-    writer->bytes_written += bytes_written;
+
+    if (len >= writer->buffer_size) {
+        retval = readstat_write_through(writer, bytes, len);
+    } else {
+        if (writer->buffer == NULL && (writer->buffer = malloc(writer->buffer_size)) == NULL)
+            return READSTAT_ERROR_MALLOC;
+
+        memcpy(&writer->buffer[writer->buffer_len], bytes, len);
+        writer->buffer_len += len;
+    }
+
+    if (retval == READSTAT_OK)
+        writer->bytes_written += len;
+
+    return retval;
+}
+
+/* Overwrites bytes already written, e.g. a header field that could not be
+ * filled in until the end */
+readstat_error_t readstat_write_bytes_at(readstat_writer_t *writer, size_t offset, const void *bytes, size_t len) {
+    readstat_error_t retval = READSTAT_OK;
+    size_t buffer_offset = writer->bytes_written - writer->buffer_len;
+
+    if (offset + len > writer->bytes_written)
+        return READSTAT_ERROR_SEEK;
+
+    if (offset >= buffer_offset) {
+        memcpy(&writer->buffer[offset - buffer_offset], bytes, len);
+        return READSTAT_OK;
+    }
+
+    if ((retval = readstat_flush_buffer(writer)) != READSTAT_OK)
+        return retval;
+
+    if (writer->spill_file) {
+        if (fseeko(writer->spill_file, offset, SEEK_SET) == -1)
+            return READSTAT_ERROR_SEEK;
+        if (fwrite(bytes, len, 1, writer->spill_file) != 1)
+            return READSTAT_ERROR_WRITE;
+        if (fseeko(writer->spill_file, 0, SEEK_END) == -1)
+            return READSTAT_ERROR_SEEK;
+    } else if (writer->data_seeker) {
+        if (writer->data_seeker(offset, READSTAT_SEEK_SET, writer->user_ctx) == -1)
+            return READSTAT_ERROR_SEEK;
+        if ((retval = readstat_write_through(writer, bytes, len)) != READSTAT_OK)
+            return retval;
+        if (writer->data_seeker(0, READSTAT_SEEK_END, writer->user_ctx) == -1)
+            return READSTAT_ERROR_SEEK;
+    } else {
+        return READSTAT_ERROR_SEEK;
+    }
+
+    return READSTAT_OK;
+}
+
+/* Without a way to seek the output, a file whose header is still to be
+ * patched is assembled in a temporary file instead */
+static readstat_error_t readstat_begin_spill(readstat_writer_t *writer) {
+    int patches_row_count = (writer->row_count < 0 && writer->callbacks.patch_row_count);
+    if (writer->data_seeker || !(patches_row_count || writer->patches_header))
+        return READSTAT_OK;
+
+    if ((writer->spill_file = tmpfile()) == NULL)
+        return READSTAT_ERROR_OPEN;
+
     return READSTAT_OK;
 }
 
+static readstat_error_t readstat_end_spill(readstat_writer_t *writer) {
+    readstat_error_t retval = READSTAT_OK;
+    FILE *spill_file = writer->spill_file;
+    char *buffer = NULL;
+    size_t len = 0;
+
+    if (spill_file == NULL)
+        return READSTAT_OK;
+
+    writer->spill_file = NULL;
+
+    if ((buffer = malloc(SPILL_COPY_BUFFER_SIZE)) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+
+    if (fseeko(spill_file, 0, SEEK_SET) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+    while ((len = fread(buffer, 1, SPILL_COPY_BUFFER_SIZE, spill_file)) > 0) {
+        if ((retval = readstat_write_through(writer, buffer, len)) != READSTAT_OK)
+            goto cleanup;
+    }
+
+    if (ferror(spill_file))
+        retval = READSTAT_ERROR_READ;
+
+cleanup:
+    free(buffer);
+    fclose(spill_file);
+
+    return retval;
+}
+
 readstat_error_t readstat_write_string(readstat_writer_t *writer, const char *bytes) {
     return readstat_write_bytes(writer, bytes, strlen(bytes));
 }
@@ -176,7 +327,9 @@ readstat_variable_t *readstat_add_variable(readstat_writer_t *writer, const char
         writer->variables = realloc(writer->variables,
                 writer->variables_capacity * sizeof(readstat_variable_t *));
     }
-    readstat_variable_t *new_variable = calloc(1, sizeof(readstat_variable_t));
+    readstat_variable_t *new_variable = readstat_variable_store_add(writer->variable_store);
+    if (new_variable == NULL)
+        return NULL;
 
     new_variable->index = writer->variables_count++;
     
@@ -192,27 +345,20 @@ readstat_variable_t *readstat_add_variable(readstat_writer_t *writer, const char
     }
     new_variable->measure = READSTAT_MEASURE_UNKNOWN;
 
-    if (name) {
-        snprintf(new_variable->name, sizeof(new_variable->name), "%s", name);
-    }
+    if ((new_variable->name = readstat_variable_store_intern(writer->variable_store, name)) == NULL)
+        new_variable->name = "";
 
     return new_variable;
 }
 
 void readstat_variable_set_label(readstat_variable_t *variable, const char *label) {
-    if (label) {
-        snprintf(variable->label, sizeof(variable->label), "%s", label);
-    } else {
-        memset(variable->label, '\0', sizeof(variable->label));
-    }
+    const char *interned = readstat_variable_store_intern(variable->store, label);
+    variable->label = interned ? interned : "";
 }
 
 void readstat_variable_set_format(readstat_variable_t *variable, const char *format) {
-    if (format) {
-        snprintf(variable->format, sizeof(variable->format), "%s", format);
-    } else {
-        memset(variable->format, '\0', sizeof(variable->format));
-    }
+    const char *interned = readstat_variable_store_intern(variable->store, format);
+    variable->format = interned ? interned : "";
 }
 
 void readstat_variable_set_measure(readstat_variable_t *variable, readstat_measure_t measure) {
@@ -256,6 +402,30 @@ readstat_error_t readstat_writer_set_file_timestamp(readstat_writer_t *writer, t
     return READSTAT_OK;
 }
 
+readstat_error_t readstat_writer_set_compression(readstat_writer_t *writer, readstat_compress_t compression) {
+    writer->compression = compression;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_writer_set_thread_count(readstat_writer_t *writer, int thread_count) {
+    if (thread_count < 1)
+        return READSTAT_ERROR_PARSE;
+
+    writer->thread_count = thread_count;
+    return READSTAT_OK;
+}
+
+readstat_error_t readstat_writer_set_buffer_size(readstat_writer_t *writer, size_t buffer_size) {
+    readstat_error_t retval = READSTAT_OK;
+    if ((retval = readstat_flush_buffer(writer)) != READSTAT_OK)
+        return retval;
+
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->buffer_size = buffer_size;
+    return READSTAT_OK;
+}
+
 readstat_error_t readstat_writer_set_fweight_variable(readstat_writer_t *writer, const readstat_variable_t *variable) {
     readstat_type_t type = readstat_variable_get_type(variable);
     if (type == READSTAT_TYPE_STRING || type == READSTAT_TYPE_LONG_STRING)
@@ -276,25 +446,37 @@ readstat_error_t readstat_writer_set_error_handler(readstat_writer_t *writer,
     return READSTAT_OK;
 }
 
+/* Lays out the row and lets the format write its headers, before the
+ * first row of data */
+static readstat_error_t readstat_begin_data(readstat_writer_t *writer) {
+    readstat_error_t retval = READSTAT_OK;
+    size_t row_len = 0;
+    int i;
+
+    if ((retval = readstat_begin_spill(writer)) != READSTAT_OK)
+        return retval;
+
+    for (i=0; i<writer->variables_count; i++) {
+        readstat_variable_t *variable = readstat_get_variable(writer, i);
+        variable->storage_width = writer->callbacks.variable_width(variable->type, variable->user_width);
+        variable->offset = row_len;
+        row_len += variable->storage_width;
+    }
+    if (writer->callbacks.begin_data) {
+        retval = writer->callbacks.begin_data(writer);
+    }
+    writer->row = malloc(row_len);
+    writer->row_len = row_len;
+    return retval;
+}
+
 readstat_error_t readstat_begin_row(readstat_writer_t *writer) {
     readstat_error_t retval = READSTAT_OK;
     if (!writer->initialized)
         return READSTAT_ERROR_WRITER_NOT_INITIALIZED;
 
-    if (writer->current_row == 0) {
-        size_t row_len = 0;
-        int i;
-        for (i=0; i<writer->variables_count; i++) {
-            readstat_variable_t *variable = readstat_get_variable(writer, i);
-            variable->storage_width = writer->callbacks.variable_width(variable->type, variable->user_width);
-            variable->offset = row_len;
-            row_len += variable->storage_width;
-        }
-        if (writer->callbacks.begin_data) {
-            retval = writer->callbacks.begin_data(writer);
-        }
-        writer->row = malloc(row_len);
-        writer->row_len = row_len;
+    if (writer->row == NULL) {
+        retval = readstat_begin_data(writer);
     }
     memset(writer->row, '\0', writer->row_len);
     return retval;
@@ -347,12 +529,17 @@ readstat_error_t readstat_insert_double_value(readstat_writer_t *writer, const r
 }
 
 readstat_error_t readstat_insert_string_value(readstat_writer_t *writer, const readstat_variable_t *variable, const char *value) {
+    return readstat_insert_string_value_len(writer, variable, value, value ? strlen(value) : 0);
+}
+
+readstat_error_t readstat_insert_string_value_len(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const char *value, size_t value_len) {
     if (!writer->initialized)
         return READSTAT_ERROR_WRITER_NOT_INITIALIZED;
     if (variable->type != READSTAT_TYPE_STRING)
         return READSTAT_ERROR_VALUE_TYPE_MISMATCH;
 
-    return writer->callbacks.write_string(&writer->row[variable->offset], variable, value);
+    return writer->callbacks.write_string(&writer->row[variable->offset], variable, value, value_len);
 }
 
 readstat_error_t readstat_insert_missing_value(readstat_writer_t *writer, const readstat_variable_t *variable) {
@@ -382,24 +569,242 @@ readstat_error_t readstat_end_row(readstat_writer_t *writer) {
     return error;
 }
 
+/* Checks a column against the current block, starting a new block if
+ * there is none, and returns the column's cell in the block's first row */
+static readstat_error_t readstat_begin_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        readstat_type_t type, long rows_count, unsigned char **out_cell) {
+    readstat_error_t retval = READSTAT_OK;
+    if (!writer->initialized)
+        return READSTAT_ERROR_WRITER_NOT_INITIALIZED;
+    if (variable->type != type)
+        return READSTAT_ERROR_VALUE_TYPE_MISMATCH;
+    if (rows_count < 0)
+        return READSTAT_ERROR_ROW_COUNT_MISMATCH;
+
+    if (writer->row == NULL && (retval = readstat_begin_data(writer)) != READSTAT_OK)
+        return retval;
+
+    if (writer->block_rows == 0) {
+        if (rows_count > writer->block_capacity) {
+            unsigned char *block = realloc(writer->block, rows_count * writer->row_len);
+            if (block == NULL && rows_count * writer->row_len > 0)
+                return READSTAT_ERROR_MALLOC;
+
+            writer->block = block;
+            writer->block_capacity = rows_count;
+        }
+        memset(writer->block, '\0', rows_count * writer->row_len);
+        writer->block_rows = rows_count;
+    } else if (rows_count != writer->block_rows) {
+        return READSTAT_ERROR_ROW_COUNT_MISMATCH;
+    }
+
+    *out_cell = &writer->block[variable->offset];
+    return READSTAT_OK;
+}
+
+static inline int readstat_column_bit_is_set(const uint8_t *missing, long i) {
+    return missing && (missing[i / 8] & (1 << (i % 8)));
+}
+
+readstat_error_t readstat_insert_int8_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const int8_t *values, const uint8_t *missing, long rows_count) {
+    readstat_write_int8_callback write_int8 = writer->callbacks.write_int8;
+    readstat_error_t retval = READSTAT_OK;
+    unsigned char *cell = NULL;
+    long i;
+
+    if ((retval = readstat_begin_column(writer, variable, READSTAT_TYPE_INT8, rows_count, &cell)) != READSTAT_OK)
+        return retval;
+
+    for (i=0; i<rows_count && retval == READSTAT_OK; i++, cell += writer->row_len) {
+        if (readstat_column_bit_is_set(missing, i)) {
+            retval = writer->callbacks.write_missing_number(cell, variable);
+        } else {
+            retval = write_int8(cell, variable, values[i]);
+        }
+    }
+    return retval;
+}
+
+readstat_error_t readstat_insert_int16_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const int16_t *values, const uint8_t *missing, long rows_count) {
+    readstat_write_int16_callback write_int16 = writer->callbacks.write_int16;
+    readstat_error_t retval = READSTAT_OK;
+    unsigned char *cell = NULL;
+    long i;
+
+    if ((retval = readstat_begin_column(writer, variable, READSTAT_TYPE_INT16, rows_count, &cell)) != READSTAT_OK)
+        return retval;
+
+    for (i=0; i<rows_count && retval == READSTAT_OK; i++, cell += writer->row_len) {
+        if (readstat_column_bit_is_set(missing, i)) {
+            retval = writer->callbacks.write_missing_number(cell, variable);
+        } else {
+            retval = write_int16(cell, variable, values[i]);
+        }
+    }
+    return retval;
+}
+
+readstat_error_t readstat_insert_int32_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const int32_t *values, const uint8_t *missing, long rows_count) {
+    readstat_write_int32_callback write_int32 = writer->callbacks.write_int32;
+    readstat_error_t retval = READSTAT_OK;
+    unsigned char *cell = NULL;
+    long i;
+
+    if ((retval = readstat_begin_column(writer, variable, READSTAT_TYPE_INT32, rows_count, &cell)) != READSTAT_OK)
+        return retval;
+
+    for (i=0; i<rows_count && retval == READSTAT_OK; i++, cell += writer->row_len) {
+        if (readstat_column_bit_is_set(missing, i)) {
+            retval = writer->callbacks.write_missing_number(cell, variable);
+        } else {
+            retval = write_int32(cell, variable, values[i]);
+        }
+    }
+    return retval;
+}
+
+readstat_error_t readstat_insert_float_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const float *values, const uint8_t *missing, long rows_count) {
+    readstat_write_float_callback write_float = writer->callbacks.write_float;
+    readstat_error_t retval = READSTAT_OK;
+    unsigned char *cell = NULL;
+    long i;
+
+    if ((retval = readstat_begin_column(writer, variable, READSTAT_TYPE_FLOAT, rows_count, &cell)) != READSTAT_OK)
+        return retval;
+
+    for (i=0; i<rows_count && retval == READSTAT_OK; i++, cell += writer->row_len) {
+        if (readstat_column_bit_is_set(missing, i)) {
+            retval = writer->callbacks.write_missing_number(cell, variable);
+        } else {
+            retval = write_float(cell, variable, values[i]);
+        }
+    }
+    return retval;
+}
+
+readstat_error_t readstat_insert_double_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const double *values, const uint8_t *missing, long rows_count) {
+    readstat_write_double_callback write_double = writer->callbacks.write_double;
+    readstat_error_t retval = READSTAT_OK;
+    unsigned char *cell = NULL;
+    long i;
+
+    if ((retval = readstat_begin_column(writer, variable, READSTAT_TYPE_DOUBLE, rows_count, &cell)) != READSTAT_OK)
+        return retval;
+
+    for (i=0; i<rows_count && retval == READSTAT_OK; i++, cell += writer->row_len) {
+        if (readstat_column_bit_is_set(missing, i)) {
+            retval = writer->callbacks.write_missing_number(cell, variable);
+        } else {
+            retval = write_double(cell, variable, values[i]);
+        }
+    }
+    return retval;
+}
+
+/* Takes the lengths from lengths, or from strlen if it is NULL */
+static readstat_error_t readstat_write_string_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const char * const *values, const size_t *lengths, const uint8_t *missing, long rows_count) {
+    readstat_write_string_callback write_string = writer->callbacks.write_string;
+    readstat_error_t retval = READSTAT_OK;
+    unsigned char *cell = NULL;
+    long i;
+
+    if ((retval = readstat_begin_column(writer, variable, READSTAT_TYPE_STRING, rows_count, &cell)) != READSTAT_OK)
+        return retval;
+
+    for (i=0; i<rows_count && retval == READSTAT_OK; i++, cell += writer->row_len) {
+        if (readstat_column_bit_is_set(missing, i)) {
+            retval = writer->callbacks.write_missing_string(cell, variable);
+        } else if (lengths) {
+            retval = write_string(cell, variable, values[i], values[i] ? lengths[i] : 0);
+        } else {
+            retval = write_string(cell, variable, values[i], values[i] ? strlen(values[i]) : 0);
+        }
+    }
+    return retval;
+}
+
+readstat_error_t readstat_insert_string_column(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const char * const *values, const uint8_t *missing, long rows_count) {
+    return readstat_write_string_column(writer, variable, values, NULL, missing, rows_count);
+}
+
+readstat_error_t readstat_insert_string_column_len(readstat_writer_t *writer, const readstat_variable_t *variable,
+        const char * const *values, const size_t *lengths, const uint8_t *missing, long rows_count) {
+    return readstat_write_string_column(writer, variable, values, lengths, missing, rows_count);
+}
+
+readstat_error_t readstat_end_rows(readstat_writer_t *writer) {
+    readstat_error_t retval = READSTAT_OK;
+    long i;
+
+    if (!writer->initialized)
+        return READSTAT_ERROR_WRITER_NOT_INITIALIZED;
+    if (writer->block_rows == 0)
+        return READSTAT_OK;
+
+    /* Uncompressed rows need no further encoding, so the block goes out
+     * in one piece */
+    if (writer->callbacks.write_row == &readstat_write_row_default_callback) {
+        retval = readstat_write_bytes(writer, writer->block, writer->block_rows * writer->row_len);
+        if (retval == READSTAT_OK)
+            writer->current_row += writer->block_rows;
+    } else {
+        for (i=0; i<writer->block_rows; i++) {
+            retval = writer->callbacks.write_row(writer, &writer->block[i * writer->row_len], writer->row_len);
+            if (retval != READSTAT_OK)
+                break;
+            writer->current_row++;
+        }
+    }
+
+    writer->block_rows = 0;
+    return retval;
+}
+
 readstat_error_t readstat_end_writing(readstat_writer_t *writer) {
     if (!writer->initialized)
         return READSTAT_ERROR_WRITER_NOT_INITIALIZED;
 
-    if (writer->current_row != writer->row_count) {
+    int patch_row_count = (writer->row_count < 0);
+    if (!patch_row_count && writer->current_row != writer->row_count) {
         return READSTAT_ERROR_ROW_COUNT_MISMATCH;
     }
 
     readstat_error_t retval = READSTAT_OK;
 
-    if (writer->row_count == 0 && writer->callbacks.begin_data) {
+    if (writer->row == NULL && writer->callbacks.begin_data) {
+        if ((retval = readstat_begin_spill(writer)) != READSTAT_OK)
+            return retval;
+
         retval = writer->callbacks.begin_data(writer);
     }
     if (retval != READSTAT_OK)
         return retval;
 
+    if (patch_row_count) {
+        writer->row_count = writer->current_row;
+        if (writer->callbacks.patch_row_count) {
+            retval = writer->callbacks.patch_row_count(writer);
+        }
+    }
+    if (retval != READSTAT_OK)
+        return retval;
+
     if (writer->callbacks.end_data) {
         retval = writer->callbacks.end_data(writer);
     }
-    return retval;
+    if (retval != READSTAT_OK)
+        return retval;
+
+    if ((retval = readstat_flush_buffer(writer)) != READSTAT_OK)
+        return retval;
+
+    return readstat_end_spill(writer);
 }
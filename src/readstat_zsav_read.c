@@ -0,0 +1,419 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "readstat_sav.h"
+#include "readstat_zsav_read.h"
+
+#if HAVE_ZLIB_H
+
+#include <zlib.h>
+
+#include "readstat_pipeline.h"
+
+typedef struct zsav_block_s {
+    readstat_off_t  compressed_ofs;
+    size_t          compressed_size;
+    size_t          uncompressed_size;
+} zsav_block_t;
+
+typedef struct zsav_job_s {
+    zsav_block_t   *block;
+    unsigned char  *compressed;
+    unsigned char  *uncompressed;
+    int             compressed_is_read;
+} zsav_job_t;
+
+struct zsav_ctx_s {
+    readstat_io_t          *io;
+
+    zsav_block_t           *blocks;
+    int                     blocks_count;
+    int                     blocks_submitted;
+    int                     blocks_delivered;
+    size_t                  max_compressed_size;
+    size_t                  max_uncompressed_size;
+
+    unsigned char          *compressed;
+    unsigned char          *buffer;
+    size_t                  buffer_used;
+
+    readstat_pipeline_t    *pipeline;
+    void                  **jobs;
+    int                     jobs_count;
+
+    readstat_error_t        error;
+};
+
+static readstat_error_t zsav_read_compressed(zsav_ctx_t *ctx, zsav_block_t *block,
+        unsigned char *compressed) {
+    readstat_io_t *io = ctx->io;
+    if (io->seek(block->compressed_ofs, READSTAT_SEEK_SET, io->io_ctx) == -1)
+        return READSTAT_ERROR_SEEK;
+
+    if (io->read(compressed, block->compressed_size, io->io_ctx) != block->compressed_size)
+        return READSTAT_ERROR_READ;
+
+    return READSTAT_OK;
+}
+
+static readstat_error_t zsav_inflate(zsav_block_t *block,
+        unsigned char *uncompressed, const unsigned char *compressed) {
+    uLongf uncompressed_len = block->uncompressed_size;
+    if (uncompress(uncompressed, &uncompressed_len, compressed, block->compressed_size) != Z_OK)
+        return READSTAT_ERROR_PARSE;
+
+    if (uncompressed_len != block->uncompressed_size)
+        return READSTAT_ERROR_PARSE;
+
+    return READSTAT_OK;
+}
+
+static readstat_error_t zsav_inflate_job(void *job_ptr, int worker_index, void *ctx_ptr) {
+    zsav_job_t *job = (zsav_job_t *)job_ptr;
+    zsav_ctx_t *ctx = (zsav_ctx_t *)ctx_ptr;
+    readstat_io_t *io = ctx->io;
+    zsav_block_t *block = job->block;
+
+    if (!job->compressed_is_read) {
+        if (io->pread(job->compressed, block->compressed_size, block->compressed_ofs,
+                    io->io_ctx) != block->compressed_size)
+            return READSTAT_ERROR_READ;
+    }
+
+    return zsav_inflate(block, job->uncompressed, job->compressed);
+}
+
+static readstat_error_t zsav_deliver_job(void *job_ptr, readstat_error_t work_retval, void *ctx_ptr) {
+    zsav_job_t *job = (zsav_job_t *)job_ptr;
+    zsav_ctx_t *ctx = (zsav_ctx_t *)ctx_ptr;
+    readstat_io_t *io = ctx->io;
+    zsav_block_t *block = job->block;
+    unsigned char *buffer = ctx->buffer;
+
+    if (work_retval != READSTAT_OK)
+        return work_retval;
+
+    /* Hand the inflated block out and give the job the one it replaces */
+    ctx->buffer = job->uncompressed;
+    ctx->buffer_used = block->uncompressed_size;
+    job->uncompressed = buffer;
+    ctx->blocks_delivered++;
+
+    /* Positional reads leave the file offset alone, so move it along for
+     * the sake of progress reporting */
+    if (!job->compressed_is_read &&
+            io->seek(block->compressed_ofs + block->compressed_size,
+                READSTAT_SEEK_SET, io->io_ctx) == -1)
+        return READSTAT_ERROR_SEEK;
+
+    return READSTAT_OK;
+}
+
+/* Sets up the worker pool. Leaves ctx->pipeline NULL (and the blocks to be
+ * inflated on the calling thread) if threads are unavailable. */
+static readstat_error_t zsav_init_pipeline(zsav_ctx_t *ctx, int thread_count) {
+    readstat_error_t retval = READSTAT_OK;
+    int i;
+
+    ctx->jobs_count = 2 * thread_count;
+    if (ctx->jobs_count > ctx->blocks_count)
+        ctx->jobs_count = ctx->blocks_count;
+
+    if ((ctx->jobs = calloc(ctx->jobs_count, sizeof(void *))) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+    for (i=0; i<ctx->jobs_count; i++) {
+        zsav_job_t *job = calloc(1, sizeof(zsav_job_t));
+        if (job == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        ctx->jobs[i] = job;
+        if ((job->compressed = malloc(ctx->max_compressed_size)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+        if ((job->uncompressed = malloc(ctx->max_uncompressed_size)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+    }
+
+    ctx->pipeline = readstat_pipeline_init(thread_count, ctx->jobs, ctx->jobs_count,
+            &zsav_inflate_job, &zsav_deliver_job, ctx);
+
+cleanup:
+    return retval;
+}
+
+static readstat_error_t zsav_read_trailer(zsav_ctx_t *ctx, zsav_header_record_t *header,
+        size_t file_size, int bswap) {
+    readstat_error_t retval = READSTAT_OK;
+    readstat_io_t *io = ctx->io;
+    zsav_trailer_record_t trailer;
+    zsav_block_record_t *records = NULL;
+    int64_t data_ofs = header->zheader_ofs + sizeof(zsav_header_record_t);
+    int i;
+
+    if (header->ztrailer_ofs < data_ofs || header->ztrailer_len < sizeof(zsav_trailer_record_t) ||
+            header->ztrailer_ofs + header->ztrailer_len > file_size) {
+        retval = READSTAT_ERROR_PARSE;
+        goto cleanup;
+    }
+
+    if (io->seek(header->ztrailer_ofs, READSTAT_SEEK_SET, io->io_ctx) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+    if (io->read(&trailer, sizeof(zsav_trailer_record_t), io->io_ctx) < sizeof(zsav_trailer_record_t)) {
+        retval = READSTAT_ERROR_READ;
+        goto cleanup;
+    }
+
+    ctx->blocks_count = bswap ? byteswap4(trailer.n_blocks) : trailer.n_blocks;
+    if (ctx->blocks_count < 0 || header->ztrailer_len != sizeof(zsav_trailer_record_t) +
+            (int64_t)ctx->blocks_count * sizeof(zsav_block_record_t)) {
+        retval = READSTAT_ERROR_PARSE;
+        goto cleanup;
+    }
+
+    if (ctx->blocks_count == 0)
+        goto cleanup;
+
+    if ((records = malloc(ctx->blocks_count * sizeof(zsav_block_record_t))) == NULL ||
+            (ctx->blocks = calloc(ctx->blocks_count, sizeof(zsav_block_t))) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+
+    if (io->read(records, ctx->blocks_count * sizeof(zsav_block_record_t), io->io_ctx) <
+            ctx->blocks_count * sizeof(zsav_block_record_t)) {
+        retval = READSTAT_ERROR_READ;
+        goto cleanup;
+    }
+
+    for (i=0; i<ctx->blocks_count; i++) {
+        zsav_block_record_t *record = &records[i];
+        zsav_block_t *block = &ctx->blocks[i];
+        int64_t compressed_ofs = bswap ? byteswap8(record->compressed_ofs) : record->compressed_ofs;
+        int32_t compressed_size = bswap ? byteswap4(record->compressed_size) : record->compressed_size;
+        int32_t uncompressed_size = bswap ? byteswap4(record->uncompressed_size) : record->uncompressed_size;
+
+        if (compressed_ofs < data_ofs || compressed_size <= 0 || uncompressed_size <= 0 ||
+                compressed_ofs + compressed_size > header->ztrailer_ofs) {
+            retval = READSTAT_ERROR_PARSE;
+            goto cleanup;
+        }
+
+        block->compressed_ofs = compressed_ofs;
+        block->compressed_size = compressed_size;
+        block->uncompressed_size = uncompressed_size;
+
+        if (block->compressed_size > ctx->max_compressed_size)
+            ctx->max_compressed_size = block->compressed_size;
+        if (block->uncompressed_size > ctx->max_uncompressed_size)
+            ctx->max_uncompressed_size = block->uncompressed_size;
+    }
+
+cleanup:
+    if (records)
+        free(records);
+
+    return retval;
+}
+
+readstat_error_t zsav_ctx_init(sav_ctx_t *sav_ctx, zsav_ctx_t **out_ctx) {
+    readstat_error_t retval = READSTAT_OK;
+    readstat_io_t *io = sav_ctx->io;
+    int bswap = sav_ctx->machine_needs_byte_swap;
+    zsav_header_record_t header;
+    zsav_ctx_t *ctx = NULL;
+    readstat_off_t header_ofs = 0;
+
+    if ((ctx = calloc(1, sizeof(zsav_ctx_t))) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+
+    ctx->io = io;
+
+    if ((header_ofs = io->seek(0, READSTAT_SEEK_CUR, io->io_ctx)) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+    if (io->read(&header, sizeof(zsav_header_record_t), io->io_ctx) < sizeof(zsav_header_record_t)) {
+        retval = READSTAT_ERROR_READ;
+        goto cleanup;
+    }
+
+    if (bswap) {
+        header.zheader_ofs = byteswap8(header.zheader_ofs);
+        header.ztrailer_ofs = byteswap8(header.ztrailer_ofs);
+        header.ztrailer_len = byteswap8(header.ztrailer_len);
+    }
+
+    if (header.zheader_ofs != header_ofs) {
+        retval = READSTAT_ERROR_PARSE;
+        goto cleanup;
+    }
+
+    if ((retval = zsav_read_trailer(ctx, &header, sav_ctx->file_size, bswap)) != READSTAT_OK)
+        goto cleanup;
+
+    if (io->seek(header_ofs + sizeof(zsav_header_record_t), READSTAT_SEEK_SET, io->io_ctx) == -1) {
+        retval = READSTAT_ERROR_SEEK;
+        goto cleanup;
+    }
+
+    if (ctx->blocks_count == 0)
+        goto cleanup;
+
+    if ((ctx->buffer = malloc(ctx->max_uncompressed_size)) == NULL) {
+        retval = READSTAT_ERROR_MALLOC;
+        goto cleanup;
+    }
+
+    if (sav_ctx->thread_count > 1 && ctx->blocks_count > 1) {
+        if ((retval = zsav_init_pipeline(ctx, sav_ctx->thread_count)) != READSTAT_OK)
+            goto cleanup;
+    }
+
+    if (ctx->pipeline == NULL) {
+        if ((ctx->compressed = malloc(ctx->max_compressed_size)) == NULL) {
+            retval = READSTAT_ERROR_MALLOC;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    if (retval != READSTAT_OK) {
+        zsav_ctx_free(ctx);
+    } else {
+        *out_ctx = ctx;
+    }
+
+    return retval;
+}
+
+void zsav_ctx_free(zsav_ctx_t *ctx) {
+    int i;
+    if (ctx == NULL)
+        return;
+
+    if (ctx->pipeline)
+        readstat_pipeline_free(ctx->pipeline);
+    if (ctx->jobs) {
+        for (i=0; i<ctx->jobs_count; i++) {
+            zsav_job_t *job = ctx->jobs[i];
+            if (job == NULL)
+                continue;
+            if (job->compressed)
+                free(job->compressed);
+            if (job->uncompressed)
+                free(job->uncompressed);
+            free(job);
+        }
+        free(ctx->jobs);
+    }
+    if (ctx->blocks)
+        free(ctx->blocks);
+    if (ctx->compressed)
+        free(ctx->compressed);
+    if (ctx->buffer)
+        free(ctx->buffer);
+    free(ctx);
+}
+
+static readstat_error_t zsav_submit_blocks(zsav_ctx_t *ctx) {
+    readstat_error_t retval = READSTAT_OK;
+
+    /* Keep every job busy; the ring is never full here, so acquiring a job
+     * never has to deliver one */
+    while (ctx->blocks_submitted < ctx->blocks_count &&
+            ctx->blocks_submitted - ctx->blocks_delivered < ctx->jobs_count) {
+        zsav_job_t *job = NULL;
+        if ((retval = readstat_pipeline_acquire(ctx->pipeline, (void **)&job)) != READSTAT_OK)
+            goto cleanup;
+
+        job->block = &ctx->blocks[ctx->blocks_submitted];
+        job->compressed_is_read = 0;
+        if (ctx->io->pread == NULL) {
+            if ((retval = zsav_read_compressed(ctx, job->block, job->compressed)) != READSTAT_OK)
+                goto cleanup;
+            job->compressed_is_read = 1;
+        }
+
+        readstat_pipeline_submit(ctx->pipeline);
+        ctx->blocks_submitted++;
+    }
+
+cleanup:
+    return retval;
+}
+
+ssize_t zsav_read_block(zsav_ctx_t *ctx, const unsigned char **out_buffer) {
+    readstat_error_t retval = READSTAT_OK;
+
+    if (ctx->error != READSTAT_OK)
+        return -1;
+
+    if (ctx->pipeline) {
+        if ((retval = zsav_submit_blocks(ctx)) != READSTAT_OK)
+            goto cleanup;
+
+        if (ctx->blocks_delivered == ctx->blocks_submitted)
+            return 0;
+
+        retval = readstat_pipeline_deliver(ctx->pipeline);
+    } else {
+        if (ctx->blocks_delivered == ctx->blocks_count)
+            return 0;
+
+        zsav_block_t *block = &ctx->blocks[ctx->blocks_delivered];
+        if ((retval = zsav_read_compressed(ctx, block, ctx->compressed)) != READSTAT_OK)
+            goto cleanup;
+
+        if ((retval = zsav_inflate(block, ctx->buffer, ctx->compressed)) != READSTAT_OK)
+            goto cleanup;
+
+        ctx->buffer_used = block->uncompressed_size;
+        ctx->blocks_delivered++;
+    }
+
+cleanup:
+    if (retval != READSTAT_OK) {
+        ctx->error = retval;
+        return -1;
+    }
+
+    *out_buffer = ctx->buffer;
+    return ctx->buffer_used;
+}
+
+readstat_error_t zsav_error(zsav_ctx_t *ctx) {
+    return ctx->error;
+}
+
+#else
+
+readstat_error_t zsav_ctx_init(sav_ctx_t *sav_ctx, zsav_ctx_t **out_ctx) {
+    return READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
+}
+
+void zsav_ctx_free(zsav_ctx_t *ctx) {
+}
+
+ssize_t zsav_read_block(zsav_ctx_t *ctx, const unsigned char **out_buffer) {
+    return -1;
+}
+
+readstat_error_t zsav_error(zsav_ctx_t *ctx) {
+    return READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
+}
+
+#endif
@@ -0,0 +1,19 @@
+
+/* Reader for the zlib-compressed data section of ZSAV files. The section
+ * starts with a header pointing at a trailer, which lists the blocks of
+ * bytecode that were deflated separately. Blocks are inflated on worker
+ * threads when more than one thread is allowed and handed back in file
+ * order. */
+
+typedef struct zsav_ctx_s zsav_ctx_t;
+
+/* Reads the ZSAV header at the current position along with the trailer
+ * that it points to */
+readstat_error_t zsav_ctx_init(sav_ctx_t *sav_ctx, zsav_ctx_t **out_ctx);
+void zsav_ctx_free(zsav_ctx_t *ctx);
+
+/* Points *out_buffer at the next block of inflated bytecode. Returns the
+ * length of the block, 0 at the end of the data and -1 on error, in which
+ * case zsav_error() tells what went wrong. */
+ssize_t zsav_read_block(zsav_ctx_t *ctx, const unsigned char **out_buffer);
+readstat_error_t zsav_error(zsav_ctx_t *ctx);
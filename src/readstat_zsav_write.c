@@ -0,0 +1,309 @@
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "readstat_sav.h"
+#include "readstat_sav_compress.h"
+#include "readstat_writer.h"
+#include "readstat_zsav_write.h"
+
+#if HAVE_ZLIB_H
+
+#include <zlib.h>
+
+#include "readstat_pipeline.h"
+
+#define ZSAV_BLOCK_SIZE                 0x3FF000
+#define ZSAV_BLOCKS_INITIAL_CAPACITY    16
+
+typedef struct zsav_write_job_s {
+    unsigned char  *uncompressed;
+    size_t          uncompressed_len;
+    unsigned char  *compressed;
+    size_t          compressed_len;
+} zsav_write_job_t;
+
+struct zsav_write_ctx_s {
+    readstat_writer_t      *writer;
+    sav_compress_state_t    state;
+    unsigned char          *row_buffer;
+
+    int64_t                 zheader_ofs;
+    int64_t                 uncompressed_ofs;
+
+    zsav_block_record_t    *blocks;
+    int                     blocks_count;
+    int                     blocks_capacity;
+
+    size_t                  compressed_bound;
+
+    readstat_pipeline_t    *pipeline;
+    void                  **jobs;
+    int                     jobs_count;
+    zsav_write_job_t       *job;
+};
+
+static readstat_error_t zsav_deflate_job(void *job_ptr, int worker_index, void *ctx_ptr) {
+    zsav_write_job_t *job = (zsav_write_job_t *)job_ptr;
+    zsav_write_ctx_t *ctx = (zsav_write_ctx_t *)ctx_ptr;
+    uLongf compressed_len = ctx->compressed_bound;
+
+    if (compress2(job->compressed, &compressed_len, job->uncompressed, job->uncompressed_len,
+                Z_DEFAULT_COMPRESSION) != Z_OK)
+        return READSTAT_ERROR_WRITE;
+
+    job->compressed_len = compressed_len;
+
+    return READSTAT_OK;
+}
+
+/* Called on the writing thread, in block order, so each block goes
+ * straight to the output */
+static readstat_error_t zsav_deliver_job(void *job_ptr, readstat_error_t work_retval, void *ctx_ptr) {
+    zsav_write_job_t *job = (zsav_write_job_t *)job_ptr;
+    zsav_write_ctx_t *ctx = (zsav_write_ctx_t *)ctx_ptr;
+
+    if (work_retval != READSTAT_OK)
+        return work_retval;
+
+    if (ctx->blocks_count == ctx->blocks_capacity) {
+        int blocks_capacity = ctx->blocks_capacity ? 2 * ctx->blocks_capacity : ZSAV_BLOCKS_INITIAL_CAPACITY;
+        zsav_block_record_t *blocks = realloc(ctx->blocks, blocks_capacity * sizeof(zsav_block_record_t));
+        if (blocks == NULL)
+            return READSTAT_ERROR_MALLOC;
+
+        ctx->blocks = blocks;
+        ctx->blocks_capacity = blocks_capacity;
+    }
+
+    zsav_block_record_t *block = &ctx->blocks[ctx->blocks_count++];
+    block->uncompressed_ofs = ctx->uncompressed_ofs;
+    block->compressed_ofs = ctx->writer->bytes_written;
+    block->uncompressed_size = job->uncompressed_len;
+    block->compressed_size = job->compressed_len;
+
+    ctx->uncompressed_ofs += job->uncompressed_len;
+
+    return readstat_write_bytes(ctx->writer, job->compressed, job->compressed_len);
+}
+
+static readstat_error_t zsav_acquire_job(zsav_write_ctx_t *ctx) {
+    readstat_error_t retval = READSTAT_OK;
+    void *job = ctx->jobs[0];
+
+    if (ctx->pipeline && (retval = readstat_pipeline_acquire(ctx->pipeline, &job)) != READSTAT_OK)
+        return retval;
+
+    ctx->job = job;
+    ctx->job->uncompressed_len = 0;
+
+    return retval;
+}
+
+static readstat_error_t zsav_flush_job(zsav_write_ctx_t *ctx) {
+    readstat_error_t retval = READSTAT_OK;
+    zsav_write_job_t *job = ctx->job;
+
+    if (job == NULL || job->uncompressed_len == 0)
+        return READSTAT_OK;
+
+    ctx->job = NULL;
+    if (ctx->pipeline) {
+        readstat_pipeline_submit(ctx->pipeline);
+    } else {
+        retval = zsav_deliver_job(job, zsav_deflate_job(job, 0, ctx), ctx);
+    }
+
+    return retval;
+}
+
+static readstat_error_t zsav_append(zsav_write_ctx_t *ctx, const unsigned char *bytes, size_t len) {
+    readstat_error_t retval = READSTAT_OK;
+
+    while (len) {
+        if (ctx->job == NULL && (retval = zsav_acquire_job(ctx)) != READSTAT_OK)
+            break;
+
+        zsav_write_job_t *job = ctx->job;
+        size_t chunk_len = ZSAV_BLOCK_SIZE - job->uncompressed_len;
+        if (chunk_len > len)
+            chunk_len = len;
+
+        memcpy(&job->uncompressed[job->uncompressed_len], bytes, chunk_len);
+        job->uncompressed_len += chunk_len;
+        bytes += chunk_len;
+        len -= chunk_len;
+
+        if (job->uncompressed_len == ZSAV_BLOCK_SIZE &&
+                (retval = zsav_flush_job(ctx)) != READSTAT_OK)
+            break;
+    }
+
+    return retval;
+}
+
+static void zsav_write_ctx_free(zsav_write_ctx_t *ctx) {
+    int i;
+    if (ctx == NULL)
+        return;
+
+    if (ctx->pipeline)
+        readstat_pipeline_free(ctx->pipeline);
+    if (ctx->jobs) {
+        for (i=0; i<ctx->jobs_count; i++) {
+            zsav_write_job_t *job = ctx->jobs[i];
+            if (job == NULL)
+                continue;
+            if (job->uncompressed)
+                free(job->uncompressed);
+            if (job->compressed)
+                free(job->compressed);
+            free(job);
+        }
+        free(ctx->jobs);
+    }
+    if (ctx->row_buffer)
+        free(ctx->row_buffer);
+    if (ctx->blocks)
+        free(ctx->blocks);
+    free(ctx);
+}
+
+static zsav_write_ctx_t *zsav_write_ctx_init(readstat_writer_t *writer, int64_t zheader_ofs) {
+    zsav_write_ctx_t *ctx = NULL;
+    int i;
+
+    if ((ctx = calloc(1, sizeof(zsav_write_ctx_t))) == NULL)
+        return NULL;
+
+    ctx->writer = writer;
+    ctx->zheader_ofs = zheader_ofs;
+    ctx->uncompressed_ofs = zheader_ofs;
+    ctx->compressed_bound = compressBound(ZSAV_BLOCK_SIZE);
+
+    if ((ctx->row_buffer = malloc(sav_compressed_row_bound(writer->row_len))) == NULL)
+        goto error;
+
+    ctx->jobs_count = writer->thread_count > 1 ? 2 * writer->thread_count : 1;
+    if ((ctx->jobs = calloc(ctx->jobs_count, sizeof(void *))) == NULL)
+        goto error;
+
+    for (i=0; i<ctx->jobs_count; i++) {
+        zsav_write_job_t *job = calloc(1, sizeof(zsav_write_job_t));
+        if (job == NULL)
+            goto error;
+
+        ctx->jobs[i] = job;
+        if ((job->uncompressed = malloc(ZSAV_BLOCK_SIZE)) == NULL)
+            goto error;
+        if ((job->compressed = malloc(ctx->compressed_bound)) == NULL)
+            goto error;
+    }
+
+    /* Falls back to deflating on the calling thread with the first job */
+    if (writer->thread_count > 1) {
+        ctx->pipeline = readstat_pipeline_init(writer->thread_count, ctx->jobs, ctx->jobs_count,
+                &zsav_deflate_job, &zsav_deliver_job, ctx);
+    }
+
+    return ctx;
+
+error:
+    zsav_write_ctx_free(ctx);
+    return NULL;
+}
+
+readstat_error_t zsav_begin_data(void *writer_ctx) {
+    readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
+    readstat_error_t retval = READSTAT_OK;
+    zsav_header_record_t header;
+    zsav_write_ctx_t *ctx = NULL;
+
+    if ((ctx = zsav_write_ctx_init(writer, writer->bytes_written)) == NULL)
+        return READSTAT_ERROR_MALLOC;
+
+    /* Patched by zsav_end_data, once the trailer's offset is known */
+    memset(&header, 0, sizeof(zsav_header_record_t));
+    if ((retval = readstat_write_bytes(writer, &header, sizeof(zsav_header_record_t))) != READSTAT_OK) {
+        zsav_write_ctx_free(ctx);
+        return retval;
+    }
+
+    writer->module_ctx = ctx;
+
+    return READSTAT_OK;
+}
+
+readstat_error_t zsav_write_row(void *writer_ctx, void *row, size_t row_len) {
+    readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
+    zsav_write_ctx_t *ctx = writer->module_ctx;
+    size_t len = sav_compress_row(ctx->row_buffer, row, writer, &ctx->state);
+
+    return zsav_append(ctx, ctx->row_buffer, len);
+}
+
+readstat_error_t zsav_end_data(void *writer_ctx) {
+    readstat_writer_t *writer = (readstat_writer_t *)writer_ctx;
+    zsav_write_ctx_t *ctx = writer->module_ctx;
+    readstat_error_t retval = READSTAT_OK;
+    zsav_header_record_t header;
+    zsav_trailer_record_t trailer;
+    size_t len = 0;
+
+    if (ctx == NULL)
+        return READSTAT_ERROR_WRITER_NOT_INITIALIZED;
+
+    len = sav_compress_finish(ctx->row_buffer, &ctx->state);
+    if ((retval = zsav_append(ctx, ctx->row_buffer, len)) != READSTAT_OK)
+        goto cleanup;
+
+    if ((retval = zsav_flush_job(ctx)) != READSTAT_OK)
+        goto cleanup;
+
+    if (ctx->pipeline && (retval = readstat_pipeline_drain(ctx->pipeline)) != READSTAT_OK)
+        goto cleanup;
+
+    header.zheader_ofs = ctx->zheader_ofs;
+    header.ztrailer_ofs = writer->bytes_written;
+    header.ztrailer_len = sizeof(zsav_trailer_record_t) + ctx->blocks_count * sizeof(zsav_block_record_t);
+
+    if ((retval = readstat_write_bytes_at(writer, ctx->zheader_ofs,
+                    &header, sizeof(zsav_header_record_t))) != READSTAT_OK)
+        goto cleanup;
+
+    trailer.bias = -100;
+    trailer.zero = 0;
+    trailer.block_size = ZSAV_BLOCK_SIZE;
+    trailer.n_blocks = ctx->blocks_count;
+
+    if ((retval = readstat_write_bytes(writer, &trailer, sizeof(zsav_trailer_record_t))) != READSTAT_OK)
+        goto cleanup;
+
+    if (ctx->blocks_count &&
+            (retval = readstat_write_bytes(writer, ctx->blocks,
+                    ctx->blocks_count * sizeof(zsav_block_record_t))) != READSTAT_OK)
+        goto cleanup;
+
+cleanup:
+    zsav_write_ctx_free(ctx);
+    writer->module_ctx = NULL;
+
+    return retval;
+}
+
+#else
+
+readstat_error_t zsav_begin_data(void *writer_ctx) {
+    return READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
+}
+
+readstat_error_t zsav_write_row(void *writer_ctx, void *row, size_t row_len) {
+    return READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
+}
+
+readstat_error_t zsav_end_data(void *writer_ctx) {
+    return READSTAT_ERROR_UNSUPPORTED_COMPRESSION;
+}
+
+#endif
@@ -0,0 +1,13 @@
+
+/* Writer for the zlib-compressed data section of ZSAV files. Cases are
+ * encoded to bytecode, cut into fixed-size blocks and deflated, on worker
+ * threads when the writer allows more than one. Blocks are written out as
+ * they complete, after a placeholder header that is patched at the end to
+ * point at the trailer. */
+
+typedef struct zsav_write_ctx_s zsav_write_ctx_t;
+
+/* Starts the data section at the current offset */
+readstat_error_t zsav_begin_data(void *writer_ctx);
+readstat_error_t zsav_write_row(void *writer_ctx, void *row, size_t row_len);
+readstat_error_t zsav_end_data(void *writer_ctx);
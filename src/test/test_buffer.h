@@ -1,4 +1,15 @@
-
 rt_buffer_t *buffer_init();
 void buffer_reset(rt_buffer_t *buffer);
+int buffer_grow(rt_buffer_t *buffer, size_t size);
 void buffer_free(rt_buffer_t *buffer);
+
+/* I/O handlers over an rt_buffer_ctx_t, for parsers and writers */
+int rt_open_handler(const char *path, void *io_ctx);
+int rt_close_handler(void *io_ctx);
+readstat_off_t rt_seek_handler(readstat_off_t offset, readstat_io_flags_t whence, void *io_ctx);
+ssize_t rt_read_handler(void *buf, size_t nbytes, void *io_ctx);
+ssize_t rt_borrow_handler(const void **buf, size_t nbytes, void *io_ctx);
+ssize_t rt_pread_handler(void *buf, size_t nbytes, readstat_off_t offset, void *io_ctx);
+readstat_error_t rt_update_handler(long file_size, readstat_progress_handler progress_handler,
+        void *user_ctx, void *io_ctx);
+ssize_t rt_write_handler(const void *bytes, size_t len, void *io_ctx);
@@ -0,0 +1,189 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <iconv.h>
+#include <sys/time.h>
+
+#include "../readstat.h"
+#include "../readstat_convert.h"
+#include "../readstat_codepage.h"
+
+/* Checks readstat_convert on space-padded fields of typical SAV/SAS/DTA
+ * widths, and each built-in codepage table against iconv, then times the
+ * conversion on the same fields. */
+
+#define BENCH_FIELDS_COUNT  100000
+
+static const size_t _field_widths[] = { 1, 7, 8, 9, 16, 32, 64, 200, 255, 1024 };
+
+static const char *_codepages[] = { "ASCII", "ISO-8859-1", "ISO-8859-2", "ISO-8859-5",
+    "ISO-8859-7", "ISO-8859-9", "ISO-8859-15", "WINDOWS-1250", "WINDOWS-1251", "WINDOWS-1252",
+    "WINDOWS-1253", "WINDOWS-1254", "WINDOWS-1256", "WINDOWS-1257", "CP437", "CP850", "KOI8-R" };
+
+static int check_convert(readstat_converter_t *converter, const char *label,
+        const char *src, size_t src_len, const char *expected) {
+    char dst[4*1024+1];
+    size_t dst_len = 0;
+    readstat_error_t error = readstat_convert_len(dst, sizeof(dst)-1, src, src_len, converter, &dst_len);
+    if (error != READSTAT_OK) {
+        printf("%s (width %ld): %s\n", label, (long)src_len, readstat_error_message(error));
+        return 1;
+    }
+    if (dst_len != strlen(expected) || strcmp(dst, expected) != 0) {
+        printf("%s (width %ld): expected \"%s\", got \"%s\" (length %ld)\n",
+                label, (long)src_len, expected, dst, (long)dst_len);
+        return 1;
+    }
+    return 0;
+}
+
+/* Converts each byte 0x80-0xFF with the built-in table and with iconv, and
+ * expects the same UTF-8, or for both to reject the byte */
+static int check_codepage(const char *charset) {
+    readstat_converter_t *converter = NULL;
+    iconv_t cd = (iconv_t)-1;
+    int failures = 0;
+    int c;
+
+    if (readstat_codepage_table(charset) == NULL) {
+        printf("%s: no built-in table\n", charset);
+        return 1;
+    }
+    if ((converter = readstat_converter_open("UTF-8", charset)) == NULL ||
+            (cd = iconv_open("UTF-8", charset)) == (iconv_t)-1) {
+        printf("%s: failed to open converters\n", charset);
+        failures++;
+        goto cleanup;
+    }
+
+    for (c=0x80; c<=0xFF; c++) {
+        char src = c;
+        char dst[8], expected[8];
+        size_t dst_len = 0;
+        char *inbuf = &src, *outbuf = expected;
+        size_t inbytesleft = 1, outbytesleft = sizeof(expected)-1;
+
+        readstat_error_t error = readstat_convert_len(dst, sizeof(dst), &src, 1, converter, &dst_len);
+        iconv(cd, NULL, NULL, NULL, NULL);
+        size_t status = iconv(cd, &inbuf, &inbytesleft, &outbuf, &outbytesleft);
+
+        if (status == (size_t)-1) {
+            if (error == READSTAT_OK) {
+                printf("%s: byte 0x%02X converted, but iconv rejects it\n", charset, c);
+                failures++;
+            }
+            continue;
+        }
+        *outbuf = '\0';
+        if (error != READSTAT_OK) {
+            printf("%s: byte 0x%02X rejected (%s)\n", charset, c, readstat_error_message(error));
+            failures++;
+        } else if (dst_len != strlen(expected) || strcmp(dst, expected) != 0) {
+            printf("%s: byte 0x%02X converted differently from iconv\n", charset, c);
+            failures++;
+        }
+    }
+
+cleanup:
+    if (converter)
+        readstat_converter_close(converter);
+    if (cd != (iconv_t)-1)
+        iconv_close(cd);
+
+    return failures;
+}
+
+static void fill_field(char *field, size_t width, const char *text) {
+    size_t len = strlen(text);
+    if (len > width)
+        len = width;
+    memset(field, ' ', width);
+    memcpy(field, text, len);
+}
+
+static int check_widths(readstat_converter_t *converter, const char *label,
+        const char *text, const char *expected_text) {
+    char field[1024];
+    char expected[4*1024+1];
+    int failures = 0;
+    int i;
+    for (i=0; i<sizeof(_field_widths)/sizeof(_field_widths[0]); i++) {
+        size_t width = _field_widths[i];
+        if (strlen(text) > width)
+            continue;
+        fill_field(field, width, text);
+        snprintf(expected, sizeof(expected), "%s", expected_text);
+        failures += check_convert(converter, label, field, width, expected);
+    }
+    return failures;
+}
+
+static double bench_convert(readstat_converter_t *converter, size_t width, const char *text) {
+    char *fields = malloc(BENCH_FIELDS_COUNT * width);
+    char dst[4*1024+1];
+    struct timeval start, end;
+    int i;
+
+    for (i=0; i<BENCH_FIELDS_COUNT; i++) {
+        fill_field(&fields[i * width], width, text);
+    }
+
+    gettimeofday(&start, NULL);
+    for (i=0; i<BENCH_FIELDS_COUNT; i++) {
+        readstat_convert(dst, sizeof(dst)-1, &fields[i * width], width, converter);
+    }
+    gettimeofday(&end, NULL);
+
+    free(fields);
+    return (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_usec - start.tv_usec) * 1e3;
+}
+
+int main(int argc, char *argv[]) {
+    readstat_converter_t *latin1 = readstat_converter_open("UTF-8", "WINDOWS-1252");
+    readstat_converter_t *utf8 = readstat_converter_open("ISO-8859-1", "UTF-8");
+    int failures = 0;
+    int i;
+
+    if (latin1 == NULL || utf8 == NULL) {
+        printf("Failed to open converters\n");
+        return 1;
+    }
+
+    failures += check_widths(NULL, "Unconverted", "a", "a");
+    failures += check_widths(NULL, "Unconverted", "abc def", "abc def");
+    failures += check_widths(NULL, "Unconverted blank", "", "");
+    failures += check_widths(latin1, "ASCII", "abc def", "abc def");
+    failures += check_widths(latin1, "ASCII", "0123456789abcdef", "0123456789abcdef");
+    failures += check_widths(latin1, "Blank", "", "");
+    failures += check_widths(latin1, "Windows-1252", "Stra\xdf" "e", "Stra\xc3\x9f" "e");
+    failures += check_widths(latin1, "Windows-1252", "12345678\x80", "12345678\xe2\x82\xac");
+    failures += check_widths(utf8, "UTF-8", "Stra\xc3\x9f" "e", "Stra\xdf" "e");
+    failures += check_widths(utf8, "UTF-8", "abc def", "abc def");
+
+    for (i=0; i<sizeof(_codepages)/sizeof(_codepages[0]); i++) {
+        failures += check_codepage(_codepages[i]);
+    }
+
+    if (failures) {
+        printf("%d conversion failures\n", failures);
+        goto cleanup;
+    }
+
+    printf("Conversion time per field (ns):\n");
+    printf("%8s %12s %12s %12s\n", "width", "unconverted", "ASCII", "Windows-1252");
+    for (i=0; i<sizeof(_field_widths)/sizeof(_field_widths[0]); i++) {
+        size_t width = _field_widths[i];
+        printf("%8ld %12.1f %12.1f %12.1f\n", (long)width,
+                bench_convert(NULL, width, "Value") / BENCH_FIELDS_COUNT,
+                bench_convert(latin1, width, "Value") / BENCH_FIELDS_COUNT,
+                bench_convert(latin1, width, "V\xe4lue") / BENCH_FIELDS_COUNT);
+    }
+
+cleanup:
+    readstat_converter_close(latin1);
+    readstat_converter_close(utf8);
+
+    return failures ? 1 : 0;
+}
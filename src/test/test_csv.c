@@ -0,0 +1,307 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "../readstat.h"
+#include "../bin/module.h"
+#include "../bin/format_number.h"
+#include "../bin/modules/mod_csv.h"
+
+/* Checks the CSV module's number formatting against strtod/strtof and known
+ * outputs, and its quoting on a small file, then times numeric output
+ * against the stdio path it replaced. */
+
+#define ROUND_TRIP_COUNT    1000000
+#define BENCH_ROWS          100000
+#define BENCH_COLS          10
+
+static uint64_t _random_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random() {
+    _random_state ^= _random_state << 13;
+    _random_state ^= _random_state >> 7;
+    _random_state ^= _random_state << 17;
+    return _random_state;
+}
+
+static int check_double(double value, const char *expected) {
+    char out[RS_FORMAT_NUMBER_MAX_LEN+1];
+    size_t len = rs_format_double(out, value);
+    out[len] = '\0';
+    if (strcmp(out, expected) != 0) {
+        printf("Double %.17g: expected \"%s\", got \"%s\"\n", value, expected, out);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_float(float value, const char *expected) {
+    char out[RS_FORMAT_NUMBER_MAX_LEN+1];
+    size_t len = rs_format_float(out, value);
+    out[len] = '\0';
+    if (strcmp(out, expected) != 0) {
+        printf("Float %.9g: expected \"%s\", got \"%s\"\n", value, expected, out);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_int64(int64_t value) {
+    char out[RS_FORMAT_NUMBER_MAX_LEN+1];
+    char expected[RS_FORMAT_NUMBER_MAX_LEN+1];
+    size_t len = rs_format_int64(out, value);
+    out[len] = '\0';
+    snprintf(expected, sizeof(expected), "%lld", (long long)value);
+    if (strcmp(out, expected) != 0) {
+        printf("Integer %s: got \"%s\"\n", expected, out);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_known_numbers() {
+    int failures = 0;
+
+    failures += check_double(0.0, "0");
+    failures += check_double(-0.0, "-0");
+    failures += check_double(1.0, "1");
+    failures += check_double(-42.0, "-42");
+    failures += check_double(0.1, "0.1");
+    failures += check_double(-2.25, "-2.25");
+    failures += check_double(1.0/3.0, "0.3333333333333333");
+    failures += check_double(123456.789, "123456.789");
+    failures += check_double(0.333333333333333, "0.333333333333333");
+    failures += check_double(1.2345678901234567, "1.2345678901234567");
+    failures += check_double(1e23, "9.999999999999999e22");
+    failures += check_double(0.000001, "0.000001");
+    failures += check_double(1e-7, "1e-7");
+    failures += check_double(9007199254740993.0, "9007199254740992");
+    failures += check_double(1e20, "100000000000000000000");
+    failures += check_double(1e21, "1e21");
+    failures += check_double(1e22, "1e22");
+    failures += check_double(1.5e300, "1.5e300");
+    failures += check_double(DBL_MAX, "1.7976931348623157e308");
+    failures += check_double(-DBL_MAX, "-1.7976931348623157e308");
+    failures += check_double(DBL_MIN, "2.2250738585072014e-308");
+    failures += check_double(4.9406564584124654e-324, "5e-324");
+    failures += check_double(HUGE_VAL, "inf");
+    failures += check_double(-HUGE_VAL, "-inf");
+
+    failures += check_float(0.0f, "0");
+    failures += check_float(-0.0f, "-0");
+    failures += check_float(0.1f, "0.1");
+    failures += check_float(-2.5f, "-2.5");
+    failures += check_float(16777217.0f, "16777216");
+    failures += check_float(3.14159265f, "3.1415927");
+    failures += check_float(FLT_MAX, "3.4028235e38");
+    failures += check_float(FLT_MIN, "1.1754944e-38");
+    failures += check_float(1.4e-45f, "1e-45");
+
+    failures += check_int64(0);
+    failures += check_int64(-1);
+    failures += check_int64(1234567890123LL);
+    failures += check_int64(INT64_MAX);
+    failures += check_int64(INT64_MIN);
+
+    return failures;
+}
+
+/* Formats random bit patterns, expecting each to read back as the same value */
+static int check_round_trips() {
+    char out[RS_FORMAT_NUMBER_MAX_LEN+1];
+    int failures = 0;
+    long i;
+
+    for (i=0; i<ROUND_TRIP_COUNT && failures < 10; i++) {
+        uint64_t bits = next_random();
+        double value;
+        memcpy(&value, &bits, sizeof(double));
+        if (!isfinite(value))
+            continue;
+
+        size_t len = rs_format_double(out, value);
+        out[len] = '\0';
+        if (len > RS_FORMAT_NUMBER_MAX_LEN || strtod(out, NULL) != value) {
+            printf("Double %.17g formatted as \"%s\"\n", value, out);
+            failures++;
+        }
+    }
+
+    for (i=0; i<ROUND_TRIP_COUNT && failures < 10; i++) {
+        uint32_t bits = next_random() >> 32;
+        float value;
+        memcpy(&value, &bits, sizeof(float));
+        if (!isfinite(value))
+            continue;
+
+        size_t len = rs_format_float(out, value);
+        out[len] = '\0';
+        if (len > RS_FORMAT_NUMBER_MAX_LEN || strtof(out, NULL) != value) {
+            printf("Float %.9g formatted as \"%s\"\n", value, out);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+static readstat_value_t string_value(const char *string) {
+    readstat_value_t value = { .type = READSTAT_TYPE_STRING, .v = { .string_value = string },
+        .string_len = strlen(string) };
+    return value;
+}
+
+static readstat_value_t double_value(double number) {
+    readstat_value_t value = { .type = READSTAT_TYPE_DOUBLE, .v = { .double_value = number } };
+    return value;
+}
+
+static readstat_value_t missing_value() {
+    readstat_value_t value = { .type = READSTAT_TYPE_DOUBLE, .v = { .double_value = NAN },
+        .is_system_missing = 1 };
+    return value;
+}
+
+/* Writes a file with awkward strings through the module and compares its
+ * bytes with the RFC 4180 rendering */
+static int check_quoting() {
+    char path[] = "/tmp/test_csv_XXXXXX";
+    char contents[1024];
+    const char *expected =
+        "\"name\",\"say \"\"hi\"\"\",\"n\"\n"
+        "\"plain\",\"a,b\",0.1\n"
+        "\"\",\"line\nbreak\",\n"
+        "\"\"\"\"\"\",\"trailing \"\"\",-3\n";
+    readstat_value_t rows[][3] = {
+        { string_value("plain"), string_value("a,b"), double_value(0.1) },
+        { string_value(""), string_value("line\nbreak"), missing_value() },
+        { string_value("\"\""), string_value("trailing \""), double_value(-3.0) }
+    };
+    const char *names[] = { "name", "say \"hi\"", "n" };
+    int failures = 0;
+    int i, j;
+
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        printf("Failed to create a temporary file\n");
+        return 1;
+    }
+    close(fd);
+
+    readstat_writer_t *writer = readstat_writer_init();
+    void *ctx = rs_mod_csv.init(path);
+    if (ctx == NULL) {
+        failures++;
+        goto cleanup;
+    }
+
+    rs_mod_csv.handle_info(3, 3, ctx);
+    for (j=0; j<3; j++) {
+        readstat_variable_t *variable = readstat_add_variable(writer, names[j],
+                j == 2 ? READSTAT_TYPE_DOUBLE : READSTAT_TYPE_STRING, 0);
+        rs_mod_csv.handle_variable(j, variable, NULL, ctx);
+    }
+    for (i=0; i<3; i++) {
+        for (j=0; j<3; j++) {
+            rs_mod_csv.handle_value(i, j, rows[i][j], ctx);
+        }
+    }
+    if (rs_mod_csv.finish(ctx) != 0) {
+        printf("CSV module failed to finish\n");
+        failures++;
+        goto cleanup;
+    }
+
+    FILE *file = fopen(path, "rb");
+    size_t len = file ? fread(contents, 1, sizeof(contents)-1, file) : 0;
+    if (file)
+        fclose(file);
+    contents[len] = '\0';
+
+    if (strcmp(contents, expected) != 0) {
+        printf("CSV quoting: expected\n%s\ngot\n%s\n", expected, contents);
+        failures++;
+    }
+
+cleanup:
+    readstat_writer_free(writer);
+    unlink(path);
+
+    return failures;
+}
+
+static double elapsed_ns(struct timeval *start, struct timeval *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_usec - start->tv_usec) * 1e3;
+}
+
+/* Writes the same doubles through the module and through fprintf */
+static void bench_numeric_output() {
+    double *values = malloc(BENCH_ROWS * BENCH_COLS * sizeof(double));
+    struct timeval start, end;
+    double module_ns = 0.0, stdio_ns = 0.0;
+    long i;
+    int j;
+
+    for (i=0; i<BENCH_ROWS * BENCH_COLS; i++) {
+        values[i] = (next_random() >> 11) * 0x1.0p-53 * 1000.0;
+    }
+
+    void *ctx = rs_mod_csv.init("/dev/null");
+    if (ctx) {
+        rs_mod_csv.handle_info(BENCH_ROWS, BENCH_COLS, ctx);
+        gettimeofday(&start, NULL);
+        for (i=0; i<BENCH_ROWS; i++) {
+            for (j=0; j<BENCH_COLS; j++) {
+                rs_mod_csv.handle_value(i, j, double_value(values[i * BENCH_COLS + j]), ctx);
+            }
+        }
+        rs_mod_csv.finish(ctx);
+        gettimeofday(&end, NULL);
+        module_ns = elapsed_ns(&start, &end);
+    }
+
+    FILE *file = fopen("/dev/null", "w");
+    if (file) {
+        gettimeofday(&start, NULL);
+        for (i=0; i<BENCH_ROWS; i++) {
+            for (j=0; j<BENCH_COLS; j++) {
+                if (j > 0)
+                    fprintf(file, ",");
+                fprintf(file, "%.17g", values[i * BENCH_COLS + j]);
+            }
+            fprintf(file, "\n");
+        }
+        fclose(file);
+        gettimeofday(&end, NULL);
+        stdio_ns = elapsed_ns(&start, &end);
+    }
+
+    printf("CSV output time per double (ns):\n");
+    printf("%12s %12s\n", "module", "fprintf");
+    printf("%12.1f %12.1f\n", module_ns / (BENCH_ROWS * BENCH_COLS), stdio_ns / (BENCH_ROWS * BENCH_COLS));
+
+    free(values);
+}
+
+int main(int argc, char *argv[]) {
+    int failures = 0;
+
+    failures += check_known_numbers();
+    failures += check_round_trips();
+    failures += check_quoting();
+
+    if (failures) {
+        printf("%d CSV failures\n", failures);
+        return 1;
+    }
+
+    bench_numeric_output();
+
+    return 0;
+}
@@ -0,0 +1,315 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../readstat.h"
+
+#include "test_types.h"
+#include "test_buffer.h"
+
+/* test_readstat round-trips POR files of a few lines. This writes one much
+ * larger than the reader's 64 KiB input buffer and reads it back with CRLF
+ * line endings, with LF only, and with trailing spaces trimmed so that short
+ * lines are padded out. Each variant is also read through a handler that
+ * returns short reads, so that line breaks, CR/LF pairs and padding all
+ * straddle buffer refills. Then counts read calls and times reading a large
+ * file in 64 KiB blocks and one byte at a time, as the reader used to. */
+
+#define POR_TEST_ROWS           10000
+#define POR_TEST_DOUBLES        3
+#define POR_TEST_STRING_WIDTH   40
+#define POR_BENCH_ROWS          100000
+
+/* Vanity and translation table, which are read before padding is known */
+#define POR_HEADER_LINES        6
+
+typedef struct por_io_ctx_s {
+    rt_buffer_ctx_t buffer_ctx; /* First, so the rt_* handlers can take this */
+    size_t          max_read_len;
+    long            reads_count;
+} por_io_ctx_t;
+
+typedef struct test_ctx_s {
+    long            rows_count;
+    long            values_count;
+    long            mismatches_count;
+} test_ctx_t;
+
+/* Integers and halves, which base-30 holds exactly */
+static double test_double(long row, int col) {
+    if (col == 0)
+        return row;
+    if (col == 1)
+        return row * 0.5 - 1000.0;
+    return row * 12345.0;
+}
+
+static int test_double_is_missing(long row, int col) {
+    return col == 2 && row % 9 == 0;
+}
+
+/* Runs of spaces, so that some lines end in spaces that can be trimmed */
+static void test_string(char *out, size_t len, long row) {
+    snprintf(out, len, "%ld%*s%.*s", row, (int)(row % 17 + 1), "",
+            (int)(row % 13 + 1), "ABCDEFGHIJKLM");
+}
+
+static readstat_error_t write_por(rt_buffer_t *buffer, long rows_count) {
+    rt_buffer_ctx_t buffer_ctx = { .buffer = buffer };
+    readstat_error_t error = READSTAT_OK;
+    readstat_variable_t *variables[POR_TEST_DOUBLES+1];
+    char name[32], string[POR_TEST_STRING_WIDTH+1];
+    long i;
+    int j;
+
+    readstat_writer_t *writer = readstat_writer_init();
+    readstat_set_data_writer(writer, &rt_write_handler);
+    readstat_writer_set_file_timestamp(writer, 1000000000);
+
+    for (j=0; j<POR_TEST_DOUBLES; j++) {
+        snprintf(name, sizeof(name), "DBL%d", j);
+        variables[j] = readstat_add_variable(writer, name, READSTAT_TYPE_DOUBLE, 0);
+    }
+    variables[j] = readstat_add_variable(writer, "STR", READSTAT_TYPE_STRING, POR_TEST_STRING_WIDTH);
+
+    if ((error = readstat_begin_writing_por(writer, &buffer_ctx, rows_count)) != READSTAT_OK)
+        goto cleanup;
+
+    for (i=0; i<rows_count; i++) {
+        if ((error = readstat_begin_row(writer)) != READSTAT_OK)
+            goto cleanup;
+
+        for (j=0; j<POR_TEST_DOUBLES; j++) {
+            if (test_double_is_missing(i, j)) {
+                error = readstat_insert_missing_value(writer, variables[j]);
+            } else {
+                error = readstat_insert_double_value(writer, variables[j], test_double(i, j));
+            }
+            if (error != READSTAT_OK)
+                goto cleanup;
+        }
+        test_string(string, sizeof(string), i);
+        if ((error = readstat_insert_string_value(writer, variables[j], string)) != READSTAT_OK)
+            goto cleanup;
+
+        if ((error = readstat_end_row(writer)) != READSTAT_OK)
+            goto cleanup;
+    }
+
+    error = readstat_end_writing(writer);
+
+cleanup:
+    readstat_writer_free(writer);
+
+    return error;
+}
+
+/* Rewrites CRLF line endings as LF, optionally trimming trailing spaces from
+ * every line after the header. Returns the number of lines trimmed. */
+static long rewrite_lines(rt_buffer_t *dst, const rt_buffer_t *src, int trim_spaces) {
+    size_t line_start = 0;
+    long line_index = 0;
+    long trimmed_count = 0;
+
+    buffer_reset(dst);
+    buffer_grow(dst, src->used);
+
+    while (line_start < src->used) {
+        size_t line_end = line_start;
+        while (line_end < src->used && src->bytes[line_end] != '\r' && src->bytes[line_end] != '\n')
+            line_end++;
+
+        size_t line_len = line_end - line_start;
+        if (trim_spaces && line_index >= POR_HEADER_LINES) {
+            while (line_len && src->bytes[line_start + line_len - 1] == ' ')
+                line_len--;
+            if (line_len < line_end - line_start)
+                trimmed_count++;
+        }
+        memcpy(&dst->bytes[dst->used], &src->bytes[line_start], line_len);
+        dst->used += line_len;
+        dst->bytes[dst->used++] = '\n';
+
+        line_start = line_end;
+        if (line_start < src->used && src->bytes[line_start] == '\r')
+            line_start++;
+        if (line_start < src->used && src->bytes[line_start] == '\n')
+            line_start++;
+        line_index++;
+    }
+    return trimmed_count;
+}
+
+static ssize_t counting_read_handler(void *buf, size_t nbytes, void *io_ctx) {
+    por_io_ctx_t *ctx = (por_io_ctx_t *)io_ctx;
+    ctx->reads_count++;
+    if (ctx->max_read_len && nbytes > ctx->max_read_len)
+        nbytes = ctx->max_read_len;
+    return rt_read_handler(buf, nbytes, &ctx->buffer_ctx);
+}
+
+static int handle_value(int obs_index, int var_index, readstat_value_t value, void *ctx) {
+    test_ctx_t *test_ctx = (test_ctx_t *)ctx;
+    char string[POR_TEST_STRING_WIDTH+1];
+    int matches = 0;
+
+    if (obs_index >= test_ctx->rows_count)
+        test_ctx->rows_count = obs_index + 1;
+
+    if (var_index < POR_TEST_DOUBLES) {
+        if (test_double_is_missing(obs_index, var_index)) {
+            matches = readstat_value_is_system_missing(value);
+        } else {
+            matches = !readstat_value_is_system_missing(value) &&
+                readstat_double_value(value) == test_double(obs_index, var_index);
+        }
+    } else {
+        test_string(string, sizeof(string), obs_index);
+        matches = (readstat_string_value(value) && strcmp(readstat_string_value(value), string) == 0);
+    }
+
+    if (!matches)
+        test_ctx->mismatches_count++;
+    test_ctx->values_count++;
+
+    return 0;
+}
+
+static int handle_value_count(int obs_index, int var_index, readstat_value_t value, void *ctx) {
+    test_ctx_t *test_ctx = (test_ctx_t *)ctx;
+    test_ctx->values_count++;
+    return 0;
+}
+
+static readstat_error_t parse_por(rt_buffer_t *buffer, size_t max_read_len, long *reads_count,
+        readstat_value_handler value_handler, test_ctx_t *test_ctx) {
+    por_io_ctx_t io_ctx = { .buffer_ctx = { .buffer = buffer }, .max_read_len = max_read_len };
+
+    memset(test_ctx, 0, sizeof(test_ctx_t));
+
+    readstat_parser_t *parser = readstat_parser_init();
+    readstat_set_open_handler(parser, &rt_open_handler);
+    readstat_set_close_handler(parser, &rt_close_handler);
+    readstat_set_seek_handler(parser, &rt_seek_handler);
+    readstat_set_read_handler(parser, &counting_read_handler);
+    readstat_set_update_handler(parser, &rt_update_handler);
+    readstat_set_io_ctx(parser, &io_ctx);
+
+    readstat_set_value_handler(parser, value_handler);
+
+    readstat_error_t error = readstat_parse_por(parser, "test", test_ctx);
+    readstat_parser_free(parser);
+
+    if (reads_count)
+        *reads_count = io_ctx.reads_count;
+
+    return error;
+}
+
+static int check_read(const char *label, rt_buffer_t *buffer, size_t max_read_len) {
+    test_ctx_t test_ctx;
+    readstat_error_t error = parse_por(buffer, max_read_len, NULL, &handle_value, &test_ctx);
+
+    if (error != READSTAT_OK) {
+        printf("%s, reads of at most %ld bytes: %s\n", label, (long)max_read_len,
+                readstat_error_message(error));
+        return 1;
+    }
+    if (test_ctx.rows_count != POR_TEST_ROWS ||
+            test_ctx.values_count != POR_TEST_ROWS * (POR_TEST_DOUBLES + 1) ||
+            test_ctx.mismatches_count) {
+        printf("%s, reads of at most %ld bytes: %ld rows, %ld values, %ld wrong\n", label,
+                (long)max_read_len, test_ctx.rows_count, test_ctx.values_count, test_ctx.mismatches_count);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_variant(const char *label, rt_buffer_t *buffer) {
+    /* Whole blocks, a size that is not a multiple of the line length, and
+     * one byte at a time */
+    size_t max_read_lens[] = { 0, 4097, 1 };
+    int failures = 0;
+    int i;
+
+    if (buffer->used <= 2 * 65536) {
+        printf("%s: only %ld bytes\n", label, (long)buffer->used);
+        return 1;
+    }
+
+    for (i=0; i<sizeof(max_read_lens)/sizeof(max_read_lens[0]); i++) {
+        failures += check_read(label, buffer, max_read_lens[i]);
+    }
+    return failures;
+}
+
+static double elapsed_ns(struct timeval *start, struct timeval *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_usec - start->tv_usec) * 1e3;
+}
+
+static void bench_reads() {
+    rt_buffer_t *buffer = buffer_init();
+    size_t max_read_lens[] = { 1, 0 };
+    const char *labels[] = { "1 byte", "buffered" };
+    struct timeval start, end;
+    test_ctx_t test_ctx;
+    int i;
+
+    if (write_por(buffer, POR_BENCH_ROWS) != READSTAT_OK) {
+        buffer_free(buffer);
+        return;
+    }
+
+    printf("POR read of %ld KB, %d rows:\n", (long)(buffer->used / 1024), POR_BENCH_ROWS);
+    printf("%12s %12s %12s\n", "reads", "read calls", "MB/s");
+    for (i=0; i<2; i++) {
+        long reads_count = 0;
+        gettimeofday(&start, NULL);
+        readstat_error_t error = parse_por(buffer, max_read_lens[i], &reads_count, &handle_value_count, &test_ctx);
+        gettimeofday(&end, NULL);
+        if (error != READSTAT_OK)
+            continue;
+
+        printf("%12s %12ld %12.1f\n", labels[i], reads_count,
+                buffer->used / (elapsed_ns(&start, &end) / 1e9) / (1024 * 1024));
+    }
+
+    buffer_free(buffer);
+}
+
+int main(int argc, char *argv[]) {
+    rt_buffer_t *crlf = buffer_init(), *lf = buffer_init(), *trimmed = buffer_init();
+    int failures = 0;
+
+    readstat_error_t error = write_por(crlf, POR_TEST_ROWS);
+    if (error != READSTAT_OK) {
+        printf("Failed to write the test file: %s\n", readstat_error_message(error));
+        failures++;
+        goto cleanup;
+    }
+    rewrite_lines(lf, crlf, 0);
+    if (rewrite_lines(trimmed, crlf, 1) < 100) {
+        printf("Too few lines end in spaces\n");
+        failures++;
+    }
+
+    failures += check_variant("CRLF", crlf);
+    failures += check_variant("LF", lf);
+    failures += check_variant("Trimmed lines", trimmed);
+
+cleanup:
+    buffer_free(crlf);
+    buffer_free(lf);
+    buffer_free(trimmed);
+
+    if (failures) {
+        printf("%d POR failures\n", failures);
+        return 1;
+    }
+
+    bench_reads();
+
+    return 0;
+}
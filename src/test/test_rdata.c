@@ -0,0 +1,277 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "../readstat.h"
+
+#include "test_types.h"
+#include "test_buffer.h"
+
+/* Parses a small data frame serialized as an RDS file and as an RData file,
+ * plain and gzipped, all built here in R's XDR format. The data frame in an
+ * RDS file is reported as a table with no name. */
+
+#define SEXP_SYMBOL             1
+#define SEXP_PAIRLIST           2
+#define SEXP_CHARACTER_STRING   9
+#define SEXP_INTEGER_VECTOR     13
+#define SEXP_REAL_VECTOR        14
+#define SEXP_CHARACTER_VECTOR   16
+#define SEXP_GENERIC_VECTOR     19
+#define SEXP_NIL                254
+
+#define SEXP_IS_OBJECT          0x100
+#define SEXP_HAS_ATTRIBUTES     0x200
+#define SEXP_HAS_TAG            0x400
+
+#define CHARSXP_UTF8            0x00040000
+
+typedef struct test_ctx_s {
+    char            table_name[32];
+    int             tables_count;
+    char            column_names[2][32];
+    int             column_names_count;
+    double          doubles[3];
+    int             doubles_count;
+    char            strings[3][32];
+    int             strings_count;
+    int             string_columns_count;
+} test_ctx_t;
+
+static const double _doubles[] = { 1.5, -2.25, 1e100 };
+static const char *_strings[] = { "one", "two", "three" };
+
+static void put_bytes(rt_buffer_t *buffer, const void *bytes, size_t len) {
+    buffer_grow(buffer, buffer->used + len);
+    memcpy(&buffer->bytes[buffer->used], bytes, len);
+    buffer->used += len;
+}
+
+static void put_int(rt_buffer_t *buffer, uint32_t value) {
+    unsigned char bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+    put_bytes(buffer, bytes, sizeof(bytes));
+}
+
+static void put_double(rt_buffer_t *buffer, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put_int(buffer, bits >> 32);
+    put_int(buffer, bits);
+}
+
+static void put_charsxp(rt_buffer_t *buffer, const char *string) {
+    put_int(buffer, SEXP_CHARACTER_STRING | CHARSXP_UTF8);
+    put_int(buffer, strlen(string));
+    put_bytes(buffer, string, strlen(string));
+}
+
+static void put_tag(rt_buffer_t *buffer, const char *name) {
+    put_int(buffer, SEXP_PAIRLIST | SEXP_HAS_TAG);
+    put_int(buffer, SEXP_SYMBOL);
+    put_charsxp(buffer, name);
+}
+
+static void put_strings(rt_buffer_t *buffer, const char **strings, int count) {
+    int i;
+    put_int(buffer, SEXP_CHARACTER_VECTOR);
+    put_int(buffer, count);
+    for (i=0; i<count; i++) {
+        put_charsxp(buffer, strings[i]);
+    }
+}
+
+static void put_header(rt_buffer_t *buffer) {
+    put_bytes(buffer, "X\n", 2);
+    put_int(buffer, 2);
+    put_int(buffer, 0x030402);
+    put_int(buffer, 0x020300);
+}
+
+static void put_data_frame(rt_buffer_t *buffer) {
+    const char *names[] = { "dbl", "str" };
+    const char *class_name[] = { "data.frame" };
+    int i;
+
+    put_int(buffer, SEXP_GENERIC_VECTOR | SEXP_IS_OBJECT | SEXP_HAS_ATTRIBUTES);
+    put_int(buffer, 2);
+
+    put_int(buffer, SEXP_REAL_VECTOR);
+    put_int(buffer, 3);
+    for (i=0; i<3; i++) {
+        put_double(buffer, _doubles[i]);
+    }
+    put_strings(buffer, _strings, 3);
+
+    put_tag(buffer, "names");
+    put_strings(buffer, names, 2);
+
+    put_tag(buffer, "row.names");
+    put_int(buffer, SEXP_INTEGER_VECTOR);
+    put_int(buffer, 2);
+    put_int(buffer, 0x80000000);
+    put_int(buffer, -3);
+
+    put_tag(buffer, "class");
+    put_strings(buffer, class_name, 1);
+
+    put_int(buffer, SEXP_NIL);
+}
+
+static void build_rds(rt_buffer_t *buffer) {
+    put_header(buffer);
+    put_data_frame(buffer);
+}
+
+static void build_rdata(rt_buffer_t *buffer) {
+    put_bytes(buffer, "RDX2\n", 5);
+    put_header(buffer);
+    put_tag(buffer, "df");
+    put_data_frame(buffer);
+    put_int(buffer, SEXP_NIL);
+}
+
+static int gzip_buffer(rt_buffer_t *dst, const rt_buffer_t *src) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return -1;
+
+    buffer_grow(dst, deflateBound(&stream, src->used));
+    stream.next_in = (unsigned char *)src->bytes;
+    stream.avail_in = src->used;
+    stream.next_out = (unsigned char *)dst->bytes;
+    stream.avail_out = dst->size;
+    int result = deflate(&stream, Z_FINISH);
+    dst->used = dst->size - stream.avail_out;
+    deflateEnd(&stream);
+
+    return result == Z_STREAM_END ? 0 : -1;
+}
+
+static int handle_table(const char *name, void *ctx) {
+    test_ctx_t *test_ctx = (test_ctx_t *)ctx;
+    snprintf(test_ctx->table_name, sizeof(test_ctx->table_name), "%s", name ? name : "");
+    test_ctx->tables_count++;
+    return 0;
+}
+
+static int handle_column(const char *name, readstat_type_t type, char *format,
+        void *data, long count, void *ctx) {
+    test_ctx_t *test_ctx = (test_ctx_t *)ctx;
+    int i;
+    if (type == READSTAT_TYPE_DOUBLE) {
+        for (i=0; i<count && test_ctx->doubles_count < 3; i++) {
+            test_ctx->doubles[test_ctx->doubles_count++] = ((double *)data)[i];
+        }
+    } else if (type == READSTAT_TYPE_STRING) {
+        test_ctx->string_columns_count++;
+    }
+    return 0;
+}
+
+static int handle_column_name(const char *value, int index, void *ctx) {
+    test_ctx_t *test_ctx = (test_ctx_t *)ctx;
+    if (test_ctx->column_names_count < 2) {
+        snprintf(test_ctx->column_names[test_ctx->column_names_count++],
+                sizeof(test_ctx->column_names[0]), "%s", value);
+    }
+    return 0;
+}
+
+static int handle_text_value(const char *value, int index, void *ctx) {
+    test_ctx_t *test_ctx = (test_ctx_t *)ctx;
+    if (test_ctx->strings_count < 3) {
+        snprintf(test_ctx->strings[test_ctx->strings_count++],
+                sizeof(test_ctx->strings[0]), "%s", value);
+    }
+    return 0;
+}
+
+static int check_parse(const char *label, rt_buffer_t *buffer, const char *expected_table) {
+    rt_buffer_ctx_t buffer_ctx = { .buffer = buffer };
+    test_ctx_t test_ctx;
+    int failures = 0;
+    int i;
+
+    memset(&test_ctx, 0, sizeof(test_ctx));
+
+    rdata_parser_t *parser = rdata_parser_init();
+    rdata_set_open_handler(parser, &rt_open_handler);
+    rdata_set_close_handler(parser, &rt_close_handler);
+    rdata_set_seek_handler(parser, &rt_seek_handler);
+    rdata_set_read_handler(parser, &rt_read_handler);
+    rdata_set_update_handler(parser, &rt_update_handler);
+    rdata_set_io_ctx(parser, &buffer_ctx);
+
+    rdata_set_table_handler(parser, &handle_table);
+    rdata_set_column_handler(parser, &handle_column);
+    rdata_set_column_name_handler(parser, &handle_column_name);
+    rdata_set_text_value_handler(parser, &handle_text_value);
+
+    readstat_error_t error = rdata_parse(parser, "test", &test_ctx);
+    rdata_parser_free(parser);
+
+    if (error != READSTAT_OK) {
+        printf("%s: %s\n", label, readstat_error_message(error));
+        return 1;
+    }
+
+    if (test_ctx.tables_count != 1 || strcmp(test_ctx.table_name, expected_table) != 0) {
+        printf("%s: expected table \"%s\", got %d tables (last \"%s\")\n",
+                label, expected_table, test_ctx.tables_count, test_ctx.table_name);
+        failures++;
+    }
+
+    if (test_ctx.column_names_count != 2 || strcmp(test_ctx.column_names[0], "dbl") != 0 ||
+            strcmp(test_ctx.column_names[1], "str") != 0) {
+        printf("%s: wrong column names\n", label);
+        failures++;
+    }
+    if (test_ctx.string_columns_count != 1) {
+        printf("%s: expected 1 string column, got %d\n", label, test_ctx.string_columns_count);
+        failures++;
+    }
+    for (i=0; i<3; i++) {
+        if (i >= test_ctx.doubles_count || test_ctx.doubles[i] != _doubles[i]) {
+            printf("%s: wrong double in row %d\n", label, i);
+            failures++;
+        }
+        if (i >= test_ctx.strings_count || strcmp(test_ctx.strings[i], _strings[i]) != 0) {
+            printf("%s: wrong string in row %d\n", label, i);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char *argv[]) {
+    rt_buffer_t *rds = buffer_init(), *rds_gz = buffer_init();
+    rt_buffer_t *rdata = buffer_init(), *rdata_gz = buffer_init();
+    int failures = 0;
+
+    build_rds(rds);
+    build_rdata(rdata);
+    if (gzip_buffer(rds_gz, rds) != 0 || gzip_buffer(rdata_gz, rdata) != 0) {
+        printf("Failed to gzip test files\n");
+        return 1;
+    }
+
+    failures += check_parse("RDS", rds, "");
+    failures += check_parse("Gzipped RDS", rds_gz, "");
+    failures += check_parse("RData", rdata, "df");
+    failures += check_parse("Gzipped RData", rdata_gz, "df");
+
+    buffer_free(rds);
+    buffer_free(rds_gz);
+    buffer_free(rdata);
+    buffer_free(rdata_gz);
+
+    if (failures)
+        printf("%d RData failures\n", failures);
+
+    return failures ? 1 : 0;
+}
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "../readstat.h"
 
@@ -9,6 +10,16 @@
 #include "test_read.h"
 #include "test_dta.h"
 
+#define RT_READ_BORROW  0x01
+#define RT_READ_BATCH   0x02
+#define RT_READ_FILTER  0x04
+#define RT_READ_OFFSET  0x08
+#define RT_READ_THREADS 0x10
+#define RT_READ_STRING_DICTIONARY   0x20
+
+/* Small enough that some columns outgrow their dictionaries */
+#define RT_STRING_DICTIONARY_MAX    2
+
 static rt_buffer_ctx_t *buffer_ctx_init(rt_buffer_t *buffer) {
     rt_buffer_ctx_t *buffer_ctx = calloc(1, sizeof(rt_buffer_ctx_t));
     buffer_ctx->buffer = buffer;
@@ -35,7 +46,7 @@ void parse_ctx_reset(rt_parse_ctx_t *parse_ctx, long file_format) {
         parse_ctx->max_file_label_len = 32;
     } else if ((file_format & RT_FORMAT_DTA)) {
         parse_ctx->max_file_label_len = 81;
-    } else if (file_format == RT_FORMAT_SAV) {
+    } else if ((file_format & RT_FORMAT_SAV)) {
         parse_ctx->max_file_label_len = 64;
     } else {
         parse_ctx->max_file_label_len = 20;
@@ -52,65 +63,6 @@ void parse_ctx_free(rt_parse_ctx_t *parse_ctx) {
     free(parse_ctx);
 }
 
-static int rt_open_handler(const char *path, void *io_ctx) {
-    return 0;
-}
-
-static int rt_close_handler(void *io_ctx) {
-    return 0;
-}
-
-static readstat_off_t rt_seek_handler(readstat_off_t offset,
-        readstat_io_flags_t whence, void *io_ctx) {
-    rt_buffer_ctx_t *buffer_ctx = (rt_buffer_ctx_t *)io_ctx;
-    readstat_off_t newpos = -1;
-    if (whence == READSTAT_SEEK_SET) {
-        newpos = offset;
-    } else if (whence == READSTAT_SEEK_CUR) {
-        newpos = buffer_ctx->pos + offset;
-    } else if (whence == READSTAT_SEEK_END) {
-        newpos = buffer_ctx->buffer->used + offset;
-    }
-
-    if (newpos < 0)
-        return -1;
-
-    if (newpos > buffer_ctx->buffer->used)
-        return -1;
-
-    buffer_ctx->pos = newpos;
-    return newpos;
-}
-
-static ssize_t rt_read_handler(void *buf, size_t nbytes, void *io_ctx) {
-    rt_buffer_ctx_t *buffer_ctx = (rt_buffer_ctx_t *)io_ctx;
-    ssize_t bytes_copied = 0;
-    ssize_t bytes_left = buffer_ctx->buffer->used - buffer_ctx->pos;
-    if (nbytes <= bytes_left) {
-        memcpy(buf, buffer_ctx->buffer->bytes + buffer_ctx->pos, nbytes);
-        bytes_copied = nbytes;
-    } else if (bytes_left > 0) {
-        memcpy(buf, buffer_ctx->buffer->bytes + buffer_ctx->pos, bytes_left);
-        bytes_copied = bytes_left;
-    }
-    buffer_ctx->pos += bytes_copied;
-    return bytes_copied;
-}
-
-static readstat_error_t rt_update_handler(long file_size,
-        readstat_progress_handler progress_handler, void *user_ctx,
-        void *io_ctx) {
-    if (!progress_handler)
-        return READSTAT_OK;
-
-    rt_buffer_ctx_t *buffer_ctx = (rt_buffer_ctx_t *)io_ctx;
-
-    if (progress_handler(1.0 * buffer_ctx->pos / buffer_ctx->buffer->used, user_ctx))
-        return READSTAT_ERROR_USER_ABORT;
-
-    return READSTAT_OK;
-}
-
 static int handle_info(int obs_count, int var_count, void *ctx) {
     rt_parse_ctx_t *rt_ctx = (rt_parse_ctx_t *)ctx;
 
@@ -123,7 +75,7 @@ static int handle_info(int obs_count, int var_count, void *ctx) {
 
     if (obs_count != -1) {
         push_error_if_doubles_differ(rt_ctx, 
-                rt_ctx->file->rows, obs_count, 
+                rt_ctx->file->rows - rt_ctx->row_offset, obs_count, 
                 "Number of observations");
     }
 
@@ -165,6 +117,10 @@ static int handle_variable(int index, readstat_variable_t *variable,
 
     rt_ctx->var_index = index;
 
+    if (rt_ctx->skip_odd_columns) {
+        push_error_if_doubles_differ(rt_ctx, 0, index % 2, "Filtered variables");
+    }
+
     push_error_if_strings_differ(rt_ctx, column->name, 
             readstat_variable_get_name(variable),
             "Column names");
@@ -176,6 +132,24 @@ static int handle_variable(int index, readstat_variable_t *variable,
     return 0;
 }
 
+static void check_string_len(rt_parse_ctx_t *rt_ctx, readstat_value_t value, const char *context) {
+    const char *string = readstat_string_value(value);
+    if (string) {
+        push_error_if_doubles_differ(rt_ctx, strlen(string),
+                readstat_string_value_len(value), context);
+    }
+}
+
+static void check_dictionary_id(rt_parse_ctx_t *rt_ctx, readstat_value_t value, const char *context) {
+    readstat_type_t type = readstat_value_type(value);
+    int32_t id = readstat_string_value_dictionary_id(value);
+    if (type != READSTAT_TYPE_STRING || !rt_ctx->string_dictionary_max || id == -1)
+        return;
+
+    if (id < 0 || id >= rt_ctx->string_dictionary_max)
+        push_error_if_doubles_differ(rt_ctx, 0, id, context);
+}
+
 static int handle_value(int obs_index, int var_index, readstat_value_t value, void *ctx) {
     rt_parse_ctx_t *rt_ctx = (rt_parse_ctx_t *)ctx;
     rt_column_t *column = &rt_ctx->file->columns[var_index];
@@ -183,10 +157,80 @@ static int handle_value(int obs_index, int var_index, readstat_value_t value, vo
     rt_ctx->obs_index = obs_index;
     rt_ctx->var_index = var_index;
 
+    if (rt_ctx->skip_odd_columns) {
+        push_error_if_doubles_differ(rt_ctx, 0, var_index % 2, "Filtered values");
+    }
+
     push_error_if_values_differ(rt_ctx, 
-            column->values[obs_index],
+            column->values[rt_ctx->row_offset + obs_index],
             value, "Data values");
 
+    check_string_len(rt_ctx, value, "String value lengths");
+    check_dictionary_id(rt_ctx, value, "String dictionary ids");
+
+    return 0;
+}
+
+static int handle_batch(int obs_index, int obs_count,
+        const readstat_column_t *columns, int columns_count, void *ctx) {
+    rt_parse_ctx_t *rt_ctx = (rt_parse_ctx_t *)ctx;
+    int i, j;
+
+    for (j=0; j<columns_count; j++) {
+        const readstat_column_t *column = &columns[j];
+        rt_column_t *rt_column = &rt_ctx->file->columns[column->index];
+
+        if (rt_ctx->skip_odd_columns) {
+            rt_ctx->var_index = column->index;
+            push_error_if_doubles_differ(rt_ctx, 0, column->index % 2, "Filtered columns");
+        }
+        for (i=0; i<obs_count; i++) {
+            readstat_value_t value = { .type = column->type };
+            if (column->type == READSTAT_TYPE_STRING ||
+                    column->type == READSTAT_TYPE_LONG_STRING) {
+                value.v.string_value = column->v.string_values[i];
+                value.string_len = column->string_lengths[i];
+            } else if (column->type == READSTAT_TYPE_INT8) {
+                value.v.i8_value = column->v.i8_values[i];
+            } else if (column->type == READSTAT_TYPE_INT16) {
+                value.v.i16_value = column->v.i16_values[i];
+            } else if (column->type == READSTAT_TYPE_INT32) {
+                value.v.i32_value = column->v.i32_values[i];
+            } else if (column->type == READSTAT_TYPE_FLOAT) {
+                value.v.float_value = column->v.float_values[i];
+            } else if (column->type == READSTAT_TYPE_DOUBLE) {
+                value.v.double_value = column->v.double_values[i];
+            }
+            value.is_system_missing = readstat_column_is_system_missing(column, i);
+            value.is_considered_missing = readstat_column_is_considered_missing(column, i);
+            value.tag = column->tags[i];
+
+            rt_ctx->obs_index = obs_index + i;
+            rt_ctx->var_index = column->index;
+
+            if (column->dictionary_ids && column->dictionary_ids[i] != -1) {
+                int32_t id = column->dictionary_ids[i];
+                push_error_if_doubles_differ(rt_ctx, 1, id < column->dictionary_count,
+                        "Batched string dictionary ids");
+                if (id < column->dictionary_count) {
+                    push_error_if_doubles_differ(rt_ctx, 1, column->dictionary[id] == value.v.string_value,
+                            "Batched string dictionary entries");
+                }
+                value.dictionary_entry = id + 1;
+            } else if (rt_ctx->string_dictionary_max && column->type == READSTAT_TYPE_STRING) {
+                push_error_if_doubles_differ(rt_ctx, 1, column->dictionary_ids != NULL,
+                        "Batched string dictionaries");
+            }
+
+            push_error_if_values_differ(rt_ctx,
+                    rt_column->values[rt_ctx->row_offset + obs_index + i],
+                    value, "Batched data values");
+
+            check_string_len(rt_ctx, value, "Batched string value lengths");
+            check_dictionary_id(rt_ctx, value, "Batched string dictionary ids");
+        }
+    }
+
     return 0;
 }
 
@@ -194,8 +238,9 @@ static void handle_error(const char *error_message, void *ctx) {
     printf("%s\n", error_message);
 }
 
-readstat_error_t read_file(rt_parse_ctx_t *parse_ctx, long format) {
+static readstat_error_t read_file_with_flags(rt_parse_ctx_t *parse_ctx, long format, long flags) {
     readstat_error_t error = READSTAT_OK;
+    int i;
 
     readstat_parser_t *parser = readstat_parser_init();
 
@@ -204,19 +249,58 @@ readstat_error_t read_file(rt_parse_ctx_t *parse_ctx, long format) {
     readstat_set_seek_handler(parser, rt_seek_handler);
     readstat_set_read_handler(parser, rt_read_handler);
     readstat_set_update_handler(parser, rt_update_handler);
+    if ((flags & RT_READ_BORROW))
+        readstat_set_borrow_handler(parser, rt_borrow_handler);
+    if ((flags & RT_READ_THREADS)) {
+        readstat_set_pread_handler(parser, rt_pread_handler);
+        readstat_set_thread_count(parser, 3);
+    }
     readstat_set_io_ctx(parser, parse_ctx->buffer_ctx);
+    parse_ctx->buffer_ctx->pos = 0;
 
     readstat_set_info_handler(parser, &handle_info);
     readstat_set_metadata_handler(parser, &handle_metadata);
     readstat_set_variable_handler(parser, &handle_variable);
     readstat_set_fweight_handler(parser, &handle_fweight);
-    readstat_set_value_handler(parser, &handle_value);
+    if ((flags & RT_READ_BATCH)) {
+        /* Small batches so that every test crosses a flush boundary */
+        readstat_set_batch_handler(parser, &handle_batch);
+        readstat_set_batch_size(parser, 2);
+    } else {
+        readstat_set_value_handler(parser, &handle_value);
+    }
     readstat_set_error_handler(parser, &handle_error);
 
+    parse_ctx->row_offset = 0;
+    if ((flags & RT_READ_OFFSET) && parse_ctx->file->rows > 1) {
+        parse_ctx->row_offset = 1;
+        readstat_set_row_offset(parser, parse_ctx->row_offset);
+    }
+
+    parse_ctx->string_dictionary_max = 0;
+    if ((flags & RT_READ_STRING_DICTIONARY)) {
+        parse_ctx->string_dictionary_max = RT_STRING_DICTIONARY_MAX;
+        readstat_set_string_dictionary(parser, parse_ctx->string_dictionary_max);
+    }
+
+    parse_ctx->skip_odd_columns = 0;
+    if ((flags & RT_READ_FILTER)) {
+        /* Select the even columns, half by index and half by name */
+        for (i=0; i<parse_ctx->file->columns_count; i+=2) {
+            if (i % 4 == 0) {
+                readstat_set_column_filter(parser, &i, 1);
+            } else {
+                const char *name = parse_ctx->file->columns[i].name;
+                readstat_set_column_filter_names(parser, &name, 1);
+            }
+        }
+        parse_ctx->skip_odd_columns = 1;
+    }
+
     if ((format & RT_FORMAT_DTA)) {
         parse_ctx->file_format_version = dta_file_format_version(format);
         error = readstat_parse_dta(parser, NULL, parse_ctx);
-    } else if (format == RT_FORMAT_SAV) {
+    } else if ((format & RT_FORMAT_SAV)) {
         parse_ctx->file_format_version = 2;
         error = readstat_parse_sav(parser, NULL, parse_ctx);
     } else if (format == RT_FORMAT_POR) {
@@ -232,3 +316,20 @@ cleanup:
     return error;
 }
 
+readstat_error_t read_file(rt_parse_ctx_t *parse_ctx, long format) {
+    readstat_error_t error = READSTAT_OK;
+
+    long flags[] = { 0, RT_READ_BORROW, RT_READ_BATCH, RT_READ_FILTER, RT_READ_BATCH | RT_READ_FILTER,
+        RT_READ_OFFSET, RT_READ_OFFSET | RT_READ_BATCH,
+        RT_READ_THREADS, RT_READ_THREADS | RT_READ_BATCH | RT_READ_FILTER, RT_READ_THREADS | RT_READ_OFFSET,
+        RT_READ_STRING_DICTIONARY, RT_READ_STRING_DICTIONARY | RT_READ_BATCH | RT_READ_FILTER,
+        RT_READ_STRING_DICTIONARY | RT_READ_THREADS, RT_READ_STRING_DICTIONARY | RT_READ_THREADS | RT_READ_BATCH };
+    int i;
+
+    for (i=0; i<sizeof(flags)/sizeof(flags[0]); i++) {
+        if ((error = read_file_with_flags(parse_ctx, format, flags[i])) != READSTAT_OK)
+            break;
+    }
+
+    return error;
+}
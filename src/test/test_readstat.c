@@ -927,7 +927,7 @@ int main(int argc, char *argv[]) {
     rt_buffer_t *buffer = buffer_init();
     readstat_error_t error = READSTAT_OK;
 
-    int g, t, f;
+    int g, t, f, m;
 
     for (g=0; g<sizeof(_test_groups)/sizeof(_test_groups[0]); g++) {
         for (t=0; t<MAX_TESTS_PER_GROUP && _test_groups[g].tests[t].label[0]; t++) {
@@ -944,22 +944,24 @@ int main(int argc, char *argv[]) {
                 if (!(file->test_formats & f))
                     continue;
 
-                parse_ctx_reset(parse_ctx, f);
+                for (m=0; m<RT_WRITE_MODES_COUNT; m++) {
+                    parse_ctx_reset(parse_ctx, f);
 
-                error = write_file_to_buffer(file, buffer, f);
-                if (error != file->write_error) {
-                    push_error_if_codes_differ(parse_ctx, file->write_error, error);
-                    error = READSTAT_OK;
-                    continue;
-                }
-                if (error != READSTAT_OK) {
-                    error = READSTAT_OK;
-                    continue;
-                }
+                    error = write_file_to_buffer(file, buffer, f, m);
+                    if (error != file->write_error) {
+                        push_error_if_codes_differ(parse_ctx, file->write_error, error);
+                        error = READSTAT_OK;
+                        continue;
+                    }
+                    if (error != READSTAT_OK) {
+                        error = READSTAT_OK;
+                        continue;
+                    }
 
-                error = read_file(parse_ctx, f);
-                if (error != READSTAT_OK)
-                    goto cleanup;
+                    error = read_file(parse_ctx, f);
+                    if (error != READSTAT_OK)
+                        goto cleanup;
+                }
             }
 
             if (parse_ctx->errors_count) {
@@ -978,9 +980,9 @@ int main(int argc, char *argv[]) {
 cleanup:
     if (error != READSTAT_OK) {
         dump_buffer(buffer);
-        printf("Error running test \"%s\" (format=0x%04x): %s\n", 
+        printf("Error running test \"%s\" (format=0x%04x, write mode=%d): %s\n", 
                 _test_groups[g].tests[t].label,
-                f, readstat_error_message(error));
+                f, m, readstat_error_message(error));
         return 1;
     }
 
@@ -21,8 +21,12 @@
 #define RT_FORMAT_DTA_108_AND_NEWER   (RT_FORMAT_DTA_108 | RT_FORMAT_DTA_110_AND_NEWER)
 #define RT_FORMAT_DTA_105_AND_NEWER   (RT_FORMAT_DTA_105 | RT_FORMAT_DTA_108_AND_NEWER)
 
-#define RT_FORMAT_SAV       0x0100
-#define RT_FORMAT_POR       0x0200
+#define RT_FORMAT_SAV_COMP_NONE     0x0100
+#define RT_FORMAT_SAV_COMP_ROWS     0x0200
+#define RT_FORMAT_SAV_COMP_ZLIB     0x0400
+#define RT_FORMAT_POR               0x0800
+
+#define RT_FORMAT_SAV       (RT_FORMAT_SAV_COMP_NONE | RT_FORMAT_SAV_COMP_ROWS | RT_FORMAT_SAV_COMP_ZLIB)
 
 #define RT_FORMAT_SPSS      (RT_FORMAT_SAV | RT_FORMAT_POR)
 
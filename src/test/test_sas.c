@@ -0,0 +1,727 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include "../readstat.h"
+
+#include "test_types.h"
+#include "test_buffer.h"
+
+/* Builds small SAS7BDAT files in memory (little-endian, 32-bit layout),
+ * uncompressed and with COMPRESS=CHAR and COMPRESS=BINARY, and reads them
+ * back on the calling thread and on worker threads, from the first row and
+ * from a row offset that skips whole pages. Compressed rows that overrun
+ * their input or output must be rejected. Then times reading the same
+ * dataset in each form, and decompressing RLE pages on their own. */
+
+#define SAS_TEST_HEADER_SIZE    1024
+#define SAS_TEST_PAGE_SIZE      4096
+#define SAS_TEST_ROWS           1000
+#define SAS_TEST_NUMBERS        3
+#define SAS_TEST_STRING_WIDTH   48
+#define SAS_TEST_ROW_LENGTH     (8 * SAS_TEST_NUMBERS + SAS_TEST_STRING_WIDTH)
+#define SAS_TEST_COLUMNS        (SAS_TEST_NUMBERS + 1)
+#define SAS_TEST_THREADS        4
+#define SAS_BENCH_ROWS          100000
+#define SAS_BENCH_RLE_ROWS      500000
+
+#define SAS_PAGE_TYPE_META      0x0000
+#define SAS_PAGE_TYPE_DATA      0x0100
+
+#define SAS_COMPRESSION_NONE    0x00
+#define SAS_COMPRESSION_ROW     0x04
+
+#define SAS_SUBHEADER_SIGNATURE_ROW_SIZE       0xF7F7F7F7
+#define SAS_SUBHEADER_SIGNATURE_COLUMN_SIZE    0xF6F6F6F6
+#define SAS_SUBHEADER_SIGNATURE_COLUMN_FORMAT  0xFFFFFBFE
+#define SAS_SUBHEADER_SIGNATURE_COLUMN_ATTRS   0xFFFFFFFC
+#define SAS_SUBHEADER_SIGNATURE_COLUMN_TEXT    0xFFFFFFFD
+#define SAS_SUBHEADER_SIGNATURE_COLUMN_NAME    0xFFFFFFFF
+
+#define SAS_RLE_COMMAND_COPY64          0
+#define SAS_RLE_COMMAND_INSERT_BYTE18   4
+#define SAS_RLE_COMMAND_INSERT_BLANK17  6
+#define SAS_RLE_COMMAND_INSERT_ZERO17   7
+#define SAS_RLE_COMMAND_COPY1           8
+#define SAS_RLE_COMMAND_COPY17          9
+#define SAS_RLE_COMMAND_COPY33         10
+#define SAS_RLE_COMMAND_COPY49         11
+#define SAS_RLE_COMMAND_INSERT_BYTE3   12
+#define SAS_RLE_COMMAND_INSERT_AT2     13
+#define SAS_RLE_COMMAND_INSERT_BLANK2  14
+#define SAS_RLE_COMMAND_INSERT_ZERO2   15
+
+typedef enum sas_test_compression_e {
+    SAS_TEST_COMPRESS_NONE,
+    SAS_TEST_COMPRESS_CHAR,
+    SAS_TEST_COMPRESS_BINARY
+} sas_test_compression_t;
+
+/* The page currently being filled with subheaders, from both ends */
+typedef struct sas_file_s {
+    rt_buffer_t    *buffer;
+    size_t          page_size;
+    long            page_count;
+    size_t          page_ofs;
+    int             subheaders_count;
+    size_t          data_start;
+} sas_file_t;
+
+typedef struct test_ctx_s {
+    long            row_offset;
+    long            obs_count;
+    long            values_count;
+    long            mismatches_count;
+} test_ctx_t;
+
+static unsigned char sas7bdat_magic_number[32] = {
+    0x00, 0x00, 0x00, 0x00,   0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00,   0xc2, 0xea, 0x81, 0x60,
+    0xb3, 0x14, 0x11, 0xcf,   0xbd, 0x92, 0x08, 0x00,
+    0x09, 0xc7, 0x31, 0x8c,   0x18, 0x1f, 0x10, 0x11
+};
+
+static const char *_column_names[SAS_TEST_COLUMNS] = { "int", "frac", "sparse", "str" };
+
+static void put2(unsigned char *out, uint16_t value) {
+    out[0] = value;
+    out[1] = value >> 8;
+}
+
+static void put4(unsigned char *out, uint32_t value) {
+    put2(&out[0], value);
+    put2(&out[2], value >> 16);
+}
+
+static void put_double(unsigned char *out, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    put4(&out[0], bits);
+    put4(&out[4], bits >> 32);
+}
+
+/* Integers leave runs of zero bytes, the rest are incompressible */
+static double test_number(long row, int col) {
+    if (col == 0)
+        return row;
+    if (col == 1)
+        return row * 0.1 - 7.0;
+    return (row % 7 == 0) ? NAN : row * 1000.5;
+}
+
+/* Blank runs of every length, a repeated pattern, '@' runs and other runs */
+static void test_string(char *out, size_t len, long row) {
+    if (row % 4 == 0) {
+        snprintf(out, len, "%s", "");
+    } else if (row % 4 == 1) {
+        snprintf(out, len, "abcdefghabcdefghabcdefgh%ld", row);
+    } else if (row % 4 == 2) {
+        snprintf(out, len, "row %ld", row);
+    } else {
+        snprintf(out, len, "@@@@@@xxxxxxxxxxxxxxxxxxxxxxxxyyy%ld", row % 100);
+    }
+}
+
+static void build_row(unsigned char *row, long i) {
+    char string[SAS_TEST_STRING_WIDTH+1];
+    int j;
+
+    for (j=0; j<SAS_TEST_NUMBERS; j++) {
+        double value = test_number(i, j);
+        if (isnan(value)) {
+            /* SAS system missing */
+            put4(&row[8*j], 0);
+            put4(&row[8*j+4], 0xFFFFFE00);
+        } else {
+            put_double(&row[8*j], value);
+        }
+    }
+    test_string(string, sizeof(string), i);
+    memset(&row[8*SAS_TEST_NUMBERS], ' ', SAS_TEST_STRING_WIDTH);
+    memcpy(&row[8*SAS_TEST_NUMBERS], string, strlen(string));
+}
+
+static size_t rle_put_copy(unsigned char *out, const unsigned char *bytes, size_t len) {
+    size_t out_len = 0;
+    while (len) {
+        size_t chunk_len = len;
+        if (chunk_len >= 64) {
+            if (chunk_len > 64 + 255 + 15 * 256)
+                chunk_len = 64 + 255 + 15 * 256;
+            out[out_len++] = (SAS_RLE_COMMAND_COPY64 << 4) | ((chunk_len - 64) >> 8);
+            out[out_len++] = (chunk_len - 64) & 0xFF;
+        } else if (chunk_len >= 49) {
+            out[out_len++] = (SAS_RLE_COMMAND_COPY49 << 4) | (chunk_len - 49);
+        } else if (chunk_len >= 33) {
+            out[out_len++] = (SAS_RLE_COMMAND_COPY33 << 4) | (chunk_len - 33);
+        } else if (chunk_len >= 17) {
+            out[out_len++] = (SAS_RLE_COMMAND_COPY17 << 4) | (chunk_len - 17);
+        } else {
+            out[out_len++] = (SAS_RLE_COMMAND_COPY1 << 4) | (chunk_len - 1);
+        }
+        memcpy(&out[out_len], bytes, chunk_len);
+        out_len += chunk_len;
+        bytes += chunk_len;
+        len -= chunk_len;
+    }
+    return out_len;
+}
+
+/* Encodes a run of at least three bytes, returning how many it covered */
+static size_t rle_put_run(unsigned char *out, size_t *out_len, unsigned char byte, size_t len) {
+    if (byte == ' ' || byte == '\0') {
+        if (len >= 17) {
+            if (len > 17 + 255 + 15 * 256)
+                len = 17 + 255 + 15 * 256;
+            out[(*out_len)++] = ((byte == ' ' ? SAS_RLE_COMMAND_INSERT_BLANK17 : SAS_RLE_COMMAND_INSERT_ZERO17) << 4) |
+                ((len - 17) >> 8);
+            out[(*out_len)++] = (len - 17) & 0xFF;
+        } else {
+            out[(*out_len)++] = ((byte == ' ' ? SAS_RLE_COMMAND_INSERT_BLANK2 : SAS_RLE_COMMAND_INSERT_ZERO2) << 4) |
+                (len - 2);
+        }
+    } else if (byte == '@' && len <= 17) {
+        out[(*out_len)++] = (SAS_RLE_COMMAND_INSERT_AT2 << 4) | (len - 2);
+    } else if (len >= 18) {
+        if (len > 18 + 255 + 15 * 16)
+            len = 18 + 255 + 15 * 16;
+        size_t high = (len - 18) / 16;
+        if (high > 15)
+            high = 15;
+        out[(*out_len)++] = (SAS_RLE_COMMAND_INSERT_BYTE18 << 4) | high;
+        out[(*out_len)++] = len - 18 - 16 * high;
+        out[(*out_len)++] = byte;
+    } else {
+        out[(*out_len)++] = (SAS_RLE_COMMAND_INSERT_BYTE3 << 4) | (len - 3);
+        out[(*out_len)++] = byte;
+    }
+    return len;
+}
+
+/* COMPRESS=CHAR. out must hold 2 * len bytes. */
+static size_t rle_compress(unsigned char *out, const unsigned char *row, size_t len) {
+    size_t out_len = 0;
+    size_t literal_start = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t run_len = 1;
+        while (i + run_len < len && row[i + run_len] == row[i])
+            run_len++;
+
+        if (run_len < 3) {
+            i += run_len;
+            continue;
+        }
+        out_len += rle_put_copy(&out[out_len], &row[literal_start], i - literal_start);
+        i += rle_put_run(out, &out_len, row[i], run_len);
+        literal_start = i;
+    }
+    out_len += rle_put_copy(&out[out_len], &row[literal_start], len - literal_start);
+
+    return out_len;
+}
+
+/* Starts a new control word every 16 items */
+static void rdc_begin_item(unsigned char *out, size_t *out_len, size_t *ctrl_pos, int *items_count,
+        int is_command) {
+    if (*items_count % 16 == 0) {
+        *ctrl_pos = *out_len;
+        out[(*out_len)++] = 0;
+        out[(*out_len)++] = 0;
+    }
+    if (is_command)
+        out[*ctrl_pos + (*items_count % 16) / 8] |= 0x80 >> (*items_count % 8);
+    (*items_count)++;
+}
+
+/* COMPRESS=BINARY, choosing greedily between runs and back-references.
+ * out must hold 2 * len bytes. */
+static size_t rdc_compress(unsigned char *out, const unsigned char *row, size_t len) {
+    size_t out_len = 0;
+    size_t ctrl_pos = 0;
+    int items_count = 0;
+    size_t i = 0;
+
+    while (i < len) {
+        size_t run_len = 1, match_len = 0, match_offset = 0;
+        size_t offset;
+
+        while (i + run_len < len && run_len < 19 + 15 + 255 * 16 && row[i + run_len] == row[i])
+            run_len++;
+
+        for (offset=3; offset <= i && offset <= 3 + 15 + 255 * 16; offset++) {
+            size_t k = 0;
+            while (i + k < len && k < 16 + 255 && row[i + k] == row[i + k - offset])
+                k++;
+            if (k > match_len) {
+                match_len = k;
+                match_offset = offset;
+            }
+        }
+
+        if (run_len >= 3 && run_len >= match_len) {
+            rdc_begin_item(out, &out_len, &ctrl_pos, &items_count, 1);
+            if (run_len <= 18) {
+                out[out_len++] = (0 << 4) | (run_len - 3);
+            } else {
+                out[out_len++] = (1 << 4) | ((run_len - 19) & 0x0F);
+                out[out_len++] = (run_len - 19) >> 4;
+            }
+            out[out_len++] = row[i];
+            i += run_len;
+        } else if (match_len >= 3) {
+            rdc_begin_item(out, &out_len, &ctrl_pos, &items_count, 1);
+            if (match_len <= 15) {
+                out[out_len++] = (match_len << 4) | ((match_offset - 3) & 0x0F);
+                out[out_len++] = (match_offset - 3) >> 4;
+            } else {
+                out[out_len++] = (2 << 4) | ((match_offset - 3) & 0x0F);
+                out[out_len++] = (match_offset - 3) >> 4;
+                out[out_len++] = match_len - 16;
+            }
+            i += match_len;
+        } else {
+            rdc_begin_item(out, &out_len, &ctrl_pos, &items_count, 0);
+            out[out_len++] = row[i++];
+        }
+    }
+
+    return out_len;
+}
+
+static void sas_new_page(sas_file_t *file, uint16_t page_type) {
+    rt_buffer_t *buffer = file->buffer;
+    buffer_grow(buffer, buffer->used + file->page_size);
+    file->page_ofs = buffer->used;
+    memset(&buffer->bytes[file->page_ofs], 0, file->page_size);
+    buffer->used += file->page_size;
+
+    put2((unsigned char *)&buffer->bytes[file->page_ofs + 16], page_type);
+    file->page_count++;
+    file->subheaders_count = 0;
+    file->data_start = file->page_size;
+}
+
+/* Pointers grow from the front of the page and subheaders from the back */
+static int sas_add_subheader(sas_file_t *file, const unsigned char *bytes, size_t len,
+        unsigned char compression, unsigned char is_compressed_data) {
+    unsigned char *page = (unsigned char *)&file->buffer->bytes[file->page_ofs];
+    size_t pointers_end = 24 + 12 * (file->subheaders_count + 1);
+
+    if (pointers_end + len > file->data_start)
+        return -1;
+
+    file->data_start -= len;
+    memcpy(&page[file->data_start], bytes, len);
+
+    unsigned char *pointer = &page[24 + 12 * file->subheaders_count];
+    put4(&pointer[0], file->data_start);
+    put4(&pointer[4], len);
+    pointer[8] = compression;
+    pointer[9] = is_compressed_data;
+
+    file->subheaders_count++;
+    put2(&page[20], file->subheaders_count);
+
+    return 0;
+}
+
+static void sas_add_metadata(sas_file_t *file, long rows_count, long page_row_count,
+        sas_test_compression_t compression) {
+    unsigned char subheader[512];
+    unsigned char *blob = &subheader[4];
+    size_t blob_len = 28;
+    size_t name_offsets[SAS_TEST_COLUMNS];
+    size_t len = 0;
+    int j;
+
+    memset(subheader, 0, sizeof(subheader));
+    put4(&subheader[0], SAS_SUBHEADER_SIGNATURE_ROW_SIZE);
+    put4(&subheader[20], SAS_TEST_ROW_LENGTH);
+    put4(&subheader[24], rows_count);
+    put4(&subheader[60], page_row_count);
+    sas_add_subheader(file, subheader, 128, SAS_COMPRESSION_NONE, 0);
+
+    memset(subheader, 0, sizeof(subheader));
+    put4(&subheader[0], SAS_SUBHEADER_SIGNATURE_COLUMN_SIZE);
+    put4(&subheader[4], SAS_TEST_COLUMNS);
+    sas_add_subheader(file, subheader, 12, SAS_COMPRESSION_NONE, 0);
+
+    /* The blob starts after the signature; the compression signature sits
+     * at offset 12 and the column names follow */
+    memset(subheader, 0, sizeof(subheader));
+    put4(&subheader[0], SAS_SUBHEADER_SIGNATURE_COLUMN_TEXT);
+    if (compression == SAS_TEST_COMPRESS_CHAR)
+        memcpy(&blob[12], "SASYZCRL", 8);
+    if (compression == SAS_TEST_COMPRESS_BINARY)
+        memcpy(&blob[12], "SASYZCR2", 8);
+    for (j=0; j<SAS_TEST_COLUMNS; j++) {
+        name_offsets[j] = blob_len;
+        memcpy(&blob[blob_len], _column_names[j], strlen(_column_names[j]));
+        blob_len += (strlen(_column_names[j]) + 3) / 4 * 4;
+    }
+    len = 4 + blob_len;
+    put2(&subheader[4], len - 12);
+    sas_add_subheader(file, subheader, len, SAS_COMPRESSION_NONE, 0);
+
+    memset(subheader, 0, sizeof(subheader));
+    put4(&subheader[0], SAS_SUBHEADER_SIGNATURE_COLUMN_NAME);
+    for (j=0; j<SAS_TEST_COLUMNS; j++) {
+        unsigned char *ref = &subheader[12 + 8 * j];
+        put2(&ref[0], 0);
+        put2(&ref[2], name_offsets[j]);
+        put2(&ref[4], strlen(_column_names[j]));
+    }
+    len = 20 + 8 * SAS_TEST_COLUMNS;
+    put2(&subheader[4], len - 12);
+    sas_add_subheader(file, subheader, len, SAS_COMPRESSION_NONE, 0);
+
+    memset(subheader, 0, sizeof(subheader));
+    put4(&subheader[0], SAS_SUBHEADER_SIGNATURE_COLUMN_ATTRS);
+    for (j=0; j<SAS_TEST_COLUMNS; j++) {
+        unsigned char *attrs = &subheader[12 + 12 * j];
+        put4(&attrs[0], 8 * j);
+        put4(&attrs[4], j < SAS_TEST_NUMBERS ? 8 : SAS_TEST_STRING_WIDTH);
+        attrs[10] = j < SAS_TEST_NUMBERS ? 0x01 : 0x02;
+    }
+    len = 20 + 12 * SAS_TEST_COLUMNS;
+    put2(&subheader[4], len - 12);
+    sas_add_subheader(file, subheader, len, SAS_COMPRESSION_NONE, 0);
+
+    for (j=0; j<SAS_TEST_COLUMNS; j++) {
+        memset(subheader, 0, sizeof(subheader));
+        put4(&subheader[0], SAS_SUBHEADER_SIGNATURE_COLUMN_FORMAT);
+        sas_add_subheader(file, subheader, 52, SAS_COMPRESSION_NONE, 0);
+    }
+}
+
+static void sas_put_header(sas_file_t *file) {
+    unsigned char *header = (unsigned char *)file->buffer->bytes;
+
+    memcpy(&header[0], sas7bdat_magic_number, sizeof(sas7bdat_magic_number));
+    header[37] = 0x01; /* little-endian */
+    header[39] = '1';
+    header[70] = 20; /* UTF-8 */
+    memcpy(&header[84], "DATA    ", 8);
+    memcpy(&header[92], "Test file", 9);
+    put4(&header[196], SAS_TEST_HEADER_SIZE);
+    put4(&header[200], file->page_size);
+    put4(&header[204], file->page_count);
+    memcpy(&header[216], "9.0401M0", 8);
+}
+
+/* If first_row is set, it replaces the first row's compressed bytes */
+static void build_sas_file(rt_buffer_t *buffer, long rows_count, sas_test_compression_t compression,
+        size_t page_size, const unsigned char *first_row, size_t first_row_len) {
+    sas_file_t file = { .buffer = buffer, .page_size = page_size };
+    long rows_per_page = (page_size - 24) / SAS_TEST_ROW_LENGTH;
+    unsigned char row[SAS_TEST_ROW_LENGTH];
+    unsigned char compressed[2 * SAS_TEST_ROW_LENGTH];
+    long i;
+
+    buffer_grow(buffer, SAS_TEST_HEADER_SIZE);
+    memset(buffer->bytes, 0, SAS_TEST_HEADER_SIZE);
+    buffer->used = SAS_TEST_HEADER_SIZE;
+
+    sas_new_page(&file, SAS_PAGE_TYPE_META);
+    sas_add_metadata(&file, rows_count, rows_per_page, compression);
+
+    if (compression == SAS_TEST_COMPRESS_NONE) {
+        for (i=0; i<rows_count; i++) {
+            if (i % rows_per_page == 0)
+                sas_new_page(&file, SAS_PAGE_TYPE_DATA);
+
+            unsigned char *page = (unsigned char *)&buffer->bytes[file.page_ofs];
+            build_row(&page[24 + (i % rows_per_page) * SAS_TEST_ROW_LENGTH], i);
+            put2(&page[18], i % rows_per_page + 1);
+        }
+    } else {
+        for (i=0; i<rows_count; i++) {
+            const unsigned char *bytes = compressed;
+            size_t len = 0;
+            unsigned char row_compression = SAS_COMPRESSION_ROW;
+
+            build_row(row, i);
+            if (compression == SAS_TEST_COMPRESS_BINARY) {
+                len = rdc_compress(compressed, row, SAS_TEST_ROW_LENGTH);
+            } else {
+                len = rle_compress(compressed, row, SAS_TEST_ROW_LENGTH);
+            }
+            if (i == 0 && first_row) {
+                bytes = first_row;
+                len = first_row_len;
+            } else if (len >= SAS_TEST_ROW_LENGTH) {
+                /* Stored as is when compression would not help */
+                bytes = row;
+                len = SAS_TEST_ROW_LENGTH;
+                row_compression = SAS_COMPRESSION_NONE;
+            }
+            if (sas_add_subheader(&file, bytes, len, row_compression, 1) != 0) {
+                sas_new_page(&file, SAS_PAGE_TYPE_META);
+                sas_add_subheader(&file, bytes, len, row_compression, 1);
+            }
+        }
+    }
+
+    sas_put_header(&file);
+}
+
+static int handle_info(int obs_count, int var_count, void *ctx) {
+    test_ctx_t *test_ctx = (test_ctx_t *)ctx;
+    test_ctx->obs_count = obs_count;
+    return 0;
+}
+
+static int handle_value(int obs_index, int var_index, readstat_value_t value, void *ctx) {
+    test_ctx_t *test_ctx = (test_ctx_t *)ctx;
+    long row = test_ctx->row_offset + obs_index;
+    char string[SAS_TEST_STRING_WIDTH+1];
+    int matches = 0;
+
+    if (var_index < SAS_TEST_NUMBERS) {
+        double expected = test_number(row, var_index);
+        if (isnan(expected)) {
+            matches = readstat_value_is_system_missing(value);
+        } else {
+            matches = !readstat_value_is_system_missing(value) && readstat_double_value(value) == expected;
+        }
+    } else {
+        test_string(string, sizeof(string), row);
+        matches = (readstat_string_value(value) && strcmp(readstat_string_value(value), string) == 0);
+    }
+
+    if (!matches)
+        test_ctx->mismatches_count++;
+    test_ctx->values_count++;
+
+    return 0;
+}
+
+static int handle_value_count(int obs_index, int var_index, readstat_value_t value, void *ctx) {
+    test_ctx_t *test_ctx = (test_ctx_t *)ctx;
+    test_ctx->values_count++;
+    return 0;
+}
+
+static readstat_error_t parse_sas_file(rt_buffer_t *buffer, int thread_count, long row_offset,
+        readstat_value_handler value_handler, test_ctx_t *test_ctx) {
+    rt_buffer_ctx_t buffer_ctx = { .buffer = buffer };
+
+    memset(test_ctx, 0, sizeof(test_ctx_t));
+    test_ctx->row_offset = row_offset;
+
+    readstat_parser_t *parser = readstat_parser_init();
+    readstat_set_open_handler(parser, &rt_open_handler);
+    readstat_set_close_handler(parser, &rt_close_handler);
+    readstat_set_seek_handler(parser, &rt_seek_handler);
+    readstat_set_read_handler(parser, &rt_read_handler);
+    readstat_set_update_handler(parser, &rt_update_handler);
+    readstat_set_io_ctx(parser, &buffer_ctx);
+    readstat_set_thread_count(parser, thread_count);
+    readstat_set_row_offset(parser, row_offset);
+
+    readstat_set_info_handler(parser, &handle_info);
+    if (value_handler)
+        readstat_set_value_handler(parser, value_handler);
+
+    readstat_error_t error = readstat_parse_sas7bdat(parser, "test", test_ctx);
+    readstat_parser_free(parser);
+
+    return error;
+}
+
+static int check_round_trip(const char *label, rt_buffer_t *buffer, int thread_count, long row_offset) {
+    test_ctx_t test_ctx;
+    readstat_error_t error = parse_sas_file(buffer, thread_count, row_offset, &handle_value, &test_ctx);
+    long rows_count = SAS_TEST_ROWS - row_offset;
+
+    if (error != READSTAT_OK) {
+        printf("%s, %d threads, offset %ld: %s\n", label, thread_count, row_offset,
+                readstat_error_message(error));
+        return 1;
+    }
+    if (test_ctx.obs_count != rows_count || test_ctx.values_count != rows_count * SAS_TEST_COLUMNS ||
+            test_ctx.mismatches_count) {
+        printf("%s, %d threads, offset %ld: %ld rows, %ld values, %ld wrong\n", label, thread_count,
+                row_offset, test_ctx.obs_count, test_ctx.values_count, test_ctx.mismatches_count);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_round_trips(const char *label, sas_test_compression_t compression) {
+    rt_buffer_t *buffer = buffer_init();
+    /* Past the first two data pages of an uncompressed file */
+    long row_offsets[] = { 0, 2 * ((SAS_TEST_PAGE_SIZE - 24) / SAS_TEST_ROW_LENGTH) + 3, SAS_TEST_ROWS - 1 };
+    int failures = 0;
+    int i;
+
+    build_sas_file(buffer, SAS_TEST_ROWS, compression, SAS_TEST_PAGE_SIZE, NULL, 0);
+
+    for (i=0; i<sizeof(row_offsets)/sizeof(row_offsets[0]); i++) {
+        failures += check_round_trip(label, buffer, 1, row_offsets[i]);
+        failures += check_round_trip(label, buffer, SAS_TEST_THREADS, row_offsets[i]);
+    }
+
+    buffer_free(buffer);
+
+    return failures;
+}
+
+/* A single bad row must fail the parse with the given error */
+static int check_bad_row(const char *label, sas_test_compression_t compression,
+        const unsigned char *row, size_t row_len, readstat_error_t expected) {
+    rt_buffer_t *buffer = buffer_init();
+    test_ctx_t test_ctx;
+    int thread_counts[] = { 1, SAS_TEST_THREADS };
+    int failures = 0;
+    int i;
+
+    build_sas_file(buffer, SAS_TEST_ROWS, compression, SAS_TEST_PAGE_SIZE, row, row_len);
+
+    for (i=0; i<sizeof(thread_counts)/sizeof(thread_counts[0]); i++) {
+        readstat_error_t error = parse_sas_file(buffer, thread_counts[i], 0, &handle_value_count, &test_ctx);
+        if (error != expected) {
+            printf("%s, %d threads: expected \"%s\", got \"%s\"\n", label, thread_counts[i],
+                    readstat_error_message(expected), readstat_error_message(error));
+            failures++;
+        }
+    }
+
+    buffer_free(buffer);
+
+    return failures;
+}
+
+static int check_bad_rle_rows() {
+    unsigned char missing_operand[] = { (SAS_RLE_COMMAND_COPY64 << 4) };
+    unsigned char missing_byte[] = { (SAS_RLE_COMMAND_INSERT_BYTE18 << 4), 0x00 };
+    unsigned char copy_past_input[] = { (SAS_RLE_COMMAND_COPY1 << 4) | 0x0F, 'a' };
+    unsigned char insert_past_row[] = { (SAS_RLE_COMMAND_INSERT_ZERO17 << 4) | 0x0F, 0xFF };
+    unsigned char unknown_command[] = { 0x10 };
+    unsigned char short_row[] = { (SAS_RLE_COMMAND_INSERT_ZERO2 << 4) };
+    int failures = 0;
+
+    failures += check_bad_row("RLE missing operand", SAS_TEST_COMPRESS_CHAR,
+            missing_operand, sizeof(missing_operand), READSTAT_ERROR_PARSE);
+    failures += check_bad_row("RLE missing insert byte", SAS_TEST_COMPRESS_CHAR,
+            missing_byte, sizeof(missing_byte), READSTAT_ERROR_PARSE);
+    failures += check_bad_row("RLE copy past the input", SAS_TEST_COMPRESS_CHAR,
+            copy_past_input, sizeof(copy_past_input), READSTAT_ERROR_PARSE);
+    failures += check_bad_row("RLE insert past the row", SAS_TEST_COMPRESS_CHAR,
+            insert_past_row, sizeof(insert_past_row), READSTAT_ERROR_ROW_WIDTH_MISMATCH);
+    failures += check_bad_row("RLE unknown command", SAS_TEST_COMPRESS_CHAR,
+            unknown_command, sizeof(unknown_command), READSTAT_ERROR_PARSE);
+    failures += check_bad_row("RLE short row", SAS_TEST_COMPRESS_CHAR,
+            short_row, sizeof(short_row), READSTAT_ERROR_ROW_WIDTH_MISMATCH);
+
+    return failures;
+}
+
+static int check_bad_rdc_rows() {
+    unsigned char truncated_control[] = { 0x80 };
+    unsigned char pattern_before_row[] = { 0x80, 0x00, 0x30, 0x00 };
+    unsigned char run_past_row[] = { 0x80, 0x00, 0x1F, 0xFF, 'a' };
+    unsigned char missing_operand[] = { 0x80, 0x00, 0x10, 0x00 };
+    unsigned char short_row[] = { 0x00, 0x00, 'a' };
+    int failures = 0;
+
+    failures += check_bad_row("RDC truncated control word", SAS_TEST_COMPRESS_BINARY,
+            truncated_control, sizeof(truncated_control), READSTAT_ERROR_PARSE);
+    failures += check_bad_row("RDC pattern before the row", SAS_TEST_COMPRESS_BINARY,
+            pattern_before_row, sizeof(pattern_before_row), READSTAT_ERROR_PARSE);
+    failures += check_bad_row("RDC run past the row", SAS_TEST_COMPRESS_BINARY,
+            run_past_row, sizeof(run_past_row), READSTAT_ERROR_ROW_WIDTH_MISMATCH);
+    failures += check_bad_row("RDC missing operand", SAS_TEST_COMPRESS_BINARY,
+            missing_operand, sizeof(missing_operand), READSTAT_ERROR_PARSE);
+    failures += check_bad_row("RDC short row", SAS_TEST_COMPRESS_BINARY,
+            short_row, sizeof(short_row), READSTAT_ERROR_ROW_WIDTH_MISMATCH);
+
+    return failures;
+}
+
+static double elapsed_ns(struct timeval *start, struct timeval *end) {
+    return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_usec - start->tv_usec) * 1e3;
+}
+
+/* Reads the same rows stored uncompressed, with RLE and with RDC */
+static void bench_compression() {
+    sas_test_compression_t compressions[] = {
+        SAS_TEST_COMPRESS_NONE, SAS_TEST_COMPRESS_CHAR, SAS_TEST_COMPRESS_BINARY };
+    double row_ns[3] = { 0.0 };
+    size_t file_size[3] = { 0 };
+    struct timeval start, end;
+    rt_buffer_t *buffer = buffer_init();
+    test_ctx_t test_ctx;
+    int i;
+
+    for (i=0; i<3; i++) {
+        build_sas_file(buffer, SAS_BENCH_ROWS, compressions[i], SAS_TEST_PAGE_SIZE, NULL, 0);
+        file_size[i] = buffer->used;
+
+        gettimeofday(&start, NULL);
+        readstat_error_t error = parse_sas_file(buffer, 1, 0, &handle_value_count, &test_ctx);
+        gettimeofday(&end, NULL);
+        if (error == READSTAT_OK)
+            row_ns[i] = elapsed_ns(&start, &end) / SAS_BENCH_ROWS;
+
+        buffer_reset(buffer);
+    }
+
+    printf("SAS7BDAT read time per row (ns) and file size (KB), %d rows:\n", SAS_BENCH_ROWS);
+    printf("%12s %12s %12s\n", "none", "CHAR", "BINARY");
+    printf("%12.1f %12.1f %12.1f\n", row_ns[0], row_ns[1], row_ns[2]);
+    printf("%12zu %12zu %12zu\n", file_size[0] / 1024, file_size[1] / 1024, file_size[2] / 1024);
+}
+
+/* With no value handler a parse is mostly page walking and decompression,
+ * so the uncompressed file gives the baseline to subtract */
+static void bench_rle_pages() {
+    sas_test_compression_t compressions[] = { SAS_TEST_COMPRESS_NONE, SAS_TEST_COMPRESS_CHAR };
+    double row_ns[2] = { 0.0 };
+    struct timeval start, end;
+    rt_buffer_t *buffer = buffer_init();
+    test_ctx_t test_ctx;
+    int i;
+
+    for (i=0; i<2; i++) {
+        build_sas_file(buffer, SAS_BENCH_RLE_ROWS, compressions[i], SAS_TEST_PAGE_SIZE, NULL, 0);
+
+        gettimeofday(&start, NULL);
+        readstat_error_t error = parse_sas_file(buffer, 1, 0, NULL, &test_ctx);
+        gettimeofday(&end, NULL);
+        if (error == READSTAT_OK)
+            row_ns[i] = elapsed_ns(&start, &end) / SAS_BENCH_RLE_ROWS;
+
+        buffer_reset(buffer);
+    }
+
+    printf("SAS7BDAT page time per row without a value handler (ns), %d rows:\n", SAS_BENCH_RLE_ROWS);
+    printf("%12s %12s %12s\n", "none", "CHAR", "RLE only");
+    printf("%12.1f %12.1f %12.1f\n", row_ns[0], row_ns[1], row_ns[1] - row_ns[0]);
+}
+
+int main(int argc, char *argv[]) {
+    int failures = 0;
+
+    failures += check_round_trips("Uncompressed", SAS_TEST_COMPRESS_NONE);
+    failures += check_round_trips("COMPRESS=CHAR", SAS_TEST_COMPRESS_CHAR);
+    failures += check_round_trips("COMPRESS=BINARY", SAS_TEST_COMPRESS_BINARY);
+    failures += check_bad_rle_rows();
+    failures += check_bad_rdc_rows();
+
+    if (failures) {
+        printf("%d SAS7BDAT failures\n", failures);
+        return 1;
+    }
+
+    bench_compression();
+    bench_rle_pages();
+
+    return 0;
+}
@@ -62,6 +62,9 @@ typedef struct rt_parse_ctx_s {
     long             file_format;
     long             file_format_version;
     size_t           max_file_label_len;
+    int              skip_odd_columns;
+    long             row_offset;
+    long             string_dictionary_max;
 
     rt_buffer_ctx_t *buffer_ctx;
 } rt_parse_ctx_t;
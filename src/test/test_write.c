@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "../readstat.h"
 
@@ -6,30 +7,164 @@
 #include "test_buffer.h"
 #include "test_readstat.h"
 #include "test_dta.h"
+#include "test_write.h"
 
 static void handle_error(const char *error_message, void *ctx) {
     printf("%s\n", error_message);
 }
 
-static ssize_t write_data(const void *bytes, size_t len, void *ctx) {
-    rt_buffer_t *buffer = (rt_buffer_t *)ctx;
-    while (len > buffer->size - buffer->used) {
-        buffer->size *= 2;
+static int file_has_tagged_values(rt_test_file_t *file) {
+    int i, j;
+    for (j=0; j<file->columns_count; j++) {
+        for (i=0; i<file->rows; i++) {
+            if (readstat_value_tag(file->columns[j].values[i]))
+                return 1;
+        }
     }
-    buffer->bytes = realloc(buffer->bytes, buffer->size);
-    if (buffer->bytes == NULL) {
-        return -1;
+    return 0;
+}
+
+static readstat_error_t write_file_rows(readstat_writer_t *writer, rt_test_file_t *file) {
+    readstat_error_t error = READSTAT_OK;
+    int i, j;
+
+    for (i=0; i<file->rows; i++) {
+        error = readstat_begin_row(writer);
+        if (error != READSTAT_OK)
+            return error;
+
+        for (j=0; j<file->columns_count; j++) {
+            rt_column_t *column = &file->columns[j];
+            readstat_variable_t *variable = readstat_get_variable(writer, j);
+
+            if (readstat_value_tag(column->values[i])) {
+                error = readstat_insert_tagged_missing_value(writer, variable, 
+                        readstat_value_tag(column->values[i]));
+            } else if (readstat_value_is_system_missing(column->values[i])) {
+                error = readstat_insert_missing_value(writer, variable);
+            } else if (column->type == READSTAT_TYPE_STRING ||
+                    column->type == READSTAT_TYPE_LONG_STRING) {
+                error = readstat_insert_string_value(writer, variable, 
+                        readstat_string_value(column->values[i]));
+            } else if (column->type == READSTAT_TYPE_DOUBLE) {
+                error = readstat_insert_double_value(writer, variable, 
+                        readstat_double_value(column->values[i]));
+            } else if (column->type == READSTAT_TYPE_FLOAT) {
+                error = readstat_insert_float_value(writer, variable, 
+                        readstat_float_value(column->values[i]));
+            } else if (column->type == READSTAT_TYPE_INT32) {
+                error = readstat_insert_int32_value(writer, variable, 
+                        readstat_int32_value(column->values[i]));
+            } else if (column->type == READSTAT_TYPE_INT16) {
+                error = readstat_insert_int16_value(writer, variable, 
+                        readstat_int16_value(column->values[i]));
+            } else if (column->type == READSTAT_TYPE_INT8) {
+                error = readstat_insert_int8_value(writer, variable, 
+                        readstat_int8_value(column->values[i]));
+            }
+            if (error != READSTAT_OK) {
+                return error;
+            }
+        }
+
+        error = readstat_end_row(writer);
+        if (error != READSTAT_OK)
+            return error;
     }
-    memcpy(buffer->bytes + buffer->used, bytes, len);
-    buffer->used += len;
-    return len;
+    return error;
 }
 
-readstat_error_t write_file_to_buffer(rt_test_file_t *file, rt_buffer_t *buffer, long format) {
+/* Writes every row as one block through the column API. String columns at
+ * odd positions are packed end to end without NULs, as in a batch, and go
+ * through readstat_insert_string_column_len. */
+static readstat_error_t write_file_columns(readstat_writer_t *writer, rt_test_file_t *file) {
     readstat_error_t error = READSTAT_OK;
+    uint8_t *missing = calloc((file->rows + 7) / 8 + 1, 1);
+    void *values = calloc(file->rows + 1, sizeof(double));
+    size_t *lengths = calloc(file->rows + 1, sizeof(size_t));
+    char *packed = NULL;
+    size_t packed_len = 0;
+    int i, j;
+
+    for (j=0; j<file->columns_count; j++) {
+        for (i=0; i<file->rows; i++) {
+            const char *string = readstat_string_value(file->columns[j].values[i]);
+            if (string)
+                packed_len += strlen(string);
+        }
+    }
+    packed = malloc(packed_len + 1);
+
+    for (j=0; j<file->columns_count; j++) {
+        rt_column_t *column = &file->columns[j];
+        readstat_variable_t *variable = readstat_get_variable(writer, j);
+
+        memset(missing, 0, (file->rows + 7) / 8 + 1);
+        packed_len = 0;
+        for (i=0; i<file->rows; i++) {
+            readstat_value_t value = column->values[i];
+            if (readstat_value_is_system_missing(value))
+                missing[i / 8] |= (1 << (i % 8));
+
+            if (column->type == READSTAT_TYPE_STRING || column->type == READSTAT_TYPE_LONG_STRING) {
+                const char *string = readstat_string_value(value);
+                ((const char **)values)[i] = string;
+                if (j % 2 == 1 && string) {
+                    lengths[i] = strlen(string);
+                    memcpy(&packed[packed_len], string, lengths[i]);
+                    ((const char **)values)[i] = &packed[packed_len];
+                    packed_len += lengths[i];
+                }
+            } else if (column->type == READSTAT_TYPE_DOUBLE) {
+                ((double *)values)[i] = readstat_double_value(value);
+            } else if (column->type == READSTAT_TYPE_FLOAT) {
+                ((float *)values)[i] = readstat_float_value(value);
+            } else if (column->type == READSTAT_TYPE_INT32) {
+                ((int32_t *)values)[i] = readstat_int32_value(value);
+            } else if (column->type == READSTAT_TYPE_INT16) {
+                ((int16_t *)values)[i] = readstat_int16_value(value);
+            } else if (column->type == READSTAT_TYPE_INT8) {
+                ((int8_t *)values)[i] = readstat_int8_value(value);
+            }
+        }
+
+        if ((column->type == READSTAT_TYPE_STRING || column->type == READSTAT_TYPE_LONG_STRING) && j % 2 == 1) {
+            error = readstat_insert_string_column_len(writer, variable, values, lengths, missing, file->rows);
+        } else if (column->type == READSTAT_TYPE_STRING || column->type == READSTAT_TYPE_LONG_STRING) {
+            error = readstat_insert_string_column(writer, variable, values, missing, file->rows);
+        } else if (column->type == READSTAT_TYPE_DOUBLE) {
+            error = readstat_insert_double_column(writer, variable, values, missing, file->rows);
+        } else if (column->type == READSTAT_TYPE_FLOAT) {
+            error = readstat_insert_float_column(writer, variable, values, missing, file->rows);
+        } else if (column->type == READSTAT_TYPE_INT32) {
+            error = readstat_insert_int32_column(writer, variable, values, missing, file->rows);
+        } else if (column->type == READSTAT_TYPE_INT16) {
+            error = readstat_insert_int16_column(writer, variable, values, missing, file->rows);
+        } else if (column->type == READSTAT_TYPE_INT8) {
+            error = readstat_insert_int8_column(writer, variable, values, missing, file->rows);
+        }
+        if (error != READSTAT_OK)
+            goto cleanup;
+    }
+
+    error = readstat_end_rows(writer);
+
+cleanup:
+    free(missing);
+    free(values);
+    free(lengths);
+    free(packed);
+
+    return error;
+}
+
+readstat_error_t write_file_to_buffer(rt_test_file_t *file, rt_buffer_t *buffer, long format, int mode) {
+    readstat_error_t error = READSTAT_OK;
+    rt_buffer_ctx_t buffer_ctx = { .buffer = buffer, .pos = buffer->used };
+    long row_count = file->rows;
 
     readstat_writer_t *writer = readstat_writer_init();
-    readstat_set_data_writer(writer, &write_data);
+    readstat_set_data_writer(writer, &rt_write_handler);
     readstat_writer_set_file_label(writer, file->label);
     readstat_writer_set_error_handler(writer, &handle_error);
     if (file->timestamp.tm_year) {
@@ -38,6 +173,15 @@ readstat_error_t write_file_to_buffer(rt_test_file_t *file, rt_buffer_t *buffer,
         readstat_writer_set_file_timestamp(writer, mktime(&timestamp));
     }
 
+    if (mode == RT_WRITE_SPILL || mode == RT_WRITE_SEEKER) {
+        /* Small enough that the row count is patched outside the buffer */
+        readstat_writer_set_buffer_size(writer, 16);
+        row_count = READSTAT_ROW_COUNT_UNKNOWN;
+    }
+    if (mode == RT_WRITE_SEEKER) {
+        readstat_set_data_seeker(writer, &rt_seek_handler);
+    }
+
     if ((format & RT_FORMAT_DTA)) {
         long version = dta_file_format_version(format);
         if (version == -1) {
@@ -45,11 +189,19 @@ readstat_error_t write_file_to_buffer(rt_test_file_t *file, rt_buffer_t *buffer,
             goto cleanup;
         }
         readstat_writer_set_file_format_version(writer, version);
-        error = readstat_begin_writing_dta(writer, buffer, file->rows);
-    } else if (format == RT_FORMAT_SAV) {
-        error = readstat_begin_writing_sav(writer, buffer, file->rows);
+        error = readstat_begin_writing_dta(writer, &buffer_ctx, row_count);
+    } else if ((format & RT_FORMAT_SAV)) {
+        if (format == RT_FORMAT_SAV_COMP_ROWS) {
+            readstat_writer_set_compression(writer, READSTAT_COMPRESS_ROWS);
+        } else if (format == RT_FORMAT_SAV_COMP_ZLIB) {
+            readstat_writer_set_compression(writer, READSTAT_COMPRESS_BINARY);
+            readstat_writer_set_thread_count(writer, 2);
+        }
+        error = readstat_begin_writing_sav(writer, &buffer_ctx, row_count);
     } else if (format == RT_FORMAT_POR) {
-        error = readstat_begin_writing_por(writer, buffer, file->rows);
+        /* Small enough that headers and rows both overflow it */
+        readstat_writer_set_buffer_size(writer, 16);
+        error = readstat_begin_writing_por(writer, &buffer_ctx, row_count);
     } else {
         error = READSTAT_ERROR_UNSUPPORTED_FILE_FORMAT_VERSION;
     }
@@ -95,49 +247,15 @@ readstat_error_t write_file_to_buffer(rt_test_file_t *file, rt_buffer_t *buffer,
         goto cleanup;
     }
 
-    for (i=0; i<file->rows; i++) {
-        error = readstat_begin_row(writer);
-        if (error != READSTAT_OK)
-            goto cleanup;
-
-        for (j=0; j<file->columns_count; j++) {
-            rt_column_t *column = &file->columns[j];
-            readstat_variable_t *variable = readstat_get_variable(writer, j);
-
-            if (readstat_value_tag(column->values[i])) {
-                error = readstat_insert_tagged_missing_value(writer, variable, 
-                        readstat_value_tag(column->values[i]));
-            } else if (readstat_value_is_system_missing(column->values[i])) {
-                error = readstat_insert_missing_value(writer, variable);
-            } else if (column->type == READSTAT_TYPE_STRING ||
-                    column->type == READSTAT_TYPE_LONG_STRING) {
-                error = readstat_insert_string_value(writer, variable, 
-                        readstat_string_value(column->values[i]));
-            } else if (column->type == READSTAT_TYPE_DOUBLE) {
-                error = readstat_insert_double_value(writer, variable, 
-                        readstat_double_value(column->values[i]));
-            } else if (column->type == READSTAT_TYPE_FLOAT) {
-                error = readstat_insert_float_value(writer, variable, 
-                        readstat_float_value(column->values[i]));
-            } else if (column->type == READSTAT_TYPE_INT32) {
-                error = readstat_insert_int32_value(writer, variable, 
-                        readstat_int32_value(column->values[i]));
-            } else if (column->type == READSTAT_TYPE_INT16) {
-                error = readstat_insert_int16_value(writer, variable, 
-                        readstat_int16_value(column->values[i]));
-            } else if (column->type == READSTAT_TYPE_INT8) {
-                error = readstat_insert_int8_value(writer, variable, 
-                        readstat_int8_value(column->values[i]));
-            }
-            if (error != READSTAT_OK) {
-                goto cleanup;
-            }
-        }
-
-        error = readstat_end_row(writer);
-        if (error != READSTAT_OK)
-            goto cleanup;
+    /* The column API has no way to insert tagged missing values */
+    if (mode == RT_WRITE_COLUMNS && !file_has_tagged_values(file)) {
+        error = write_file_columns(writer, file);
+    } else {
+        error = write_file_rows(writer, file);
     }
+    if (error != READSTAT_OK)
+        goto cleanup;
+
     error = readstat_end_writing(writer);
     if (error != READSTAT_OK)
         goto cleanup;
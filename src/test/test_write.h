@@ -1,2 +1,9 @@
 
-readstat_error_t write_file_to_buffer(rt_test_file_t *file, rt_buffer_t *buffer, long format);
+/* Ways of writing each test file; every file is read back after each one */
+#define RT_WRITE_ROWS       0   /* Known row count, one row at a time */
+#define RT_WRITE_SPILL      1   /* Row count patched in a spill file */
+#define RT_WRITE_SEEKER     2   /* Row count patched through the data seeker */
+#define RT_WRITE_COLUMNS    3   /* Known row count, one column at a time */
+#define RT_WRITE_MODES_COUNT    4
+
+readstat_error_t write_file_to_buffer(rt_test_file_t *file, rt_buffer_t *buffer, long format, int mode);
@@ -0,0 +1,196 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../readstat.h"
+
+#include "test_types.h"
+#include "test_buffer.h"
+
+/* test_readstat round-trips small ZSAV files, which fit in one compressed
+ * block. This writes one large enough to span several blocks, with and
+ * without worker threads and through a data seeker and a spill file. Every
+ * variant must produce the same bytes, which must then read back with and
+ * without worker threads. */
+
+/* About 13 MB of bytecode, or four blocks of 0x3FF000 bytes */
+#define ZSAV_TEST_ROWS      150000
+#define ZSAV_TEST_DOUBLES   8
+#define ZSAV_TEST_THREADS   4
+
+typedef struct test_ctx_s {
+    long            obs_count;
+    long            values_count;
+    long            mismatches_count;
+} test_ctx_t;
+
+/* Not a small integer, so every value takes a full 8 bytes of bytecode */
+static double test_double(long row, int col) {
+    return row * 1.25 + col * 0.001 + 0.1;
+}
+
+static void test_string(char *out, size_t len, long row) {
+    snprintf(out, len, "r%07ld", row);
+}
+
+static readstat_error_t write_zsav(rt_buffer_t *buffer, int thread_count, int use_seeker) {
+    rt_buffer_ctx_t buffer_ctx = { .buffer = buffer };
+    readstat_error_t error = READSTAT_OK;
+    readstat_variable_t *variables[ZSAV_TEST_DOUBLES+1];
+    char name[32], string[32];
+    long i;
+    int j;
+
+    readstat_writer_t *writer = readstat_writer_init();
+    readstat_set_data_writer(writer, &rt_write_handler);
+    if (use_seeker)
+        readstat_set_data_seeker(writer, &rt_seek_handler);
+    readstat_writer_set_file_timestamp(writer, 1000000000);
+    readstat_writer_set_compression(writer, READSTAT_COMPRESS_BINARY);
+    readstat_writer_set_thread_count(writer, thread_count);
+
+    for (j=0; j<ZSAV_TEST_DOUBLES; j++) {
+        snprintf(name, sizeof(name), "dbl%d", j);
+        variables[j] = readstat_add_variable(writer, name, READSTAT_TYPE_DOUBLE, 0);
+    }
+    variables[j] = readstat_add_variable(writer, "str", READSTAT_TYPE_STRING, 8);
+
+    if ((error = readstat_begin_writing_sav(writer, &buffer_ctx, ZSAV_TEST_ROWS)) != READSTAT_OK)
+        goto cleanup;
+
+    for (i=0; i<ZSAV_TEST_ROWS; i++) {
+        if ((error = readstat_begin_row(writer)) != READSTAT_OK)
+            goto cleanup;
+
+        for (j=0; j<ZSAV_TEST_DOUBLES; j++) {
+            if ((error = readstat_insert_double_value(writer, variables[j], test_double(i, j))) != READSTAT_OK)
+                goto cleanup;
+        }
+        test_string(string, sizeof(string), i);
+        if ((error = readstat_insert_string_value(writer, variables[j], string)) != READSTAT_OK)
+            goto cleanup;
+
+        if ((error = readstat_end_row(writer)) != READSTAT_OK)
+            goto cleanup;
+    }
+
+    error = readstat_end_writing(writer);
+
+cleanup:
+    readstat_writer_free(writer);
+
+    return error;
+}
+
+static int handle_info(int obs_count, int var_count, void *ctx) {
+    test_ctx_t *test_ctx = (test_ctx_t *)ctx;
+    test_ctx->obs_count = obs_count;
+    return 0;
+}
+
+static int handle_value(int obs_index, int var_index, readstat_value_t value, void *ctx) {
+    test_ctx_t *test_ctx = (test_ctx_t *)ctx;
+    char string[32];
+    int matches = 0;
+
+    if (var_index < ZSAV_TEST_DOUBLES) {
+        matches = (readstat_double_value(value) == test_double(obs_index, var_index));
+    } else {
+        test_string(string, sizeof(string), obs_index);
+        matches = (readstat_string_value(value) && strcmp(readstat_string_value(value), string) == 0);
+    }
+
+    if (!matches)
+        test_ctx->mismatches_count++;
+    test_ctx->values_count++;
+
+    return 0;
+}
+
+static int check_read(rt_buffer_t *buffer, int thread_count) {
+    rt_buffer_ctx_t buffer_ctx = { .buffer = buffer };
+    test_ctx_t test_ctx;
+
+    memset(&test_ctx, 0, sizeof(test_ctx));
+
+    readstat_parser_t *parser = readstat_parser_init();
+    readstat_set_open_handler(parser, &rt_open_handler);
+    readstat_set_close_handler(parser, &rt_close_handler);
+    readstat_set_seek_handler(parser, &rt_seek_handler);
+    readstat_set_read_handler(parser, &rt_read_handler);
+    readstat_set_update_handler(parser, &rt_update_handler);
+    if (thread_count > 1) {
+        readstat_set_pread_handler(parser, &rt_pread_handler);
+        readstat_set_thread_count(parser, thread_count);
+    }
+    readstat_set_io_ctx(parser, &buffer_ctx);
+
+    readstat_set_info_handler(parser, &handle_info);
+    readstat_set_value_handler(parser, &handle_value);
+
+    readstat_error_t error = readstat_parse_sav(parser, "test", &test_ctx);
+    readstat_parser_free(parser);
+
+    if (error != READSTAT_OK) {
+        printf("Read with %d threads: %s\n", thread_count, readstat_error_message(error));
+        return 1;
+    }
+    if (test_ctx.obs_count != ZSAV_TEST_ROWS ||
+            test_ctx.values_count != ZSAV_TEST_ROWS * (ZSAV_TEST_DOUBLES + 1) ||
+            test_ctx.mismatches_count) {
+        printf("Read with %d threads: %ld rows, %ld values, %ld wrong\n", thread_count,
+                test_ctx.obs_count, test_ctx.values_count, test_ctx.mismatches_count);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    struct {
+        const char     *label;
+        int             thread_count;
+        int             use_seeker;
+        rt_buffer_t    *buffer;
+    } files[] = {
+        { .label = "Single-threaded, seeker", .thread_count = 1, .use_seeker = 1 },
+        { .label = "Single-threaded, spill file", .thread_count = 1, .use_seeker = 0 },
+        { .label = "Multi-threaded, seeker", .thread_count = ZSAV_TEST_THREADS, .use_seeker = 1 },
+        { .label = "Multi-threaded, spill file", .thread_count = ZSAV_TEST_THREADS, .use_seeker = 0 }
+    };
+    int files_count = sizeof(files)/sizeof(files[0]);
+    int failures = 0;
+    int i;
+
+    for (i=0; i<files_count; i++) {
+        files[i].buffer = buffer_init();
+        readstat_error_t error = write_zsav(files[i].buffer, files[i].thread_count, files[i].use_seeker);
+        if (error != READSTAT_OK) {
+            printf("%s: %s\n", files[i].label, readstat_error_message(error));
+            failures++;
+            continue;
+        }
+
+        if (i > 0 && (files[i].buffer->used != files[0].buffer->used ||
+                    memcmp(files[i].buffer->bytes, files[0].buffer->bytes, files[0].buffer->used) != 0)) {
+            printf("%s: output differs from \"%s\"\n", files[i].label, files[0].label);
+            failures++;
+        }
+    }
+
+    /* The variants are identical, so reading one covers them all */
+    if (failures == 0) {
+        failures += check_read(files[0].buffer, 1);
+        failures += check_read(files[0].buffer, ZSAV_TEST_THREADS);
+    }
+
+    for (i=0; i<files_count; i++) {
+        buffer_free(files[i].buffer);
+    }
+
+    if (failures)
+        printf("%d ZSAV failures\n", failures);
+
+    return failures ? 1 : 0;
+}